@@ -71,11 +71,15 @@ struct msi_ec_cpu_conf {
 	int bs_fan_speed_address; // basic
 	int bs_fan_speed_base_min;
 	int bs_fan_speed_base_max;
+	int curve_temp_address;  // advanced fan mode tables:
+	int curve_speed_address; // 6 thresholds, 7 speeds
 };
 
 struct msi_ec_gpu_conf {
 	int rt_temp_address;
 	int rt_fan_speed_address; // realtime
+	int curve_temp_address;
+	int curve_speed_address;
 };
 
 struct msi_ec_led_conf {
@@ -95,8 +99,39 @@ struct msi_ec_kbd_bl_conf {
 	int max_state;
 };
 
+/*
+ * Features a configuration supports. The bitmap is computed at build time
+ * by scripts/gen_ec_configurations.py from the addresses in the database.
+ */
+enum msi_ec_capability {
+	MSI_EC_CAP_CHARGE_CONTROL,
+	MSI_EC_CAP_WEBCAM,
+	MSI_EC_CAP_WEBCAM_BLOCK,
+	MSI_EC_CAP_FN_WIN_SWAP,
+	MSI_EC_CAP_COOLER_BOOST,
+	MSI_EC_CAP_SHIFT_MODE,
+	MSI_EC_CAP_SUPER_BATTERY,
+	MSI_EC_CAP_FAN_MODE,
+	MSI_EC_CAP_CPU_RT_TEMP,
+	MSI_EC_CAP_CPU_RT_FAN_SPEED,
+	MSI_EC_CAP_CPU_BS_FAN_SPEED,
+	MSI_EC_CAP_GPU_RT_TEMP,
+	MSI_EC_CAP_GPU_RT_FAN_SPEED,
+	MSI_EC_CAP_MICMUTE_LED,
+	MSI_EC_CAP_MUTE_LED,
+	MSI_EC_CAP_KBD_BL,
+};
+
+// platform_profile choices the driver offers
+enum msi_ec_profile {
+	MSI_EC_PROFILE_LOW_POWER,
+	MSI_EC_PROFILE_BALANCED,
+	MSI_EC_PROFILE_PERFORMANCE,
+	MSI_EC_PROFILE_NR,
+};
+
 struct msi_ec_conf {
-	const char **allowed_fw;
+	u32 caps; // BIT(enum msi_ec_capability)
 
 	struct msi_ec_charge_control_conf charge_control;
 	struct msi_ec_webcam_conf         webcam;
@@ -109,6 +144,15 @@ struct msi_ec_conf {
 	struct msi_ec_gpu_conf            gpu;
 	struct msi_ec_led_conf            leds;
 	struct msi_ec_kbd_bl_conf         kbd_bl;
+
+	// settings applied for each profile, in the transaction format
+	const char *profiles[MSI_EC_PROFILE_NR];
+};
+
+// firmware version -> CONFIGURATIONS[] index, sorted by version
+struct msi_ec_fw_entry {
+	const char *fw;
+	u8 conf;
 };
 
 #endif // __MSI_EC_REGISTERS_CONFIG__
@@ -0,0 +1,693 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-stress.c - Concurrency stress test for the msi-ec driver.
+ *
+ * Spawns kthreads calling the driver's show/store handlers, LED setters
+ * and debug helpers through their sysfs files, in configurable ratios,
+ * with 1, 2, 4... threads and finally the given number, and reports the
+ * operations per second at every thread count.
+ *
+ * Every writable attribute is owned by at most one thread, which checks
+ * that reading it back returns what it wrote: a read-modify-write racing
+ * with another attribute sharing the register would lose the update. The
+ * values must also match the state attribute, decoded from a single EC
+ * snapshot, and ec_get must return the register that was asked for.
+ *
+ * The test runs when the module is loaded, against msi-ec loaded with
+ * emulate=1 (see "make stress"). The results go to the kernel log, and
+ * loading fails with -EINVAL if an invariant was broken.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/delay.h>
+#include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "ec_memory_configuration.h"
+
+#define MSI_EC_STRESS_MAX_THREADS 64
+#define MSI_EC_STRESS_BUF_SIZE    4096
+
+static char *device = "/sys/devices/platform/msi-ec";
+module_param(device, charp, 0);
+MODULE_PARM_DESC(device, "The msi-ec platform device directory");
+
+static unsigned int threads = 8;
+module_param(threads, uint, 0);
+MODULE_PARM_DESC(threads, "Maximum number of concurrent threads");
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0);
+MODULE_PARM_DESC(duration_ms, "Duration of the run at every thread count");
+
+static char *ratio = "70,20,5,5";
+module_param(ratio, charp, 0);
+MODULE_PARM_DESC(ratio, "Relative weights of show,store,led,debug operations");
+
+static bool allow_hardware = false;
+module_param(allow_hardware, bool, 0);
+MODULE_PARM_DESC(allow_hardware, "Run even if msi-ec is not using an emulated EC");
+
+// ============================================================ //
+// Targets
+// ============================================================ //
+
+enum msi_ec_stress_op {
+	MSI_EC_STRESS_SHOW,
+	MSI_EC_STRESS_STORE,
+	MSI_EC_STRESS_LED,
+	MSI_EC_STRESS_DEBUG,
+	MSI_EC_STRESS_NR_OPS,
+};
+
+static const char *const msi_ec_stress_op_names[MSI_EC_STRESS_NR_OPS] = {
+	[MSI_EC_STRESS_SHOW]  = "show",
+	[MSI_EC_STRESS_STORE] = "store",
+	[MSI_EC_STRESS_LED]   = "led",
+	[MSI_EC_STRESS_DEBUG] = "debug",
+};
+
+struct msi_ec_stress_target {
+	const char *path;      // relative to device, or absolute for LEDs
+	const char *state_key; // its line in the state attribute
+	const char *values[2]; // written alternately
+	bool led;              // set through the LED class, asynchronously
+};
+
+// settings occupying a few bits of a register, next to other settings
+static const struct msi_ec_stress_target msi_ec_stress_targets[] = {
+	{ "webcam",              "webcam",              { "on", "off" } },
+	{ "webcam_block",        "webcam_block",        { "on", "off" } },
+	{ "fn_key",              "fn_key",              { "left", "right" } },
+	{ "cooler_boost",        "cooler_boost",        { "on", "off" } },
+	{ "super_battery",       "super_battery",       { "on", "off" } },
+	{ "cpu/basic_fan_speed", "cpu/basic_fan_speed", { "0", "100" } },
+	{ "/sys/class/leds/platform::micmute/brightness", "micmute_led",
+	  { "1", "0" }, true },
+	{ "/sys/class/leds/platform::mute/brightness", "mute_led",
+	  { "1", "0" }, true },
+	{ "/sys/class/leds/msiacpi::kbd_backlight/brightness", "kbd_backlight",
+	  { "3", "0" }, true },
+};
+
+// read-only attributes exercised by the show operations
+static const char *const msi_ec_stress_readers[] = {
+	"state",
+	"shift_mode",
+	"fan_mode",
+	"fw_version",
+	"cpu/realtime_temperature",
+	"cpu/realtime_fan_speed",
+	"gpu/realtime_temperature",
+};
+
+// ============================================================ //
+// File helpers
+// ============================================================ //
+
+static struct file *msi_ec_stress_open(const char *name, int flags)
+{
+	char *path;
+	struct file *file;
+
+	if (name[0] == '/')
+		return filp_open(name, flags, 0);
+
+	path = kasprintf(GFP_KERNEL, "%s/%s", device, name);
+	if (!path)
+		return ERR_PTR(-ENOMEM);
+
+	file = filp_open(path, flags, 0);
+	kfree(path);
+	return file;
+}
+
+// reads the whole attribute, calling its show handler once
+static ssize_t msi_ec_stress_read(struct file *file, char *buf)
+{
+	loff_t pos = 0;
+	ssize_t len;
+
+	len = kernel_read(file, buf, MSI_EC_STRESS_BUF_SIZE - 1, &pos);
+	if (len < 0)
+		return len;
+
+	buf[len] = '\0';
+	return len;
+}
+
+static ssize_t msi_ec_stress_write(struct file *file, const char *value)
+{
+	loff_t pos = 0;
+
+	return kernel_write(file, value, strlen(value), &pos);
+}
+
+static ssize_t msi_ec_stress_read_file(const char *name, char *buf)
+{
+	struct file *file = msi_ec_stress_open(name, O_RDONLY);
+	ssize_t len;
+
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+
+	len = msi_ec_stress_read(file, buf);
+	filp_close(file, NULL);
+	return len;
+}
+
+// the value of key in the output of the state attribute
+static bool msi_ec_stress_state_value(char *state, const char *key,
+				      char *value, size_t size)
+{
+	size_t len = strlen(key);
+	char *line = state;
+
+	while (line && *line) {
+		if (!strncmp(line, key, len) && line[len] == '=') {
+			strscpy(value, line + len + 1, size);
+			value[strcspn(value, "\n")] = '\0';
+			return true;
+		}
+
+		line = strchr(line, '\n');
+		if (line)
+			line++;
+	}
+
+	return false;
+}
+
+// ============================================================ //
+// Threads
+// ============================================================ //
+
+struct msi_ec_stress_thread {
+	struct task_struct *task;
+	int id;
+	u32 seed;
+
+	struct file *state;
+	struct file *readers[ARRAY_SIZE(msi_ec_stress_readers)];
+	struct file *target;     // owned setting, if any
+	struct file *led;        // owned LED, if any
+	struct file *ec_get;     // debug mode only
+	const struct msi_ec_stress_target *target_def;
+	const struct msi_ec_stress_target *led_def;
+	int target_next;
+	int led_next;
+
+	char buf[MSI_EC_STRESS_BUF_SIZE];
+
+	u64 ops[MSI_EC_STRESS_NR_OPS];
+	u64 errors;
+	u64 lost_updates;   // an owned setting read back wrong
+	u64 inconsistent;   // an owned setting differing from state
+	u64 ec_get_races;   // ec_get answered for another address
+};
+
+static struct msi_ec_stress_thread *stress_threads;
+
+static unsigned int op_weights[MSI_EC_STRESS_NR_OPS];
+static unsigned int op_weights_total;
+
+static const struct msi_ec_stress_target *available_targets[
+	ARRAY_SIZE(msi_ec_stress_targets)];
+static int nr_targets;
+static int nr_led_targets;
+
+// the firmware version registers never change, ec_get must return them
+static char fw_version[MSI_EC_FW_VERSION_LENGTH + 1];
+static bool debug_available;
+
+static u32 msi_ec_stress_random(struct msi_ec_stress_thread *t)
+{
+	// xorshift32, cheap and per thread
+	t->seed ^= t->seed << 13;
+	t->seed ^= t->seed >> 17;
+	t->seed ^= t->seed << 5;
+	return t->seed;
+}
+
+static enum msi_ec_stress_op msi_ec_stress_pick(struct msi_ec_stress_thread *t)
+{
+	unsigned int roll = msi_ec_stress_random(t) % op_weights_total;
+	int op;
+
+	for (op = 0; op < MSI_EC_STRESS_NR_OPS - 1; op++) {
+		if (roll < op_weights[op])
+			break;
+		roll -= op_weights[op];
+	}
+
+	return op;
+}
+
+static void msi_ec_stress_show(struct msi_ec_stress_thread *t)
+{
+	int idx = msi_ec_stress_random(t) % ARRAY_SIZE(t->readers);
+
+	// attributes the configuration does not support are not opened
+	if (!t->readers[idx])
+		idx = 0;
+
+	if (msi_ec_stress_read(t->readers[idx], t->buf) < 0)
+		t->errors++;
+}
+
+static void msi_ec_stress_store(struct msi_ec_stress_thread *t)
+{
+	const struct msi_ec_stress_target *def = t->target_def;
+	const char *value;
+	char state_value[32];
+
+	if (!t->target) {
+		msi_ec_stress_show(t);
+		return;
+	}
+
+	value = def->values[t->target_next];
+	t->target_next ^= 1;
+
+	if (msi_ec_stress_write(t->target, value) < 0) {
+		t->errors++;
+		return;
+	}
+
+	// nobody else writes this attribute, it must read back unchanged
+	if (msi_ec_stress_read(t->target, t->buf) < 0) {
+		t->errors++;
+		return;
+	}
+	if (strncmp(t->buf, value, strlen(value)) ||
+	    t->buf[strlen(value)] != '\n')
+		t->lost_updates++;
+
+	if (msi_ec_stress_read(t->state, t->buf) < 0) {
+		t->errors++;
+		return;
+	}
+	if (!msi_ec_stress_state_value(t->buf, def->state_key, state_value,
+				       sizeof(state_value)) ||
+	    strcmp(state_value, value))
+		t->inconsistent++;
+}
+
+static void msi_ec_stress_led(struct msi_ec_stress_thread *t)
+{
+	if (!t->led) {
+		msi_ec_stress_show(t);
+		return;
+	}
+
+	// the LED core applies the value from a work item, checked at the end
+	if (msi_ec_stress_write(t->led, t->led_def->values[t->led_next]) < 0)
+		t->errors++;
+	t->led_next ^= 1;
+}
+
+static void msi_ec_stress_debug(struct msi_ec_stress_thread *t)
+{
+	int offset;
+	char addr[4];
+	unsigned int value;
+
+	if (!t->ec_get) {
+		msi_ec_stress_show(t);
+		return;
+	}
+
+	offset = msi_ec_stress_random(t) % MSI_EC_FW_VERSION_LENGTH;
+	snprintf(addr, sizeof(addr), "%02x",
+		 MSI_EC_FW_VERSION_ADDRESS + offset);
+
+	// the address is shared by every ec_get user
+	if (msi_ec_stress_write(t->ec_get, addr) < 0 ||
+	    msi_ec_stress_read(t->ec_get, t->buf) < 0 ||
+	    kstrtouint(strim(t->buf), 16, &value) < 0) {
+		t->errors++;
+		return;
+	}
+
+	if (value != (u8)fw_version[offset])
+		t->ec_get_races++;
+}
+
+static int msi_ec_stress_fn(void *data)
+{
+	struct msi_ec_stress_thread *t = data;
+
+	while (!kthread_should_stop()) {
+		enum msi_ec_stress_op op = msi_ec_stress_pick(t);
+
+		switch (op) {
+		case MSI_EC_STRESS_SHOW:
+			msi_ec_stress_show(t);
+			break;
+		case MSI_EC_STRESS_STORE:
+			msi_ec_stress_store(t);
+			break;
+		case MSI_EC_STRESS_LED:
+			msi_ec_stress_led(t);
+			break;
+		case MSI_EC_STRESS_DEBUG:
+			msi_ec_stress_debug(t);
+			break;
+		default:
+			break;
+		}
+
+		t->ops[op]++;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static void msi_ec_stress_close(struct msi_ec_stress_thread *t)
+{
+	struct file **files[] = { &t->state, &t->target, &t->led, &t->ec_get };
+
+	for (int i = 0; i < ARRAY_SIZE(files); i++) {
+		if (*files[i])
+			filp_close(*files[i], NULL);
+		*files[i] = NULL;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(t->readers); i++) {
+		if (t->readers[i])
+			filp_close(t->readers[i], NULL);
+		t->readers[i] = NULL;
+	}
+}
+
+static int msi_ec_stress_setup(struct msi_ec_stress_thread *t, int id)
+{
+	struct file *file;
+
+	memset(t, 0, sizeof(*t));
+	t->id = id;
+	t->seed = id * 2654435761u + 1;
+
+	t->state = msi_ec_stress_open("state", O_RDONLY);
+	if (IS_ERR(t->state)) {
+		int result = PTR_ERR(t->state);
+
+		t->state = NULL;
+		return result;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_stress_readers); i++) {
+		file = msi_ec_stress_open(msi_ec_stress_readers[i], O_RDONLY);
+		t->readers[i] = IS_ERR(file) ? NULL : file;
+	}
+
+	// settings and LEDs are split between the first threads
+	if (id < nr_targets - nr_led_targets) {
+		t->target_def = available_targets[id];
+		file = msi_ec_stress_open(t->target_def->path, O_RDWR);
+		t->target = IS_ERR(file) ? NULL : file;
+	}
+
+	if (id < nr_led_targets) {
+		t->led_def = available_targets[nr_targets - nr_led_targets + id];
+		file = msi_ec_stress_open(t->led_def->path, O_RDWR);
+		t->led = IS_ERR(file) ? NULL : file;
+	}
+
+	if (debug_available) {
+		file = msi_ec_stress_open("debug/ec_get", O_RDWR);
+		t->ec_get = IS_ERR(file) ? NULL : file;
+	}
+
+	return 0;
+}
+
+// ============================================================ //
+// Runs
+// ============================================================ //
+
+static bool msi_ec_stress_failed;
+
+static int msi_ec_stress_run(unsigned int nr_threads)
+{
+	u64 ops[MSI_EC_STRESS_NR_OPS] = { 0 };
+	u64 total = 0, errors = 0, lost = 0, inconsistent = 0, races = 0;
+	unsigned int started;
+	ktime_t start;
+	s64 elapsed_us;
+	int result = 0;
+
+	for (started = 0; started < nr_threads; started++) {
+		struct msi_ec_stress_thread *t = &stress_threads[started];
+
+		result = msi_ec_stress_setup(t, started);
+		if (result < 0)
+			break;
+	}
+
+	start = ktime_get();
+	for (unsigned int i = 0; i < started; i++) {
+		struct msi_ec_stress_thread *t = &stress_threads[i];
+
+		t->task = kthread_run(msi_ec_stress_fn, t, "msi-ec-stress/%u",
+				      i);
+		if (IS_ERR(t->task)) {
+			result = PTR_ERR(t->task);
+			t->task = NULL;
+		}
+	}
+
+	msleep(duration_ms);
+
+	for (unsigned int i = 0; i < started; i++) {
+		struct msi_ec_stress_thread *t = &stress_threads[i];
+
+		if (t->task)
+			kthread_stop(t->task);
+	}
+	elapsed_us = ktime_us_delta(ktime_get(), start);
+
+	for (unsigned int i = 0; i < started; i++) {
+		struct msi_ec_stress_thread *t = &stress_threads[i];
+
+		for (int op = 0; op < MSI_EC_STRESS_NR_OPS; op++) {
+			ops[op] += t->ops[op];
+			total += t->ops[op];
+		}
+		errors += t->errors;
+		lost += t->lost_updates;
+		inconsistent += t->inconsistent;
+		races += t->ec_get_races;
+		msi_ec_stress_close(t);
+	}
+
+	if (result < 0) {
+		pr_err("failed to start %u threads: %d\n", nr_threads, result);
+		return result;
+	}
+
+	pr_info("threads=%u ops_per_sec=%llu %s=%llu %s=%llu %s=%llu %s=%llu errors=%llu lost_updates=%llu inconsistent=%llu ec_get_races=%llu\n",
+		nr_threads, div64_u64(total * USEC_PER_SEC, max(elapsed_us, 1LL)),
+		msi_ec_stress_op_names[0], ops[0],
+		msi_ec_stress_op_names[1], ops[1],
+		msi_ec_stress_op_names[2], ops[2],
+		msi_ec_stress_op_names[3], ops[3],
+		errors, lost, inconsistent, races);
+
+	// ec_get_races are reported, the address is shared by design
+	if (errors || lost || inconsistent)
+		msi_ec_stress_failed = true;
+
+	return 0;
+}
+
+// the LEDs are set asynchronously, check them once everything settled
+static void msi_ec_stress_check_leds(void)
+{
+	char *state, *value, expected[4];
+	int result;
+
+	state = kmalloc(MSI_EC_STRESS_BUF_SIZE, GFP_KERNEL);
+	value = kmalloc(MSI_EC_STRESS_BUF_SIZE, GFP_KERNEL);
+	if (!state || !value)
+		goto free;
+
+	for (int i = nr_targets - nr_led_targets; i < nr_targets; i++) {
+		const struct msi_ec_stress_target *def = available_targets[i];
+		struct file *file = msi_ec_stress_open(def->path, O_RDWR);
+
+		if (IS_ERR(file))
+			continue;
+
+		result = msi_ec_stress_write(file, def->values[0]);
+		filp_close(file, NULL);
+		if (result < 0)
+			continue;
+
+		msleep(50);
+		strscpy(expected, def->values[0], sizeof(expected));
+		if (msi_ec_stress_read_file("state", state) < 0 ||
+		    !msi_ec_stress_state_value(state, def->state_key, value,
+					       MSI_EC_STRESS_BUF_SIZE) ||
+		    strcmp(value, expected)) {
+			pr_err("%s does not match its LED\n", def->state_key);
+			msi_ec_stress_failed = true;
+		}
+	}
+
+free:
+	kfree(value);
+	kfree(state);
+}
+
+// ============================================================ //
+// Module load/unload
+// ============================================================ //
+
+static int __init msi_ec_stress_parse_ratio(void)
+{
+	char *input, *cur, *token;
+	int op = 0;
+
+	input = kstrdup(ratio, GFP_KERNEL);
+	if (!input)
+		return -ENOMEM;
+
+	cur = input;
+	op_weights_total = 0;
+	while ((token = strsep(&cur, ",")) && op < MSI_EC_STRESS_NR_OPS) {
+		if (kstrtouint(token, 10, &op_weights[op]) < 0) {
+			kfree(input);
+			return -EINVAL;
+		}
+		op_weights_total += op_weights[op++];
+	}
+	kfree(input);
+
+	return op_weights_total ? 0 : -EINVAL;
+}
+
+static void __init msi_ec_stress_find_targets(void)
+{
+	char *state = kmalloc(MSI_EC_STRESS_BUF_SIZE, GFP_KERNEL);
+	char value[32];
+
+	if (!state)
+		return;
+
+	if (msi_ec_stress_read_file("state", state) < 0)
+		goto free;
+
+	// settings first, then LEDs
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < ARRAY_SIZE(msi_ec_stress_targets); i++) {
+			const struct msi_ec_stress_target *def =
+				&msi_ec_stress_targets[i];
+
+			if (def->led != pass)
+				continue;
+			if (!msi_ec_stress_state_value(state, def->state_key,
+						       value, sizeof(value)))
+				continue;
+
+			available_targets[nr_targets++] = def;
+			nr_led_targets += def->led;
+		}
+	}
+
+	if (msi_ec_stress_read_file("fw_version", state) > 0) {
+		strscpy(fw_version, state, sizeof(fw_version));
+		fw_version[strcspn(fw_version, "\n")] = '\0';
+		debug_available = msi_ec_stress_read_file("debug/ec_get",
+							  state) >= 0;
+	}
+
+free:
+	kfree(state);
+}
+
+static bool __init msi_ec_stress_emulated(void)
+{
+	char *buf = kmalloc(MSI_EC_STRESS_BUF_SIZE, GFP_KERNEL);
+	bool emulated;
+
+	if (!buf)
+		return false;
+
+	emulated = msi_ec_stress_read_file("/sys/module/msi_ec/parameters/emulate",
+					   buf) > 0 && buf[0] == 'Y';
+	kfree(buf);
+	return emulated;
+}
+
+static int __init msi_ec_stress_init(void)
+{
+	int result;
+
+	if (!threads || threads > MSI_EC_STRESS_MAX_THREADS || !duration_ms)
+		return -EINVAL;
+
+	result = msi_ec_stress_parse_ratio();
+	if (result < 0) {
+		pr_err("invalid ratio \"%s\"\n", ratio);
+		return result;
+	}
+
+	if (!allow_hardware && !msi_ec_stress_emulated()) {
+		pr_err("msi-ec must be loaded with emulate=1 (or set allow_hardware)\n");
+		return -ENODEV;
+	}
+
+	msi_ec_stress_find_targets();
+	pr_info("%d settings, %d LEDs, ec_get %s\n",
+		nr_targets - nr_led_targets, nr_led_targets,
+		debug_available ? "available" : "unavailable (load msi-ec with debug=1)");
+
+	stress_threads = kcalloc(threads, sizeof(*stress_threads), GFP_KERNEL);
+	if (!stress_threads)
+		return -ENOMEM;
+
+	// the last run always uses the requested count, even if not a power of 2
+	for (unsigned int n = 1;; n = min(n * 2, threads)) {
+		result = msi_ec_stress_run(n);
+		if (result < 0 || n == threads)
+			break;
+	}
+
+	if (result >= 0)
+		msi_ec_stress_check_leds();
+
+	kfree(stress_threads);
+	stress_threads = NULL;
+
+	if (result < 0)
+		return result;
+
+	if (msi_ec_stress_failed) {
+		pr_err("FAIL\n");
+		return -EINVAL;
+	}
+
+	pr_info("PASS\n");
+	return 0;
+}
+
+static void __exit msi_ec_stress_exit(void)
+{
+}
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MSI Embedded Controller concurrency stress test");
+
+module_init(msi_ec_stress_init);
+module_exit(msi_ec_stress_exit);
@@ -13,7 +13,17 @@
  *   fan_mode          FAN performance modes
  *   fw_version        Firmware version
  *   fw_release_date   Firmware release date
+ *   state, state_bin  All of the above from a single EC snapshot
+ *   transaction       Several settings applied at once
+ *   resume_stats      Settings restored on resume and how long it took
+ *   enforce_stats     Settings re-applied after the EC reverted them
+ *   ec_breaker        Serving the last known values while the EC stalls
+ *   throttle          Users whose reads are rate limited
  *   cpu/..            CPU related options
+ *   fan_control/..    In-driver CPU fan speed controller
+ *   power_source/..   Settings applied on AC and on battery
+ *   shift_governor/.. Shift mode picked from the CPU load
+ *   residency/..      Time spent in every mode and temperature band
  *   gpu/..            GPU related options
  *
  * In addition to these platform device attributes the driver
@@ -24,7 +34,11 @@
  *   charge_control_end_threshold
  * 
  * This driver also registers available led class devices for
- * mute, micmute and keyboard_backlight leds
+ * mute, micmute and keyboard_backlight leds, an IIO device and
+ * the msi_ec perf PMU with the temperatures and fan speeds, /dev/msi-ec for
+ * batched register access (see msi_ec_uapi.h), an input device
+ * reporting the changes made by the laptop's hotkeys and
+ * /sys/kernel/debug/msi-ec/top, the processes polling the attributes
  *
  * This driver might not work on other laptops produced by MSI. Also, and until
  * future enhancements, no DMI data are used to identify your compatibility
@@ -34,4749 +48,5790 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include "ec_memory_configuration.h"
+#include "msi_ec_uapi.h"
 
 #include <acpi/battery.h>
 #include <linux/acpi.h>
+#include <linux/bsearch.h>
+#include <linux/cred.h>
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
 #include <linux/init.h>
+#include <linux/input.h>
 #include <linux/kernel.h>
+#include <linux/kernel_stat.h>
+#include <linux/ktime.h>
+#include <linux/miscdevice.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
+#include <linux/perf_event.h>
 #include <linux/platform_device.h>
+#include <linux/platform_profile.h>
+#include <linux/power_supply.h>
 #include <linux/proc_fs.h>
+#include <linux/sched.h>
 #include <linux/seq_file.h>
+#include <linux/sort.h>
 #include <linux/string.h>
 #include <linux/slab.h>
+#include <linux/stringhash.h>
+#include <linux/tick.h>
+#include <linux/uaccess.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
 
-static DEFINE_MUTEX(ec_set_by_mask_mutex);
-static DEFINE_MUTEX(ec_unset_by_mask_mutex);
-static DEFINE_MUTEX(ec_set_bit_mutex);
+// serializes every read-modify-write and snapshot of the EC memory
+static DEFINE_MUTEX(ec_lock);
 
-#define SM_ECO_NAME		"eco"
-#define SM_COMFORT_NAME		"comfort"
-#define SM_SPORT_NAME		"sport"
-#define SM_TURBO_NAME		"turbo"
+// generated from ec_configurations.ini by scripts/gen_ec_configurations.py
+#include "ec_configurations.h"
 
-#define FM_AUTO_NAME		"auto"
-#define FM_SILENT_NAME		"silent"
-#define FM_BASIC_NAME		"basic"
-#define FM_ADVANCED_NAME	"advanced"
+static bool conf_loaded = false;
 
-static const char *ALLOWED_FW_0[] __initconst = {
-	"14C1EMS1.012", // Prestige 14 A10SC
-	"14C1EMS1.101",
-	"14C1EMS1.102",
-	NULL
-};
+#ifdef MSI_EC_MODEL
 
-static struct msi_ec_conf CONF0 __initdata = {
-	.allowed_fw = ALLOWED_FW_0, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN, // 0xd5 needs testing
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_BASIC_NAME,    0x4d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = 0x89,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+// single-model build (make MODEL=CONFn): the configuration is a constant,
+// so its addresses fold into the code and msi_ec_has() into true or false
+#define __MSI_EC_MODEL(model, what) MSI_EC_##model##_##what
+#define _MSI_EC_MODEL(model, what) __MSI_EC_MODEL(model, what)
+#define MSI_EC_MODEL_INDEX _MSI_EC_MODEL(MSI_EC_MODEL, INDEX)
+#define MSI_EC_MODEL_CAPS _MSI_EC_MODEL(MSI_EC_MODEL, CAPS)
 
-static const char *ALLOWED_FW_1[] __initconst = {
-	"17F2EMS1.103", // GF75 Thin 9SC
-	"17F2EMS1.104",
-	"17F2EMS1.106",
-	"17F2EMS1.107",
-	NULL
-};
+static const struct msi_ec_conf conf = _MSI_EC_MODEL(MSI_EC_MODEL, INIT);
 
-static struct msi_ec_conf CONF1 __initdata = {
-	.allowed_fw = ALLOWED_FW_1, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_BASIC_NAME,    0x4d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = 0x89,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+#else
 
-static const char *ALLOWED_FW_2[] __initconst = {
-	"1552EMS1.115", // Modern 15 A11M
-	"1552EMS1.118",
-	"1552EMS1.119",
-	"1552EMS1.120",
-	NULL
-};
+static struct msi_ec_conf conf; // current configuration
 
-static struct msi_ec_conf CONF2 __initdata = {
-	.allowed_fw = ALLOWED_FW_2, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xD2, // because WMI2 device
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_BASIC_NAME,    0x4d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = 0x89,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c, // ?
-		.bl_modes         = { 0x00, 0x08 }, // ?
-		.max_mode         = 1, // ?
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+#endif // MSI_EC_MODEL
 
-static const char *ALLOWED_FW_3[] __initconst = {
-	"1592EMS1.111", // Summit E16 Flip A12UCT / A12MT
-	NULL
+struct attribute_support {
+	struct attribute *attribute;
+	bool supported;
 };
 
-static struct msi_ec_conf CONF3 __initdata = {
-	.allowed_fw = ALLOWED_FW_3, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_BASIC_NAME,    0x4d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0xc9,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = 0x89,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static char *firmware = NULL;
+module_param(firmware, charp, 0);
+MODULE_PARM_DESC(firmware, "Load a configuration for a specified firmware version");
 
-static const char *ALLOWED_FW_4[] __initconst = {
-	"16V4EMS1.114", // GS66 Stealth 11UE
-	NULL
-};
+static bool debug = false;
+module_param(debug, bool, 0);
+MODULE_PARM_DESC(debug, "Load the driver in the debug mode, exporting the debug attributes");
 
-static struct msi_ec_conf CONF4 __initdata = {
-	.allowed_fw = ALLOWED_FW_4, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = MSI_EC_ADDR_UNKNOWN, // supported, but unknown
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = { // may be supported, but address is unknown
-		.address = MSI_EC_ADDR_UNKNOWN,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68, // needs testing
-		.rt_fan_speed_address  = 0x71, // needs testing
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNKNOWN,
-		.mute_led_address    = MSI_EC_ADDR_UNKNOWN,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN, // ?
-		.bl_modes         = { 0x00, 0x08 }, // ?
-		.max_mode         = 1, // ?
-		.bl_state_address = MSI_EC_ADDR_UNSUPP, // 0xd3, not functional
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static bool emulate = false;
+module_param(emulate, bool, 0);
+MODULE_PARM_DESC(emulate, "Use an in-memory EC instead of the real one, for benchmarks and tests (requires firmware)");
 
-static const char *ALLOWED_FW_5[] __initconst = {
-	"158LEMS1.103", // Alpha 15 B5EE / B5EEK
-	"158LEMS1.105",
-	"158LEMS1.106",
-	NULL
-};
+// ============================================================ //
+// Helper functions
+// ============================================================ //
 
-static struct msi_ec_conf CONF5 __initdata = {
-	.allowed_fw = ALLOWED_FW_5, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP, // 0xf3, not functional (RGB)
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+#define check_bit(v, b) ((bool)((v >> b) & 1))
 
-static const char *ALLOWED_FW_6[] __initconst = {
-	"1542EMS1.102", // GP66 Leopard 10UG / 10UE / 10UH
-	"1542EMS1.104",
-	NULL
-};
+// the register file used instead of the EC when emulate is set
+static u8 emulated_ec[256];
 
-static struct msi_ec_conf CONF6 __initdata = {
-	.allowed_fw = ALLOWED_FW_6, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xd5,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0xc9,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = MSI_EC_ADDR_UNSUPP,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP, // not functional (RGB)
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static unsigned int ec_breaker_threshold = 3;
+module_param(ec_breaker_threshold, uint, 0644);
+MODULE_PARM_DESC(ec_breaker_threshold, "Consecutive EC failures after which reads are answered with the last known values (0 disables)");
 
-static const char *ALLOWED_FW_7[] __initconst = {
-	"17FKEMS1.108", // Bravo 17 A4DDR / A4DDK
-	"17FKEMS1.109",
-	"17FKEMS1.10A",
-	NULL
-};
+static unsigned int ec_read_deadline_ms = 100;
+module_param(ec_read_deadline_ms, uint, 0644);
+MODULE_PARM_DESC(ec_read_deadline_ms, "EC reads from show handlers slower than this count as EC failures (0 disables)");
 
-static struct msi_ec_conf CONF7 __initdata = {
-	.allowed_fw = ALLOWED_FW_7, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN, // 0xd5 but has its own set of modes
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d }, // d may not be relevant
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0xc9,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+/*
+ * Circuit breaker for a stalled EC. Every ec_read() can block for the
+ * whole ACPI EC timeout, and the readers queue up behind each other on
+ * ec_lock. After ec_breaker_threshold consecutive failures (-ETIME, -EIO,
+ * or reads slower than ec_read_deadline_ms) the breaker opens and reads
+ * are answered from ec_cache without touching the EC. After a backoff a
+ * single read probes the EC, the backoff doubles while the probes fail
+ * and a success closes the breaker.
+ *
+ * Writes and the reads of read-modify-write cycles always go to the EC
+ * with the full timeout, a setting is never computed from a stale value.
+ * Their outcome counts like the one of other reads.
+ */
+#define EC_BREAKER_BACKOFF_MIN_MS 250
+#define EC_BREAKER_BACKOFF_MAX_MS 8000
 
-static const char *ALLOWED_FW_8[] __initconst = {
-	"14F1EMS1.114", // Summit E14 Evo A12M
-	"14F1EMS1.115",
-	"14F1EMS1.116",
-	"14F1EMS1.117",
-	"14F1EMS1.118",
-	"14F1EMS1.119",
-	"14F1EMS1.120",
-	NULL
+enum ec_breaker_state {
+	EC_BREAKER_CLOSED,
+	EC_BREAKER_OPEN,
+	EC_BREAKER_PROBING, // one read is on its way to the EC
 };
 
-static struct msi_ec_conf CONF8 __initdata = {
-	.allowed_fw = ALLOWED_FW_8, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x80 }, // 00 - on, 80 - 10 sec auto off
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
+static const char *const ec_breaker_state_names[] = {
+	[EC_BREAKER_CLOSED] = "closed",
+	[EC_BREAKER_OPEN] = "open",
+	[EC_BREAKER_PROBING] = "probing",
 };
 
-static const char *ALLOWED_FW_9[] __initconst = {
-	"14JKEMS1.104", // Modern 14 C5M
-	NULL
-};
+// protects ec_breaker and ec_cache
+static DEFINE_SPINLOCK(ec_breaker_lock);
+
+static struct {
+	enum ec_breaker_state state;
+	unsigned int failures; // consecutive
+	unsigned int backoff_ms;
+	ktime_t next_probe;
+	u64 trips;
+	u64 probes;
+	u64 slow_reads;   // past ec_read_deadline_ms
+	u64 stale_reads;  // answered from ec_cache
+	u64 failed_fast;  // open, and nothing cached for the register
+} ec_breaker;
+
+// last value read from or written to every register
+static u8 ec_cache[256];
+static DECLARE_BITMAP(ec_cache_valid, 256);
+
+static bool ec_breaker_open(void)
+{
+	return READ_ONCE(ec_breaker.state) != EC_BREAKER_CLOSED;
+}
 
-static struct msi_ec_conf CONF9 __initdata = {
-	.allowed_fw = ALLOWED_FW_9, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // unsupported or enabled by ECO shift
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNSUPP,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNSUPP,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP, // not presented in MSI app
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+// whether a read may go to the EC, the caller becomes the probe if one is due
+static bool ec_breaker_admit(void)
+{
+	bool admit = true;
 
-static const char *ALLOWED_FW_10[] __initconst = {
-	"1582EMS1.107", // Katana GF66 11UC / 11UD
-	NULL
-};
+	spin_lock(&ec_breaker_lock);
 
-static struct msi_ec_conf CONF10 __initdata = {
-	.allowed_fw = ALLOWED_FW_10, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = MSI_EC_ADDR_UNSUPP,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xe5,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+	if (ec_breaker.state == EC_BREAKER_PROBING) {
+		admit = false;
+	} else if (ec_breaker.state == EC_BREAKER_OPEN) {
+		admit = !ktime_before(ktime_get(), ec_breaker.next_probe);
+		if (admit) {
+			ec_breaker.state = EC_BREAKER_PROBING;
+			ec_breaker.probes++;
+		}
+	}
 
-static const char *ALLOWED_FW_11[] __initconst = {
-	"16S6EMS1.111", // Prestige 15 A11SCX
-	NULL 
-};
+	spin_unlock(&ec_breaker_lock);
+	return admit;
+}
 
-static struct msi_ec_conf CONF11 __initdata = {
-	.allowed_fw = ALLOWED_FW_11, // WMI2 based
-	.charge_control = {
-		.address      = 0xD7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNKNOWN,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x4d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNSUPP,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNSUPP,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = {},
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static void ec_breaker_report(int result, bool slow)
+{
+	enum ec_breaker_state old;
+	bool failed = result == -ETIME || result == -EIO || slow;
+
+	spin_lock(&ec_breaker_lock);
+
+	// other errors (no EC, bad address, EC stopped for suspend) say
+	// nothing about its health, a probe ending with one is retried later
+	if (result < 0 && !failed) {
+		if (ec_breaker.state == EC_BREAKER_PROBING) {
+			ec_breaker.next_probe = ktime_add_ms(ktime_get(),
+							     ec_breaker.backoff_ms);
+			ec_breaker.state = EC_BREAKER_OPEN;
+		}
+		spin_unlock(&ec_breaker_lock);
+		return;
+	}
 
-static const char *ALLOWED_FW_12[] __initconst = {
-	"16R6EMS1.104", // GF63 Thin 11UC
-	"16R6EMS1.106",
-	"16R6EMS1.107",
-	NULL
-};
+	old = ec_breaker.state;
+	if (slow)
+		ec_breaker.slow_reads++;
+
+	if (!failed) {
+		ec_breaker.state = EC_BREAKER_CLOSED;
+		ec_breaker.failures = 0;
+	} else if (old == EC_BREAKER_PROBING) {
+		ec_breaker.backoff_ms = min(ec_breaker.backoff_ms * 2,
+					    EC_BREAKER_BACKOFF_MAX_MS);
+		ec_breaker.next_probe = ktime_add_ms(ktime_get(),
+						     ec_breaker.backoff_ms);
+		ec_breaker.state = EC_BREAKER_OPEN;
+	} else if (old == EC_BREAKER_CLOSED && ec_breaker_threshold &&
+		   ++ec_breaker.failures >= ec_breaker_threshold) {
+		ec_breaker.backoff_ms = EC_BREAKER_BACKOFF_MIN_MS;
+		ec_breaker.next_probe = ktime_add_ms(ktime_get(),
+						     ec_breaker.backoff_ms);
+		ec_breaker.state = EC_BREAKER_OPEN;
+		ec_breaker.trips++;
+	}
 
-static struct msi_ec_conf CONF12 __initdata = {
-	.allowed_fw = ALLOWED_FW_12, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // 0xeb
-		.mask    = 0x0f, // 00, 0f
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNSUPP,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+	spin_unlock(&ec_breaker_lock);
 
-static const char *ALLOWED_FW_13[] __initconst = {
-	"1594EMS1.109", // Prestige 16 Studio A13VE
-	NULL
-};
+	if (old == EC_BREAKER_CLOSED && ec_breaker.state == EC_BREAKER_OPEN)
+		pr_warn("EC not responding (%d), serving the last known values\n",
+			result);
+	else if (old != EC_BREAKER_CLOSED && !failed)
+		pr_info("EC responding again\n");
+}
 
-static struct msi_ec_conf CONF13 __initdata = {
-	.allowed_fw = ALLOWED_FW_13, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4, // 0x00-0x10
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // super battery
-			{ SM_COMFORT_NAME, 0xc1 }, // balanced
-			{ SM_TURBO_NAME,   0xc4 }, // extreme
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP,
-		.mask    = 0x0f, // 00, 0f
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71, // 0x0-0x96
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c, // KB auto turn off
-		.bl_modes         = { 0x00, 0x08 }, // always on; off after 10 sec
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static void ec_cache_store(u8 addr, u8 val)
+{
+	spin_lock(&ec_breaker_lock);
+	ec_cache[addr] = val;
+	__set_bit(addr, ec_cache_valid);
+	spin_unlock(&ec_breaker_lock);
+}
 
-static const char *ALLOWED_FW_14[] __initconst = {
-	"17L2EMS1.108", // Katana 17 B11UCX, Katana GF76 11UC
-	NULL
-};
+static int ec_cache_load(u8 addr, u8 *val)
+{
+	int result = 0;
 
-static struct msi_ec_conf CONF14 __initdata = {
-	.allowed_fw = ALLOWED_FW_14, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	// .usb_share  {
-	// 	.address      = 0xbf, // states: 0x08 || 0x28
-	// 	.bit          = 5,
-	// }
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8, // states: 0x40 || 0x50
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98, // states: 0x02 || 0x82
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2, // Performance Level
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // Low
-			{ SM_COMFORT_NAME, 0xc1 }, // Medium
-			{ SM_SPORT_NAME,   0xc0 }, // High
-			{ SM_TURBO_NAME,   0xc4 }, // Turbo
-			MSI_EC_MODE_NULL
-			
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // enabled by Low Performance Level
-		// .address = 0xeb, // states: 0x00 || 0x0f
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0xc9,
-		.rt_fan_speed_base_min = 0x00, // ?
-		.rt_fan_speed_base_max = 0x96, // ?
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00, // ?
-		.bs_fan_speed_base_max = 0x0f, // ?
-		// .rt_temp_table_start_adress = 0x6a,
-		// .rt_fan_speed_table_start_address = 0x72,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0xcb,
-		// .rt_temp_table_start_adress = 0x82,
-		// .rt_fan_speed_table_start_address = 0x8a,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c, // states: 0x00 || 0x02
-		.mute_led_address    = 0x2d, // states: 0x04 || 0x06
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		// .bl_mode_address  = 0x2c, // ?
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 }, // ? always on; off after 10 sec
-		.max_mode         = 1, // ?
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+	spin_lock(&ec_breaker_lock);
 
-static const char *ALLOWED_FW_15[] __initconst = {
-	"15CKEMS1.108", // Delta 15 A5EFK
-	NULL
-};
+	if (test_bit(addr, ec_cache_valid)) {
+		*val = ec_cache[addr];
+		ec_breaker.stale_reads++;
+	} else {
+		ec_breaker.failed_fast++;
+		result = -ETIME;
+	}
 
-static struct msi_ec_conf CONF15 __initdata = {
-	.allowed_fw = ALLOWED_FW_15, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a, 
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e, 
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2, 
-		.modes = {
-			{ SM_ECO_NAME,     0xa5 }, // super battery
-			{ SM_COMFORT_NAME, 0xa1 }, // balanced
-			{ SM_TURBO_NAME,   0xa0 }, // extreme
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN,
-		.mask    = 0x0f
-	},
-	.fan_mode = {
-		.address = 0xf4, 
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68, 
-		.rt_fan_speed_address  = 0xc9, 
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = 0xcd, 
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,  
-		.rt_fan_speed_address = 0xcb, 
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2d,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x01 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP, // RGB
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+	spin_unlock(&ec_breaker_lock);
+	return result;
+}
 
-static const char *ALLOWED_FW_16[] __initconst = {
-	"155LEMS1.105", // Modern 15 A5M
-	"155LEMS1.106",
-	NULL
-};
+// counts the time spent in a mode, see Residency statistics
+static void residency_observe(u8 addr, u8 val);
 
-static struct msi_ec_conf CONF16 __initdata = {
-	.allowed_fw = ALLOWED_FW_16, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN, // 0xed
-		.mask    = 0x0f, // a5, a4, a2
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static int ec_read_deadline(u8 addr, u8 *val, unsigned int deadline_ms)
+{
+	ktime_t start = ktime_get();
+	int result = ec_read(addr, val);
+	s64 elapsed_ms = ktime_ms_delta(ktime_get(), start);
+
+	ec_breaker_report(result, deadline_ms && elapsed_ms > deadline_ms);
+	if (!result) {
+		ec_cache_store(addr, *val);
+		residency_observe(addr, *val);
+	}
 
-static const char *ALLOWED_FW_17[] __initconst = {
-	"15K1IMS1.110", // Cyborg 15 A12VF
-	NULL
-};
+	return result;
+}
 
-static struct msi_ec_conf CONF17 __initdata = {
-	.allowed_fw = ALLOWED_FW_17, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	// .usb_share  {
-	// 	.address      = 0xbf, // states: 0x08 || 0x28
-	// 	.bit          = 5,
-	// }, // Like Katana 17 B11UCX
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4, // 0x01-0x11
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // super battery
-			{ SM_COMFORT_NAME, 0xc1 }, // balanced
-			{ SM_TURBO_NAME,   0xc4 }, // extreme
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb, // 0x0F ( on ) or 0x00 ( off ) on 0xEB
-		.mask    = 0x0f, // 00, 0f
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-		// n/rpm register is C9
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c, // KB auto turn off
-		.bl_modes         = { 0x00, 0x08 }, // always on; off after 10 sec
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+// the last known value of a register, without touching the EC
+static bool ec_cache_peek(u8 addr, u8 *val)
+{
+	bool cached;
 
-static const char *ALLOWED_FW_18[] __initconst = {
-	"15HKEMS1.104", // Modern 15 B7M
-	NULL
-};
+	spin_lock(&ec_breaker_lock);
+	cached = test_bit(addr, ec_cache_valid);
+	if (cached)
+		*val = ec_cache[addr];
+	spin_unlock(&ec_breaker_lock);
 
-static struct msi_ec_conf CONF18 __initdata = {
-	.allowed_fw = ALLOWED_FW_18, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // unsupported or enabled by ECO shift
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNSUPP,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNSUPP,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP, // not presented in MSI app
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+	return cached;
+}
 
-static const char *ALLOWED_FW_19[] __initconst = { 
-	"1543EMS1.113", // GP66 Leopard 11UG / 11U*
-	NULL 
-};
+// reads for show handlers, fail fast or answer stale while the EC stalls
+static int msi_ec_read(u8 addr, u8 *val)
+{
+	if (emulate) {
+		*val = READ_ONCE(emulated_ec[addr]);
+		residency_observe(addr, *val);
+		return 0;
+	}
 
-static struct msi_ec_conf CONF19 __initdata = {
-	.allowed_fw = ALLOWED_FW_19, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0xc9,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNKNOWN,
-		.mute_led_address    = MSI_EC_ADDR_UNKNOWN,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = {},
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+	if (!ec_breaker_admit())
+		return ec_cache_load(addr, val);
 
-static const char *ALLOWED_FW_20[] __initconst = {
-	"1581EMS1.107", // Katana GF66 11UE / 11UG
-	NULL
-};
+	return ec_read_deadline(addr, val, ec_read_deadline_ms);
+}
 
-static struct msi_ec_conf CONF20 __initdata = {
-	.allowed_fw = ALLOWED_FW_20, // WMI2 based
-	.charge_control = { // tested
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = { // tested
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = { // tested
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = { // tested
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = { // tested
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = { // tested
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = { // tested
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68, // tested
-		.rt_fan_speed_address  = 0xc9, // tested
-		.rt_fan_speed_base_min = 0x00, // ! observed on machine (0x35 when fans was at min), but not working !
-		.rt_fan_speed_base_max = 0x96, // ! ^ (0x56 with fans on cooler boost) !
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP, // reason: no such setting in the "MSI Center", checked in version 2.0.35
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80, // tested
-		.rt_fan_speed_address = 0xcb, // ! observed the file reporting over 100% fan speed, which should not be possible !
-	},
-	.leds = { // tested
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = { // tested
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP, // reason: no such setting in the "MSI Center", checked in version 2.0.35
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+// reads that must see the EC: read-modify-write cycles and debugging
+static int msi_ec_read_direct(u8 addr, u8 *val)
+{
+	if (emulate) {
+		*val = READ_ONCE(emulated_ec[addr]);
+		residency_observe(addr, *val);
+		return 0;
+	}
 
-static const char *ALLOWED_FW_21[] __initconst = {
-	"16R3EMS1.100", // GF63 Thin 9SC
-	"16R3EMS1.102",
-	"16R3EMS1.104",
-	"16R4EMS2.102", // GF63 Thin 9SCSR
-	NULL
-};
+	return ec_read_deadline(addr, val, 0);
+}
 
-static struct msi_ec_conf CONF21 __initdata = {
-	.allowed_fw = ALLOWED_FW_21, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0xbc,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_BASIC_NAME,    0x4d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x64,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-		// .rt_temp_table_start_adress = ,
-		// .rt_fan_speed_table_start_address = ,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-		// .rt_temp_table_start_adress = ,
-		// .rt_fan_speed_table_start_address = ,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = MSI_EC_ADDR_UNSUPP,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP, // Only mode is solid red
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static int msi_ec_write(u8 addr, u8 val)
+{
+	int result;
 
-static const char *ALLOWED_FW_22[] __initconst = {
-	"17LLEMS1.106", // Alpha 17 B5EEK
-	NULL
-};
+	if (emulate) {
+		WRITE_ONCE(emulated_ec[addr], val);
+		residency_observe(addr, val);
+		return 0;
+	}
 
-static struct msi_ec_conf CONF22 __initdata = {
-	.allowed_fw = ALLOWED_FW_22, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // super_battery = 0xa5
-			{ SM_COMFORT_NAME, 0xc1 }, // super_battery = 0xa4
-			{ SM_SPORT_NAME,   0xc1 }, // super_battery = 0xa1
-			{ SM_TURBO_NAME,   0xc4 }, // super_battery = 0xa0
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN, // knwon. 0xd5.
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP, // RGB
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+	result = ec_write(addr, val);
+	ec_breaker_report(result, false);
+	if (!result) {
+		ec_cache_store(addr, val);
+		residency_observe(addr, val);
+	}
 
-static const char *ALLOWED_FW_23[] __initconst = {
-	"16WKEMS1.105", // MSI Bravo 15 A4DDR (issue #134)
-	NULL
-};
+	return result;
+}
 
-static struct msi_ec_conf CONF23 __initdata = {
-	.allowed_fw = ALLOWED_FW_23, // WMI1 based
-	.charge_control = { // threshold
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4, // 0xe4 = 100%, but 0x80 too?
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP, // not in MSI app
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			// values can also be 0x81... when booting on Linux
-			{ SM_COMFORT_NAME, 0xc1 }, // Silent / Balanced / AI
-			{ SM_ECO_NAME,     0xc2 }, // Super Battery
-			{ SM_TURBO_NAME,   0xc4 }, // Performance
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // enabled by "Super Battery" shift mode?
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			// 'd' is not relevant, values can also be 0x00... or 0x03...
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68, // a second value/sensor is at 0x64
-		.rt_fan_speed_address  = 0x71, // target speed
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96, // at 150%
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-		// current RPM speed is 480000/x
-		// with x 2 bytes at 0xcc and 0xcd
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89, // target speed
-		// current RPM speed is 480000/x
-		// with x 2 bytes at 0xca and 0xcb
-	},
-	.leds = {
-		// No LED indicator
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = MSI_EC_ADDR_UNSUPP,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP, // not in MSI Center
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static inline bool msi_ec_has(enum msi_ec_capability cap)
+{
+	return conf.caps & BIT(cap);
+}
 
-static const char *ALLOWED_FW_24[] __initconst = {
-	"14D1EMS1.103", // Modern 14 B10MW (#100)
-	NULL
-};
+#ifdef MSI_EC_MODEL
 
-static struct msi_ec_conf CONF24 __initdata = {
-	.allowed_fw = ALLOWED_FW_24, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2E,
-		.block_address = 0x2F,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xBF,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xC2 }, // Super Battery
-			{ SM_COMFORT_NAME, 0xC1 }, // + Silent
-			{ SM_SPORT_NAME,   0xC0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // not 0xD5, tested
-		.mask    = 0x0f,
-	},
-	.fan_mode = { // Creator Center sets 0x?0 instead of 0x?D
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNSUPP,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNSUPP,
-	},
-	.leds = {
-		.micmute_led_address = 0x2B,
-		.mute_led_address    = 0x2C,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xF3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
+// hidden by every is_visible, stands in for the attributes of the
+// features the model lacks so they are left out of the build
+static struct attribute msi_ec_attr_none __maybe_unused = {
+	.name = "none",
+	.mode = 0,
 };
 
-static const char *ALLOWED_FW_25[] __initconst = {
-	"14F1EMS1.209", // Summit E14 Flip Evo A13MT
-	"14F1EMS1.211",
-	NULL
-};
+#define MSI_EC_ATTR(cap, attr) \
+	((MSI_EC_MODEL_CAPS & BIT(MSI_EC_CAP_##cap)) ? (attr) : \
+						       &msi_ec_attr_none)
 
-static struct msi_ec_conf CONF25 __initdata = {
-	.allowed_fw = ALLOWED_FW_25, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x08 }, // 00 - on, 08 - 10 sec auto off
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+#else
 
-static const char *ALLOWED_FW_26[] __initconst = {
-	"14DLEMS1.105", // Modern 14 B5M
-	NULL
-};
+#define MSI_EC_ATTR(cap, attr) (attr)
 
-static struct msi_ec_conf CONF26 __initdata = {
-	.allowed_fw = ALLOWED_FW_26, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0xbc,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // Super Battery
-			{ SM_COMFORT_NAME, 0xc1 }, // Silent / Balanced / AI
-			{ SM_SPORT_NAME,   0xc0 }, // Performance
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // 0x33 switches between 0x0D and 0x05 
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0xcd,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNSUPP,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNSUPP,
-	},
-	.leds = {
-		.micmute_led_address = 0x2b,
-		.mute_led_address    = 0x2c,
-		.bit                 = 2,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP, // not presented in MSI app
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+#endif // MSI_EC_MODEL
 
-static const char *ALLOWED_FW_27[] __initconst = {
-	"17S2IMS1.113", // Raider GE78 HX Smart Touchpad 13V
-	NULL
-};
+// last known value if cached is set and there is one, EC read otherwise
+static int msi_ec_read_cached(u8 addr, u8 *val, bool cached)
+{
+	if (cached && ec_cache_peek(addr, val))
+		return 0;
 
-static struct msi_ec_conf CONF27 __initdata = {
-	.allowed_fw = ALLOWED_FW_27, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+	return msi_ec_read(addr, val);
+}
 
-static const char *ALLOWED_FW_28[] __initconst = {
-	"1822EMS1.105", // Titan 18 HX A14V
-	"1822EMS1.109", // WMI 2.8
-	"1822EMS1.111",
-	"1822EMS1.112",
-// .116 reports as .114
-// DMIDECODE Version: E1822IMS.116 but /sys/devices/platform/msi-ec/debug/fw_version reads 1822EMS1.114
-	"1822EMS1.114", 
-	NULL
-};
+static int ec_read_seq(u8 addr, u8 *buf, u8 len, bool cached)
+{
+	int result;
+	for (u8 i = 0; i < len; i++) {
+		result = msi_ec_read_cached(addr + i, buf + i, cached);
+		if (result < 0)
+			return result;
+	}
+	return 0;
+}
 
-static struct msi_ec_conf CONF28 __initdata = {
-	.allowed_fw = ALLOWED_FW_28,
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	// .usb_share  {
-	// 	.address      = 0xbf, // states: 0x08 || 0x28
-	// 	.bit          = 5,
-	// }, // Like Katana 17 B11UCX
-	.webcam = {
-		.address       = MSI_EC_ADDR_UNSUPP,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4, // 0x01-0x11
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // super battery
-			{ SM_COMFORT_NAME, 0xc1 }, // balanced
-			{ SM_TURBO_NAME,   0xc4 }, // extreme
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb, // 0x0F ( on ) or 0x00 ( off ) on 0xEB
-		.mask    = 0x0f, // 00, 0f
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-		// n/rpm register is C9
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP, // KB auto turn off
-		.bl_modes         = { 0x00, 0x08 }, // always on; off after 10 sec
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x81,
-		.max_state        = 3,
-	},
-};
+static unsigned int read_rate_limit = 10;
+module_param(read_rate_limit, uint, 0644);
+MODULE_PARM_DESC(read_rate_limit, "EC reads per second allowed to every non-root user for every attribute, the others are answered with the last known value (0 disables)");
 
-static const char *ALLOWED_FW_29[] __initconst = {
-	"16V5EMS1.107", // MSI GS66 12UGS
-	NULL
-};
+static unsigned int read_rate_burst = 20;
+module_param(read_rate_burst, uint, 0644);
+MODULE_PARM_DESC(read_rate_burst, "EC reads a non-root user may make at once for every attribute");
 
-static struct msi_ec_conf CONF29 __initdata = {
-	.allowed_fw = ALLOWED_FW_29,
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	// .usb_share  {
-	// 	.address      = 0xbf,
-	// 	.bit          = 5,
-	// },
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // super battery
-			{ SM_COMFORT_NAME, 0xc1 }, // balanced
-			{ SM_TURBO_NAME,   0xc4 }, // extreme
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = MSI_EC_ADDR_UNKNOWN, // 0xc9
-		.rt_fan_speed_base_min = 0x00, // ?
-		.rt_fan_speed_base_max = 0x3d, // ?
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN, // 0xcd
-		.bs_fan_speed_base_min = 0x00, // ?
-		.bs_fan_speed_base_max = 0x0f, // ?
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0xcb,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = MSI_EC_ADDR_UNSUPP,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+/*
+ * Token buckets limiting the EC reads of unprivileged users, one per
+ * (uid, attribute) in a small hash table. The attribute is a field of
+ * msi_ec_fields or one of the keys below. A table full of live buckets
+ * reuses the least recently used of the slots a key may go to.
+ */
+enum msi_ec_throttle_key {
+	MSI_EC_THROTTLE_STATE = MSI_EC_STATE_MAX_FIELDS, // state, state_bin
+	MSI_EC_THROTTLE_FW, // fw_version, fw_release_date
+	MSI_EC_THROTTLE_DEV, // /dev/msi-ec: per register read, per snapshot
 
-static const char *ALLOWED_FW_30[] __initconst = {
-	"17Q2IMS1.10D", // Titan GT77HX 13VH
-	NULL
+	MSI_EC_THROTTLE_NR
 };
 
-static struct msi_ec_conf CONF30 __initdata = {
-	.allowed_fw = ALLOWED_FW_30, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // eco works as expected (much slower, uses less power and lower fan speeds)
-			{ SM_COMFORT_NAME, 0xc1 }, // comfort, sport, and turbo all seem to be the same
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNKNOWN,
-		.mute_led_address    = MSI_EC_ADDR_UNKNOWN,
-		.bit = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNKNOWN,
-		.bl_modes         = {},
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
+#define MSI_EC_THROTTLE_BITS  6
+#define MSI_EC_THROTTLE_PROBE 4
+
+struct msi_ec_bucket {
+	bool used;
+	u8 key;
+	uid_t uid;
+	u32 millitokens;
+	ktime_t last; // refill time
+	u64 allowed;
+	u64 throttled;
 };
 
-static const char *ALLOWED_FW_31[] __initconst = {
-	"16Q4EMS1.110", // GS65 Stealth
-	NULL
-};
+static DEFINE_SPINLOCK(msi_ec_throttle_lock);
+static struct msi_ec_bucket msi_ec_buckets[1 << MSI_EC_THROTTLE_BITS];
+static u64 msi_ec_throttle_evictions;
 
-static struct msi_ec_conf CONF31 __initdata = {
-	.allowed_fw = ALLOWED_FW_31,
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4, // 0x00-0x10
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // super battery
-			{ SM_COMFORT_NAME, 0xc1 }, // balanced
-			{ SM_TURBO_NAME,   0xc4 }, // extreme
-			{ SM_SPORT_NAME,   0xc0 }, // sport
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // Function not shown in dragon center
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_BASIC_NAME,    0x4c },
-			{ FM_AUTO_NAME,     0x0c },
-			{ FM_ADVANCED_NAME, 0x8c },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-		// n/rpm register is C9
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
+static struct msi_ec_bucket *msi_ec_bucket_get(uid_t uid, u8 key)
+{
+	u32 hash = hash_32(uid ^ (key << 24), MSI_EC_THROTTLE_BITS);
+	struct msi_ec_bucket *victim = NULL;
+
+	for (int i = 0; i < MSI_EC_THROTTLE_PROBE; i++) {
+		struct msi_ec_bucket *bucket = &msi_ec_buckets[
+			(hash + i) % ARRAY_SIZE(msi_ec_buckets)];
+
+		if (bucket->used && bucket->uid == uid && bucket->key == key)
+			return bucket;
+
+		if (!bucket->used) {
+			if (!victim || victim->used)
+				victim = bucket;
+		} else if (!victim ||
+			   (victim->used && bucket->last < victim->last)) {
+			victim = bucket;
+		}
+	}
+
+	if (victim->used)
+		msi_ec_throttle_evictions++;
+
+	*victim = (struct msi_ec_bucket) {
+		.used = true,
+		.key = key,
+		.uid = uid,
+		.millitokens = read_rate_burst * 1000,
+		.last = ktime_get(),
+	};
+	return victim;
+}
+
+// whether the current task is over its budget for key
+static bool msi_ec_throttle(unsigned int key)
+{
+	uid_t uid = from_kuid(&init_user_ns, current_uid());
+	unsigned int rate = READ_ONCE(read_rate_limit);
+	u32 burst = READ_ONCE(read_rate_burst) * 1000;
+	struct msi_ec_bucket *bucket;
+	bool throttled;
+	ktime_t now;
+	s64 ms;
+
+	// root and the driver's own work are never throttled
+	if (!rate || !uid)
+		return false;
+
+	spin_lock(&msi_ec_throttle_lock);
+
+	bucket = msi_ec_bucket_get(uid, key);
+	now = ktime_get();
+	ms = ktime_ms_delta(now, bucket->last);
+	if (ms > 0) {
+		bucket->millitokens = min_t(u64, burst, bucket->millitokens +
+					    (u64)ms * rate);
+		bucket->last = now;
+	}
+
+	throttled = bucket->millitokens < 1000;
+	if (throttled) {
+		bucket->throttled++;
+	} else {
+		bucket->millitokens -= 1000;
+		bucket->allowed++;
+	}
+
+	spin_unlock(&msi_ec_throttle_lock);
+	return throttled;
+}
+
+/*
+ * Attribute accesses per process, to find the pollers hammering the EC
+ * without running a tracer. Every (process, attribute) pair gets an entry
+ * in a fixed-size hash table, a new pair replaces the least recently seen
+ * entry of the slots it may go to. The accesses and the time spent in the
+ * handler, mostly EC I/O, are kept per second over the last
+ * MSI_EC_ACCT_WINDOW seconds. Attributes use the keys of the throttle.
+ */
+#define MSI_EC_ACCT_BITS   7
+#define MSI_EC_ACCT_PROBE  4
+#define MSI_EC_ACCT_WINDOW 10 // seconds
+
+struct msi_ec_acct {
+	bool used;
+	u8 key;
+	pid_t tgid;
+	char comm[TASK_COMM_LEN];
+	time64_t last; // second of the last access
+	u32 accesses[MSI_EC_ACCT_WINDOW];
+	u32 ec_us[MSI_EC_ACCT_WINDOW];
+	u64 total_accesses;
+	u64 total_ec_us;
+};
+
+static DEFINE_SPINLOCK(msi_ec_acct_lock);
+static struct msi_ec_acct msi_ec_accts[1 << MSI_EC_ACCT_BITS];
+static u64 msi_ec_acct_evictions;
+
+static struct msi_ec_acct *msi_ec_acct_get(pid_t tgid, u8 key)
+{
+	u32 hash = hash_32(tgid ^ (key << 24), MSI_EC_ACCT_BITS);
+	struct msi_ec_acct *victim = NULL;
+
+	for (int i = 0; i < MSI_EC_ACCT_PROBE; i++) {
+		struct msi_ec_acct *acct = &msi_ec_accts[
+			(hash + i) % ARRAY_SIZE(msi_ec_accts)];
+
+		if (acct->used && acct->tgid == tgid && acct->key == key)
+			return acct;
+
+		if (!acct->used) {
+			if (!victim || victim->used)
+				victim = acct;
+		} else if (!victim ||
+			   (victim->used && acct->last < victim->last)) {
+			victim = acct;
+		}
+	}
+
+	if (victim->used)
+		msi_ec_acct_evictions++;
+
+	memset(victim, 0, sizeof(*victim));
+	victim->used = true;
+	victim->key = key;
+	victim->tgid = tgid;
+	return victim;
+}
+
+// records an access of the current process to key, started at start
+static void msi_ec_account(unsigned int key, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	time64_t now = ktime_get_seconds();
+	struct msi_ec_acct *acct;
+	int slot = now % MSI_EC_ACCT_WINDOW;
+
+	spin_lock(&msi_ec_acct_lock);
+
+	acct = msi_ec_acct_get(task_tgid_nr(current), key);
+	// the comm of the last thread, like top shows it
+	memcpy(acct->comm, current->comm, sizeof(acct->comm));
+
+	// clear the seconds without accesses since the last one
+	if (acct->last != now) {
+		for (time64_t t = max(acct->last + 1,
+				      now - MSI_EC_ACCT_WINDOW + 1);
+		     t <= now; t++) {
+			acct->accesses[t % MSI_EC_ACCT_WINDOW] = 0;
+			acct->ec_us[t % MSI_EC_ACCT_WINDOW] = 0;
+		}
+		acct->last = now;
+	}
+
+	acct->accesses[slot]++;
+	acct->ec_us[slot] += us;
+	acct->total_accesses++;
+	acct->total_ec_us += us;
+
+	spin_unlock(&msi_ec_acct_lock);
+}
+
+/*
+ * Journal of the last value written through the driver to every bit of
+ * the EC, protected by ec_lock. Some ECs reset their settings across
+ * suspend, the journal is replayed on resume.
+ */
+static struct {
+	u8 mask[256];  // bits ever written
+	u8 value[256];
+} ec_journal;
+
+static struct {
+	u64 restores;
+	u64 write_errors;
+	unsigned int last_restored; // registers rewritten by the last restore
+	s64 last_us;
+	s64 max_us;
+} ec_journal_stats;
+
+static void ec_journal_record(u8 addr, u8 mask, u8 value)
+{
+	lockdep_assert_held(&ec_lock);
+	ec_journal.mask[addr] |= mask;
+	ec_journal.value[addr] = (ec_journal.value[addr] & ~mask) |
+				 (value & mask);
+}
+
+/*
+ * Rewrites the journaled bits the EC no longer holds. Every register is
+ * read first, then only the differing ones are written, all under one
+ * lock hold so that resume is not interleaved with other writers.
+ */
+static int ec_journal_restore(void)
+{
+	DECLARE_BITMAP(pending, 256);
+	u8 stored[256];
+	ktime_t start = ktime_get();
+	unsigned int addr, restored = 0;
+	int result = 0;
+	s64 elapsed;
+
+	bitmap_zero(pending, 256);
+
+	mutex_lock(&ec_lock);
+
+	for (addr = 0; addr < 256; addr++) {
+		u8 mask = ec_journal.mask[addr];
+
+		if (!mask)
+			continue;
+
+		result = msi_ec_read_direct(addr, &stored[addr]);
+		if (result < 0)
+			goto unlock;
+
+		if ((stored[addr] ^ ec_journal.value[addr]) & mask)
+			__set_bit(addr, pending);
+	}
+
+	for_each_set_bit(addr, pending, 256) {
+		u8 mask = ec_journal.mask[addr];
+		u8 wdata = (stored[addr] & ~mask) |
+			   (ec_journal.value[addr] & mask);
+
+		// keep going, the other settings are still worth restoring
+		if (msi_ec_write(addr, wdata) < 0) {
+			pr_warn("failed to restore EC[0x%02x]\n", addr);
+			ec_journal_stats.write_errors++;
+			result = -EIO;
+			continue;
+		}
+		restored++;
+	}
+
+unlock:
+	elapsed = ktime_us_delta(ktime_get(), start);
+	ec_journal_stats.restores++;
+	ec_journal_stats.last_restored = restored;
+	ec_journal_stats.last_us = elapsed;
+	ec_journal_stats.max_us = max(ec_journal_stats.max_us, elapsed);
+	mutex_unlock(&ec_lock);
+
+	return result;
+}
+
+// writes value to the bits of addr selected by mask
+struct ec_write_op {
+	u8 addr;
+	u8 mask;
+	u8 value;
+};
+
+/*
+ * Applies a batch of writes under a single lock hold. Each address must
+ * appear once in the batch. All the affected bytes are read before the
+ * first write, and if any write fails the bytes already written are
+ * restored in reverse order, so the batch is applied either entirely or
+ * not at all (as far as the EC lets us).
+ */
+static int ec_write_batch(const struct ec_write_op *ops, int count)
+{
+	u8 stored[MSI_EC_STATE_MAX_FIELDS] = { 0 };
+	// a lone full-byte write has nothing to merge or roll back
+	bool blind = count == 1 && ops[0].mask == 0xff;
+	int result = 0;
+	int i;
+
+	if (count > ARRAY_SIZE(stored))
+		return -E2BIG;
+
+	mutex_lock(&ec_lock);
+
+	for (i = 0; i < count && !blind; i++) {
+		result = msi_ec_read_direct(ops[i].addr, &stored[i]);
+		if (result < 0)
+			goto unlock;
+	}
+
+	for (i = 0; i < count; i++) {
+		u8 wdata = (stored[i] & ~ops[i].mask) |
+			   (ops[i].value & ops[i].mask);
+
+		result = msi_ec_write(ops[i].addr, wdata);
+		if (result < 0)
+			break;
+	}
+
+	// roll back the writes that went through
+	if (result < 0) {
+		while (--i >= 0) {
+			if (msi_ec_write(ops[i].addr, stored[i]) < 0)
+				pr_warn("failed to restore EC[0x%02x]\n",
+					ops[i].addr);
+		}
+	} else {
+		for (i = 0; i < count; i++)
+			ec_journal_record(ops[i].addr, ops[i].mask,
+					  ops[i].value);
+	}
+
+unlock:
+	mutex_unlock(&ec_lock);
+	return result;
+}
+
+static int ec_update_by_mask(u8 addr, u8 mask, u8 value)
+{
+	struct ec_write_op op = {
+		.addr = addr,
+		.mask = mask,
+		.value = value,
+	};
+
+	return ec_write_batch(&op, 1);
+}
+
+static int ec_get_firmware_version(char buf[MSI_EC_FW_VERSION_LENGTH + 1],
+				   bool cached)
+{
+	int result;
+
+	memset(buf, 0, MSI_EC_FW_VERSION_LENGTH + 1);
+	result = ec_read_seq(MSI_EC_FW_VERSION_ADDRESS, (u8 *)buf,
+			     MSI_EC_FW_VERSION_LENGTH, cached);
+	if (result < 0)
+		return result;
+
+	return MSI_EC_FW_VERSION_LENGTH + 1;
+}
+
+// ============================================================ //
+// Enum attribute tables
+// ============================================================ //
+
+/*
+ * Shift, fan and battery modes and the keyboard backlight level are small
+ * sets of named EC byte values. Their lookup tables are built once when the
+ * configuration is loaded, so show handlers decode a register with a single
+ * array access and store handlers find the written name by hash instead of
+ * comparing it against every mode.
+ */
+
+#define MSI_EC_ENUM_MAX       6
+#define MSI_EC_ENUM_NONE      0xff
+#define MSI_EC_ENUM_HASH_BITS 3
+#define MSI_EC_ENUM_HASH_SIZE (1 << MSI_EC_ENUM_HASH_BITS)
+
+struct msi_ec_enum {
+	const char *names[MSI_EC_ENUM_MAX];
+	u8 values[MSI_EC_ENUM_MAX];
+	int count;    // entries accepted by store, listed first
+	int total;    // count + read-only entries
+
+	u8 by_value[256];                   // EC byte -> index
+	u8 by_name[MSI_EC_ENUM_HASH_SIZE]; // name hash slot -> index
+};
+
+static struct msi_ec_enum shift_mode_enum;
+static struct msi_ec_enum fan_mode_enum;
+static struct msi_ec_enum battery_mode_enum;
+static struct msi_ec_enum kbd_bl_enum;
+
+static u32 msi_ec_enum_hash(const char *name, size_t len)
+{
+	return full_name_hash(NULL, name, len) & (MSI_EC_ENUM_HASH_SIZE - 1);
+}
+
+static void __init msi_ec_enum_init(struct msi_ec_enum *e)
+{
+	memset(e, 0, sizeof(*e));
+	memset(e->by_value, MSI_EC_ENUM_NONE, sizeof(e->by_value));
+	memset(e->by_name, MSI_EC_ENUM_NONE, sizeof(e->by_name));
+}
+
+// adds an entry; read-only entries are decoded but never accepted by store
+static void __init msi_ec_enum_add(struct msi_ec_enum *e, const char *name,
+				   u8 value, bool read_only)
+{
+	u8 idx;
+
+	if (e->total == MSI_EC_ENUM_MAX)
+		return;
+
+	// read-only entries must stay behind the writable ones
+	if (!read_only && e->count != e->total)
+		return;
+
+	idx = e->total++;
+	if (!read_only)
+		e->count++;
+
+	e->names[idx] = name;
+	e->values[idx] = value;
+
+	// the first entry using a value wins, like the old linear scan
+	if (e->by_value[value] == MSI_EC_ENUM_NONE)
+		e->by_value[value] = idx;
+
+	if (read_only || !name)
+		return;
+
+	for (u32 slot = msi_ec_enum_hash(name, strlen(name));;
+	     slot = (slot + 1) & (MSI_EC_ENUM_HASH_SIZE - 1)) {
+		if (e->by_name[slot] == MSI_EC_ENUM_NONE) {
+			e->by_name[slot] = idx;
+			break;
+		}
+	}
+}
+
+static void __init msi_ec_enum_add_modes(struct msi_ec_enum *e,
+					 const struct msi_ec_mode *modes)
+{
+	for (int i = 0; modes[i].name; i++) // NULL entries have NULL name
+		msi_ec_enum_add(e, modes[i].name, modes[i].value, false);
+}
+
+static void __init msi_ec_build_enums(void)
+{
+	msi_ec_enum_init(&shift_mode_enum);
+	msi_ec_enum_add_modes(&shift_mode_enum, conf.shift_mode.modes);
+	msi_ec_enum_add(&shift_mode_enum, "unspecified", 0x80, true);
+
+	msi_ec_enum_init(&fan_mode_enum);
+	msi_ec_enum_add_modes(&fan_mode_enum, conf.fan_mode.modes);
+
+	msi_ec_enum_init(&battery_mode_enum);
+	msi_ec_enum_add(&battery_mode_enum, "max",
+			conf.charge_control.range_max, false);
+	msi_ec_enum_add(&battery_mode_enum, "medium", // up to 80%
+			conf.charge_control.offset_end + 80, false);
+	msi_ec_enum_add(&battery_mode_enum, "min", // up to 60%
+			conf.charge_control.offset_end + 60, false);
+
+	// levels are stored in the low bits, the rest of the byte is ignored
+	msi_ec_enum_init(&kbd_bl_enum);
+	for (int level = 0; level <= conf.kbd_bl.max_state &&
+			    level <= MSI_EC_KBD_BL_STATE_MASK; level++)
+		msi_ec_enum_add(&kbd_bl_enum, NULL,
+				conf.kbd_bl.state_base_value | level, false);
+	for (int value = 0; value < 256; value++) {
+		u8 level = value & MSI_EC_KBD_BL_STATE_MASK;
+
+		if (level < kbd_bl_enum.total)
+			kbd_bl_enum.by_value[value] = level;
+	}
+}
+
+// returns the entry index for an EC byte, or -ENOENT
+static inline int msi_ec_enum_decode(const struct msi_ec_enum *e, u8 value)
+{
+	u8 idx = e->by_value[value];
+
+	return idx == MSI_EC_ENUM_NONE ? -ENOENT : idx;
+}
+
+// returns the index of the writable entry named in buf, or -EINVAL
+static int msi_ec_enum_parse(const struct msi_ec_enum *e, const char *buf)
+{
+	size_t len = strlen(buf);
+
+	// sysfs input may end with a newline
+	if (len && buf[len - 1] == '\n')
+		len--;
+
+	for (u32 slot = msi_ec_enum_hash(buf, len), n = 0;
+	     n < MSI_EC_ENUM_HASH_SIZE;
+	     slot = (slot + 1) & (MSI_EC_ENUM_HASH_SIZE - 1), n++) {
+		u8 idx = e->by_name[slot];
+
+		if (idx == MSI_EC_ENUM_NONE)
+			break;
+
+		if (!strncmp(e->names[idx], buf, len) && !e->names[idx][len])
+			return idx;
+	}
+
+	return -EINVAL;
+}
+
+static ssize_t msi_ec_enum_list(const struct msi_ec_enum *e, char *buf)
+{
+	int result = 0;
+	int count = 0;
+
+	for (int i = 0; i < e->count; i++) {
+		result = sysfs_emit_at(buf, count, "%s\n", e->names[i]);
+		if (result < 0)
+			return result;
+		count += result;
+	}
+
+	return count;
+}
+
+// ============================================================ //
+// EC state fields
+// ============================================================ //
+
+/*
+ * Every EC-backed value the driver reports is described by a field: the
+ * register it lives in, how a raw byte is decoded and, for writable values,
+ * how user input is encoded. The individual show/store handlers, the
+ * consolidated state attributes and transactions share these helpers, so
+ * a value is rendered and validated the same way everywhere.
+ */
+
+#define MSI_EC_FIELD_NEGATE BIT(0) // report the inverted bit
+#define MSI_EC_FIELD_SWAP   BIT(1) // xor the bit with fn_win_swap.invert
+#define MSI_EC_FIELD_LED    BIT(2) // written through the LED class
+
+struct msi_ec_field {
+	const char *name; // key in the state attribute
+	enum msi_ec_capability cap;
+	const int *address;
+
+	// returns 0, -ENOENT for an unknown enum value or -EINVAL
+	int (*decode)(const struct msi_ec_field *field, u8 raw, s32 *value);
+	// validates user input and turns it into a write; NULL if read-only
+	int (*encode)(const struct msi_ec_field *field, const char *buf,
+		      struct ec_write_op *op);
+
+	const int *bit;                   // bit fields
+	const int *mask;                  // mask fields
+	const struct msi_ec_enum *values; // enum fields, reported by name
+	const char *const *strs;          // boolean fields, reported by name
+	unsigned int flags;
+};
+
+static const char *const msi_ec_off_on[] = { "off", "on" };
+static const char *const msi_ec_left_right[] = { "left", "right" };
+
+static int msi_ec_decode_raw(const struct msi_ec_field *field, u8 raw,
+			     s32 *value)
+{
+	*value = raw;
+	return 0;
+}
+
+static int msi_ec_decode_bit(const struct msi_ec_field *field, u8 raw,
+			     s32 *value)
+{
+	bool bit_value = check_bit(raw, *field->bit);
+
+	if (field->flags & MSI_EC_FIELD_SWAP)
+		bit_value ^= conf.fn_win_swap.invert;
+	if (field->flags & MSI_EC_FIELD_NEGATE)
+		bit_value = !bit_value;
+
+	*value = bit_value;
+	return 0;
+}
+
+static int msi_ec_decode_enum(const struct msi_ec_field *field, u8 raw,
+			      s32 *value)
+{
+	int result = msi_ec_enum_decode(field->values, raw);
+	if (result < 0)
+		return result;
+
+	*value = result;
+	return 0;
+}
+
+static int msi_ec_decode_super_battery(const struct msi_ec_field *field,
+				       u8 raw, s32 *value)
+{
+	*value = (raw & conf.super_battery.mask) == conf.super_battery.mask;
+	return 0;
+}
+
+static int msi_ec_decode_fan_speed(u8 raw, int base_min, int base_max,
+				   s32 *value)
+{
+	if (raw < base_min || raw > base_max)
+		return -EINVAL;
+
+	*value = 100 * (raw - base_min) / (base_max - base_min);
+	return 0;
+}
+
+static int msi_ec_decode_cpu_rt_fan_speed(const struct msi_ec_field *field,
+					  u8 raw, s32 *value)
+{
+	return msi_ec_decode_fan_speed(raw, conf.cpu.rt_fan_speed_base_min,
+				       conf.cpu.rt_fan_speed_base_max, value);
+}
+
+static int msi_ec_decode_cpu_bs_fan_speed(const struct msi_ec_field *field,
+					  u8 raw, s32 *value)
+{
+	return msi_ec_decode_fan_speed(raw, conf.cpu.bs_fan_speed_base_min,
+				       conf.cpu.bs_fan_speed_base_max, value);
+}
+
+static int msi_ec_decode_threshold(u8 raw, int offset, s32 *value)
+{
+	// thresholds are unknown
+	if (raw == 0x80) {
+		*value = 0;
+		return 0;
+	}
+
+	*value = raw - offset;
+	return 0;
+}
+
+static int msi_ec_decode_charge_start(const struct msi_ec_field *field,
+				      u8 raw, s32 *value)
+{
+	return msi_ec_decode_threshold(raw, conf.charge_control.offset_start,
+				       value);
+}
+
+static int msi_ec_decode_charge_end(const struct msi_ec_field *field,
+				    u8 raw, s32 *value)
+{
+	return msi_ec_decode_threshold(raw, conf.charge_control.offset_end,
+				       value);
+}
+
+static int msi_ec_encode_bit(const struct msi_ec_field *field,
+			     const char *buf, struct ec_write_op *op)
+{
+	bool bit_value;
+
+	if (sysfs_streq(buf, field->strs[1]))
+		bit_value = true;
+	else if (sysfs_streq(buf, field->strs[0]))
+		bit_value = false;
+	else
+		return -EINVAL;
+
+	if (field->flags & MSI_EC_FIELD_NEGATE)
+		bit_value = !bit_value;
+	if (field->flags & MSI_EC_FIELD_SWAP)
+		bit_value ^= conf.fn_win_swap.invert;
+
+	op->addr = *field->address;
+	op->mask = BIT(*field->bit);
+	op->value = bit_value ? op->mask : 0;
+	return 0;
+}
+
+static int msi_ec_encode_enum(const struct msi_ec_field *field,
+			      const char *buf, struct ec_write_op *op)
+{
+	int result = msi_ec_enum_parse(field->values, buf);
+	if (result < 0)
+		return result;
+
+	op->addr = *field->address;
+	op->mask = 0xff;
+	op->value = field->values->values[result];
+	return 0;
+}
+
+// kbd_backlight takes a level, like the brightness of its LED
+static int msi_ec_encode_kbd_bl(const struct msi_ec_field *field,
+				const char *buf, struct ec_write_op *op)
+{
+	u8 level;
+	int result;
+
+	result = kstrtou8(buf, 10, &level);
+	if (result < 0)
+		return result;
+
+	if (level >= field->values->count)
+		return -EINVAL;
+
+	op->addr = *field->address;
+	op->mask = 0xff;
+	op->value = field->values->values[level];
+	return 0;
+}
+
+static int msi_ec_encode_super_battery(const struct msi_ec_field *field,
+				       const char *buf, struct ec_write_op *op)
+{
+	op->addr = *field->address;
+	op->mask = conf.super_battery.mask;
+
+	if (sysfs_streq(buf, "on"))
+		op->value = conf.super_battery.mask;
+	else if (sysfs_streq(buf, "off"))
+		op->value = 0;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+// scales a percentage to the basic fan speed register range, rounded so
+// that the percentage read back stores to the same register value
+static u8 msi_ec_cpu_bs_fan_speed_raw(u8 percent)
+{
+	return (percent * (conf.cpu.bs_fan_speed_base_max -
+			   conf.cpu.bs_fan_speed_base_min) +
+		100 * conf.cpu.bs_fan_speed_base_min + 50) / 100;
+}
+
+static int msi_ec_encode_cpu_bs_fan_speed(const struct msi_ec_field *field,
+					  const char *buf,
+					  struct ec_write_op *op)
+{
+	u8 wdata;
+	int result;
+
+	result = kstrtou8(buf, 10, &wdata);
+	if (result < 0)
+		return result;
+
+	if (wdata > 100)
+		return -EINVAL;
+
+	op->addr = *field->address;
+	op->mask = 0xff;
+	op->value = msi_ec_cpu_bs_fan_speed_raw(wdata);
+	return 0;
+}
+
+static int msi_ec_encode_threshold(const char *buf, int offset,
+				   struct ec_write_op *op)
+{
+	u8 wdata;
+	int result;
+
+	result = kstrtou8(buf, 10, &wdata);
+	if (result < 0)
+		return result;
+
+	wdata += offset;
+	if (wdata < conf.charge_control.range_min ||
+	    wdata > conf.charge_control.range_max)
+		return -EINVAL;
+
+	op->addr = conf.charge_control.address;
+	op->mask = 0xff;
+	op->value = wdata;
+	return 0;
+}
+
+static int msi_ec_encode_charge_start(const struct msi_ec_field *field,
+				      const char *buf, struct ec_write_op *op)
+{
+	return msi_ec_encode_threshold(buf, conf.charge_control.offset_start,
+				       op);
+}
+
+static int msi_ec_encode_charge_end(const struct msi_ec_field *field,
+				    const char *buf, struct ec_write_op *op)
+{
+	return msi_ec_encode_threshold(buf, conf.charge_control.offset_end,
+				       op);
+}
+
+static const struct msi_ec_field msi_ec_fields[MSI_EC_STATE_NR_FIELDS] = {
+	[MSI_EC_STATE_WEBCAM] = {
+		.name    = "webcam",
+		.cap     = MSI_EC_CAP_WEBCAM,
+		.address = &conf.webcam.address,
+		.decode  = msi_ec_decode_bit,
+		.encode  = msi_ec_encode_bit,
+		.bit     = &conf.webcam.bit,
+		.strs    = msi_ec_off_on,
+	},
+	[MSI_EC_STATE_WEBCAM_BLOCK] = {
+		.name    = "webcam_block",
+		.cap     = MSI_EC_CAP_WEBCAM_BLOCK,
+		.address = &conf.webcam.block_address,
+		.decode  = msi_ec_decode_bit,
+		.encode  = msi_ec_encode_bit,
+		.bit     = &conf.webcam.bit,
+		.strs    = msi_ec_off_on,
+		.flags   = MSI_EC_FIELD_NEGATE,
+	},
+	[MSI_EC_STATE_FN_KEY] = {
+		.name    = "fn_key",
+		.cap     = MSI_EC_CAP_FN_WIN_SWAP,
+		.address = &conf.fn_win_swap.address,
+		.decode  = msi_ec_decode_bit,
+		.encode  = msi_ec_encode_bit,
+		.bit     = &conf.fn_win_swap.bit,
+		.strs    = msi_ec_left_right,
+		.flags   = MSI_EC_FIELD_SWAP,
+	},
+	[MSI_EC_STATE_WIN_KEY] = {
+		.name    = "win_key",
+		.cap     = MSI_EC_CAP_FN_WIN_SWAP,
+		.address = &conf.fn_win_swap.address,
+		.decode  = msi_ec_decode_bit,
+		.encode  = msi_ec_encode_bit,
+		.bit     = &conf.fn_win_swap.bit,
+		.strs    = msi_ec_left_right,
+		.flags   = MSI_EC_FIELD_SWAP | MSI_EC_FIELD_NEGATE,
+	},
+	[MSI_EC_STATE_BATTERY_MODE] = {
+		.name    = "battery_mode",
+		.cap     = MSI_EC_CAP_CHARGE_CONTROL,
+		.address = &conf.charge_control.address,
+		.decode  = msi_ec_decode_enum,
+		.encode  = msi_ec_encode_enum,
+		.values  = &battery_mode_enum,
+	},
+	[MSI_EC_STATE_COOLER_BOOST] = {
+		.name    = "cooler_boost",
+		.cap     = MSI_EC_CAP_COOLER_BOOST,
+		.address = &conf.cooler_boost.address,
+		.decode  = msi_ec_decode_bit,
+		.encode  = msi_ec_encode_bit,
+		.bit     = &conf.cooler_boost.bit,
+		.strs    = msi_ec_off_on,
+	},
+	[MSI_EC_STATE_SHIFT_MODE] = {
+		.name    = "shift_mode",
+		.cap     = MSI_EC_CAP_SHIFT_MODE,
+		.address = &conf.shift_mode.address,
+		.decode  = msi_ec_decode_enum,
+		.encode  = msi_ec_encode_enum,
+		.values  = &shift_mode_enum,
+	},
+	[MSI_EC_STATE_SUPER_BATTERY] = {
+		.name    = "super_battery",
+		.cap     = MSI_EC_CAP_SUPER_BATTERY,
+		.address = &conf.super_battery.address,
+		.decode  = msi_ec_decode_super_battery,
+		.mask    = &conf.super_battery.mask,
+		.encode  = msi_ec_encode_super_battery,
+		.strs    = msi_ec_off_on,
+	},
+	[MSI_EC_STATE_FAN_MODE] = {
+		.name    = "fan_mode",
+		.cap     = MSI_EC_CAP_FAN_MODE,
+		.address = &conf.fan_mode.address,
+		.decode  = msi_ec_decode_enum,
+		.encode  = msi_ec_encode_enum,
+		.values  = &fan_mode_enum,
+	},
+	[MSI_EC_STATE_CPU_RT_TEMP] = {
+		.name    = "cpu/realtime_temperature",
+		.cap     = MSI_EC_CAP_CPU_RT_TEMP,
+		.address = &conf.cpu.rt_temp_address,
+		.decode  = msi_ec_decode_raw,
+	},
+	[MSI_EC_STATE_CPU_RT_FAN_SPEED] = {
+		.name    = "cpu/realtime_fan_speed",
+		.cap     = MSI_EC_CAP_CPU_RT_FAN_SPEED,
+		.address = &conf.cpu.rt_fan_speed_address,
+		.decode  = msi_ec_decode_cpu_rt_fan_speed,
+	},
+	[MSI_EC_STATE_CPU_BS_FAN_SPEED] = {
+		.name    = "cpu/basic_fan_speed",
+		.cap     = MSI_EC_CAP_CPU_BS_FAN_SPEED,
+		.address = &conf.cpu.bs_fan_speed_address,
+		.decode  = msi_ec_decode_cpu_bs_fan_speed,
+		.encode  = msi_ec_encode_cpu_bs_fan_speed,
+	},
+	[MSI_EC_STATE_GPU_RT_TEMP] = {
+		.name    = "gpu/realtime_temperature",
+		.cap     = MSI_EC_CAP_GPU_RT_TEMP,
+		.address = &conf.gpu.rt_temp_address,
+		.decode  = msi_ec_decode_raw,
+	},
+	[MSI_EC_STATE_GPU_RT_FAN_SPEED] = {
+		.name    = "gpu/realtime_fan_speed",
+		.cap     = MSI_EC_CAP_GPU_RT_FAN_SPEED,
+		.address = &conf.gpu.rt_fan_speed_address,
+		.decode  = msi_ec_decode_raw,
+	},
+	[MSI_EC_STATE_CHARGE_START] = {
+		.name    = "charge_control_start_threshold",
+		.cap     = MSI_EC_CAP_CHARGE_CONTROL,
+		.address = &conf.charge_control.address,
+		.decode  = msi_ec_decode_charge_start,
+		.encode  = msi_ec_encode_charge_start,
+	},
+	[MSI_EC_STATE_CHARGE_END] = {
+		.name    = "charge_control_end_threshold",
+		.cap     = MSI_EC_CAP_CHARGE_CONTROL,
+		.address = &conf.charge_control.address,
+		.decode  = msi_ec_decode_charge_end,
+		.encode  = msi_ec_encode_charge_end,
+	},
+	[MSI_EC_STATE_MICMUTE_LED] = {
+		.name    = "micmute_led",
+		.cap     = MSI_EC_CAP_MICMUTE_LED,
+		.address = &conf.leds.micmute_led_address,
+		.decode  = msi_ec_decode_bit,
+		.bit     = &conf.leds.bit,
+		.flags   = MSI_EC_FIELD_LED,
+	},
+	[MSI_EC_STATE_MUTE_LED] = {
+		.name    = "mute_led",
+		.cap     = MSI_EC_CAP_MUTE_LED,
+		.address = &conf.leds.mute_led_address,
+		.decode  = msi_ec_decode_bit,
+		.bit     = &conf.leds.bit,
+		.flags   = MSI_EC_FIELD_LED,
+	},
+	[MSI_EC_STATE_KBD_BL] = {
+		.name    = "kbd_backlight",
+		.cap     = MSI_EC_CAP_KBD_BL,
+		.address = &conf.kbd_bl.bl_state_address,
+		.decode  = msi_ec_decode_enum,
+		.encode  = msi_ec_encode_kbd_bl,
+		.values  = &kbd_bl_enum,
+		.flags   = MSI_EC_FIELD_LED,
+	},
+};
+
+static_assert(MSI_EC_STATE_NR_FIELDS <= MSI_EC_STATE_MAX_FIELDS);
+
+// emits the text form of a decoded value, as reported by the show handlers
+static ssize_t msi_ec_field_emit(const struct msi_ec_field *field, u8 raw,
+				 char *buf, int at)
+{
+	s32 value;
+	int result;
+
+	result = field->decode(field, raw, &value);
+	if (result == -ENOENT)
+		return sysfs_emit_at(buf, at, "%s (%i)\n", "unknown", raw);
+	if (result < 0)
+		return result;
+
+	// kbd_backlight is an enum reported as a number
+	if (field->values && field->values->names[value])
+		return sysfs_emit_at(buf, at, "%s\n",
+				     field->values->names[value]);
+
+	if (field->strs)
+		return sysfs_emit_at(buf, at, "%s\n", field->strs[value]);
+
+	return sysfs_emit_at(buf, at, "%i\n", value);
+}
+
+// the bits of its register a field occupies
+static u8 msi_ec_field_mask(const struct msi_ec_field *field)
+{
+	if (field->bit)
+		return BIT(*field->bit);
+	if (field->mask)
+		return *field->mask;
+
+	return 0xff;
+}
+
+static ssize_t msi_ec_field_show(enum msi_ec_state_field id, char *buf)
+{
+	const struct msi_ec_field *field = &msi_ec_fields[id];
+	ktime_t start = ktime_get();
+	u8 rdata;
+	int result;
+
+	result = msi_ec_read_cached(*field->address, &rdata,
+				    msi_ec_throttle(id));
+	msi_ec_account(id, start);
+	if (result < 0)
+		return result;
+
+	return msi_ec_field_emit(field, rdata, buf, 0);
+}
+
+static ssize_t msi_ec_field_store(enum msi_ec_state_field id, const char *buf,
+				  size_t count)
+{
+	const struct msi_ec_field *field = &msi_ec_fields[id];
+	ktime_t start = ktime_get();
+	struct ec_write_op op;
+	int result;
+
+	result = field->encode(field, buf, &op);
+	if (result < 0)
+		return result;
+
+	result = ec_write_batch(&op, 1);
+	msi_ec_account(id, start);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+static const struct msi_ec_field *msi_ec_field_find(const char *name)
+{
+	for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+		if (!strcmp(msi_ec_fields[i].name, name))
+			return &msi_ec_fields[i];
+	}
+
+	return NULL;
+}
+
+// adds op to the batch, merging it with an earlier write to the same byte
+static int msi_ec_batch_add(struct ec_write_op *ops, int count,
+			    const struct ec_write_op *op)
+{
+	for (int i = 0; i < count; i++) {
+		if (ops[i].addr != op->addr)
+			continue;
+
+		// two settings claiming the same bits, e.g. fn_key and win_key
+		if (ops[i].mask & op->mask)
+			return -EINVAL;
+
+		ops[i].mask |= op->mask;
+		ops[i].value |= op->value & op->mask;
+		return count;
+	}
+
+	if (count >= MSI_EC_STATE_MAX_FIELDS)
+		return -E2BIG;
+
+	ops[count] = *op;
+	return count + 1;
+}
+
+// parses "key=value" pairs into a batch, returns the number of writes
+static int msi_ec_parse_settings(char *input, struct ec_write_op *ops)
+{
+	char *token;
+	int nr_ops = 0;
+	int result;
+
+	while ((token = strsep(&input, " \t\n"))) {
+		const struct msi_ec_field *field;
+		struct ec_write_op op;
+		char *value;
+
+		if (!*token)
+			continue;
+
+		value = strchr(token, '=');
+		if (!value)
+			return -EINVAL;
+		*value++ = '\0';
+
+		field = msi_ec_field_find(token);
+		if (!field || !field->encode || !msi_ec_has(field->cap))
+			return -EINVAL;
+
+		result = field->encode(field, value, &op);
+		if (result < 0)
+			return result;
+
+		result = msi_ec_batch_add(ops, nr_ops, &op);
+		if (result < 0)
+			return result;
+		nr_ops = result;
+	}
+
+	return nr_ops;
+}
+
+// ============================================================ //
+// EC snapshot
+// ============================================================ //
+
+/*
+ * A snapshot reads every register used by a supported field in one burst
+ * and stamps it once, so values reported together come from the same
+ * moment. The register set is computed when the configuration is loaded.
+ */
+
+struct msi_ec_snapshot {
+	u64 timestamp_ns; // CLOCK_BOOTTIME
+	bool stale; // the breaker was open, regs may be last known values
+	u8 regs[256];
+};
+
+static DECLARE_BITMAP(snapshot_regs, 256);
+
+static void __init msi_ec_build_snapshot_regs(void)
+{
+	bitmap_zero(snapshot_regs, 256);
+
+	for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+		if (msi_ec_has(msi_ec_fields[i].cap))
+			__set_bit(*msi_ec_fields[i].address, snapshot_regs);
+	}
+}
+
+// cached: answered from the last known values, for throttled readers
+static int msi_ec_snapshot_read(struct msi_ec_snapshot *snap, bool cached)
+{
+	unsigned int addr;
+	int result = 0;
+
+	// don't observe a transaction halfway through
+	mutex_lock(&ec_lock);
+
+	snap->timestamp_ns = ktime_get_boottime_ns();
+	snap->stale = cached || ec_breaker_open();
+
+	for_each_set_bit(addr, snapshot_regs, 256) {
+		result = msi_ec_read_cached(addr, &snap->regs[addr], cached);
+		if (result < 0)
+			break;
+	}
+
+	snap->stale |= ec_breaker_open();
+	mutex_unlock(&ec_lock);
+	return result;
+}
+
+static void msi_ec_snapshot_decode(const struct msi_ec_snapshot *snap,
+				   struct msi_ec_state *state)
+{
+	memset(state, 0, sizeof(*state));
+	state->version = MSI_EC_STATE_VERSION;
+	state->size = sizeof(*state);
+	state->nr_fields = MSI_EC_STATE_NR_FIELDS;
+	state->timestamp_ns = snap->timestamp_ns;
+	if (snap->stale)
+		state->flags |= MSI_EC_STATE_STALE;
+
+	for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+		const struct msi_ec_field *field = &msi_ec_fields[i];
+
+		if (!msi_ec_has(field->cap))
+			continue;
+
+		state->present |= BIT(i);
+		state->raw[i] = snap->regs[*field->address];
+		if (!field->decode(field, state->raw[i], &state->values[i]))
+			state->valid |= BIT(i);
+	}
+}
+
+// ============================================================ //
+// Setting enforcement
+// ============================================================ //
+
+/*
+ * Some firmwares silently revert the shift mode, the fan mode or cooler
+ * boost on AC plug/unplug or thermal events. When enforce is set, the
+ * value last written through the driver, as recorded in the journal, is
+ * re-applied whenever the EC diverges from it: before every EC event is
+ * reported and every enforce_interval_ms. The EC doesn't tell the
+ * firmware's changes from the hotkeys', so the hotkeys are reverted too.
+ */
+
+static const enum msi_ec_state_field msi_ec_enforced[] = {
+	MSI_EC_STATE_SHIFT_MODE,
+	MSI_EC_STATE_FAN_MODE,
+	MSI_EC_STATE_COOLER_BOOST,
+};
+
+// protected by ec_lock
+static struct {
+	u64 checks;
+	u64 reapplied[ARRAY_SIZE(msi_ec_enforced)];
+	u64 write_errors;
+} msi_ec_enforce_stats;
+
+/*
+ * Re-applies the enforced settings the EC no longer holds. They are all
+ * read, then the differing ones written, under one lock hold like the
+ * resume restore. Returns the number of settings re-applied.
+ */
+static int msi_ec_enforce(void)
+{
+	u8 regs[ARRAY_SIZE(msi_ec_enforced)];
+	int result = 0, reapplied = 0;
+
+	mutex_lock(&ec_lock);
+	msi_ec_enforce_stats.checks++;
+
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_enforced); i++) {
+		const struct msi_ec_field *field =
+			&msi_ec_fields[msi_ec_enforced[i]];
+		u8 addr = *field->address;
+
+		// only what was written through the driver is enforced
+		if (!msi_ec_has(field->cap) ||
+		    !(msi_ec_field_mask(field) & ec_journal.mask[addr]))
+			continue;
+
+		result = msi_ec_read_direct(addr, &regs[i]);
+		if (result < 0)
+			goto unlock;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_enforced); i++) {
+		const struct msi_ec_field *field =
+			&msi_ec_fields[msi_ec_enforced[i]];
+		u8 addr = *field->address;
+		u8 mask = msi_ec_field_mask(field) & ec_journal.mask[addr];
+		u8 wdata;
+
+		if (!msi_ec_has(field->cap) || !mask ||
+		    !((regs[i] ^ ec_journal.value[addr]) & mask))
+			continue;
+
+		wdata = (regs[i] & ~mask) | (ec_journal.value[addr] & mask);
+		if (msi_ec_write(addr, wdata) < 0) {
+			pr_warn("failed to re-apply %s\n", field->name);
+			msi_ec_enforce_stats.write_errors++;
+			result = -EIO;
+			continue;
+		}
+
+		// settings sharing the register see the write
+		for (int j = i + 1; j < ARRAY_SIZE(msi_ec_enforced); j++)
+			if (*msi_ec_fields[msi_ec_enforced[j]].address == addr)
+				regs[j] = wdata;
+
+		msi_ec_enforce_stats.reapplied[i]++;
+		reapplied++;
+	}
+
+unlock:
+	mutex_unlock(&ec_lock);
+
+	return result < 0 ? result : reapplied;
+}
+
+static void msi_ec_enforce_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(msi_ec_enforce_work, msi_ec_enforce_fn);
+
+// the work may run, protected by kernel_param_lock
+static bool msi_ec_enforce_ready = false;
+
+static bool enforce = false;
+static unsigned int enforce_interval_ms = 5000;
+
+static void msi_ec_enforce_fn(struct work_struct *work)
+{
+	unsigned int interval_ms = READ_ONCE(enforce_interval_ms);
+
+	if (!READ_ONCE(enforce))
+		return;
+
+	msi_ec_enforce();
+
+	if (interval_ms)
+		schedule_delayed_work(&msi_ec_enforce_work,
+				      msecs_to_jiffies(interval_ms));
+}
+
+// checks right away when enforcement is switched on or retimed
+static void msi_ec_enforce_kick(void)
+{
+	if (msi_ec_enforce_ready && enforce)
+		mod_delayed_work(system_wq, &msi_ec_enforce_work, 0);
+}
+
+static int enforce_set(const char *val, const struct kernel_param *kp)
+{
+	int result = param_set_bool(val, kp);
+
+	if (result == 0)
+		msi_ec_enforce_kick();
+	return result;
+}
+
+static const struct kernel_param_ops enforce_ops = {
+	.set = enforce_set,
+	.get = param_get_bool,
+};
+
+module_param_cb(enforce, &enforce_ops, &enforce, 0644);
+MODULE_PARM_DESC(enforce, "Re-apply shift_mode, fan_mode and cooler_boost when the EC reverts them");
+
+static int enforce_interval_ms_set(const char *val,
+				   const struct kernel_param *kp)
+{
+	int result = param_set_uint(val, kp);
+
+	if (result == 0)
+		msi_ec_enforce_kick();
+	return result;
+}
+
+static const struct kernel_param_ops enforce_interval_ms_ops = {
+	.set = enforce_interval_ms_set,
+	.get = param_get_uint,
+};
+
+module_param_cb(enforce_interval_ms, &enforce_interval_ms_ops,
+		&enforce_interval_ms, 0644);
+MODULE_PARM_DESC(enforce_interval_ms, "Period of the enforcement checks, in addition to the EC events (0 for events only)");
+
+static void msi_ec_enforce_init(void)
+{
+	kernel_param_lock(THIS_MODULE);
+	msi_ec_enforce_ready = true;
+	msi_ec_enforce_kick();
+	kernel_param_unlock(THIS_MODULE);
+}
+
+static void msi_ec_enforce_exit(void)
+{
+	kernel_param_lock(THIS_MODULE);
+	msi_ec_enforce_ready = false;
+	kernel_param_unlock(THIS_MODULE);
+
+	cancel_delayed_work_sync(&msi_ec_enforce_work);
+}
+
+// ============================================================ //
+// Residency statistics
+// ============================================================ //
+
+/*
+ * Time spent in every shift mode, fan mode and cooler boost state and in
+ * every 5 °C temperature band, and the transitions between them, like
+ * cpufreq's time_in_state and trans_table. The state is updated whenever
+ * the driver reads or writes the register and every sample_ms, so the
+ * changes made by the firmware or the hotkeys are seen at the latest on
+ * the next sample. Time is CLOCK_MONOTONIC, suspend is not counted.
+ */
+
+#define RESIDENCY_BAND   5  // celsius
+#define RESIDENCY_STATES 21 // temperature bands, from 0 to 100 and above
+
+static_assert(MSI_EC_ENUM_MAX <= RESIDENCY_STATES);
+
+struct residency {
+	const char *name;
+	enum msi_ec_state_field field;
+	bool bands; // temperatures, in RESIDENCY_BAND bands
+
+	int state; // -1 while unknown
+	ktime_t since; // time accounted up to
+	u64 time_ns[RESIDENCY_STATES];
+	u32 trans[RESIDENCY_STATES][RESIDENCY_STATES];
+	u64 total_trans;
+};
+
+static struct residency residencies[] = {
+	{ .name = "shift_mode", .field = MSI_EC_STATE_SHIFT_MODE },
+	{ .name = "fan_mode", .field = MSI_EC_STATE_FAN_MODE },
+	{ .name = "cooler_boost", .field = MSI_EC_STATE_COOLER_BOOST },
+	{ .name = "cpu_temperature", .field = MSI_EC_STATE_CPU_RT_TEMP,
+	  .bands = true },
+	{ .name = "gpu_temperature", .field = MSI_EC_STATE_GPU_RT_TEMP,
+	  .bands = true },
+};
+
+static_assert(ARRAY_SIZE(residencies) <= 8);
+
+// residencies of every register, one bit each, empty until configured
+static u8 residency_map[256];
+
+// protects residencies
+static DEFINE_SPINLOCK(residency_lock);
+
+static void __init msi_ec_build_residency_map(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(residencies); i++) {
+		const struct msi_ec_field *field =
+			&msi_ec_fields[residencies[i].field];
+
+		residencies[i].state = -1;
+		if (msi_ec_has(field->cap))
+			residency_map[*field->address] |= BIT(i);
+	}
+}
+
+// the state of a register value, -1 if it decodes to none
+static int residency_state(const struct residency *r, u8 raw)
+{
+	const struct msi_ec_field *field = &msi_ec_fields[r->field];
+	s32 value;
+
+	if (field->decode(field, raw, &value) < 0)
+		return -1;
+
+	if (r->bands)
+		return min_t(s32, value / RESIDENCY_BAND, RESIDENCY_STATES - 1);
+
+	return value;
+}
+
+static const char *residency_state_name(const struct residency *r, int state,
+					char *buf, size_t size)
+{
+	const struct msi_ec_field *field = &msi_ec_fields[r->field];
+
+	if (field->values)
+		return field->values->names[state];
+	if (field->strs)
+		return field->strs[state];
+
+	snprintf(buf, size, "%d", state * RESIDENCY_BAND);
+	return buf;
+}
+
+// residency_lock must be held
+static void residency_account(struct residency *r, ktime_t now)
+{
+	if (r->state >= 0)
+		r->time_ns[r->state] += ktime_to_ns(ktime_sub(now, r->since));
+	r->since = now;
+}
+
+static void residency_observe(u8 addr, u8 val)
+{
+	unsigned long map = READ_ONCE(residency_map[addr]);
+	ktime_t now;
+	int i;
+
+	if (!map)
+		return;
+
+	now = ktime_get();
+	spin_lock(&residency_lock);
+
+	for_each_set_bit(i, &map, ARRAY_SIZE(residencies)) {
+		struct residency *r = &residencies[i];
+		int state = residency_state(r, val);
+
+		residency_account(r, now);
+		if (state == r->state)
+			continue;
+
+		// entering or leaving an unknown state is no transition
+		if (r->state >= 0 && state >= 0) {
+			r->trans[r->state][state]++;
+			r->total_trans++;
+		}
+		r->state = state;
+	}
+
+	spin_unlock(&residency_lock);
+}
+
+static void residency_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(residency_work, residency_fn);
+
+// protects residency_ready and residency_sample_ms
+static DEFINE_MUTEX(residency_sample_lock);
+static bool residency_ready = false;
+static int residency_sample_ms = 10000;
+
+static void residency_fn(struct work_struct *work)
+{
+	u8 rdata;
+
+	// a read is an observation, failed or stale ones are skipped
+	for (int i = 0; i < ARRAY_SIZE(residencies); i++) {
+		const struct msi_ec_field *field =
+			&msi_ec_fields[residencies[i].field];
+
+		if (msi_ec_has(field->cap))
+			msi_ec_read(*field->address, &rdata);
+	}
+
+	mutex_lock(&residency_sample_lock);
+	if (residency_ready && residency_sample_ms)
+		schedule_delayed_work(&residency_work,
+				      msecs_to_jiffies(residency_sample_ms));
+	mutex_unlock(&residency_sample_lock);
+}
+
+static void residency_init(void)
+{
+	mutex_lock(&residency_sample_lock);
+	residency_ready = true;
+	schedule_delayed_work(&residency_work, 0);
+	mutex_unlock(&residency_sample_lock);
+}
+
+static void residency_exit(void)
+{
+	mutex_lock(&residency_sample_lock);
+	residency_ready = false;
+	mutex_unlock(&residency_sample_lock);
+
+	cancel_delayed_work_sync(&residency_work);
+}
+
+// a page overflow fails the whole table, like cpufreq's trans_table
+static int residency_emit(char *buf, int *count, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf + *count, PAGE_SIZE - *count, fmt, args);
+	va_end(args);
+
+	if (len >= PAGE_SIZE - *count)
+		return -EFBIG;
+
+	*count += len;
+	return 0;
+}
+
+// Format: one line per value, "name state=ms ...", unvisited bands left out
+static ssize_t residency_time_in_state_show(struct device *device,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	ktime_t now = ktime_get();
+	char name[8];
+	int count = 0;
+	int result = 0;
+
+	spin_lock(&residency_lock);
+
+	for (int i = 0; i < ARRAY_SIZE(residencies) && !result; i++) {
+		struct residency *r = &residencies[i];
+		const struct msi_ec_field *field = &msi_ec_fields[r->field];
+		int nr_states = RESIDENCY_STATES;
+
+		if (!msi_ec_has(field->cap))
+			continue;
+
+		if (field->values)
+			nr_states = field->values->total;
+		else if (field->strs)
+			nr_states = 2;
+
+		residency_account(r, now);
+		result = residency_emit(buf, &count, "%s", r->name);
+
+		for (int s = 0; s < nr_states && !result; s++) {
+			if (r->bands && !r->time_ns[s])
+				continue;
+
+			result = residency_emit(buf, &count, " %s=%llu",
+				residency_state_name(r, s, name, sizeof(name)),
+				div_u64(r->time_ns[s], NSEC_PER_MSEC));
+		}
+
+		if (!result)
+			result = residency_emit(buf, &count, "\n");
+	}
+
+	spin_unlock(&residency_lock);
+
+	return result < 0 ? result : count;
+}
+
+// Format: one line per value, "name total=n from->to=n ..."
+static ssize_t residency_trans_table_show(struct device *device,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	char from_name[8], to_name[8];
+	int count = 0;
+	int result = 0;
+
+	spin_lock(&residency_lock);
+
+	for (int i = 0; i < ARRAY_SIZE(residencies) && !result; i++) {
+		const struct residency *r = &residencies[i];
+
+		if (!msi_ec_has(msi_ec_fields[r->field].cap))
+			continue;
+
+		result = residency_emit(buf, &count, "%s total=%llu", r->name,
+					r->total_trans);
+
+		for (int from = 0; from < RESIDENCY_STATES && !result; from++) {
+			for (int to = 0; to < RESIDENCY_STATES && !result;
+			     to++) {
+				if (!r->trans[from][to])
+					continue;
+
+				result = residency_emit(buf, &count,
+					" %s->%s=%u",
+					residency_state_name(r, from, from_name,
+							     sizeof(from_name)),
+					residency_state_name(r, to, to_name,
+							     sizeof(to_name)),
+					r->trans[from][to]);
+			}
+		}
+
+		if (!result)
+			result = residency_emit(buf, &count, "\n");
+	}
+
+	spin_unlock(&residency_lock);
+
+	return result < 0 ? result : count;
+}
+
+static ssize_t residency_sample_ms_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return sysfs_emit(buf, "%d\n", READ_ONCE(residency_sample_ms));
+}
+
+// 0 counts the driver's own reads and writes only
+static ssize_t residency_sample_ms_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	int value;
+	int result;
+
+	result = kstrtoint(buf, 10, &value);
+	if (result < 0)
+		return result;
+
+	if (value != 0 && (value < 1000 || value > 3600000))
+		return -EINVAL;
+
+	mutex_lock(&residency_sample_lock);
+	residency_sample_ms = value;
+	if (residency_ready && value)
+		mod_delayed_work(system_wq, &residency_work, 0);
+	mutex_unlock(&residency_sample_lock);
+
+	return count;
+}
+
+// the current states are kept, only the counters start over
+static ssize_t residency_reset_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	ktime_t now = ktime_get();
+	bool reset;
+	int result;
+
+	result = kstrtobool(buf, &reset);
+	if (result < 0)
+		return result;
+	if (!reset)
+		return count;
+
+	spin_lock(&residency_lock);
+	for (int i = 0; i < ARRAY_SIZE(residencies); i++) {
+		struct residency *r = &residencies[i];
+
+		memset(r->time_ns, 0, sizeof(r->time_ns));
+		memset(r->trans, 0, sizeof(r->trans));
+		r->total_trans = 0;
+		r->since = now;
+	}
+	spin_unlock(&residency_lock);
+
+	return count;
+}
+
+static struct device_attribute dev_attr_residency_time_in_state = {
+	.attr = {
+		.name = "time_in_state",
+		.mode = 0444,
+	},
+	.show = residency_time_in_state_show,
+};
+
+static struct device_attribute dev_attr_residency_trans_table = {
+	.attr = {
+		.name = "trans_table",
+		.mode = 0444,
+	},
+	.show = residency_trans_table_show,
+};
+
+static struct device_attribute dev_attr_residency_sample_ms = {
+	.attr = {
+		.name = "sample_ms",
+		.mode = 0644,
+	},
+	.show = residency_sample_ms_show,
+	.store = residency_sample_ms_store,
+};
+
+static struct device_attribute dev_attr_residency_reset = {
+	.attr = {
+		.name = "reset",
+		.mode = 0200,
+	},
+	.store = residency_reset_store,
+};
+
+static struct attribute *msi_residency_attrs[] = {
+	&dev_attr_residency_time_in_state.attr,
+	&dev_attr_residency_trans_table.attr,
+	&dev_attr_residency_sample_ms.attr,
+	&dev_attr_residency_reset.attr,
+	NULL
+};
+
+// ============================================================ //
+// Sysfs power_supply subsystem
+// ============================================================ //
+
+static ssize_t
+charge_control_start_threshold_show(struct device *device,
+				    struct device_attribute *attr, char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_CHARGE_START, buf);
+}
+
+static ssize_t
+charge_control_start_threshold_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_CHARGE_START, buf, count);
+}
+
+static ssize_t charge_control_end_threshold_show(struct device *device,
+						 struct device_attribute *attr,
+						 char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_CHARGE_END, buf);
+}
+
+static ssize_t charge_control_end_threshold_store(struct device *dev,
+						  struct device_attribute *attr,
+						  const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_CHARGE_END, buf, count);
+}
+
+static DEVICE_ATTR_RW(charge_control_start_threshold);
+static DEVICE_ATTR_RW(charge_control_end_threshold);
+
+static struct attribute *msi_battery_attrs[] = {
+	&dev_attr_charge_control_start_threshold.attr,
+	&dev_attr_charge_control_end_threshold.attr,
+	NULL
+};
+
+ATTRIBUTE_GROUPS(msi_battery);
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0))
+static int msi_battery_add(struct power_supply *battery,
+			   struct acpi_battery_hook *hook)
+#else
+static int msi_battery_add(struct power_supply *battery)
+#endif
+{
+	return device_add_groups(&battery->dev, msi_battery_groups);
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0))
+static int msi_battery_remove(struct power_supply *battery,
+			      struct acpi_battery_hook *hook)
+#else
+static int msi_battery_remove(struct power_supply *battery)
+#endif
+{
+	device_remove_groups(&battery->dev, msi_battery_groups);
+	return 0;
+}
+
+static struct acpi_battery_hook battery_hook = {
+	.add_battery = msi_battery_add,
+	.remove_battery = msi_battery_remove,
+	.name = MSI_EC_DRIVER_NAME,
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (root)
+// ============================================================ //
+
+static ssize_t webcam_show(struct device *device,
+			   struct device_attribute *attr,
+			   char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_WEBCAM, buf);
+}
+
+static ssize_t webcam_store(struct device *dev,
+			    struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_WEBCAM, buf, count);
+}
+
+static ssize_t webcam_block_show(struct device *device,
+				 struct device_attribute *attr,
+				 char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_WEBCAM_BLOCK, buf);
+}
+
+static ssize_t webcam_block_store(struct device *dev,
+				  struct device_attribute *attr,
+			          const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_WEBCAM_BLOCK, buf, count);
+}
+
+static ssize_t fn_key_show(struct device *device, struct device_attribute *attr,
+			   char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_FN_KEY, buf);
+}
+
+static ssize_t fn_key_store(struct device *dev, struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_FN_KEY, buf, count);
+}
+
+static ssize_t win_key_show(struct device *device,
+			    struct device_attribute *attr, char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_WIN_KEY, buf);
+}
+
+static ssize_t win_key_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_WIN_KEY, buf, count);
+}
+
+static ssize_t battery_mode_show(struct device *device,
+				 struct device_attribute *attr, char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_BATTERY_MODE, buf);
+}
+
+static ssize_t battery_mode_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_BATTERY_MODE, buf, count);
+}
+
+static ssize_t cooler_boost_show(struct device *device,
+				 struct device_attribute *attr, char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_COOLER_BOOST, buf);
+}
+
+static ssize_t cooler_boost_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_COOLER_BOOST, buf, count);
+}
+
+static ssize_t available_shift_modes_show(struct device *device,
+				          struct device_attribute *attr,
+				          char *buf)
+{
+	return msi_ec_enum_list(&shift_mode_enum, buf);
+}
+
+static ssize_t shift_mode_show(struct device *device,
+			       struct device_attribute *attr,
+			       char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_SHIFT_MODE, buf);
+}
+
+static ssize_t shift_mode_store(struct device *dev,
+				struct device_attribute *attr, const char *buf,
+				size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_SHIFT_MODE, buf, count);
+}
+
+static ssize_t super_battery_show(struct device *device,
+				  struct device_attribute *attr, char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_SUPER_BATTERY, buf);
+}
+
+static ssize_t super_battery_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_SUPER_BATTERY, buf, count);
+}
+
+static ssize_t available_fan_modes_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return msi_ec_enum_list(&fan_mode_enum, buf);
+}
+
+static ssize_t fan_mode_show(struct device *device,
+			     struct device_attribute *attr, char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_FAN_MODE, buf);
+}
+
+static ssize_t fan_mode_store(struct device *dev, struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_FAN_MODE, buf, count);
+}
+
+static ssize_t fw_version_show(struct device *device,
+			       struct device_attribute *attr, char *buf)
+{
+	char rdata[MSI_EC_FW_VERSION_LENGTH + 1];
+	ktime_t start = ktime_get();
+	int result;
+
+	result = ec_get_firmware_version(rdata,
+					 msi_ec_throttle(MSI_EC_THROTTLE_FW));
+	msi_ec_account(MSI_EC_THROTTLE_FW, start);
+	if (result < 0)
+		return result;
+
+	return sysfs_emit(buf, "%s\n", rdata);
+}
+
+static ssize_t fw_release_date_show(struct device *device,
+				    struct device_attribute *attr, char *buf)
+{
+	char rdate[MSI_EC_FW_DATE_LENGTH + 1];
+	char rtime[MSI_EC_FW_TIME_LENGTH + 1];
+	bool cached = msi_ec_throttle(MSI_EC_THROTTLE_FW);
+	ktime_t start = ktime_get();
+	int result;
+	int year, month, day, hour, minute, second;
+
+	memset(rdate, 0, MSI_EC_FW_DATE_LENGTH + 1);
+	memset(rtime, 0, MSI_EC_FW_TIME_LENGTH + 1);
+	result = ec_read_seq(MSI_EC_FW_DATE_ADDRESS, (u8 *)rdate,
+			     MSI_EC_FW_DATE_LENGTH, cached);
+	if (result == 0)
+		result = ec_read_seq(MSI_EC_FW_TIME_ADDRESS, (u8 *)rtime,
+				     MSI_EC_FW_TIME_LENGTH, cached);
+	msi_ec_account(MSI_EC_THROTTLE_FW, start);
+	if (result < 0)
+		return result;
+
+	sscanf(rdate, "%02d%02d%04d", &month, &day, &year);
+	sscanf(rtime, "%02d:%02d:%02d", &hour, &minute, &second);
+
+	return sysfs_emit(buf, "%04d/%02d/%02d %02d:%02d:%02d\n", year, month, day,
+		          hour, minute, second);
+}
+
+// all supported values from one EC snapshot, one "key=value" per line
+static ssize_t state_show(struct device *device,
+			  struct device_attribute *attr, char *buf)
+{
+	struct msi_ec_snapshot snap;
+	ktime_t start = ktime_get();
+	int result;
+	int count = 0;
+
+	result = msi_ec_snapshot_read(&snap,
+				      msi_ec_throttle(MSI_EC_THROTTLE_STATE));
+	msi_ec_account(MSI_EC_THROTTLE_STATE, start);
+	if (result < 0)
+		return result;
+
+	count += sysfs_emit_at(buf, count, "version=%d\n",
+			       MSI_EC_STATE_VERSION);
+	count += sysfs_emit_at(buf, count, "timestamp_ns=%llu\n",
+			       snap.timestamp_ns);
+	if (snap.stale)
+		count += sysfs_emit_at(buf, count, "stale=1\n");
+
+	for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+		const struct msi_ec_field *field = &msi_ec_fields[i];
+		int len;
+
+		if (!msi_ec_has(field->cap))
+			continue;
+
+		// skip values that can't be decoded, like the show handlers do
+		len = sysfs_emit_at(buf, count, "%s=", field->name);
+		result = msi_ec_field_emit(field, snap.regs[*field->address],
+					   buf, count + len);
+		if (result < 0)
+			continue;
+
+		count += len + result;
+	}
+
+	return count;
+}
+
+// same snapshot as state, as a struct msi_ec_state
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0))
+static ssize_t state_bin_read(struct file *filp, struct kobject *kobj,
+			      const struct bin_attribute *attr, char *buf,
+			      loff_t off, size_t count)
+#else
+static ssize_t state_bin_read(struct file *filp, struct kobject *kobj,
+			      struct bin_attribute *attr, char *buf,
+			      loff_t off, size_t count)
+#endif
+{
+	struct msi_ec_snapshot snap;
+	struct msi_ec_state state;
+	ktime_t start;
+	int result;
+
+	if (off >= sizeof(state))
+		return 0;
+
+	start = ktime_get();
+	result = msi_ec_snapshot_read(&snap,
+				      msi_ec_throttle(MSI_EC_THROTTLE_STATE));
+	msi_ec_account(MSI_EC_THROTTLE_STATE, start);
+	if (result < 0)
+		return result;
+
+	msi_ec_snapshot_decode(&snap, &state);
+
+	count = min_t(size_t, count, sizeof(state) - off);
+	memcpy(buf, (u8 *)&state + off, count);
+
+	return count;
+}
+
+static BIN_ATTR_RO(state_bin, sizeof(struct msi_ec_state));
+
+/*
+ * Applies several settings at once. Format: whitespace separated
+ * "key=value" pairs using the keys of the state attribute, e.g.
+ * "shift_mode=sport fan_mode=auto cooler_boost=on". Every pair is
+ * validated before anything is written, then the writes are applied
+ * as one batch and rolled back if any of them fails.
+ */
+static ssize_t transaction_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct ec_write_op ops[MSI_EC_STATE_MAX_FIELDS];
+	char *input;
+	int result;
+
+	input = kmemdup_nul(buf, count, GFP_KERNEL);
+	if (!input)
+		return -ENOMEM;
+
+	result = msi_ec_parse_settings(input, ops);
+	kfree(input);
+	if (result < 0)
+		return result;
+
+	if (!result)
+		return -EINVAL;
+
+	result = ec_write_batch(ops, result);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+static ssize_t resume_stats_show(struct device *device,
+				 struct device_attribute *attr, char *buf)
+{
+	int count = 0;
+
+	mutex_lock(&ec_lock);
+	count += sysfs_emit_at(buf, count, "restores=%llu\n",
+			       ec_journal_stats.restores);
+	count += sysfs_emit_at(buf, count, "last_restored=%u\n",
+			       ec_journal_stats.last_restored);
+	count += sysfs_emit_at(buf, count, "last_us=%lld\n",
+			       ec_journal_stats.last_us);
+	count += sysfs_emit_at(buf, count, "max_us=%lld\n",
+			       ec_journal_stats.max_us);
+	count += sysfs_emit_at(buf, count, "write_errors=%llu\n",
+			       ec_journal_stats.write_errors);
+	mutex_unlock(&ec_lock);
+
+	return count;
+}
+
+static ssize_t enforce_stats_show(struct device *device,
+				  struct device_attribute *attr, char *buf)
+{
+	int count = 0;
+
+	mutex_lock(&ec_lock);
+	count += sysfs_emit_at(buf, count, "checks=%llu\n",
+			       msi_ec_enforce_stats.checks);
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_enforced); i++) {
+		const struct msi_ec_field *field =
+			&msi_ec_fields[msi_ec_enforced[i]];
+
+		if (msi_ec_has(field->cap))
+			count += sysfs_emit_at(buf, count, "%s=%llu\n",
+					       field->name,
+					       msi_ec_enforce_stats.reapplied[i]);
+	}
+	count += sysfs_emit_at(buf, count, "write_errors=%llu\n",
+			       msi_ec_enforce_stats.write_errors);
+	mutex_unlock(&ec_lock);
+
+	return count;
+}
+
+static ssize_t ec_breaker_show(struct device *device,
+			       struct device_attribute *attr, char *buf)
+{
+	int count = 0;
+
+	spin_lock(&ec_breaker_lock);
+	count += sysfs_emit_at(buf, count, "state=%s\n",
+			       ec_breaker_state_names[ec_breaker.state]);
+	count += sysfs_emit_at(buf, count, "failures=%u\n",
+			       ec_breaker.failures);
+	count += sysfs_emit_at(buf, count, "backoff_ms=%u\n",
+			       ec_breaker.backoff_ms);
+	count += sysfs_emit_at(buf, count, "trips=%llu\n", ec_breaker.trips);
+	count += sysfs_emit_at(buf, count, "probes=%llu\n", ec_breaker.probes);
+	count += sysfs_emit_at(buf, count, "slow_reads=%llu\n",
+			       ec_breaker.slow_reads);
+	count += sysfs_emit_at(buf, count, "stale_reads=%llu\n",
+			       ec_breaker.stale_reads);
+	count += sysfs_emit_at(buf, count, "failed_fast=%llu\n",
+			       ec_breaker.failed_fast);
+	spin_unlock(&ec_breaker_lock);
+
+	return count;
+}
+
+static const char *msi_ec_throttle_key_name(unsigned int key)
+{
+	if (key < MSI_EC_STATE_NR_FIELDS)
+		return msi_ec_fields[key].name;
+	if (key == MSI_EC_THROTTLE_STATE)
+		return "state";
+	if (key == MSI_EC_THROTTLE_FW)
+		return "fw";
+	if (key == MSI_EC_THROTTLE_DEV)
+		return "dev";
+	return "?";
+}
+
+// one line per (uid, attribute) bucket
+static ssize_t throttle_show(struct device *device,
+			     struct device_attribute *attr, char *buf)
+{
+	int count = 0;
+
+	spin_lock(&msi_ec_throttle_lock);
+
+	count += sysfs_emit_at(buf, count, "evictions=%llu\n",
+			       msi_ec_throttle_evictions);
+
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_buckets); i++) {
+		const struct msi_ec_bucket *bucket = &msi_ec_buckets[i];
+
+		if (!bucket->used)
+			continue;
+
+		count += sysfs_emit_at(buf, count,
+				       "uid=%u attr=%s allowed=%llu throttled=%llu\n",
+				       bucket->uid,
+				       msi_ec_throttle_key_name(bucket->key),
+				       bucket->allowed, bucket->throttled);
+	}
+
+	spin_unlock(&msi_ec_throttle_lock);
+	return count;
+}
+
+static DEVICE_ATTR_RW(webcam);
+static DEVICE_ATTR_RW(webcam_block);
+static DEVICE_ATTR_RW(fn_key);
+static DEVICE_ATTR_RW(win_key);
+static DEVICE_ATTR_RW(battery_mode);
+static DEVICE_ATTR_RW(cooler_boost);
+static DEVICE_ATTR_RO(available_shift_modes);
+static DEVICE_ATTR_RW(shift_mode);
+static DEVICE_ATTR_RW(super_battery);
+static DEVICE_ATTR_RO(available_fan_modes);
+static DEVICE_ATTR_RW(fan_mode);
+static DEVICE_ATTR_RO(fw_version);
+static DEVICE_ATTR_RO(fw_release_date);
+static DEVICE_ATTR_RO(state);
+static DEVICE_ATTR_WO(transaction);
+static DEVICE_ATTR_RO(resume_stats);
+static DEVICE_ATTR_RO(enforce_stats);
+static DEVICE_ATTR_RO(ec_breaker);
+// uids of other users are nobody's business
+static DEVICE_ATTR(throttle, 0400, throttle_show, NULL);
+
+static struct attribute *msi_root_attrs[] = {
+	MSI_EC_ATTR(WEBCAM, &dev_attr_webcam.attr),
+	MSI_EC_ATTR(WEBCAM_BLOCK, &dev_attr_webcam_block.attr),
+	MSI_EC_ATTR(FN_WIN_SWAP, &dev_attr_fn_key.attr),
+	MSI_EC_ATTR(FN_WIN_SWAP, &dev_attr_win_key.attr),
+	MSI_EC_ATTR(CHARGE_CONTROL, &dev_attr_battery_mode.attr),
+	MSI_EC_ATTR(COOLER_BOOST, &dev_attr_cooler_boost.attr),
+	MSI_EC_ATTR(SHIFT_MODE, &dev_attr_available_shift_modes.attr),
+	MSI_EC_ATTR(SHIFT_MODE, &dev_attr_shift_mode.attr),
+	MSI_EC_ATTR(SUPER_BATTERY, &dev_attr_super_battery.attr),
+	MSI_EC_ATTR(FAN_MODE, &dev_attr_available_fan_modes.attr),
+	MSI_EC_ATTR(FAN_MODE, &dev_attr_fan_mode.attr),
+	&dev_attr_fw_version.attr,
+	&dev_attr_fw_release_date.attr,
+	&dev_attr_state.attr,
+	&dev_attr_transaction.attr,
+	&dev_attr_resume_stats.attr,
+	&dev_attr_enforce_stats.attr,
+	&dev_attr_ec_breaker.attr,
+	&dev_attr_throttle.attr,
+	NULL
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (cpu)
+// ============================================================ //
+
+static ssize_t cpu_realtime_temperature_show(struct device *device,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_CPU_RT_TEMP, buf);
+}
+
+static ssize_t cpu_realtime_fan_speed_show(struct device *device,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_CPU_RT_FAN_SPEED, buf);
+}
+
+static ssize_t cpu_basic_fan_speed_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_CPU_BS_FAN_SPEED, buf);
+}
+
+static ssize_t cpu_basic_fan_speed_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	return msi_ec_field_store(MSI_EC_STATE_CPU_BS_FAN_SPEED, buf, count);
+}
+
+static struct device_attribute dev_attr_cpu_realtime_temperature = {
+	.attr = {
+		.name = "realtime_temperature",
+		.mode = 0444,
+	},
+	.show = cpu_realtime_temperature_show,
+};
+
+static struct device_attribute dev_attr_cpu_realtime_fan_speed = {
+	.attr = {
+		.name = "realtime_fan_speed",
+		.mode = 0444,
+	},
+	.show = cpu_realtime_fan_speed_show,
+};
+
+static struct device_attribute dev_attr_cpu_basic_fan_speed = {
+	.attr = {
+		.name = "basic_fan_speed",
+		.mode = 0644,
+	},
+	.show = cpu_basic_fan_speed_show,
+	.store = cpu_basic_fan_speed_store,
+};
+
+static struct attribute *msi_cpu_attrs[] = {
+	MSI_EC_ATTR(CPU_RT_TEMP, &dev_attr_cpu_realtime_temperature.attr),
+	MSI_EC_ATTR(CPU_RT_FAN_SPEED, &dev_attr_cpu_realtime_fan_speed.attr),
+	MSI_EC_ATTR(CPU_BS_FAN_SPEED, &dev_attr_cpu_basic_fan_speed.attr),
+	NULL
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (gpu)
+// ============================================================ //
+
+static ssize_t gpu_realtime_temperature_show(struct device *device,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_GPU_RT_TEMP, buf);
+}
+
+static ssize_t gpu_realtime_fan_speed_show(struct device *device,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	return msi_ec_field_show(MSI_EC_STATE_GPU_RT_FAN_SPEED, buf);
+}
+
+static struct device_attribute dev_attr_gpu_realtime_temperature = {
+	.attr = {
+		.name = "realtime_temperature",
+		.mode = 0444,
+	},
+	.show = gpu_realtime_temperature_show,
+};
+
+static struct device_attribute dev_attr_gpu_realtime_fan_speed = {
+	.attr = {
+		.name = "realtime_fan_speed",
+		.mode = 0444,
+	},
+	.show = gpu_realtime_fan_speed_show,
+};
+
+static struct attribute *msi_gpu_attrs[] = {
+	MSI_EC_ATTR(GPU_RT_TEMP, &dev_attr_gpu_realtime_temperature.attr),
+	MSI_EC_ATTR(GPU_RT_FAN_SPEED, &dev_attr_gpu_realtime_fan_speed.attr),
+	NULL
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (fan_control)
+// ============================================================ //
+
+/*
+ * Optional closed-loop control of cpu/basic_fan_speed, replacing a
+ * userspace daemon polling the temperature. Every period the CPU
+ * temperature is fed through a piecewise linear curve, and a PID term
+ * around the setpoint corrects the result. When the temperature falls,
+ * the curve input only follows once it dropped by more than the
+ * hysteresis, so the fan doesn't oscillate around a curve point.
+ *
+ * All math is fixed point: gains are in 1/1000 % per celsius (per
+ * period for ki), the output in 1/1000 % until it is rounded. The timer
+ * is deferrable, so an idle CPU is not woken up just for the fan.
+ */
+
+#define FAN_CONTROL_POINTS      8
+#define FAN_CONTROL_GAIN_MAX    100000 // 100 % per celsius
+#define FAN_CONTROL_INTEGRAL_MAX 50000 // 50 %
+
+struct fan_control_point {
+	int temp;  // celsius
+	int speed; // percent
+};
+
+static struct {
+	bool enabled;
+
+	// tunables
+	int period_ms;
+	int setpoint;
+	int hysteresis;
+	int kp, ki, kd;
+	struct fan_control_point curve[FAN_CONTROL_POINTS];
+	int nr_points;
+
+	// controller state
+	int curve_temp;     // curve input, follows the temperature with hysteresis
+	int prev_error;
+	int integral;       // 1/1000 %
+	int output;         // percent, -1 until written
+	int saved_fan_mode; // fan_mode register before enabling, or -1
+
+	// stats since enabling
+	int temp;
+	int error;
+	int max_abs_error;
+	u64 sum_abs_error;
+	u64 samples;
+	u64 writes;
+	u64 read_errors;
+	u64 stale_skips; // periods skipped while the EC breaker was open
+} fan_control = {
+	.period_ms = 1000,
+	.setpoint = 75,
+	.hysteresis = 3,
+	.kp = 2000,
+	.ki = 50,
+	.kd = 0,
+	.curve = { { 40, 0 }, { 60, 30 }, { 75, 60 }, { 90, 100 } },
+	.nr_points = 4,
+	.saved_fan_mode = -1,
+};
+
+static DEFINE_MUTEX(fan_control_lock);
+
+static void fan_control_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(fan_control_work, fan_control_fn);
+
+// curve speed at temp, in 1/1000 %
+static int fan_control_curve(int temp)
+{
+	const struct fan_control_point *curve = fan_control.curve;
+	int last = fan_control.nr_points - 1;
+
+	if (temp <= curve[0].temp)
+		return curve[0].speed * 1000;
+
+	for (int i = 1; i <= last; i++) {
+		if (temp > curve[i].temp)
+			continue;
+
+		return curve[i - 1].speed * 1000 +
+		       (curve[i].speed - curve[i - 1].speed) * 1000 *
+		       (temp - curve[i - 1].temp) /
+		       (curve[i].temp - curve[i - 1].temp);
+	}
+
+	return curve[last].speed * 1000;
+}
+
+// fan_control_lock must be held
+static void fan_control_step(void)
+{
+	int temp, error, abs_error, output;
+	bool stale;
+	u8 rdata;
+	int result;
+
+	stale = ec_breaker_open();
+	result = msi_ec_read(conf.cpu.rt_temp_address, &rdata);
+	if (result < 0) {
+		fan_control.read_errors++;
+		return;
+	}
+
+	// a last known value would wind up the integral, the fan keeps its
+	// speed until the EC answers again
+	if (stale || ec_breaker_open()) {
+		fan_control.stale_skips++;
+		return;
+	}
+	temp = rdata;
+
+	if (temp > fan_control.curve_temp || !fan_control.samples)
+		fan_control.curve_temp = temp;
+	else if (temp < fan_control.curve_temp - fan_control.hysteresis)
+		fan_control.curve_temp = temp + fan_control.hysteresis;
+
+	error = temp - fan_control.setpoint;
+	fan_control.integral = clamp(fan_control.integral +
+				     fan_control.ki * error,
+				     -FAN_CONTROL_INTEGRAL_MAX,
+				     FAN_CONTROL_INTEGRAL_MAX);
+
+	output = fan_control_curve(fan_control.curve_temp) +
+		 fan_control.kp * error + fan_control.integral +
+		 fan_control.kd * (error - fan_control.prev_error);
+	output = clamp(DIV_ROUND_CLOSEST(output, 1000), 0, 100);
+	fan_control.prev_error = error;
+
+	abs_error = abs(error);
+	fan_control.temp = temp;
+	fan_control.error = error;
+	fan_control.max_abs_error = max(fan_control.max_abs_error, abs_error);
+	fan_control.sum_abs_error += abs_error;
+	fan_control.samples++;
+
+	if (output == fan_control.output)
+		return;
+
+	result = ec_update_by_mask(conf.cpu.bs_fan_speed_address, 0xff,
+				   msi_ec_cpu_bs_fan_speed_raw(output));
+	if (result < 0)
+		return;
+
+	fan_control.output = output;
+	fan_control.writes++;
+}
+
+static void fan_control_fn(struct work_struct *work)
+{
+	mutex_lock(&fan_control_lock);
+	if (fan_control.enabled) {
+		fan_control_step();
+		schedule_delayed_work(&fan_control_work,
+				      msecs_to_jiffies(fan_control.period_ms));
+	}
+	mutex_unlock(&fan_control_lock);
+}
+
+// fan_control_lock must be held
+static int fan_control_start(void)
+{
+	int basic;
+	u8 rdata;
+	int result;
+
+	// basic_fan_speed is only followed in the basic fan mode
+	fan_control.saved_fan_mode = -1;
+	basic = msi_ec_has(MSI_EC_CAP_FAN_MODE) ?
+		msi_ec_enum_parse(&fan_mode_enum, "basic") : -EINVAL;
+	if (basic >= 0) {
+		result = msi_ec_read(conf.fan_mode.address, &rdata);
+		if (result < 0)
+			return result;
+
+		result = ec_update_by_mask(conf.fan_mode.address, 0xff,
+					   fan_mode_enum.values[basic]);
+		if (result < 0)
+			return result;
+
+		fan_control.saved_fan_mode = rdata;
+	}
+
+	fan_control.prev_error = 0;
+	fan_control.integral = 0;
+	fan_control.output = -1;
+	fan_control.temp = 0;
+	fan_control.error = 0;
+	fan_control.max_abs_error = 0;
+	fan_control.sum_abs_error = 0;
+	fan_control.samples = 0;
+	fan_control.writes = 0;
+	fan_control.read_errors = 0;
+	fan_control.stale_skips = 0;
+
+	fan_control.enabled = true;
+	schedule_delayed_work(&fan_control_work, 0);
+
+	return 0;
+}
+
+static void fan_control_stop(void)
+{
+	int saved_fan_mode;
+
+	mutex_lock(&fan_control_lock);
+	if (!fan_control.enabled) {
+		mutex_unlock(&fan_control_lock);
+		return;
+	}
+	fan_control.enabled = false;
+	saved_fan_mode = fan_control.saved_fan_mode;
+	mutex_unlock(&fan_control_lock);
+
+	// the work takes fan_control_lock, don't wait for it holding the lock
+	cancel_delayed_work_sync(&fan_control_work);
+
+	if (saved_fan_mode >= 0)
+		ec_update_by_mask(conf.fan_mode.address, 0xff, saved_fan_mode);
+}
+
+static ssize_t fan_control_enabled_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return sysfs_emit(buf, "%d\n", fan_control.enabled);
+}
+
+static ssize_t fan_control_enabled_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	bool enable;
+	int result = 0;
+
+	result = kstrtobool(buf, &enable);
+	if (result < 0)
+		return result;
+
+	if (!enable) {
+		fan_control_stop();
+		return count;
+	}
+
+	mutex_lock(&fan_control_lock);
+	if (!fan_control.enabled)
+		result = fan_control_start();
+	mutex_unlock(&fan_control_lock);
+
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+// an integer tunable of the controller
+struct fan_control_param {
+	struct device_attribute dev_attr;
+	int *value;
+	int min;
+	int max;
+};
+
+static ssize_t fan_control_param_show(struct device *device,
+				      struct device_attribute *attr, char *buf)
+{
+	struct fan_control_param *param =
+		container_of(attr, struct fan_control_param, dev_attr);
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(*param->value));
+}
+
+static ssize_t fan_control_param_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct fan_control_param *param =
+		container_of(attr, struct fan_control_param, dev_attr);
+	int value;
+	int result;
+
+	result = kstrtoint(buf, 10, &value);
+	if (result < 0)
+		return result;
+
+	if (value < param->min || value > param->max)
+		return -EINVAL;
+
+	mutex_lock(&fan_control_lock);
+	*param->value = value;
+	mutex_unlock(&fan_control_lock);
+
+	return count;
+}
+
+#define FAN_CONTROL_PARAM(_name, _min, _max)				\
+	static struct fan_control_param fan_control_param_##_name = {	\
+		.dev_attr = __ATTR(_name, 0644, fan_control_param_show,	\
+				   fan_control_param_store),		\
+		.value = &fan_control._name,				\
+		.min = _min,						\
+		.max = _max,						\
+	}
+
+FAN_CONTROL_PARAM(period_ms, 100, 10000);
+FAN_CONTROL_PARAM(setpoint, 30, 100);
+FAN_CONTROL_PARAM(hysteresis, 0, 20);
+FAN_CONTROL_PARAM(kp, -FAN_CONTROL_GAIN_MAX, FAN_CONTROL_GAIN_MAX);
+FAN_CONTROL_PARAM(ki, -FAN_CONTROL_GAIN_MAX, FAN_CONTROL_GAIN_MAX);
+FAN_CONTROL_PARAM(kd, -FAN_CONTROL_GAIN_MAX, FAN_CONTROL_GAIN_MAX);
+
+static ssize_t fan_control_curve_show(struct device *device,
+				      struct device_attribute *attr, char *buf)
+{
+	int count = 0;
+
+	mutex_lock(&fan_control_lock);
+	for (int i = 0; i < fan_control.nr_points; i++)
+		count += sysfs_emit_at(buf, count, "%s%d:%d",
+				       i ? " " : "",
+				       fan_control.curve[i].temp,
+				       fan_control.curve[i].speed);
+	mutex_unlock(&fan_control_lock);
+
+	count += sysfs_emit_at(buf, count, "\n");
+	return count;
+}
+
+// Format: up to 8 "temp:speed" points, temperatures strictly increasing
+static ssize_t fan_control_curve_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct fan_control_point curve[FAN_CONTROL_POINTS];
+	char *input, *cursor, *token;
+	int nr_points = 0;
+	int result = 0;
+
+	input = kmemdup_nul(buf, count, GFP_KERNEL);
+	if (!input)
+		return -ENOMEM;
+
+	cursor = input;
+	while ((token = strsep(&cursor, " \t\n"))) {
+		struct fan_control_point *point = &curve[nr_points];
+
+		if (!*token)
+			continue;
+
+		if (nr_points == FAN_CONTROL_POINTS ||
+		    sscanf(token, "%d:%d", &point->temp, &point->speed) != 2 ||
+		    point->temp < 0 || point->temp > 100 ||
+		    point->speed < 0 || point->speed > 100 ||
+		    (nr_points && point->temp <= curve[nr_points - 1].temp)) {
+			result = -EINVAL;
+			break;
+		}
+
+		nr_points++;
+	}
+	kfree(input);
+
+	if (result < 0)
+		return result;
+	if (!nr_points)
+		return -EINVAL;
+
+	mutex_lock(&fan_control_lock);
+	memcpy(fan_control.curve, curve, sizeof(curve));
+	fan_control.nr_points = nr_points;
+	mutex_unlock(&fan_control_lock);
+
+	return count;
+}
+
+static ssize_t fan_control_stats_show(struct device *device,
+				      struct device_attribute *attr, char *buf)
+{
+	u64 mean_abs_error = 0; // 1/1000 celsius
+	int count = 0;
+
+	mutex_lock(&fan_control_lock);
+	if (fan_control.samples)
+		mean_abs_error = div64_u64(fan_control.sum_abs_error * 1000,
+					   fan_control.samples);
+
+	count += sysfs_emit_at(buf, count, "temperature=%d\n",
+			       fan_control.temp);
+	count += sysfs_emit_at(buf, count, "error=%d\n", fan_control.error);
+	count += sysfs_emit_at(buf, count, "mean_abs_error=%llu.%03llu\n",
+			       mean_abs_error / 1000, mean_abs_error % 1000);
+	count += sysfs_emit_at(buf, count, "max_abs_error=%d\n",
+			       fan_control.max_abs_error);
+	count += sysfs_emit_at(buf, count, "output=%d\n", fan_control.output);
+	count += sysfs_emit_at(buf, count, "samples=%llu\n",
+			       fan_control.samples);
+	count += sysfs_emit_at(buf, count, "writes=%llu\n",
+			       fan_control.writes);
+	count += sysfs_emit_at(buf, count, "read_errors=%llu\n",
+			       fan_control.read_errors);
+	count += sysfs_emit_at(buf, count, "stale_skips=%llu\n",
+			       fan_control.stale_skips);
+	mutex_unlock(&fan_control_lock);
+
+	return count;
+}
+
+static struct device_attribute dev_attr_fan_control_enabled = {
+	.attr = {
+		.name = "enabled",
+		.mode = 0644,
 	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = MSI_EC_ADDR_UNSUPP,
-		.bit                 = 1,
+	.show = fan_control_enabled_show,
+	.store = fan_control_enabled_store,
+};
+
+static struct device_attribute dev_attr_fan_control_curve = {
+	.attr = {
+		.name = "curve",
+		.mode = 0644,
 	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP, // KB auto turn off
-		.bl_modes         = { 0x00, 0x08 }, // always on; off after 10 sec
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x81,
-		.max_state        = 3,
+	.show = fan_control_curve_show,
+	.store = fan_control_curve_store,
+};
+
+static struct device_attribute dev_attr_fan_control_stats = {
+	.attr = {
+		.name = "stats",
+		.mode = 0444,
 	},
+	.show = fan_control_stats_show,
+};
+
+static struct attribute *msi_fan_control_attrs[] = {
+	&dev_attr_fan_control_enabled.attr,
+	&fan_control_param_period_ms.dev_attr.attr,
+	&fan_control_param_setpoint.dev_attr.attr,
+	&fan_control_param_hysteresis.dev_attr.attr,
+	&fan_control_param_kp.dev_attr.attr,
+	&fan_control_param_ki.dev_attr.attr,
+	&fan_control_param_kd.dev_attr.attr,
+	&dev_attr_fan_control_curve.attr,
+	&dev_attr_fan_control_stats.attr,
+	NULL
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (debug)
+// ============================================================ //
+
+// Prints an EC memory dump in form of a table
+static ssize_t ec_dump_show(struct device *device,
+			    struct device_attribute *attr,
+			    char *buf)
+{
+	int count = 0;
+
+	// print header
+	count += sysfs_emit(
+		buf,
+		"     | _0 _1 _2 _3 _4 _5 _6 _7 _8 _9 _a _b _c _d _e _f\n"
+		"-----+------------------------------------------------\n");
+
+	// print dump
+	for (u8 i = 0x0; i <= 0xf; i++) {
+		u8 addr_base = i * 16;
+
+		count += sysfs_emit_at(buf, count, "%#x_ |", i);
+		for (u8 j = 0x0; j <= 0xf; j++) {
+			u8 rdata;
+			int result = msi_ec_read_direct(addr_base + j, &rdata);
+			if (result < 0)
+				return result;
+
+			count += sysfs_emit_at(buf, count, " %02x", rdata);
+		}
+
+		count += sysfs_emit_at(buf, count, "\n");
+	}
+
+	return count;
+}
+
+// stores a value in the specified EC memory address. Format: "xx=xx", xx - hex u8
+static ssize_t ec_set_store(struct device *dev, struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	if (count > 6) // "xx=xx\n" - 6 chars
+		return -EINVAL;
+
+	int result;
+
+	char addr_s[3], val_s[3];
+	result = sscanf(buf, "%2s=%2s", addr_s, val_s);
+	if (result != 2)
+		return -EINVAL;
+
+	u8 addr, val;
+
+	// convert addr
+	result = kstrtou8(addr_s, 16, &addr);
+	if (result < 0)
+		return result;
+
+	// convert val
+	result = kstrtou8(val_s, 16, &val);
+	if (result < 0)
+		return result;
+
+	// write val to EC[addr]
+	result = ec_update_by_mask(addr, 0xff, val);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+// ec_get. stores the specified EC memory address. MAY BE UNSAFE!!!
+static u8 ec_get_addr;
+
+// ec_get. reads and stores the specified EC memory address. Format: "xx", xx - hex u8
+static ssize_t ec_get_store(struct device *dev, struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	if (count > 3) // "xx\n" - 3 chars
+		return -EINVAL;
+
+	int result;
+	char addr_s[3];
+
+	result = sscanf(buf, "%2s", addr_s);
+	if (result != 1)
+		return -EINVAL;
+
+	// convert addr
+	result = kstrtou8(addr_s, 16, &ec_get_addr);
+	if (result < 0)
+		return result;
+
+	return count;
+};
+
+// ec_get. prints value of previously stored EC memory address
+static ssize_t ec_get_show(struct device *device,
+			   struct device_attribute *attr,
+			   char *buf)
+{
+	u8 rdata;
+	int result;
+	
+	result = msi_ec_read_direct(ec_get_addr, &rdata);
+	if (result < 0)
+		return result;
+
+	//	return sysfs_emit(buf, "%02x=%02x\n", ec_get_addr, rdata);
+	return sysfs_emit(buf, "%02x\n", rdata);
+};
+
+static DEVICE_ATTR_RO(ec_dump);
+static DEVICE_ATTR_WO(ec_set);
+static DEVICE_ATTR_RW(ec_get);
+
+static struct attribute *msi_debug_attrs[] = {
+	&dev_attr_fw_version.attr,
+	&dev_attr_ec_dump.attr,
+	&dev_attr_ec_set.attr,
+	&dev_attr_ec_get.attr,
+	NULL
+};
+
+// ============================================================ //
+// Platform profile
+// ============================================================ //
+
+/*
+ * Maps the low-power, balanced and performance platform profiles to the
+ * per-model settings in conf.profiles. The settings are parsed once at
+ * load time, so a profile switch is a single EC write batch.
+ */
+
+#if IS_REACHABLE(CONFIG_ACPI_PLATFORM_PROFILE)
+
+struct msi_ec_profile_ops {
+	struct ec_write_op ops[MSI_EC_STATE_MAX_FIELDS];
+	int count;
+};
+
+static struct msi_ec_profile_ops msi_ec_profiles[MSI_EC_PROFILE_NR];
+static bool msi_ec_profiles_loaded = false;
+static bool msi_ec_profile_registered = false;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0))
+static struct device *msi_ec_profile_dev;
+#endif
+
+static const enum platform_profile_option
+msi_ec_profile_options[MSI_EC_PROFILE_NR] = {
+	[MSI_EC_PROFILE_LOW_POWER]   = PLATFORM_PROFILE_LOW_POWER,
+	[MSI_EC_PROFILE_BALANCED]    = PLATFORM_PROFILE_BALANCED,
+	[MSI_EC_PROFILE_PERFORMANCE] = PLATFORM_PROFILE_PERFORMANCE,
+};
+
+// the last profile set, reported when the EC matches none of them
+static enum msi_ec_profile msi_ec_profile_last = MSI_EC_PROFILE_BALANCED;
+
+static void __init msi_ec_build_profiles(void)
+{
+	char settings[128];
+	int result;
+
+	for (int i = 0; i < MSI_EC_PROFILE_NR; i++) {
+		strscpy(settings, conf.profiles[i] ?: "", sizeof(settings));
+
+		result = msi_ec_parse_settings(settings, msi_ec_profiles[i].ops);
+		if (result <= 0) {
+			if (result < 0)
+				pr_warn("invalid settings for profile %d: %d\n",
+					i, result);
+			return;
+		}
+
+		msi_ec_profiles[i].count = result;
+	}
+
+	msi_ec_profiles_loaded = true;
+}
+
+static int msi_ec_profile_find(enum platform_profile_option option)
+{
+	for (int i = 0; i < MSI_EC_PROFILE_NR; i++) {
+		if (msi_ec_profile_options[i] == option)
+			return i;
+	}
+
+	return -EOPNOTSUPP;
+}
+
+static int msi_ec_profile_read(enum platform_profile_option *option)
+{
+	u8 stored[256];
+	DECLARE_BITMAP(read, 256);
+	int match = -ENOENT;
+	int result = 0;
+
+	bitmap_zero(read, 256);
+
+	mutex_lock(&ec_lock);
+
+	for (int i = 0; i < MSI_EC_PROFILE_NR && match < 0; i++) {
+		const struct msi_ec_profile_ops *profile = &msi_ec_profiles[i];
+		bool matches = true;
+
+		for (int j = 0; j < profile->count && matches; j++) {
+			const struct ec_write_op *op = &profile->ops[j];
+
+			if (!test_and_set_bit(op->addr, read)) {
+				result = msi_ec_read(op->addr, &stored[op->addr]);
+				if (result < 0)
+					goto unlock;
+			}
+
+			matches = (stored[op->addr] & op->mask) ==
+				  (op->value & op->mask);
+		}
+
+		if (matches)
+			match = i;
+	}
+
+unlock:
+	mutex_unlock(&ec_lock);
+	if (result < 0)
+		return result;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0))
+	if (match < 0) {
+		*option = PLATFORM_PROFILE_CUSTOM;
+		return 0;
+	}
+#else
+	if (match < 0)
+		match = msi_ec_profile_last;
+#endif
+
+	*option = msi_ec_profile_options[match];
+	return 0;
+}
+
+static int msi_ec_profile_write(enum platform_profile_option option)
+{
+	int idx;
+	int result;
+
+	idx = msi_ec_profile_find(option);
+	if (idx < 0)
+		return idx;
+
+	result = ec_write_batch(msi_ec_profiles[idx].ops,
+				msi_ec_profiles[idx].count);
+	if (result < 0)
+		return result;
+
+	msi_ec_profile_last = idx;
+	return 0;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0))
+static int msi_ec_profile_probe(void *drvdata, unsigned long *choices)
+{
+	for (int i = 0; i < MSI_EC_PROFILE_NR; i++)
+		set_bit(msi_ec_profile_options[i], choices);
+
+	return 0;
+}
+
+static int msi_ec_profile_get(struct device *dev,
+			      enum platform_profile_option *profile)
+{
+	return msi_ec_profile_read(profile);
+}
+
+static int msi_ec_profile_set(struct device *dev,
+			      enum platform_profile_option profile)
+{
+	return msi_ec_profile_write(profile);
+}
+
+static const struct platform_profile_ops msi_ec_profile_ops = {
+	.probe = msi_ec_profile_probe,
+	.profile_get = msi_ec_profile_get,
+	.profile_set = msi_ec_profile_set,
+};
+#else
+static int msi_ec_profile_get(struct platform_profile_handler *pprof,
+			      enum platform_profile_option *profile)
+{
+	return msi_ec_profile_read(profile);
+}
+
+static int msi_ec_profile_set(struct platform_profile_handler *pprof,
+			      enum platform_profile_option profile)
+{
+	return msi_ec_profile_write(profile);
+}
+
+static struct platform_profile_handler msi_ec_profile_handler = {
+	.profile_get = msi_ec_profile_get,
+	.profile_set = msi_ec_profile_set,
+};
+#endif
+
+// a failure leaves the rest of the driver working, so it is not fatal
+static void msi_ec_profile_register(struct device *dev)
+{
+	int result;
+
+	if (!msi_ec_profiles_loaded)
+		return;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0))
+	msi_ec_profile_dev = devm_platform_profile_register(dev,
+							    MSI_EC_DRIVER_NAME,
+							    NULL,
+							    &msi_ec_profile_ops);
+	result = IS_ERR(msi_ec_profile_dev) ? PTR_ERR(msi_ec_profile_dev) : 0;
+#else
+	for (int i = 0; i < MSI_EC_PROFILE_NR; i++)
+		set_bit(msi_ec_profile_options[i],
+			msi_ec_profile_handler.choices);
+
+	result = platform_profile_register(&msi_ec_profile_handler);
+#endif
+	if (result < 0) {
+		pr_warn("failed to register the platform profile: %d\n",
+			result);
+		return;
+	}
+
+	msi_ec_profile_registered = true;
+}
+
+// the profile settings were changed behind the handler's back
+static void msi_ec_profile_notify(void)
+{
+	if (!msi_ec_profile_registered)
+		return;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0))
+	platform_profile_notify(msi_ec_profile_dev);
+#else
+	platform_profile_notify();
+#endif
+}
+
+static void msi_ec_profile_unregister(void)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(6, 14, 0))
+	if (msi_ec_profile_registered)
+		platform_profile_remove();
+#endif
+	msi_ec_profile_registered = false;
+}
+
+#else // CONFIG_ACPI_PLATFORM_PROFILE
+
+static void __init msi_ec_build_profiles(void) {}
+static void msi_ec_profile_register(struct device *dev) {}
+static void msi_ec_profile_notify(void) {}
+static void msi_ec_profile_unregister(void) {}
+
+#endif // CONFIG_ACPI_PLATFORM_PROFILE
+
+// ============================================================ //
+// Power source profiles
+// ============================================================ //
+
+/*
+ * Settings applied when the system switches between AC and battery, e.g.
+ * the eco shift mode and super battery on battery, without a daemon. A
+ * power_supply notifier schedules the switch, debounced so that a flaky
+ * connector applies the settings once, and every profile is applied as
+ * one EC write batch. Profiles use the format of the transaction
+ * attribute and are empty by default.
+ */
+
+enum msi_ec_power_source {
+	MSI_EC_POWER_UNKNOWN,
+	MSI_EC_POWER_AC,
+	MSI_EC_POWER_BATTERY,
+	MSI_EC_POWER_NR,
+};
+
+static const char *const msi_ec_power_source_names[MSI_EC_POWER_NR] = {
+	[MSI_EC_POWER_UNKNOWN] = "unknown",
+	[MSI_EC_POWER_AC]      = "ac",
+	[MSI_EC_POWER_BATTERY] = "battery",
+};
+
+#define POWER_SOURCE_SETTINGS_MAX 128
+#define POWER_SOURCE_DEBOUNCE_MAX 10000 // ms
+
+struct power_source_profile {
+	char settings[POWER_SOURCE_SETTINGS_MAX]; // as written
+	struct ec_write_op ops[MSI_EC_STATE_MAX_FIELDS];
+	int count;
+};
+
+static struct {
+	struct power_source_profile profiles[MSI_EC_POWER_NR];
+	enum msi_ec_power_source source;
+	int debounce_ms;
+
+	// stats
+	u64 switches;
+	u64 errors;
+} power_source = {
+	.source = MSI_EC_POWER_UNKNOWN,
+	.debounce_ms = 500,
+};
+
+static DEFINE_MUTEX(power_source_lock);
+
+// power_source_lock must be held
+static int power_source_apply(void)
+{
+	const struct power_source_profile *profile =
+		&power_source.profiles[power_source.source];
+	int result;
+
+	if (!profile->count)
+		return 0;
+
+	result = ec_write_batch(profile->ops, profile->count);
+	if (result < 0) {
+		pr_warn("failed to apply the %s settings: %d\n",
+			msi_ec_power_source_names[power_source.source], result);
+		power_source.errors++;
+		return result;
+	}
+
+	power_source.switches++;
+	return 0;
+}
+
+static void power_source_fn(struct work_struct *work)
+{
+	enum msi_ec_power_source source;
+	bool applied = false;
+	int result;
+
+	// negative without any AC adapter or battery to ask
+	result = power_supply_is_system_supplied();
+	if (result < 0)
+		return;
+	source = result ? MSI_EC_POWER_AC : MSI_EC_POWER_BATTERY;
+
+	mutex_lock(&power_source_lock);
+	if (source != power_source.source) {
+		power_source.source = source;
+		applied = power_source.profiles[source].count &&
+			  !power_source_apply();
+	}
+	mutex_unlock(&power_source_lock);
+
+	if (applied)
+		msi_ec_profile_notify();
+}
+
+static DECLARE_DELAYED_WORK(power_source_work, power_source_fn);
+
+// called in atomic context, for every property change of every supply
+static int power_source_notify(struct notifier_block *nb,
+			       unsigned long event, void *data)
+{
+	if (event == PSY_EVENT_PROP_CHANGED)
+		mod_delayed_work(system_wq, &power_source_work,
+				 msecs_to_jiffies(READ_ONCE(power_source.debounce_ms)));
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block power_source_nb = {
+	.notifier_call = power_source_notify,
 };
 
-static const char *ALLOWED_FW_32[] __initconst = {
-	"158PIMS1.207", // Bravo 15 B7E
-	"158PIMS1.112", // Bravo 15 B7ED
-	NULL
-};
+static bool power_source_registered = false;
+
+static void power_source_init(void)
+{
+	int result = power_supply_reg_notifier(&power_source_nb);
+
+	if (result < 0) {
+		pr_warn("failed to register the power supply notifier: %d\n",
+			result);
+		return;
+	}
+	power_source_registered = true;
+
+	// the source at load time, its profile is still empty
+	schedule_delayed_work(&power_source_work, 0);
+}
+
+static void power_source_exit(void)
+{
+	if (!power_source_registered)
+		return;
+
+	power_supply_unreg_notifier(&power_source_nb);
+	cancel_delayed_work_sync(&power_source_work);
+	power_source_registered = false;
+}
+
+static struct power_source_profile *
+power_source_profile(struct device_attribute *attr)
+{
+	if (!strcmp(attr->attr.name, "ac"))
+		return &power_source.profiles[MSI_EC_POWER_AC];
+
+	return &power_source.profiles[MSI_EC_POWER_BATTERY];
+}
+
+static ssize_t power_source_profile_show(struct device *device,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	ssize_t count;
+
+	mutex_lock(&power_source_lock);
+	count = sysfs_emit(buf, "%s\n", power_source_profile(attr)->settings);
+	mutex_unlock(&power_source_lock);
+
+	return count;
+}
+
+// Format: like transaction, an empty profile changes nothing
+static ssize_t power_source_profile_store(struct device *dev,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	struct power_source_profile *profile = power_source_profile(attr);
+	struct ec_write_op ops[MSI_EC_STATE_MAX_FIELDS];
+	char settings[POWER_SOURCE_SETTINGS_MAX];
+	char *input;
+	int result;
+
+	if (count >= sizeof(settings))
+		return -EINVAL;
+
+	input = kmemdup_nul(buf, count, GFP_KERNEL);
+	if (!input)
+		return -ENOMEM;
+
+	strscpy(settings, strim(input), sizeof(settings));
+	result = msi_ec_parse_settings(input, ops);
+	kfree(input);
+	if (result < 0)
+		return result;
+
+	mutex_lock(&power_source_lock);
+	memcpy(profile->settings, settings, sizeof(settings));
+	memcpy(profile->ops, ops, sizeof(ops));
+	profile->count = result;
+
+	// the profile of the current source takes effect right away
+	result = 0;
+	if (profile == &power_source.profiles[power_source.source])
+		result = power_source_apply();
+	mutex_unlock(&power_source_lock);
+
+	if (result < 0)
+		return result;
+
+	msi_ec_profile_notify();
+	return count;
+}
+
+static ssize_t power_source_source_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return sysfs_emit(buf, "%s\n",
+			  msi_ec_power_source_names[READ_ONCE(power_source.source)]);
+}
+
+static ssize_t power_source_debounce_ms_show(struct device *device,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	return sysfs_emit(buf, "%d\n", READ_ONCE(power_source.debounce_ms));
+}
+
+static ssize_t power_source_debounce_ms_store(struct device *dev,
+					      struct device_attribute *attr,
+					      const char *buf, size_t count)
+{
+	int value;
+	int result;
+
+	result = kstrtoint(buf, 10, &value);
+	if (result < 0)
+		return result;
+
+	if (value < 0 || value > POWER_SOURCE_DEBOUNCE_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(power_source.debounce_ms, value);
+	return count;
+}
 
-static struct msi_ec_conf CONF32 __initdata = {
-	.allowed_fw = ALLOWED_FW_32,
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = MSI_EC_ADDR_UNSUPP,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNSUPP,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { },
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+static ssize_t power_source_stats_show(struct device *device,
+				       struct device_attribute *attr,
+				       char *buf)
+{
+	int count = 0;
 
-static const char *ALLOWED_FW_33[] __initconst = {
-	"17N1EMS1.109", // MSI Creator Z17 A12UGST
-	NULL
-};
+	mutex_lock(&power_source_lock);
+	count += sysfs_emit_at(buf, count, "switches=%llu\n",
+			       power_source.switches);
+	count += sysfs_emit_at(buf, count, "errors=%llu\n",
+			       power_source.errors);
+	mutex_unlock(&power_source_lock);
 
-static struct msi_ec_conf CONF33 __initdata = {
-	.allowed_fw = ALLOWED_FW_33,
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xD2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x4d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x96,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x80,
-		.max_state        = 3,
+	return count;
+}
+
+static struct device_attribute dev_attr_power_source_ac = {
+	.attr = {
+		.name = "ac",
+		.mode = 0644,
 	},
+	.show = power_source_profile_show,
+	.store = power_source_profile_store,
 };
 
-static const char *ALLOWED_FW_34[] __initconst = {
-	"14C6EMS1.109", // Prestige 14 Evo A12M
-	NULL
+static struct device_attribute dev_attr_power_source_battery = {
+	.attr = {
+		.name = "battery",
+		.mode = 0644,
+	},
+	.show = power_source_profile_show,
+	.store = power_source_profile_store,
 };
 
-static struct msi_ec_conf CONF34 __initdata = {
-	.allowed_fw = ALLOWED_FW_34,
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // super battery
-			{ SM_COMFORT_NAME, 0xc1 }, // silent / balanced
-			{ SM_SPORT_NAME,   0xc0 }, // high performance
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d }, // super battery, balanced and auto high performance modes
-			{ FM_SILENT_NAME,   0x1d }, // silent mode
-			{ FM_ADVANCED_NAME, 0x4d }, // advanced high performance mode
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNKNOWN,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x08 }, // always on / off after 10 sec
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
+static struct device_attribute dev_attr_power_source_source = {
+	.attr = {
+		.name = "source",
+		.mode = 0444,
 	},
+	.show = power_source_source_show,
 };
 
-static const char *ALLOWED_FW_35[] __initconst = {
-	"15M2IMS1.113", // Raider GE68HX 13VG
-	NULL
+static struct device_attribute dev_attr_power_source_debounce_ms = {
+	.attr = {
+		.name = "debounce_ms",
+		.mode = 0644,
+	},
+	.show = power_source_debounce_ms_show,
+	.store = power_source_debounce_ms_store,
 };
 
-static struct msi_ec_conf CONF35 __initdata = {
-	.allowed_fw = ALLOWED_FW_35, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	// .usb_share = {
-	//  	.address      = 0xbf, // states: 0x08 || 0x28
-	//  	.bit          = 5,
-	// },
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP, // not in MSI app
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_COMFORT_NAME, 0xc1 }, // Silent / Balanced / AI
-			{ SM_ECO_NAME,     0xc2 }, // Super Battery
-			{ SM_TURBO_NAME,   0xc4 }, // Performance
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-		// Fan rpm is 480000 / value at combined: c8..c9
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-		// Fan rpm is 480000 / value at combined: ca..cb
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x80,
-		.max_state        = 3,
+static struct device_attribute dev_attr_power_source_stats = {
+	.attr = {
+		.name = "stats",
+		.mode = 0444,
 	},
+	.show = power_source_stats_show,
 };
 
-static const char *ALLOWED_FW_36[] __initconst = {
-	"1585EMS1.115", // MSI Katana 15 B13VFK
+static struct attribute *msi_power_source_attrs[] = {
+	&dev_attr_power_source_ac.attr,
+	&dev_attr_power_source_battery.attr,
+	&dev_attr_power_source_source.attr,
+	&dev_attr_power_source_debounce_ms.attr,
+	&dev_attr_power_source_stats.attr,
 	NULL
 };
 
-static struct msi_ec_conf CONF36 __initdata = {
-	.allowed_fw = ALLOWED_FW_36, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a, // offset 10%
-		.offset_end   = 0x80, // offset 0%
-		.range_min    = 0x8a, // 10%
-		.range_max    = 0xe4, // 100%
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP, // not supported but it is already controlled by hardware
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = true, // true because FN key is on right side
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xD2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68, // CPU temperature
-		.rt_fan_speed_address  = 0xc9,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x96,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80, // GPU temperature
-		.rt_fan_speed_address = 0xcb,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+// ============================================================ //
+// Shift mode governor
+// ============================================================ //
 
-static const char *ALLOWED_FW_37[] __initconst = {
-	"15M1IMS1.113", // Vector GP68 HX 12V
-	NULL
-};
+/*
+ * Optional governor picking the shift mode from the workload. Every
+ * period the CPU utilization since the last sample and the hottest EC
+ * temperature are checked: at up_util or more the next faster mode is
+ * used, at down_util or less the next slower one, and in between the
+ * mode is kept. A mode is kept for at least dwell_ms, unless the
+ * temperature reached temp_limit, which steps down right away. The timer
+ * is deferrable, like the fan controller's.
+ */
 
-static struct msi_ec_conf CONF37 __initdata = {
-	.allowed_fw = ALLOWED_FW_37, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	// .usb_share  {
-	// 	.address      = 0xbf, // states: 0x08 || 0x28
-	// 	.bit          = 5,
-	// }
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = { // also on address 0x91 (?) = 0x5f - normal, 0x50 - silent
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+#define SHIFT_GOVERNOR_MODES 4
 
-static const char *ALLOWED_FW_38[] __initconst = {
-	"17E8IMS1.106", // GL75 Leopard 10SCXR/MS-17E8
-	"17E8EMS1.101",
-	NULL
+// from the slowest to the fastest, the configurations list them unordered
+static const char *const shift_governor_ladder_names[SHIFT_GOVERNOR_MODES] = {
+	"eco", "comfort", "sport", "turbo",
 };
 
-static struct msi_ec_conf CONF38 __initdata = {
-	.allowed_fw = ALLOWED_FW_38, // WMI1 based
-	.charge_control = {
-		.address      = 0xef,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xbf,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xf2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 },
-			{ SM_COMFORT_NAME, 0xc1 },
-			{ SM_SPORT_NAME,   0xc0 },
-			{ SM_TURBO_NAME,   0xc4 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNKNOWN,
-	},
-	.fan_mode = {
-		.address = 0xf4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x00 },
-			{ FM_ADVANCED_NAME, 0x80 },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x19,
-		.rt_fan_speed_base_max = 0x37,
-		.bs_fan_speed_address  = 0x89,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNKNOWN,
-		.mute_led_address    = MSI_EC_ADDR_UNKNOWN,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = 0xf3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
-static const char *ALLOWED_FW_39[] __initconst = {
-	"16R8IMS1.117", // Thin GF63 12UC & Thin GF63 12UCX
-	NULL
-};
+static struct {
+	bool enabled;
 
-static struct msi_ec_conf CONF39 __initdata = {
-	.allowed_fw = ALLOWED_FW_39, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,      0xc2},
-			{ SM_COMFORT_NAME,  0xc1},
-			{ SM_TURBO_NAME,    0xc4},
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,      0x0d},
-			{ FM_SILENT_NAME,    0x1d},
-			{ FM_ADVANCED_NAME,  0x8d},
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNKNOWN,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNSUPP,
-	},
-	.leds = {
-		.micmute_led_address = MSI_EC_ADDR_UNSUPP,
-		.mute_led_address    = MSI_EC_ADDR_UNSUPP,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { },
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
+	// tunables
+	int period_ms;
+	int up_util;    // percent
+	int down_util;  // percent
+	int temp_limit; // celsius
+	int dwell_ms;
+
+	// shift_mode_enum entries of the model, from the slowest
+	int ladder[SHIFT_GOVERNOR_MODES];
+	int nr_modes;
+
+	// governor state
+	int step;                // position in the ladder
+	int saved_shift_mode;    // shift_mode register before enabling, or -1
+	ktime_t switched;
+	u64 prev_idle, prev_wall; // us, summed over the CPUs
+
+	// stats since enabling
+	int util;
+	int temp;
+	u64 samples;
+	u64 thermal; // steps down forced by temp_limit
+	u64 write_errors;
+	u64 transitions[SHIFT_GOVERNOR_MODES][SHIFT_GOVERNOR_MODES];
+} shift_governor = {
+	.period_ms = 2000,
+	.up_util = 60,
+	.down_util = 20,
+	.temp_limit = 90,
+	.dwell_ms = 10000,
+	.saved_shift_mode = -1,
 };
 
-static const char *ALLOWED_FW_40[] __initconst = {
-	"17S1IMS1.105", // Raider GE78HX 13VI
-	NULL
-};
+static DEFINE_MUTEX(shift_governor_lock);
 
-static struct msi_ec_conf CONF40 __initdata = {
-	.allowed_fw = ALLOWED_FW_40, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	// .usb_share = {
-	//  	.address      = 0xbf, // states: 0x08 || 0x28
-	//  	.bit          = 5,
-	// },
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP, // not in MSI app
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = true,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_COMFORT_NAME, 0xc1 }, // Silent / Balanced / AI
-			{ SM_ECO_NAME,     0xc2 }, // Super Battery
-			{ SM_TURBO_NAME,   0xc4 }, // Performance
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = 0x89,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-		// Fan rpm is 480000 / value at combined: c8..c9
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-		// Fan rpm is 480000 / value at combined: ca..cb
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
+static void shift_governor_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(shift_governor_work, shift_governor_fn);
+
+static void shift_governor_cpu_times(u64 *idle, u64 *wall)
+{
+	int cpu;
+
+	*idle = 0;
+	*wall = 0;
+
+	for_each_online_cpu(cpu) {
+		u64 cpu_wall;
+		u64 cpu_idle = get_cpu_idle_time_us(cpu, &cpu_wall);
+
+		// without NOHZ, the tick accounts the idle time
+		if (cpu_idle == -1ULL) {
+			const u64 *stat = kcpustat_cpu(cpu).cpustat;
+
+			cpu_idle = div_u64(stat[CPUTIME_IDLE] +
+					   stat[CPUTIME_IOWAIT], NSEC_PER_USEC);
+			cpu_wall = ktime_to_us(ktime_get());
+		}
+
+		*idle += cpu_idle;
+		*wall += cpu_wall;
+	}
+}
+
+// shift_governor_lock must be held
+static void shift_governor_step(void)
+{
+	static const enum msi_ec_state_field temps[] = {
+		MSI_EC_STATE_CPU_RT_TEMP,
+		MSI_EC_STATE_GPU_RT_TEMP,
+	};
+	ktime_t now = ktime_get();
+	u64 idle, wall;
+	int util = 0, temp = 0, step;
+	int result;
+
+	shift_governor_cpu_times(&idle, &wall);
+	if (wall > shift_governor.prev_wall && idle >= shift_governor.prev_idle)
+		util = 100 - div64_u64((idle - shift_governor.prev_idle) * 100,
+				       wall - shift_governor.prev_wall);
+	util = clamp(util, 0, 100);
+	shift_governor.prev_idle = idle;
+	shift_governor.prev_wall = wall;
+
+	// a failed read doesn't count as hot
+	for (int i = 0; i < ARRAY_SIZE(temps); i++) {
+		const struct msi_ec_field *field = &msi_ec_fields[temps[i]];
+		u8 rdata;
+
+		if (msi_ec_has(field->cap) &&
+		    msi_ec_read(*field->address, &rdata) >= 0)
+			temp = max_t(int, temp, rdata);
+	}
+
+	shift_governor.util = util;
+	shift_governor.temp = temp;
+	shift_governor.samples++;
+
+	step = shift_governor.step;
+	if (temp >= shift_governor.temp_limit) {
+		if (step > 0) {
+			step--;
+			shift_governor.thermal++;
+		}
+	} else if (ktime_ms_delta(now, shift_governor.switched) >=
+		   shift_governor.dwell_ms) {
+		if (util >= shift_governor.up_util &&
+		    step < shift_governor.nr_modes - 1)
+			step++;
+		else if (util <= shift_governor.down_util && step > 0)
+			step--;
+	}
+
+	if (step == shift_governor.step)
+		return;
+
+	result = ec_update_by_mask(conf.shift_mode.address, 0xff,
+		shift_mode_enum.values[shift_governor.ladder[step]]);
+	if (result < 0) {
+		shift_governor.write_errors++;
+		return;
+	}
+
+	shift_governor.transitions[shift_governor.step][step]++;
+	shift_governor.step = step;
+	shift_governor.switched = now;
+	msi_ec_profile_notify();
+}
+
+static void shift_governor_fn(struct work_struct *work)
+{
+	mutex_lock(&shift_governor_lock);
+	if (shift_governor.enabled) {
+		shift_governor_step();
+		schedule_delayed_work(&shift_governor_work,
+			msecs_to_jiffies(shift_governor.period_ms));
+	}
+	mutex_unlock(&shift_governor_lock);
+}
+
+// shift_governor_lock must be held
+static int shift_governor_start(void)
+{
+	int idx;
+	u8 rdata;
+	int result;
+
+	shift_governor.nr_modes = 0;
+	for (int i = 0; i < SHIFT_GOVERNOR_MODES; i++) {
+		idx = msi_ec_enum_parse(&shift_mode_enum,
+					shift_governor_ladder_names[i]);
+		if (idx >= 0)
+			shift_governor.ladder[shift_governor.nr_modes++] = idx;
+	}
+	if (shift_governor.nr_modes < 2)
+		return -EOPNOTSUPP;
+
+	result = msi_ec_read(conf.shift_mode.address, &rdata);
+	if (result < 0)
+		return result;
+
+	// start from the current mode, or from the slowest one
+	idx = msi_ec_enum_decode(&shift_mode_enum, rdata);
+	shift_governor.step = 0;
+	for (int i = 0; i < shift_governor.nr_modes; i++)
+		if (shift_governor.ladder[i] == idx)
+			shift_governor.step = i;
+
+	if (shift_governor.ladder[shift_governor.step] != idx) {
+		result = ec_update_by_mask(conf.shift_mode.address, 0xff,
+			shift_mode_enum.values[shift_governor.ladder[0]]);
+		if (result < 0)
+			return result;
+	}
+
+	shift_governor.saved_shift_mode = rdata;
+	shift_governor.switched = ktime_get();
+	shift_governor_cpu_times(&shift_governor.prev_idle,
+				 &shift_governor.prev_wall);
+
+	shift_governor.util = 0;
+	shift_governor.temp = 0;
+	shift_governor.samples = 0;
+	shift_governor.thermal = 0;
+	shift_governor.write_errors = 0;
+	memset(shift_governor.transitions, 0,
+	       sizeof(shift_governor.transitions));
+
+	shift_governor.enabled = true;
+	schedule_delayed_work(&shift_governor_work,
+			      msecs_to_jiffies(shift_governor.period_ms));
+
+	return 0;
+}
+
+static void shift_governor_stop(void)
+{
+	int saved_shift_mode;
+
+	mutex_lock(&shift_governor_lock);
+	if (!shift_governor.enabled) {
+		mutex_unlock(&shift_governor_lock);
+		return;
+	}
+	shift_governor.enabled = false;
+	saved_shift_mode = shift_governor.saved_shift_mode;
+	mutex_unlock(&shift_governor_lock);
+
+	// the work takes shift_governor_lock, don't wait for it holding it
+	cancel_delayed_work_sync(&shift_governor_work);
+
+	if (saved_shift_mode >= 0)
+		ec_update_by_mask(conf.shift_mode.address, 0xff,
+				  saved_shift_mode);
+}
+
+static ssize_t shift_governor_enabled_show(struct device *device,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	return sysfs_emit(buf, "%d\n", shift_governor.enabled);
+}
+
+static ssize_t shift_governor_enabled_store(struct device *dev,
+					    struct device_attribute *attr,
+					    const char *buf, size_t count)
+{
+	bool enable;
+	int result = 0;
+
+	result = kstrtobool(buf, &enable);
+	if (result < 0)
+		return result;
+
+	if (!enable) {
+		shift_governor_stop();
+		return count;
+	}
+
+	mutex_lock(&shift_governor_lock);
+	if (!shift_governor.enabled)
+		result = shift_governor_start();
+	mutex_unlock(&shift_governor_lock);
+
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+// an integer tunable of the governor
+struct shift_governor_param {
+	struct device_attribute dev_attr;
+	int *value;
+	int min;
+	int max;
 };
 
-static const char *ALLOWED_FW_41[] __initconst = {
-	"15M1IMS2.111", // MSI Vector 16 HX A14VHG
-	NULL
+static ssize_t shift_governor_param_show(struct device *device,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	struct shift_governor_param *param =
+		container_of(attr, struct shift_governor_param, dev_attr);
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(*param->value));
+}
+
+static ssize_t shift_governor_param_store(struct device *dev,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	struct shift_governor_param *param =
+		container_of(attr, struct shift_governor_param, dev_attr);
+	int value, old;
+	int result;
+
+	result = kstrtoint(buf, 10, &value);
+	if (result < 0)
+		return result;
+
+	if (value < param->min || value > param->max)
+		return -EINVAL;
+
+	mutex_lock(&shift_governor_lock);
+	old = *param->value;
+	*param->value = value;
+
+	// the band between the thresholds is the hysteresis
+	if (shift_governor.down_util >= shift_governor.up_util) {
+		*param->value = old;
+		result = -EINVAL;
+	}
+	mutex_unlock(&shift_governor_lock);
+
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+#define SHIFT_GOVERNOR_PARAM(_name, _min, _max)				\
+	static struct shift_governor_param shift_governor_param_##_name = { \
+		.dev_attr = __ATTR(_name, 0644, shift_governor_param_show, \
+				   shift_governor_param_store),		\
+		.value = &shift_governor._name,				\
+		.min = _min,						\
+		.max = _max,						\
+	}
+
+SHIFT_GOVERNOR_PARAM(period_ms, 500, 60000);
+SHIFT_GOVERNOR_PARAM(up_util, 0, 100);
+SHIFT_GOVERNOR_PARAM(down_util, 0, 100);
+SHIFT_GOVERNOR_PARAM(temp_limit, 30, 100);
+SHIFT_GOVERNOR_PARAM(dwell_ms, 0, 600000);
+
+// the mode name of a ladder position
+static const char *shift_governor_name(int step)
+{
+	return shift_mode_enum.names[shift_governor.ladder[step]];
+}
+
+static ssize_t shift_governor_stats_show(struct device *device,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	int count = 0;
+
+	mutex_lock(&shift_governor_lock);
+	count += sysfs_emit_at(buf, count, "mode=%s\n", shift_governor.enabled ?
+			       shift_governor_name(shift_governor.step) : "none");
+	count += sysfs_emit_at(buf, count, "utilization=%d\n",
+			       shift_governor.util);
+	count += sysfs_emit_at(buf, count, "temperature=%d\n",
+			       shift_governor.temp);
+	count += sysfs_emit_at(buf, count, "samples=%llu\n",
+			       shift_governor.samples);
+	count += sysfs_emit_at(buf, count, "thermal=%llu\n",
+			       shift_governor.thermal);
+	count += sysfs_emit_at(buf, count, "write_errors=%llu\n",
+			       shift_governor.write_errors);
+
+	// one "from->to=count" line per transition taken
+	for (int from = 0; from < shift_governor.nr_modes; from++) {
+		for (int to = 0; to < shift_governor.nr_modes; to++) {
+			u64 n = shift_governor.transitions[from][to];
+
+			if (n)
+				count += sysfs_emit_at(buf, count,
+						       "%s->%s=%llu\n",
+						       shift_governor_name(from),
+						       shift_governor_name(to),
+						       n);
+		}
+	}
+	mutex_unlock(&shift_governor_lock);
+
+	return count;
+}
+
+static struct device_attribute dev_attr_shift_governor_enabled = {
+	.attr = {
+		.name = "enabled",
+		.mode = 0644,
+	},
+	.show = shift_governor_enabled_show,
+	.store = shift_governor_enabled_store,
 };
 
-static struct msi_ec_conf CONF41 __initdata = {
-	.allowed_fw = ALLOWED_FW_41, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = 0x2e,
-		.block_address = MSI_EC_ADDR_UNSUPP,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_COMFORT_NAME, 0xc1 }, // Silent / Balanced / AI
-			{ SM_TURBO_NAME,   0xc4 }, // Performance
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = MSI_EC_ADDR_UNSUPP, // Function not shown in dragon center
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0x71,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = 0x89,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x96,
-	},
-	.gpu = {
-		.rt_temp_address      = 0x80,
-		.rt_fan_speed_address = 0x89,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = 0x2d,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = MSI_EC_ADDR_UNSUPP,
-		.bl_modes         = { 0x00, 0x08 },
-		.max_mode         = 1,
-		.bl_state_address = MSI_EC_ADDR_UNSUPP,
-		.state_base_value = 0x80,
-		.max_state        = 3,
+static struct device_attribute dev_attr_shift_governor_stats = {
+	.attr = {
+		.name = "stats",
+		.mode = 0444,
 	},
+	.show = shift_governor_stats_show,
 };
 
-static const char *ALLOWED_FW_42[] __initconst = {
-	"14L1EMS1.307", // Modern 14 H D13M
-	"14L1EMS1.308",
+static struct attribute *msi_shift_governor_attrs[] = {
+	&dev_attr_shift_governor_enabled.attr,
+	&shift_governor_param_period_ms.dev_attr.attr,
+	&shift_governor_param_up_util.dev_attr.attr,
+	&shift_governor_param_down_util.dev_attr.attr,
+	&shift_governor_param_temp_limit.dev_attr.attr,
+	&shift_governor_param_dwell_ms.dev_attr.attr,
+	&dev_attr_shift_governor_stats.attr,
 	NULL
 };
 
-static struct msi_ec_conf CONF42 __initdata = {
-	.allowed_fw = ALLOWED_FW_42, // WMI2 based
-	.charge_control = {
-		.address      = 0xd7,
-		.offset_start = 0x8a,
-		.offset_end   = 0x80,
-		.range_min    = 0x8a,
-		.range_max    = 0xe4,
-	},
-	.webcam = {
-		.address       = MSI_EC_ADDR_UNSUPP,
-		.block_address = 0x2f,
-		.bit           = 1,
-	},
-	.fn_win_swap = {
-		.address = 0xe8,
-		.bit     = 4,
-		.invert  = false,
-	},
-	.cooler_boost = {
-		.address = 0x98,
-		.bit     = 7,
-	},
-	.shift_mode = {
-		.address = 0xd2,
-		.modes = {
-			{ SM_ECO_NAME,     0xc2 }, // super battery
-			{ SM_COMFORT_NAME, 0xc1 }, // balanced + silent + ai
-			{ SM_TURBO_NAME,   0xc4 }, // extreme performance
-			MSI_EC_MODE_NULL
-		},
-	},
-	.super_battery = {
-		.address = 0xeb,
-		.mask    = 0x0f,
-	},
-	.fan_mode = {
-		.address = 0xd4,
-		.modes = {
-			{ FM_AUTO_NAME,     0x0d },
-			{ FM_SILENT_NAME,   0x1d },
-			{ FM_ADVANCED_NAME, 0x8d },
-			MSI_EC_MODE_NULL
-		},
-	},
-	.cpu = {
-		.rt_temp_address       = 0x68,
-		.rt_fan_speed_address  = 0xc9,
-		.rt_fan_speed_base_min = 0x00,
-		.rt_fan_speed_base_max = 0x96,
-		.bs_fan_speed_address  = MSI_EC_ADDR_UNSUPP,
-		.bs_fan_speed_base_min = 0x00,
-		.bs_fan_speed_base_max = 0x0f,
-	},
-	.gpu = {
-		.rt_temp_address      = MSI_EC_ADDR_UNSUPP,
-		.rt_fan_speed_address = MSI_EC_ADDR_UNSUPP,
-	},
-	.leds = {
-		.micmute_led_address = 0x2c,
-		.mute_led_address    = MSI_EC_ADDR_UNSUPP,
-		.bit                 = 1,
-	},
-	.kbd_bl = {
-		.bl_mode_address  = 0x2c,
-		.bl_modes         = { 0x00, 0x08 }, // 00 - on, 08 - 10 sec auto off
-		.max_mode         = 1,
-		.bl_state_address = 0xd3,
-		.state_base_value = 0x80,
-		.max_state        = 3,
-	},
-};
+// ============================================================ //
+// IIO device
+// ============================================================ //
 
-static struct msi_ec_conf *CONFIGURATIONS[] __initdata = {
-	&CONF0,
-	&CONF1,
-	&CONF2,
-	&CONF3,
-	&CONF4,
-	&CONF5,
-	&CONF6,
-	&CONF7,
-	&CONF8,
-	&CONF9,
-	&CONF10,
-	&CONF11,
-	&CONF12,
-	&CONF13,
-	&CONF14,
-	&CONF15,
-	&CONF16,
-	&CONF17,
-	&CONF18,
-	&CONF19,
-	&CONF20,
-	&CONF21,
-	&CONF22,
-	&CONF23,
-	&CONF24,
-	&CONF25,
-	&CONF26,
-	&CONF27,
-	&CONF28,
-	&CONF29,
-	&CONF30,
-	&CONF31,
-	&CONF32,
-	&CONF33,
-	&CONF34,
-	&CONF35,
-	&CONF36,
-	&CONF37,
-	&CONF38,
-	&CONF39,
-	&CONF40,
-	&CONF41,
-	&CONF42,
-	NULL
+/*
+ * The temperatures and the fan speeds as an IIO device, for captures at a
+ * steady rate with kernel timestamps: once a trigger is attached, e.g. an
+ * hrtimer one, every trigger reads the enabled channels in one burst and
+ * pushes them to the buffer. IIO has no type for fans, their speeds are
+ * relative positions, in percent once offset and scaled, and labelled.
+ */
+
+#if IS_REACHABLE(CONFIG_IIO_TRIGGERED_BUFFER)
+
+enum msi_ec_iio_source {
+	MSI_EC_IIO_CPU_TEMP,
+	MSI_EC_IIO_GPU_TEMP,
+	MSI_EC_IIO_CPU_FAN,
+	MSI_EC_IIO_GPU_FAN,
+	MSI_EC_IIO_NR,
 };
 
-static bool conf_loaded = false;
-static struct msi_ec_conf conf; // current configuration
+static const enum msi_ec_state_field msi_ec_iio_fields[MSI_EC_IIO_NR] = {
+	[MSI_EC_IIO_CPU_TEMP] = MSI_EC_STATE_CPU_RT_TEMP,
+	[MSI_EC_IIO_GPU_TEMP] = MSI_EC_STATE_GPU_RT_TEMP,
+	[MSI_EC_IIO_CPU_FAN]  = MSI_EC_STATE_CPU_RT_FAN_SPEED,
+	[MSI_EC_IIO_GPU_FAN]  = MSI_EC_STATE_GPU_RT_FAN_SPEED,
+};
 
-struct attribute_support {
-	struct attribute *attribute;
-	bool supported;
+static const char *const msi_ec_iio_labels[MSI_EC_IIO_NR] = {
+	[MSI_EC_IIO_CPU_TEMP] = "cpu_temperature",
+	[MSI_EC_IIO_GPU_TEMP] = "gpu_temperature",
+	[MSI_EC_IIO_CPU_FAN]  = "cpu_fan_speed",
+	[MSI_EC_IIO_GPU_FAN]  = "gpu_fan_speed",
 };
 
-static char *firmware = NULL;
-module_param(firmware, charp, 0);
-MODULE_PARM_DESC(firmware, "Load a configuration for a specified firmware version");
+// one EC register each, the scan index is assigned at registration
+#define MSI_EC_IIO_CHANNEL(_type, _channel, _source, _info) {		\
+	.type = _type,							\
+	.indexed = 1,							\
+	.channel = _channel,						\
+	.address = _source,						\
+	.info_mask_separate = BIT(IIO_CHAN_INFO_RAW) | (_info),		\
+	.scan_type = {							\
+		.sign = 'u',						\
+		.realbits = 8,						\
+		.storagebits = 8,					\
+	},								\
+}
 
-static bool debug = false;
-module_param(debug, bool, 0);
-MODULE_PARM_DESC(debug, "Load the driver in the debug mode, exporting the debug attributes");
+static const struct iio_chan_spec msi_ec_iio_templates[MSI_EC_IIO_NR] = {
+	MSI_EC_IIO_CHANNEL(IIO_TEMP, 0, MSI_EC_IIO_CPU_TEMP,
+			   BIT(IIO_CHAN_INFO_SCALE)),
+	MSI_EC_IIO_CHANNEL(IIO_TEMP, 1, MSI_EC_IIO_GPU_TEMP,
+			   BIT(IIO_CHAN_INFO_SCALE)),
+	MSI_EC_IIO_CHANNEL(IIO_POSITIONRELATIVE, 0, MSI_EC_IIO_CPU_FAN,
+			   BIT(IIO_CHAN_INFO_OFFSET) | BIT(IIO_CHAN_INFO_SCALE)),
+	MSI_EC_IIO_CHANNEL(IIO_POSITIONRELATIVE, 1, MSI_EC_IIO_GPU_FAN,
+			   BIT(IIO_CHAN_INFO_OFFSET) | BIT(IIO_CHAN_INFO_SCALE)),
+};
 
-// ============================================================ //
-// Helper functions
-// ============================================================ //
+// the supported channels, then the timestamp
+static struct iio_chan_spec msi_ec_iio_channels[MSI_EC_IIO_NR + 1];
 
-#define streq(x, y) (strcmp(x, y) == 0 || strcmp(x, y "\n") == 0)
+static struct iio_dev *msi_ec_iio_dev;
 
-#define set_bit(v, b)   (v |= (1 << b))
-#define unset_bit(v, b) (v &= ~(1 << b))
-#define check_bit(v, b) ((bool)((v >> b) & 1))
+static u8 msi_ec_iio_address(const struct iio_chan_spec *chan)
+{
+	return *msi_ec_fields[msi_ec_iio_fields[chan->address]].address;
+}
 
-static int ec_read_seq(u8 addr, u8 *buf, u8 len)
+static int msi_ec_iio_read_raw(struct iio_dev *indio_dev,
+			       const struct iio_chan_spec *chan,
+			       int *val, int *val2, long mask)
 {
+	u8 rdata;
 	int result;
-	for (u8 i = 0; i < len; i++) {
-		result = ec_read(addr + i, buf + i);
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		result = msi_ec_read(msi_ec_iio_address(chan), &rdata);
 		if (result < 0)
 			return result;
-	}
-	return 0;
-}
 
-static int ec_set_by_mask(u8 addr, u8 mask)
-{
-	int result;
-	u8 stored;
+		*val = rdata;
+		return IIO_VAL_INT;
 
-	mutex_lock(&ec_set_by_mask_mutex);
-	result = ec_read(addr, &stored);
-	if (result < 0)
-		goto unlock;
+	case IIO_CHAN_INFO_SCALE:
+		// millidegrees, like every IIO temperature
+		if (chan->type == IIO_TEMP) {
+			*val = 1000;
+			return IIO_VAL_INT;
+		}
 
-	stored |= mask;
-	result = ec_write(addr, stored);
+		// the CPU fan register spans a range, the GPU one is a percentage
+		if (chan->address == MSI_EC_IIO_CPU_FAN) {
+			*val = 100;
+			*val2 = max(conf.cpu.rt_fan_speed_base_max -
+				    conf.cpu.rt_fan_speed_base_min, 1);
+			return IIO_VAL_FRACTIONAL;
+		}
 
-unlock:
-	mutex_unlock(&ec_set_by_mask_mutex);
-	return result;
+		*val = 1;
+		return IIO_VAL_INT;
+
+	case IIO_CHAN_INFO_OFFSET:
+		*val = chan->address == MSI_EC_IIO_CPU_FAN ?
+		       -conf.cpu.rt_fan_speed_base_min : 0;
+		return IIO_VAL_INT;
+	}
+
+	return -EINVAL;
 }
 
-static int ec_unset_by_mask(u8 addr, u8 mask)
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0))
+static int msi_ec_iio_read_label(struct iio_dev *indio_dev,
+				 const struct iio_chan_spec *chan, char *label)
 {
-	int result;
-	u8 stored;
+	return sysfs_emit(label, "%s\n", msi_ec_iio_labels[chan->address]);
+}
+#endif
 
-	mutex_lock(&ec_unset_by_mask_mutex);
-	result = ec_read(addr, &stored);
-	if (result < 0)
-		goto unlock;
+static const struct iio_info msi_ec_iio_info = {
+	.read_raw = msi_ec_iio_read_raw,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0))
+	.read_label = msi_ec_iio_read_label,
+#endif
+};
 
-	stored &= ~mask;
-	result = ec_write(addr, stored);
+// runs in a thread, the EC reads may sleep
+static irqreturn_t msi_ec_iio_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct {
+		u8 values[MSI_EC_IIO_NR];
+		s64 timestamp __aligned(8);
+	} scan;
+	int bit, i = 0;
+	int result = 0;
 
-unlock:
-	mutex_unlock(&ec_unset_by_mask_mutex);
-	return result;
-}
+	memset(&scan, 0, sizeof(scan));
 
-static int ec_check_by_mask(u8 addr, u8 mask, bool *output)
-{
-	int result;
-	u8 stored;
+	// don't observe a transaction halfway through
+	mutex_lock(&ec_lock);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0))
+	iio_for_each_active_channel(indio_dev, bit) {
+#else
+	for_each_set_bit(bit, indio_dev->active_scan_mask,
+			 indio_dev->masklength) {
+#endif
+		u8 addr = msi_ec_iio_address(&msi_ec_iio_channels[bit]);
 
-	result = ec_read(addr, &stored);
-	if (result < 0)
-		return result;
+		result = msi_ec_read(addr, &scan.values[i++]);
+		if (result < 0)
+			break;
+	}
+	mutex_unlock(&ec_lock);
 
-	*output = ((stored & mask) == mask);
+	// a sample the EC failed to deliver is dropped
+	if (result >= 0)
+		iio_push_to_buffers_with_timestamp(indio_dev, &scan,
+						   pf->timestamp);
 
-	return 0;
+	iio_trigger_notify_done(indio_dev->trig);
+	return IRQ_HANDLED;
 }
 
-static int ec_set_bit(u8 addr, u8 bit, bool value)
+// a failure leaves the rest of the driver working, so it is not fatal
+static void msi_ec_iio_init(struct device *parent)
 {
+	struct iio_dev *indio_dev;
+	int count = 0;
 	int result;
-	u8 stored;
 
-	mutex_lock(&ec_set_bit_mutex);
-	result = ec_read(addr, &stored);
-	if (result < 0)
-		goto unlock;
+	for (int i = 0; i < MSI_EC_IIO_NR; i++) {
+		if (!msi_ec_has(msi_ec_fields[msi_ec_iio_fields[i]].cap))
+			continue;
 
-	if (value)
-		set_bit(stored, bit);
-	else
-		unset_bit(stored, bit);
+		msi_ec_iio_channels[count] = msi_ec_iio_templates[i];
+		msi_ec_iio_channels[count].scan_index = count;
+		count++;
+	}
+	if (!count)
+		return;
 
-	result = ec_write(addr, stored);
+	msi_ec_iio_channels[count] =
+		(struct iio_chan_spec)IIO_CHAN_SOFT_TIMESTAMP(count);
 
-unlock:
-	mutex_unlock(&ec_set_bit_mutex);
-	return result;
-}
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0))
+	indio_dev = iio_device_alloc(parent, 0);
+#else
+	indio_dev = iio_device_alloc(0);
+#endif
+	if (!indio_dev) {
+		pr_warn("failed to allocate the IIO device\n");
+		return;
+	}
 
-static int ec_check_bit(u8 addr, u8 bit, bool *output)
-{
-	int result;
-	u8 stored;
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0))
+	indio_dev->dev.parent = parent;
+#endif
+	indio_dev->name = MSI_EC_DRIVER_NAME;
+	indio_dev->info = &msi_ec_iio_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->channels = msi_ec_iio_channels;
+	indio_dev->num_channels = count + 1;
+
+	result = iio_triggered_buffer_setup(indio_dev, iio_pollfunc_store_time,
+					    msi_ec_iio_trigger_handler, NULL);
+	if (result < 0)
+		goto free;
 
-	result = ec_read(addr, &stored);
+	result = iio_device_register(indio_dev);
 	if (result < 0)
-		return result;
+		goto cleanup;
 
-	*output = check_bit(stored, bit);
+	msi_ec_iio_dev = indio_dev;
+	return;
 
-	return 0;
+cleanup:
+	iio_triggered_buffer_cleanup(indio_dev);
+free:
+	iio_device_free(indio_dev);
+	pr_warn("failed to register the IIO device: %d\n", result);
 }
 
-static int ec_get_firmware_version(u8 buf[MSI_EC_FW_VERSION_LENGTH + 1])
+static void msi_ec_iio_exit(void)
 {
-	int result;
-
-	memset(buf, 0, MSI_EC_FW_VERSION_LENGTH + 1);
-	result = ec_read_seq(MSI_EC_FW_VERSION_ADDRESS, buf,
-			     MSI_EC_FW_VERSION_LENGTH);
-	if (result < 0)
-		return result;
+	if (!msi_ec_iio_dev)
+		return;
 
-	return MSI_EC_FW_VERSION_LENGTH + 1;
+	iio_device_unregister(msi_ec_iio_dev);
+	iio_triggered_buffer_cleanup(msi_ec_iio_dev);
+	iio_device_free(msi_ec_iio_dev);
+	msi_ec_iio_dev = NULL;
 }
 
+#else // CONFIG_IIO_TRIGGERED_BUFFER
+
+static void msi_ec_iio_init(struct device *parent) {}
+static void msi_ec_iio_exit(void) {}
+
+#endif // CONFIG_IIO_TRIGGERED_BUFFER
+
 // ============================================================ //
-// Sysfs power_supply subsystem
+// perf PMU
 // ============================================================ //
 
-static ssize_t charge_control_threshold_show(u8 offset, struct device *device,
-					     struct device_attribute *attr,
-					     char *buf)
-{
-	u8 rdata;
-	int result;
+/*
+ * The temperatures and fan speeds as perf events, e.g.
+ * "perf stat -a -e msi_ec/cpu_temp/,msi_ec/cpu_fan/". While an event
+ * runs, a work item samples the EC every pmu_period_ms. The EC gives
+ * levels, not counts, so like the frequency events of i915 an event
+ * counts the integral of its value over time: the sampled value times
+ * the microseconds it held, up to the read. The difference of two reads
+ * divided by the time between them is the mean value, over a perf stat
+ * run or between two samples of a perf record group. The events are
+ * system wide, counted on CPU 0, and have no interrupt to sample on.
+ */
 
-	result = ec_read(conf.charge_control.address, &rdata);
-	if (result < 0)
-		return result;
+#if IS_ENABLED(CONFIG_PERF_EVENTS)
 
-	// thresholds are unknown
-	if (rdata == 0x80) {
-		return sysfs_emit(buf, "0\n");
-	}
+enum msi_ec_pmu_source {
+	MSI_EC_PMU_CPU_TEMP,
+	MSI_EC_PMU_GPU_TEMP,
+	MSI_EC_PMU_CPU_FAN,
+	MSI_EC_PMU_GPU_FAN,
+	MSI_EC_PMU_NR,
+};
 
-	return sysfs_emit(buf, "%i\n", rdata - offset);
-}
+static const enum msi_ec_state_field msi_ec_pmu_fields[MSI_EC_PMU_NR] = {
+	[MSI_EC_PMU_CPU_TEMP] = MSI_EC_STATE_CPU_RT_TEMP,
+	[MSI_EC_PMU_GPU_TEMP] = MSI_EC_STATE_GPU_RT_TEMP,
+	[MSI_EC_PMU_CPU_FAN]  = MSI_EC_STATE_CPU_RT_FAN_SPEED,
+	[MSI_EC_PMU_GPU_FAN]  = MSI_EC_STATE_GPU_RT_FAN_SPEED,
+};
 
-static ssize_t charge_control_threshold_store(u8 offset, struct device *dev,
-					      struct device_attribute *attr,
-					      const char *buf, size_t count)
-{
-	u8 wdata;
-	int result;
+static unsigned int pmu_period_ms = 100;
+module_param(pmu_period_ms, uint, 0644);
+MODULE_PARM_DESC(pmu_period_ms, "EC sampling period of the running perf events, at least 10 ms");
 
-	result = kstrtou8(buf, 10, &wdata);
-	if (result < 0)
-		return result;
+static struct {
+	int active; // events started
 
-	wdata += offset;
-	if (wdata < conf.charge_control.range_min ||
-	    wdata > conf.charge_control.range_max)
-		return -EINVAL;
+	// the last sample, decoded, and the integrals up to it
+	ktime_t sampled;
+	bool valid[MSI_EC_PMU_NR];
+	s32 value[MSI_EC_PMU_NR];
+	u64 total[MSI_EC_PMU_NR]; // value * us
+} msi_ec_pmu_state;
 
-	result = ec_write(conf.charge_control.address, wdata);
-	if (result < 0)
-		return result;
+// protects msi_ec_pmu_state, the perf callbacks run with interrupts off
+static DEFINE_SPINLOCK(msi_ec_pmu_lock);
 
-	return count;
-}
+static void msi_ec_pmu_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(msi_ec_pmu_work, msi_ec_pmu_fn);
 
-static ssize_t
-charge_control_start_threshold_show(struct device *device,
-				    struct device_attribute *attr, char *buf)
+// msi_ec_pmu_lock must be held
+static u64 msi_ec_pmu_integral(int source, ktime_t now)
 {
-	return charge_control_threshold_show(conf.charge_control.offset_start,
-					     device, attr, buf);
-}
+	u64 total = msi_ec_pmu_state.total[source];
 
-static ssize_t
-charge_control_start_threshold_store(struct device *dev,
-				     struct device_attribute *attr,
-				     const char *buf, size_t count)
-{
-	return charge_control_threshold_store(
-		conf.charge_control.offset_start, dev, attr, buf, count);
-}
+	if (msi_ec_pmu_state.valid[source])
+		total += (u64)msi_ec_pmu_state.value[source] *
+			 ktime_us_delta(now, msi_ec_pmu_state.sampled);
 
-static ssize_t charge_control_end_threshold_show(struct device *device,
-						 struct device_attribute *attr,
-						 char *buf)
-{
-	return charge_control_threshold_show(conf.charge_control.offset_end,
-					     device, attr, buf);
+	return total;
 }
 
-static ssize_t charge_control_end_threshold_store(struct device *dev,
-						  struct device_attribute *attr,
-						  const char *buf, size_t count)
+static void msi_ec_pmu_fn(struct work_struct *work)
 {
-	return charge_control_threshold_store(conf.charge_control.offset_end,
-					      dev, attr, buf, count);
-}
-
-static DEVICE_ATTR_RW(charge_control_start_threshold);
-static DEVICE_ATTR_RW(charge_control_end_threshold);
-
-static struct attribute *msi_battery_attrs[] = {
-	&dev_attr_charge_control_start_threshold.attr,
-	&dev_attr_charge_control_end_threshold.attr,
-	NULL
-};
+	bool valid[MSI_EC_PMU_NR] = { false };
+	s32 value[MSI_EC_PMU_NR];
+	unsigned long flags;
+	ktime_t now;
+	bool active;
+
+	for (int i = 0; i < MSI_EC_PMU_NR; i++) {
+		const struct msi_ec_field *field =
+			&msi_ec_fields[msi_ec_pmu_fields[i]];
+		u8 rdata;
+
+		// a failed read or an undecodable value counts as nothing
+		valid[i] = msi_ec_has(field->cap) &&
+			   msi_ec_read(*field->address, &rdata) >= 0 &&
+			   field->decode(field, rdata, &value[i]) >= 0;
+	}
 
-ATTRIBUTE_GROUPS(msi_battery);
+	spin_lock_irqsave(&msi_ec_pmu_lock, flags);
+	now = ktime_get();
+	for (int i = 0; i < MSI_EC_PMU_NR; i++) {
+		msi_ec_pmu_state.total[i] = msi_ec_pmu_integral(i, now);
+		msi_ec_pmu_state.valid[i] = valid[i];
+		if (valid[i])
+			msi_ec_pmu_state.value[i] = value[i];
+	}
+	msi_ec_pmu_state.sampled = now;
+	active = msi_ec_pmu_state.active;
+	spin_unlock_irqrestore(&msi_ec_pmu_lock, flags);
 
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0))
-static int msi_battery_add(struct power_supply *battery,
-			   struct acpi_battery_hook *hook)
-#else
-static int msi_battery_add(struct power_supply *battery)
-#endif
-{
-	return device_add_groups(&battery->dev, msi_battery_groups);
+	if (active)
+		schedule_delayed_work(&msi_ec_pmu_work,
+			msecs_to_jiffies(max(READ_ONCE(pmu_period_ms), 10U)));
 }
 
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0))
-static int msi_battery_remove(struct power_supply *battery,
-			      struct acpi_battery_hook *hook)
-#else
-static int msi_battery_remove(struct power_supply *battery)
-#endif
+static void msi_ec_pmu_update(struct perf_event *event)
 {
-	device_remove_groups(&battery->dev, msi_battery_groups);
-	return 0;
-}
+	unsigned long flags;
+	u64 prev, now;
 
-static struct acpi_battery_hook battery_hook = {
-	.add_battery = msi_battery_add,
-	.remove_battery = msi_battery_remove,
-	.name = MSI_EC_DRIVER_NAME,
-};
+	spin_lock_irqsave(&msi_ec_pmu_lock, flags);
+	now = msi_ec_pmu_integral(event->attr.config, ktime_get());
+	spin_unlock_irqrestore(&msi_ec_pmu_lock, flags);
 
-// ============================================================ //
-// Sysfs platform device attributes (root)
-// ============================================================ //
+	prev = local64_xchg(&event->hw.prev_count, now);
+	local64_add(now - prev, &event->count);
+}
 
-static ssize_t webcam_common_show(u8 address,
-			          char *buf,
-				  const char *str_on_0,
-				  const char *str_on_1)
+static void msi_ec_pmu_start(struct perf_event *event, int flags)
 {
-	int result;
-	bool bit_value;
+	unsigned long irq_flags;
+	bool first;
 
-	result = ec_check_bit(address, conf.webcam.bit, &bit_value);
-	if (result < 0)
-		return result;
+	spin_lock_irqsave(&msi_ec_pmu_lock, irq_flags);
+	local64_set(&event->hw.prev_count,
+		    msi_ec_pmu_integral(event->attr.config, ktime_get()));
+	first = !msi_ec_pmu_state.active++;
+	spin_unlock_irqrestore(&msi_ec_pmu_lock, irq_flags);
 
-	if (bit_value) {
-		return sysfs_emit(buf, "%s\n", str_on_1);
-	} else {
-		return sysfs_emit(buf, "%s\n", str_on_0);
-	}
+	event->hw.state = 0;
+
+	// the work doesn't run while no event does
+	if (first)
+		mod_delayed_work(system_wq, &msi_ec_pmu_work, 0);
 }
 
-static ssize_t webcam_common_store(u8 address,
-				   const char *buf,
-				   size_t count,
-				   const char *str_for_0,
-				   const char *str_for_1)
+static void msi_ec_pmu_stop(struct perf_event *event, int flags)
 {
-	int result = -EINVAL;
+	unsigned long irq_flags;
 
-	if (sysfs_streq(str_for_1, buf))
-		result = ec_set_bit(address, conf.webcam.bit, true);
+	if (event->hw.state & PERF_HES_STOPPED)
+		return;
 
-	if (sysfs_streq(str_for_0, buf))
-		result = ec_set_bit(address, conf.webcam.bit, false);
+	if (flags & PERF_EF_UPDATE)
+		msi_ec_pmu_update(event);
 
-	if (result < 0)
-		return result;
+	spin_lock_irqsave(&msi_ec_pmu_lock, irq_flags);
+	msi_ec_pmu_state.active--;
+	spin_unlock_irqrestore(&msi_ec_pmu_lock, irq_flags);
 
-	return count;
+	event->hw.state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
 }
 
-static ssize_t webcam_show(struct device *device,
-			   struct device_attribute *attr,
-			   char *buf)
+static int msi_ec_pmu_add(struct perf_event *event, int flags)
 {
-	return webcam_common_show(conf.webcam.address,
-				  buf,
-				  "off", "on");
-}
+	event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
 
-static ssize_t webcam_store(struct device *dev,
-			    struct device_attribute *attr,
-			    const char *buf, size_t count)
-{
-	return webcam_common_store(conf.webcam.address,
-				   buf, count,
-				   "off", "on");
-}
+	if (flags & PERF_EF_START)
+		msi_ec_pmu_start(event, flags);
 
-static ssize_t webcam_block_show(struct device *device,
-				 struct device_attribute *attr,
-				 char *buf)
-{
-	return webcam_common_show(conf.webcam.block_address,
-				  buf,
-				  "on", "off");
+	return 0;
 }
 
-static ssize_t webcam_block_store(struct device *dev,
-				  struct device_attribute *attr,
-			          const char *buf, size_t count)
+static void msi_ec_pmu_del(struct perf_event *event, int flags)
 {
-	return webcam_common_store(conf.webcam.block_address,
-				   buf, count,
-				   "on", "off");
+	msi_ec_pmu_stop(event, PERF_EF_UPDATE);
 }
 
-static ssize_t fn_key_show(struct device *device, struct device_attribute *attr,
-			   char *buf)
+static void msi_ec_pmu_read(struct perf_event *event)
 {
-	int result;
-	bool bit_value;
-
-	result = ec_check_bit(conf.fn_win_swap.address, conf.fn_win_swap.bit, &bit_value);
-
-	if (bit_value ^ conf.fn_win_swap.invert) {
-		return sysfs_emit(buf, "%s\n", "right");
-	} else {
-		return sysfs_emit(buf, "%s\n", "left");
-	}
+	msi_ec_pmu_update(event);
 }
 
-static ssize_t fn_key_store(struct device *dev, struct device_attribute *attr,
-			    const char *buf, size_t count)
+static int msi_ec_pmu_event_init(struct perf_event *event)
 {
-	int result;
-
-	if (streq(buf, "right")) {
-		result = ec_set_bit(conf.fn_win_swap.address,
-				    conf.fn_win_swap.bit,
-				    true ^ conf.fn_win_swap.invert);
-	} else if (streq(buf, "left")) {
-		result = ec_set_bit(conf.fn_win_swap.address,
-				    conf.fn_win_swap.bit,
-				    false ^ conf.fn_win_swap.invert);
-	}
+	u64 config = event->attr.config;
 
-	if (result < 0)
-		return result;
-
-	return count;
-}
+	if (event->attr.type != event->pmu->type)
+		return -ENOENT;
 
-static ssize_t win_key_show(struct device *device,
-			    struct device_attribute *attr, char *buf)
-{
-	int result;
-	bool bit_value;
+	// counted once, not per CPU nor per task
+	if (event->cpu != 0)
+		return -EINVAL;
+	if (is_sampling_event(event))
+		return -EINVAL;
 
-	result = ec_check_bit(conf.fn_win_swap.address, conf.fn_win_swap.bit, &bit_value);
+	if (config >= MSI_EC_PMU_NR ||
+	    !msi_ec_has(msi_ec_fields[msi_ec_pmu_fields[config]].cap))
+		return -EINVAL;
 
-	if (bit_value ^ conf.fn_win_swap.invert) {
-		return sysfs_emit(buf, "%s\n", "left");
-	} else {
-		return sysfs_emit(buf, "%s\n", "right");
-	}
+	return 0;
 }
 
-static ssize_t win_key_store(struct device *dev, struct device_attribute *attr,
-			     const char *buf, size_t count)
-{
-	int result;
+PMU_FORMAT_ATTR(event, "config:0-7");
 
-	if (streq(buf, "right")) {
-		result = ec_set_bit(conf.fn_win_swap.address,
-				    conf.fn_win_swap.bit,
-				    false ^ conf.fn_win_swap.invert);
-	} else if (streq(buf, "left")) {
-		result = ec_set_bit(conf.fn_win_swap.address,
-				    conf.fn_win_swap.bit,
-				    true ^ conf.fn_win_swap.invert);
-	}
+static struct attribute *msi_ec_pmu_format_attrs[] = {
+	&format_attr_event.attr,
+	NULL
+};
 
-	if (result < 0)
-		return result;
+static const struct attribute_group msi_ec_pmu_format_group = {
+	.name = "format",
+	.attrs = msi_ec_pmu_format_attrs,
+};
 
-	return count;
-}
+// the counts are in value * us, perf scales them to value * s
+PMU_EVENT_ATTR_STRING(cpu_temp, msi_ec_pmu_cpu_temp, "event=0x00");
+PMU_EVENT_ATTR_STRING(cpu_temp.unit, msi_ec_pmu_cpu_temp_unit, "C.s");
+PMU_EVENT_ATTR_STRING(cpu_temp.scale, msi_ec_pmu_cpu_temp_scale, "1e-6");
+PMU_EVENT_ATTR_STRING(gpu_temp, msi_ec_pmu_gpu_temp, "event=0x01");
+PMU_EVENT_ATTR_STRING(gpu_temp.unit, msi_ec_pmu_gpu_temp_unit, "C.s");
+PMU_EVENT_ATTR_STRING(gpu_temp.scale, msi_ec_pmu_gpu_temp_scale, "1e-6");
+PMU_EVENT_ATTR_STRING(cpu_fan, msi_ec_pmu_cpu_fan, "event=0x02");
+PMU_EVENT_ATTR_STRING(cpu_fan.unit, msi_ec_pmu_cpu_fan_unit, "%.s");
+PMU_EVENT_ATTR_STRING(cpu_fan.scale, msi_ec_pmu_cpu_fan_scale, "1e-6");
+PMU_EVENT_ATTR_STRING(gpu_fan, msi_ec_pmu_gpu_fan, "event=0x03");
+PMU_EVENT_ATTR_STRING(gpu_fan.unit, msi_ec_pmu_gpu_fan_unit, "%.s");
+PMU_EVENT_ATTR_STRING(gpu_fan.scale, msi_ec_pmu_gpu_fan_scale, "1e-6");
+
+// three per source, in the order of enum msi_ec_pmu_source
+static struct attribute *msi_ec_pmu_event_attrs[] = {
+	&msi_ec_pmu_cpu_temp.attr.attr,
+	&msi_ec_pmu_cpu_temp_unit.attr.attr,
+	&msi_ec_pmu_cpu_temp_scale.attr.attr,
+	&msi_ec_pmu_gpu_temp.attr.attr,
+	&msi_ec_pmu_gpu_temp_unit.attr.attr,
+	&msi_ec_pmu_gpu_temp_scale.attr.attr,
+	&msi_ec_pmu_cpu_fan.attr.attr,
+	&msi_ec_pmu_cpu_fan_unit.attr.attr,
+	&msi_ec_pmu_cpu_fan_scale.attr.attr,
+	&msi_ec_pmu_gpu_fan.attr.attr,
+	&msi_ec_pmu_gpu_fan_unit.attr.attr,
+	&msi_ec_pmu_gpu_fan_scale.attr.attr,
+	NULL
+};
 
-static ssize_t battery_mode_show(struct device *device,
-				 struct device_attribute *attr, char *buf)
+static umode_t msi_ec_pmu_events_is_visible(struct kobject *kobj,
+					    struct attribute *attr, int idx)
 {
-	u8 rdata;
-	int result;
-
-	result = ec_read(conf.charge_control.address, &rdata);
-	if (result < 0)
-		return result;
+	enum msi_ec_state_field id = msi_ec_pmu_fields[idx / 3];
 
-	if (rdata == conf.charge_control.range_max) {
-		return sysfs_emit(buf, "%s\n", "max");
-	} else if (rdata == conf.charge_control.offset_end + 80) { // up to 80%
-		return sysfs_emit(buf, "%s\n", "medium");
-	} else if (rdata == conf.charge_control.offset_end + 60) { // up to 60%
-		return sysfs_emit(buf, "%s\n", "min");
-	} else {
-		return sysfs_emit(buf, "%s (%i)\n", "unknown", rdata);
-	}
+	return msi_ec_has(msi_ec_fields[id].cap) ? attr->mode : 0;
 }
 
-static ssize_t battery_mode_store(struct device *dev,
-				  struct device_attribute *attr,
-				  const char *buf, size_t count)
+static const struct attribute_group msi_ec_pmu_events_group = {
+	.name = "events",
+	.is_visible = msi_ec_pmu_events_is_visible,
+	.attrs = msi_ec_pmu_event_attrs,
+};
+
+// perf opens the events on these CPUs only
+static ssize_t cpumask_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
 {
-	int result = -EINVAL;
+	return sysfs_emit(buf, "0\n");
+}
 
-	if (streq(buf, "max"))
-		result = ec_write(conf.charge_control.address,
-				  conf.charge_control.range_max);
+static DEVICE_ATTR_RO(cpumask);
+
+static struct attribute *msi_ec_pmu_cpumask_attrs[] = {
+	&dev_attr_cpumask.attr,
+	NULL
+};
 
-	else if (streq(buf, "medium")) // up to 80%
-		result = ec_write(conf.charge_control.address,
-				  conf.charge_control.offset_end + 80);
+static const struct attribute_group msi_ec_pmu_cpumask_group = {
+	.attrs = msi_ec_pmu_cpumask_attrs,
+};
 
-	else if (streq(buf, "min")) // up to 60%
-		result = ec_write(conf.charge_control.address,
-				  conf.charge_control.offset_end + 60);
+static const struct attribute_group *msi_ec_pmu_attr_groups[] = {
+	&msi_ec_pmu_format_group,
+	&msi_ec_pmu_events_group,
+	&msi_ec_pmu_cpumask_group,
+	NULL
+};
 
-	if (result < 0)
-		return result;
+static struct pmu msi_ec_pmu = {
+	.module       = THIS_MODULE,
+	.task_ctx_nr  = perf_invalid_context,
+	.capabilities = PERF_PMU_CAP_NO_INTERRUPT | PERF_PMU_CAP_NO_EXCLUDE,
+	.attr_groups  = msi_ec_pmu_attr_groups,
+	.event_init   = msi_ec_pmu_event_init,
+	.add          = msi_ec_pmu_add,
+	.del          = msi_ec_pmu_del,
+	.start        = msi_ec_pmu_start,
+	.stop         = msi_ec_pmu_stop,
+	.read         = msi_ec_pmu_read,
+};
 
-	return count;
-}
+static bool msi_ec_pmu_registered = false;
 
-static ssize_t cooler_boost_show(struct device *device,
-				 struct device_attribute *attr, char *buf)
+// a failure leaves the rest of the driver working, so it is not fatal
+static void msi_ec_pmu_init(void)
 {
 	int result;
-	bool bit_value;
+	bool any = false;
 
-	result = ec_check_bit(conf.cooler_boost.address, conf.cooler_boost.bit, &bit_value);
+	for (int i = 0; i < MSI_EC_PMU_NR; i++)
+		any |= msi_ec_has(msi_ec_fields[msi_ec_pmu_fields[i]].cap);
+	if (!any)
+		return;
 
-	if (bit_value) {
-		return sysfs_emit(buf, "%s\n", "on");
-	} else {
-		return sysfs_emit(buf, "%s\n", "off");
+	result = perf_pmu_register(&msi_ec_pmu, "msi_ec", -1);
+	if (result < 0) {
+		pr_warn("failed to register the perf PMU: %d\n", result);
+		return;
 	}
+	msi_ec_pmu_registered = true;
 }
 
-static ssize_t cooler_boost_store(struct device *dev,
-				  struct device_attribute *attr,
-				  const char *buf, size_t count)
+// perf holds a module reference while events exist, none runs here
+static void msi_ec_pmu_exit(void)
 {
-	int result = -EINVAL;
+	if (!msi_ec_pmu_registered)
+		return;
 
-	if (streq(buf, "on"))
-		result = ec_set_bit(conf.cooler_boost.address,
-				    conf.cooler_boost.bit,
-				    true);
+	perf_pmu_unregister(&msi_ec_pmu);
+	cancel_delayed_work_sync(&msi_ec_pmu_work);
+	msi_ec_pmu_registered = false;
+}
 
-	else if (streq(buf, "off"))
-		result = ec_set_bit(conf.cooler_boost.address,
-				    conf.cooler_boost.bit,
-				    false);
+#else // CONFIG_PERF_EVENTS
 
-	if (result < 0)
-		return result;
+static void msi_ec_pmu_init(void) {}
+static void msi_ec_pmu_exit(void) {}
 
-	return count;
-}
+#endif // CONFIG_PERF_EVENTS
 
-static ssize_t available_shift_modes_show(struct device *device,
-				          struct device_attribute *attr,
-				          char *buf)
-{
-	int result = 0;
-	int count = 0;
+// ============================================================ //
+// Sysfs platform driver
+// ============================================================ //
 
-	for (int i = 0; conf.shift_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
+static umode_t msi_ec_is_visible(struct kobject *kobj,
+				   struct attribute *attr,
+				   int idx)
+{
+	enum msi_ec_capability cap;
 
-		result = sysfs_emit_at(buf, count, "%s\n", conf.shift_mode.modes[i].name);
-		if (result < 0)
-			return result;
-		count += result;
-	}
+#ifdef MSI_EC_MODEL
+	// the attributes the model lacks are msi_ec_attr_none by now
+	return attr->mode;
+#endif
 
-	return count;
-}
+	/* root group */
+	if (attr == &dev_attr_webcam.attr)
+		cap = MSI_EC_CAP_WEBCAM;
 
-static ssize_t shift_mode_show(struct device *device,
-			       struct device_attribute *attr,
-			       char *buf)
-{
-	u8 rdata;
-	int result;
+	else if (attr == &dev_attr_webcam_block.attr)
+		cap = MSI_EC_CAP_WEBCAM_BLOCK;
 
-	result = ec_read(conf.shift_mode.address, &rdata);
-	if (result < 0)
-		return result;
+	else if (attr == &dev_attr_fn_key.attr ||
+		 attr == &dev_attr_win_key.attr)
+		cap = MSI_EC_CAP_FN_WIN_SWAP;
 
-	if (rdata == 0x80)
-		return sysfs_emit(buf, "%s\n", "unspecified");
+	else if (attr == &dev_attr_battery_mode.attr)
+		cap = MSI_EC_CAP_CHARGE_CONTROL;
 
-	for (int i = 0; conf.shift_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
+	else if (attr == &dev_attr_cooler_boost.attr)
+		cap = MSI_EC_CAP_COOLER_BOOST;
 
-		if (rdata == conf.shift_mode.modes[i].value) {
-			return sysfs_emit(buf, "%s\n", conf.shift_mode.modes[i].name);
-		}
-	}
+	else if (attr == &dev_attr_available_shift_modes.attr ||
+		 attr == &dev_attr_shift_mode.attr)
+		cap = MSI_EC_CAP_SHIFT_MODE;
 
-	return sysfs_emit(buf, "%s (%i)\n", "unknown", rdata);
-}
+	else if (attr == &dev_attr_super_battery.attr)
+		cap = MSI_EC_CAP_SUPER_BATTERY;
 
-static ssize_t shift_mode_store(struct device *dev,
-				struct device_attribute *attr, const char *buf,
-				size_t count)
-{
-	int result;
+	else if (attr == &dev_attr_available_fan_modes.attr ||
+		 attr == &dev_attr_fan_mode.attr)
+		cap = MSI_EC_CAP_FAN_MODE;
 
-	for (int i = 0; conf.shift_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
+	/* cpu group */
+	else if (attr == &dev_attr_cpu_realtime_temperature.attr)
+		cap = MSI_EC_CAP_CPU_RT_TEMP;
 
-		if (sysfs_streq(conf.shift_mode.modes[i].name, buf)) {
-			result = ec_write(conf.shift_mode.address,
-					  conf.shift_mode.modes[i].value);
-			if (result < 0)
-				return result;
+	else if (attr == &dev_attr_cpu_realtime_fan_speed.attr)
+		cap = MSI_EC_CAP_CPU_RT_FAN_SPEED;
 
-			return count;
-		}
-	}
+	else if (attr == &dev_attr_cpu_basic_fan_speed.attr)
+		cap = MSI_EC_CAP_CPU_BS_FAN_SPEED;
 
-	return -EINVAL;
-}
+	/* gpu group */
+	else if (attr == &dev_attr_gpu_realtime_temperature.attr)
+		cap = MSI_EC_CAP_GPU_RT_TEMP;
 
-static ssize_t super_battery_show(struct device *device,
-				  struct device_attribute *attr, char *buf)
-{
-	int result;
-	bool enabled;
+	else if (attr == &dev_attr_gpu_realtime_fan_speed.attr)
+		cap = MSI_EC_CAP_GPU_RT_FAN_SPEED;
 
-	result = ec_check_by_mask(conf.super_battery.address,
-				  conf.super_battery.mask,
-				  &enabled);
+	/* default */
+	else
+		return attr->mode;
 
-	if (enabled) {
-		return sysfs_emit(buf, "%s\n", "on");
-	} else {
-		return sysfs_emit(buf, "%s\n", "off");
-	}
+	return msi_ec_has(cap) ? attr->mode : 0;
 }
 
-static ssize_t super_battery_store(struct device *dev,
-				   struct device_attribute *attr,
-				   const char *buf, size_t count)
-{
-	int result = -EINVAL;
+static struct attribute_group msi_root_group = {
+	.is_visible = msi_ec_is_visible,
+	.attrs = msi_root_attrs,
+};
 
-	if (streq(buf, "on"))
-		result = ec_set_by_mask(conf.super_battery.address,
-				        conf.super_battery.mask);
+static struct attribute_group msi_cpu_group = {
+	.name = "cpu",
+	.is_visible = msi_ec_is_visible,
+	.attrs = msi_cpu_attrs,
+};
+static struct attribute_group msi_gpu_group = {
+	.name = "gpu",
+	.is_visible = msi_ec_is_visible,
+	.attrs = msi_gpu_attrs,
+};
 
-	else if (streq(buf, "off"))
-		result = ec_unset_by_mask(conf.super_battery.address,
-					  conf.super_battery.mask);
+// needs both the temperature and the fan speed it controls
+static umode_t msi_ec_fan_control_is_visible(struct kobject *kobj,
+					     struct attribute *attr, int idx)
+{
+	return (msi_ec_has(MSI_EC_CAP_CPU_RT_TEMP) &&
+		msi_ec_has(MSI_EC_CAP_CPU_BS_FAN_SPEED)) ? attr->mode : 0;
+}
 
-	if (result < 0)
-		return result;
+static struct attribute_group msi_fan_control_group = {
+	.name = "fan_control",
+	.is_visible = msi_ec_fan_control_is_visible,
+	.attrs = msi_fan_control_attrs,
+};
 
-	return count;
+static umode_t msi_ec_shift_governor_is_visible(struct kobject *kobj,
+						struct attribute *attr,
+						int idx)
+{
+	return msi_ec_has(MSI_EC_CAP_SHIFT_MODE) ? attr->mode : 0;
 }
 
-static ssize_t available_fan_modes_show(struct device *device,
-					struct device_attribute *attr,
-					char *buf)
-{
-	int result = 0;
-	int count = 0;
+static struct attribute_group msi_shift_governor_group = {
+	.name = "shift_governor",
+	.is_visible = msi_ec_shift_governor_is_visible,
+	.attrs = msi_shift_governor_attrs,
+};
 
-	for (int i = 0; conf.fan_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
+static struct attribute_group msi_power_source_group = {
+	.name = "power_source",
+	.attrs = msi_power_source_attrs,
+};
 
-		result = sysfs_emit_at(buf, count, "%s\n", conf.fan_mode.modes[i].name);
-		if (result < 0)
-			return result;
-		count += result;
-	}
+static struct attribute_group msi_residency_group = {
+	.name = "residency",
+	.attrs = msi_residency_attrs,
+};
 
-	return count;
-}
+static const struct attribute_group msi_debug_group = {
+	.name = "debug",
+	.attrs = msi_debug_attrs,
+};
 
-static ssize_t fan_mode_show(struct device *device,
-			     struct device_attribute *attr, char *buf)
-{
-	u8 rdata;
-	int result;
+/* the debug group is created separately if needed */
+static const struct attribute_group *msi_platform_groups[] = {
+	&msi_root_group,
+	&msi_cpu_group,
+	&msi_gpu_group,
+	&msi_fan_control_group,
+	&msi_power_source_group,
+	&msi_shift_governor_group,
+	&msi_residency_group,
+	NULL
+};
 
-	result = ec_read(conf.fan_mode.address, &rdata);
-	if (result < 0)
-		return result;
+/*
+ * Only the configuration lookup and the device registration are done
+ * synchronously in msi_ec_init(), the probe runs asynchronously and the
+ * rest is registered from a work item. The time spent in every phase is
+ * reported once both the probe and the work are done.
+ */
+enum msi_ec_init_phase {
+	MSI_EC_INIT_CONFIG,
+	MSI_EC_INIT_DRIVER,
+	MSI_EC_INIT_DEVICE,
+	MSI_EC_INIT_MISC,
+	MSI_EC_INIT_PROBE,   // async
+	MSI_EC_INIT_DEBUG,   // deferred
+	MSI_EC_INIT_BATTERY, // deferred
+	MSI_EC_INIT_LEDS,    // deferred
+	MSI_EC_INIT_IIO,     // deferred
+	MSI_EC_INIT_PMU,     // deferred
+	MSI_EC_INIT_EVENTS,  // deferred
+	MSI_EC_INIT_NR,
+};
 
-	for (int i = 0; conf.fan_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
+static const char *const msi_ec_init_phase_names[MSI_EC_INIT_NR] = {
+	[MSI_EC_INIT_CONFIG]  = "config",
+	[MSI_EC_INIT_DRIVER]  = "driver",
+	[MSI_EC_INIT_DEVICE]  = "device",
+	[MSI_EC_INIT_MISC]    = "misc",
+	[MSI_EC_INIT_PROBE]   = "probe",
+	[MSI_EC_INIT_DEBUG]   = "debug",
+	[MSI_EC_INIT_BATTERY] = "battery",
+	[MSI_EC_INIT_LEDS]    = "leds",
+	[MSI_EC_INIT_IIO]     = "iio",
+	[MSI_EC_INIT_PMU]     = "pmu",
+	[MSI_EC_INIT_EVENTS]  = "events",
+};
 
-		if (rdata == conf.fan_mode.modes[i].value) {
-			return sysfs_emit(buf, "%s\n", conf.fan_mode.modes[i].name);
-		}
-	}
+static s64 msi_ec_init_us[MSI_EC_INIT_NR];
 
-	return sysfs_emit(buf, "%s (%i)\n", "unknown", rdata);
-}
+// the probe and the deferred work
+static atomic_t msi_ec_init_pending = ATOMIC_INIT(2);
 
-static ssize_t fan_mode_store(struct device *dev, struct device_attribute *attr,
-			      const char *buf, size_t count)
+// records the time since start, returns the start of the next phase
+static ktime_t msi_ec_init_time(enum msi_ec_init_phase phase, ktime_t start)
 {
-	int result;
+	ktime_t now = ktime_get();
 
-	for (int i = 0; conf.fan_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
+	msi_ec_init_us[phase] = ktime_us_delta(now, start);
+	return now;
+}
 
-		if (sysfs_streq(conf.fan_mode.modes[i].name, buf)) {
-			result = ec_write(conf.fan_mode.address,
-					  conf.fan_mode.modes[i].value);
-			if (result < 0)
-				return result;
+static void msi_ec_init_done(void)
+{
+	char report[208];
+	int count = 0;
 
-			return count;
-		}
-	}
+	if (!atomic_dec_and_test(&msi_ec_init_pending))
+		return;
 
-	return -EINVAL;
+	for (int i = 0; i < MSI_EC_INIT_NR; i++)
+		count += scnprintf(report + count, sizeof(report) - count,
+				   " %s=%lld", msi_ec_init_phase_names[i],
+				   msi_ec_init_us[i]);
+
+	pr_info("init timings (us):%s\n", report);
 }
 
-static ssize_t fw_version_show(struct device *device,
-			       struct device_attribute *attr, char *buf)
+static int msi_platform_setup(struct platform_device *pdev)
 {
-	u8 rdata[MSI_EC_FW_VERSION_LENGTH + 1];
 	int result;
 
-	result = ec_get_firmware_version(rdata);
+	if (!conf_loaded) // an unsupported device loaded in debug mode
+		return 0;
+
+	result = sysfs_create_groups(&pdev->dev.kobj, msi_platform_groups);
 	if (result < 0)
 		return result;
 
-	return sysfs_emit(buf, "%s\n", rdata);
+	result = device_create_bin_file(&pdev->dev, &bin_attr_state_bin);
+	if (result < 0)
+		return result;
+
+	msi_ec_profile_register(&pdev->dev);
+	return 0;
 }
 
-static ssize_t fw_release_date_show(struct device *device,
-				    struct device_attribute *attr, char *buf)
+static int msi_platform_probe(struct platform_device *pdev)
 {
-	u8 rdate[MSI_EC_FW_DATE_LENGTH + 1];
-	u8 rtime[MSI_EC_FW_TIME_LENGTH + 1];
-	int result;
-	int year, month, day, hour, minute, second;
+	ktime_t start = ktime_get();
+	int result = msi_platform_setup(pdev);
 
-	memset(rdate, 0, MSI_EC_FW_DATE_LENGTH + 1);
-	result = ec_read_seq(MSI_EC_FW_DATE_ADDRESS, rdate,
-			     MSI_EC_FW_DATE_LENGTH);
-	if (result < 0)
-		return result;
-	sscanf(rdate, "%02d%02d%04d", &month, &day, &year);
+	msi_ec_init_time(MSI_EC_INIT_PROBE, start);
+	msi_ec_init_done();
+	return result;
+}
 
-	memset(rtime, 0, MSI_EC_FW_TIME_LENGTH + 1);
-	result = ec_read_seq(MSI_EC_FW_TIME_ADDRESS, rtime,
-			     MSI_EC_FW_TIME_LENGTH);
-	if (result < 0)
-		return result;
-	sscanf(rtime, "%02d:%02d:%02d", &hour, &minute, &second);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0))
+static void msi_platform_remove(struct platform_device *pdev)
+#else
+static int msi_platform_remove(struct platform_device *pdev)
+#endif
+{
+	if (conf_loaded) {
+		fan_control_stop();
+		shift_governor_stop();
+		msi_ec_profile_unregister();
+		device_remove_bin_file(&pdev->dev, &bin_attr_state_bin);
+		sysfs_remove_groups(&pdev->dev.kobj, msi_platform_groups);
+	}
 
-	return sysfs_emit(buf, "%04d/%02d/%02d %02d:%02d:%02d\n", year, month, day,
-		          hour, minute, second);
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(6, 11, 0))
+	return 0;
+#endif
 }
 
-static DEVICE_ATTR_RW(webcam);
-static DEVICE_ATTR_RW(webcam_block);
-static DEVICE_ATTR_RW(fn_key);
-static DEVICE_ATTR_RW(win_key);
-static DEVICE_ATTR_RW(battery_mode);
-static DEVICE_ATTR_RW(cooler_boost);
-static DEVICE_ATTR_RO(available_shift_modes);
-static DEVICE_ATTR_RW(shift_mode);
-static DEVICE_ATTR_RW(super_battery);
-static DEVICE_ATTR_RO(available_fan_modes);
-static DEVICE_ATTR_RW(fan_mode);
-static DEVICE_ATTR_RO(fw_version);
-static DEVICE_ATTR_RO(fw_release_date);
+static int msi_platform_resume(struct device *dev)
+{
+	int result = ec_journal_restore();
+
+	// a partial restore is no reason to fail the resume
+	if (result < 0)
+		pr_warn("failed to restore the EC settings: %d\n", result);
 
-static struct attribute *msi_root_attrs[] = {
-	&dev_attr_webcam.attr,
-	&dev_attr_webcam_block.attr,
-	&dev_attr_fn_key.attr,
-	&dev_attr_win_key.attr,
-	&dev_attr_battery_mode.attr,
-	&dev_attr_cooler_boost.attr,
-	&dev_attr_available_shift_modes.attr,
-	&dev_attr_shift_mode.attr,
-	&dev_attr_super_battery.attr,
-	&dev_attr_available_fan_modes.attr,
-	&dev_attr_fan_mode.attr,
-	&dev_attr_fw_version.attr,
-	&dev_attr_fw_release_date.attr,
-	NULL
+	return 0;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0))
+static DEFINE_SIMPLE_DEV_PM_OPS(msi_platform_pm, NULL, msi_platform_resume);
+#else
+static SIMPLE_DEV_PM_OPS(msi_platform_pm, NULL, msi_platform_resume);
+#endif
+
+static struct platform_device *msi_platform_device;
+
+static struct platform_driver msi_platform_driver = {
+	.driver = {
+		.name = MSI_EC_DRIVER_NAME,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0))
+		.pm = pm_sleep_ptr(&msi_platform_pm),
+#else
+		.pm = &msi_platform_pm,
+#endif
+	},
+	.probe = msi_platform_probe,
+	.remove = msi_platform_remove,
 };
 
 // ============================================================ //
-// Sysfs platform device attributes (cpu)
+// Sysfs leds subsystem
 // ============================================================ //
 
-static ssize_t cpu_realtime_temperature_show(struct device *device,
-					     struct device_attribute *attr,
-					     char *buf)
+static int micmute_led_sysfs_set(struct led_classdev *led_cdev,
+				 enum led_brightness brightness)
 {
-	u8 rdata;
 	int result;
 
-	result = ec_read(conf.cpu.rt_temp_address, &rdata);
+	result = ec_update_by_mask(conf.leds.micmute_led_address,
+				   BIT(conf.leds.bit),
+				   brightness ? BIT(conf.leds.bit) : 0);
+
 	if (result < 0)
 		return result;
 
-	return sysfs_emit(buf, "%i\n", rdata);
+	return 0;
 }
 
-static ssize_t cpu_realtime_fan_speed_show(struct device *device,
-					   struct device_attribute *attr,
-					   char *buf)
+static int mute_led_sysfs_set(struct led_classdev *led_cdev,
+			      enum led_brightness brightness)
 {
-	u8 rdata;
 	int result;
 
-	result = ec_read(conf.cpu.rt_fan_speed_address, &rdata);
+	result = ec_update_by_mask(conf.leds.mute_led_address,
+				   BIT(conf.leds.bit),
+				   brightness ? BIT(conf.leds.bit) : 0);
+
 	if (result < 0)
 		return result;
 
-	if ((rdata < conf.cpu.rt_fan_speed_base_min ||
-	    rdata > conf.cpu.rt_fan_speed_base_max))
-		return -EINVAL;
-
-	return sysfs_emit(buf, "%i\n",
-		          100 * (rdata - conf.cpu.rt_fan_speed_base_min) /
-				  (conf.cpu.rt_fan_speed_base_max -
-				   conf.cpu.rt_fan_speed_base_min));
+	return 0;
 }
 
-static ssize_t cpu_basic_fan_speed_show(struct device *device,
-					struct device_attribute *attr,
-					char *buf)
+static enum led_brightness kbd_bl_sysfs_get(struct led_classdev *led_cdev)
 {
 	u8 rdata;
-	int result;
-
-	result = ec_read(conf.cpu.bs_fan_speed_address, &rdata);
+	int result = msi_ec_read(conf.kbd_bl.bl_state_address, &rdata);
 	if (result < 0)
-		return result;
-
-	if (rdata < conf.cpu.bs_fan_speed_base_min ||
-	    rdata > conf.cpu.bs_fan_speed_base_max)
-		return -EINVAL;
+		return 0;
 
-	return sysfs_emit(buf, "%i\n",
-		          100 * (rdata - conf.cpu.bs_fan_speed_base_min) /
-				  (conf.cpu.bs_fan_speed_base_max -
-				   conf.cpu.bs_fan_speed_base_min));
+	result = msi_ec_enum_decode(&kbd_bl_enum, rdata);
+	return result < 0 ? 0 : result;
 }
 
-static ssize_t cpu_basic_fan_speed_store(struct device *dev,
-					 struct device_attribute *attr,
-					 const char *buf, size_t count)
+static int kbd_bl_sysfs_set(struct led_classdev *led_cdev,
+			    enum led_brightness brightness)
 {
-	u8 wdata;
-	int result;
-
-	result = kstrtou8(buf, 10, &wdata);
-	if (result < 0)
-		return result;
-
-	if (wdata > 100)
-		return -EINVAL;
-
-	result = ec_write(conf.cpu.bs_fan_speed_address,
-			  (wdata * (conf.cpu.bs_fan_speed_base_max -
-				    conf.cpu.bs_fan_speed_base_min) +
-			   100 * conf.cpu.bs_fan_speed_base_min) /
-				  100);
-	if (result < 0)
-		return result;
+	// By default, on an unregister event, 
+	// kernel triggers the setter with 0 brightness.
+	if (led_cdev->flags & LED_UNREGISTERING) 
+		return 0;
 
-	return count;
+	if (brightness < 0 || brightness >= kbd_bl_enum.count)
+		return -1;
+	return ec_update_by_mask(conf.kbd_bl.bl_state_address, 0xff,
+				 kbd_bl_enum.values[brightness]);
 }
 
-static struct device_attribute dev_attr_cpu_realtime_temperature = {
-	.attr = {
-		.name = "realtime_temperature",
-		.mode = 0444,
-	},
-	.show = cpu_realtime_temperature_show,
-};
-
-static struct device_attribute dev_attr_cpu_realtime_fan_speed = {
-	.attr = {
-		.name = "realtime_fan_speed",
-		.mode = 0444,
-	},
-	.show = cpu_realtime_fan_speed_show,
+static struct led_classdev micmute_led_cdev = {
+	.name = "platform::micmute",
+	.max_brightness = 1,
+	.brightness_set_blocking = &micmute_led_sysfs_set,
+	.default_trigger = "audio-micmute",
 };
 
-static struct device_attribute dev_attr_cpu_basic_fan_speed = {
-	.attr = {
-		.name = "basic_fan_speed",
-		.mode = 0644,
-	},
-	.show = cpu_basic_fan_speed_show,
-	.store = cpu_basic_fan_speed_store,
+static struct led_classdev mute_led_cdev = {
+	.name = "platform::mute",
+	.max_brightness = 1,
+	.brightness_set_blocking = &mute_led_sysfs_set,
+	.default_trigger = "audio-mute",
 };
 
-static struct attribute *msi_cpu_attrs[] = {
-	&dev_attr_cpu_realtime_temperature.attr,
-	&dev_attr_cpu_realtime_fan_speed.attr,
-	&dev_attr_cpu_basic_fan_speed.attr,
-	NULL
+static struct led_classdev msiacpi_led_kbdlight = {
+	.name = "msiacpi::kbd_backlight",
+	.max_brightness = 3,
+	.flags = LED_BRIGHT_HW_CHANGED,
+	.brightness_set_blocking = &kbd_bl_sysfs_set,
+	.brightness_get = &kbd_bl_sysfs_get,
 };
 
 // ============================================================ //
-// Sysfs platform device attributes (gpu)
+// EC events
 // ============================================================ //
 
-static ssize_t gpu_realtime_temperature_show(struct device *device,
-					     struct device_attribute *attr,
-					     char *buf)
-{
-	u8 rdata;
-	int result;
+/*
+ * Hotkeys handled by the EC firmware (keyboard backlight, cooler boost,
+ * shift mode, webcam...) change the registers behind our attributes and
+ * raise an EC query event, which the firmware's _Qxx method passes on as
+ * a WMI event. We listen to the WMI events, then compare a fresh snapshot
+ * against the previous one and report what changed: LED brightness
+ * changes, sysfs_notify() for poll()ing readers, platform profile changes
+ * and key events.
+ *
+ * The EC query handlers themselves belong to the ACPI EC driver and are
+ * not available to modules, so a change the firmware doesn't pass on
+ * through WMI goes unnoticed.
+ */
 
-	result = ec_read(conf.gpu.rt_temp_address, &rdata);
-	if (result < 0)
-		return result;
+static bool ec_events = true;
+module_param(ec_events, bool, 0);
+MODULE_PARM_DESC(ec_events, "Listen to WMI events to report changes made by hotkeys");
 
-	return sysfs_emit(buf, "%i\n", rdata);
-}
+static char *wmi_events[4];
+static int nr_wmi_events;
+module_param_array(wmi_events, charp, &nr_wmi_events, 0);
+MODULE_PARM_DESC(wmi_events, "WMI event GUIDs to listen to in addition to the MSI ones");
 
-static ssize_t gpu_realtime_fan_speed_show(struct device *device,
-					   struct device_attribute *attr,
-					   char *buf)
-{
-	u8 rdata;
-	int result;
+// event GUIDs of the MSI firmwares, the ones msi-wmi listens to as well
+static const char *const msi_ec_wmi_guids[] = {
+	"B6F3EEF2-3D2F-49DC-9DE3-85BCE18C62F2",
+	"5B3CC38A-40D9-7245-8AE6-1145B751BE3F",
+};
 
-	result = ec_read(conf.gpu.rt_fan_speed_address, &rdata);
-	if (result < 0)
-		return result;
+// GUIDs with our notify handler installed
+static const char *wmi_hooked[ARRAY_SIZE(msi_ec_wmi_guids) +
+			      ARRAY_SIZE(wmi_events)];
+static int nr_wmi_hooked;
 
-	return sysfs_emit(buf, "%i\n", rdata);
-}
+static struct input_dev *msi_ec_input;
 
-static struct device_attribute dev_attr_gpu_realtime_temperature = {
-	.attr = {
-		.name = "realtime_temperature",
-		.mode = 0444,
-	},
-	.show = gpu_realtime_temperature_show,
-};
+// last snapshot seen by the event work, refreshed on every event
+static struct msi_ec_snapshot event_snapshot;
+static bool event_snapshot_valid = false;
 
-static struct device_attribute dev_attr_gpu_realtime_fan_speed = {
-	.attr = {
-		.name = "realtime_fan_speed",
-		.mode = 0444,
-	},
-	.show = gpu_realtime_fan_speed_show,
+struct msi_ec_event_key {
+	enum msi_ec_state_field field;
+	unsigned int on;  // key for a value != 0, or any change
+	unsigned int off; // key for 0, or 0 to use on
 };
 
-static struct attribute *msi_gpu_attrs[] = {
-	&dev_attr_gpu_realtime_temperature.attr,
-	&dev_attr_gpu_realtime_fan_speed.attr,
-	NULL
+static const struct msi_ec_event_key msi_ec_event_keys[] = {
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0))
+	{ MSI_EC_STATE_WEBCAM, KEY_CAMERA_ACCESS_ENABLE,
+	  KEY_CAMERA_ACCESS_DISABLE },
+#endif
+	{ MSI_EC_STATE_COOLER_BOOST, KEY_PROG1, 0 },
+	{ MSI_EC_STATE_SHIFT_MODE, KEY_PROG2, 0 },
 };
 
-// ============================================================ //
-// Sysfs platform device attributes (debug)
-// ============================================================ //
-
-// Prints an EC memory dump in form of a table
-static ssize_t ec_dump_show(struct device *device,
-			    struct device_attribute *attr,
-			    char *buf)
+static void msi_ec_event_key(enum msi_ec_state_field id, s32 value)
 {
-	int count = 0;
+	if (!msi_ec_input)
+		return;
 
-	// print header
-	count += sysfs_emit(
-		buf,
-		"     | _0 _1 _2 _3 _4 _5 _6 _7 _8 _9 _a _b _c _d _e _f\n"
-		"-----+------------------------------------------------\n");
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_event_keys); i++) {
+		const struct msi_ec_event_key *key = &msi_ec_event_keys[i];
+		unsigned int code;
 
-	// print dump
-	for (u8 i = 0x0; i <= 0xf; i++) {
-		u8 addr_base = i * 16;
+		if (key->field != id)
+			continue;
 
-		count += sysfs_emit_at(buf, count, "%#x_ |", i);
-		for (u8 j = 0x0; j <= 0xf; j++) {
-			u8 rdata;
-			int result = ec_read(addr_base + j, &rdata);
-			if (result < 0)
-				return result;
+		code = (value || !key->off) ? key->on : key->off;
+		input_report_key(msi_ec_input, code, 1);
+		input_sync(msi_ec_input);
+		input_report_key(msi_ec_input, code, 0);
+		input_sync(msi_ec_input);
+	}
+}
 
-			count += sysfs_emit_at(buf, count, " %02x", rdata);
-		}
+static void msi_ec_event_field(enum msi_ec_state_field id, u8 raw)
+{
+	const struct msi_ec_field *field = &msi_ec_fields[id];
+	char dir[8], *name;
+	s32 value = 0;
+
+	field->decode(field, raw, &value);
+
+	switch (id) {
+	case MSI_EC_STATE_KBD_BL:
+		led_classdev_notify_brightness_hw_changed(&msiacpi_led_kbdlight,
+							  value);
+		return;
+	case MSI_EC_STATE_SHIFT_MODE:
+	case MSI_EC_STATE_FAN_MODE:
+	case MSI_EC_STATE_SUPER_BATTERY:
+		msi_ec_profile_notify();
+		break;
+	default:
+		break;
+	}
 
-		count += sysfs_emit_at(buf, count, "\n");
+	// field names double as attribute paths, e.g. "cpu/basic_fan_speed"
+	name = strchr(field->name, '/');
+	if (name) {
+		strscpy(dir, field->name, min_t(size_t, sizeof(dir),
+						name - field->name + 1));
+		sysfs_notify(&msi_platform_device->dev.kobj, dir, name + 1);
+	} else if (field->encode) {
+		sysfs_notify(&msi_platform_device->dev.kobj, NULL, field->name);
 	}
 
-	return count;
+	msi_ec_event_key(id, value);
 }
 
-// stores a value in the specified EC memory address. Format: "xx=xx", xx - hex u8
-static ssize_t ec_set_store(struct device *dev, struct device_attribute *attr,
-			    const char *buf, size_t count)
+static void msi_ec_event_fn(struct work_struct *work)
 {
-	if (count > 6) // "xx=xx\n" - 6 chars
-		return -EINVAL;
+	struct msi_ec_snapshot snap;
 
-	int result;
+	// a reverted setting is not a change worth reporting
+	if (READ_ONCE(enforce))
+		msi_ec_enforce();
 
-	char addr_s[3], val_s[3];
-	result = sscanf(buf, "%2s=%2s", addr_s, val_s);
-	if (result != 2)
-		return -EINVAL;
+	if (msi_ec_snapshot_read(&snap, false) < 0)
+		return;
 
-	u8 addr, val;
+	for (int i = 0; event_snapshot_valid && i < MSI_EC_STATE_NR_FIELDS;
+	     i++) {
+		const struct msi_ec_field *field = &msi_ec_fields[i];
+		u8 addr = *field->address;
+		u8 mask = msi_ec_field_mask(field);
 
-	// convert addr
-	result = kstrtou8(addr_s, 16, &addr);
-	if (result < 0)
-		return result;
+		// only settings, not sensors that change all the time
+		if (!msi_ec_has(field->cap) ||
+		    (!field->encode && !(field->flags & MSI_EC_FIELD_LED)))
+			continue;
 
-	// convert val
-	result = kstrtou8(val_s, 16, &val);
-	if (result < 0)
-		return result;
+		if ((event_snapshot.regs[addr] ^ snap.regs[addr]) & mask)
+			msi_ec_event_field(i, snap.regs[addr]);
+	}
 
-	// write val to EC[addr]
-	result = ec_write(addr, val);
-	if (result < 0)
-		return result;
+	event_snapshot = snap;
+	event_snapshot_valid = true;
+}
 
-	return count;
+static DECLARE_WORK(msi_ec_event_work, msi_ec_event_fn);
+
+#if IS_ENABLED(CONFIG_ACPI_WMI)
+
+// the event data is not needed, the snapshot tells what changed
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0))
+static void msi_ec_wmi_notify(union acpi_object *data, void *context)
+#else
+static void msi_ec_wmi_notify(u32 value, void *context)
+#endif
+{
+	schedule_work(&msi_ec_event_work);
 }
 
-// ec_get. stores the specified EC memory address. MAY BE UNSAFE!!!
-static u8 ec_get_addr;
+static bool msi_ec_wmi_has(const char *guid)
+{
+	return wmi_has_guid(guid);
+}
 
-// ec_get. reads and stores the specified EC memory address. Format: "xx", xx - hex u8
-static ssize_t ec_get_store(struct device *dev, struct device_attribute *attr,
-			    const char *buf, size_t count)
+static int msi_ec_wmi_install(const char *guid)
 {
-	if (count > 3) // "xx\n" - 3 chars
-		return -EINVAL;
+	acpi_status status;
+
+	status = wmi_install_notify_handler(guid, msi_ec_wmi_notify, NULL);
+	if (status == AE_ALREADY_ACQUIRED)
+		return -EBUSY;
+
+	return ACPI_FAILURE(status) ? -EIO : 0;
+}
+
+static void msi_ec_wmi_remove(const char *guid)
+{
+	wmi_remove_notify_handler(guid);
+}
+
+#else // CONFIG_ACPI_WMI
+
+static bool msi_ec_wmi_has(const char *guid) { return false; }
+static int msi_ec_wmi_install(const char *guid) { return -ENODEV; }
+static void msi_ec_wmi_remove(const char *guid) {}
+
+#endif // CONFIG_ACPI_WMI
+
+static bool msi_ec_wmi_events(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_wmi_guids); i++) {
+		if (msi_ec_wmi_has(msi_ec_wmi_guids[i]))
+			return true;
+	}
+
+	for (int i = 0; i < nr_wmi_events; i++) {
+		if (msi_ec_wmi_has(wmi_events[i]))
+			return true;
+	}
 
+	return false;
+}
+
+static void msi_ec_hook_event(const char *guid)
+{
 	int result;
-	char addr_s[3];
 
-	result = sscanf(buf, "%2s", addr_s);
-	if (result != 1)
-		return -EINVAL;
+	for (int i = 0; i < nr_wmi_hooked; i++) {
+		if (!strcasecmp(wmi_hooked[i], guid))
+			return;
+	}
 
-	// convert addr
-	result = kstrtou8(addr_s, 16, &ec_get_addr);
-	if (result < 0)
-		return result;
+	if (!msi_ec_wmi_has(guid))
+		return;
 
-	return count;
-};
+	// fails with -EBUSY while msi-wmi listens to the same events
+	result = msi_ec_wmi_install(guid);
+	if (result < 0) {
+		pr_warn("failed to listen to WMI event %s: %d\n", guid, result);
+		return;
+	}
 
-// ec_get. prints value of previously stored EC memory address
-static ssize_t ec_get_show(struct device *device,
-			   struct device_attribute *attr,
-			   char *buf)
+	wmi_hooked[nr_wmi_hooked++] = guid;
+}
+
+static int msi_ec_input_init(void)
 {
-	u8 rdata;
 	int result;
-	
-	result = ec_read(ec_get_addr, &rdata);
-	if (result < 0)
-		return result;
 
-	//	return sysfs_emit(buf, "%02x=%02x\n", ec_get_addr, rdata);
-	return sysfs_emit(buf, "%02x\n", rdata);
-};
+	msi_ec_input = input_allocate_device();
+	if (!msi_ec_input)
+		return -ENOMEM;
 
-static DEVICE_ATTR_RO(ec_dump);
-static DEVICE_ATTR_WO(ec_set);
-static DEVICE_ATTR_RW(ec_get);
+	msi_ec_input->name = "MSI EC hotkeys";
+	msi_ec_input->phys = MSI_EC_DRIVER_NAME "/input0";
+	msi_ec_input->id.bustype = BUS_HOST;
+	msi_ec_input->dev.parent = &msi_platform_device->dev;
+
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_event_keys); i++) {
+		input_set_capability(msi_ec_input, EV_KEY,
+				     msi_ec_event_keys[i].on);
+		if (msi_ec_event_keys[i].off)
+			input_set_capability(msi_ec_input, EV_KEY,
+					     msi_ec_event_keys[i].off);
+	}
 
-static struct attribute *msi_debug_attrs[] = {
-	&dev_attr_fw_version.attr,
-	&dev_attr_ec_dump.attr,
-	&dev_attr_ec_set.attr,
-	&dev_attr_ec_get.attr,
-	NULL
-};
+	result = input_register_device(msi_ec_input);
+	if (result < 0) {
+		input_free_device(msi_ec_input);
+		msi_ec_input = NULL;
+	}
 
-// ============================================================ //
-// Sysfs platform driver
-// ============================================================ //
+	return result;
+}
 
-static umode_t msi_ec_is_visible(struct kobject *kobj,
-				   struct attribute *attr,
-				   int idx)
+static void msi_ec_events_init(void)
 {
-	int address;
+	int result;
 
-	/* root group */
-	if (attr == &dev_attr_webcam.attr)
-		address = conf.webcam.address;
+	// an emulated EC raises no events
+	if (!ec_events || emulate || !msi_ec_wmi_events())
+		return;
 
-	else if (attr == &dev_attr_webcam_block.attr)
-		address = conf.webcam.block_address;
+	result = msi_ec_input_init();
+	if (result < 0)
+		pr_warn("failed to register the input device: %d\n", result);
 
-	else if (attr == &dev_attr_fn_key.attr ||
-		 attr == &dev_attr_win_key.attr)
-		address = conf.fn_win_swap.address;
+	// the baseline every later event is compared against
+	schedule_work(&msi_ec_event_work);
 
-	else if (attr == &dev_attr_battery_mode.attr)
-		address = conf.charge_control.address;
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_wmi_guids); i++)
+		msi_ec_hook_event(msi_ec_wmi_guids[i]);
+	for (int i = 0; i < nr_wmi_events; i++)
+		msi_ec_hook_event(wmi_events[i]);
+}
 
-	else if (attr == &dev_attr_cooler_boost.attr)
-		address = conf.cooler_boost.address;
+static void msi_ec_events_exit(void)
+{
+	for (int i = 0; i < nr_wmi_hooked; i++)
+		msi_ec_wmi_remove(wmi_hooked[i]);
+	nr_wmi_hooked = 0;
 
-	else if (attr == &dev_attr_available_shift_modes.attr ||
-		 attr == &dev_attr_shift_mode.attr)
-		address = conf.shift_mode.address;
+	cancel_work_sync(&msi_ec_event_work);
 
-	else if (attr == &dev_attr_super_battery.attr)
-		address = conf.super_battery.address;
+	if (msi_ec_input) {
+		input_unregister_device(msi_ec_input);
+		msi_ec_input = NULL;
+	}
+}
 
-	else if (attr == &dev_attr_available_fan_modes.attr ||
-		 attr == &dev_attr_fan_mode.attr)
-		address = conf.fan_mode.address;
+// ============================================================ //
+// Character device
+// ============================================================ //
 
-	/* cpu group */
-	else if (attr == &dev_attr_cpu_realtime_temperature.attr)
-		address = conf.cpu.rt_temp_address;
+/*
+ * /dev/msi-ec runs batches of register reads and writes in a single
+ * ioctl, see msi_ec_uapi.h. Access mirrors the sysfs interface and is
+ * computed from the configuration when it is loaded.
+ */
 
-	else if (attr == &dev_attr_cpu_realtime_fan_speed.attr)
-		address = conf.cpu.rt_fan_speed_address;
+static DECLARE_BITMAP(io_readable, 256);
+static u8 io_writable[256];   // writable bits of every register
+static s8 io_owner[256];      // field validating full-byte writes, or -1
+static bool msi_ec_dev_registered = false;
 
-	else if (attr == &dev_attr_cpu_basic_fan_speed.attr)
-		address = conf.cpu.bs_fan_speed_address;
+static void __init msi_ec_build_io_access(void)
+{
+	bitmap_copy(io_readable, snapshot_regs, 256);
+	bitmap_set(io_readable, MSI_EC_FW_VERSION_ADDRESS,
+		   MSI_EC_FW_VERSION_LENGTH);
+	bitmap_set(io_readable, MSI_EC_FW_DATE_ADDRESS, MSI_EC_FW_DATE_LENGTH);
+	bitmap_set(io_readable, MSI_EC_FW_TIME_ADDRESS, MSI_EC_FW_TIME_LENGTH);
+
+	memset(io_owner, -1, sizeof(io_owner));
+
+	// charge thresholds come after battery_mode and check the full range
+	for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+		const struct msi_ec_field *field = &msi_ec_fields[i];
+		u8 mask;
+
+		if (!msi_ec_has(field->cap))
+			continue;
+		if (!field->encode && !(field->flags & MSI_EC_FIELD_LED))
+			continue;
+
+		mask = msi_ec_field_mask(field);
+		io_writable[*field->address] |= mask;
+		if (mask == 0xff)
+			io_owner[*field->address] = i;
+	}
+}
 
-	/* gpu group */
-	else if (attr == &dev_attr_gpu_realtime_temperature.attr)
-		address = conf.gpu.rt_temp_address;
+// whether the field owning addr would accept wdata through sysfs
+static bool msi_ec_io_value_ok(u8 addr, u8 wdata)
+{
+	const struct msi_ec_field *field;
+	int id = io_owner[addr];
 
-	else if (attr == &dev_attr_gpu_realtime_fan_speed.attr)
-		address = conf.gpu.rt_fan_speed_address;
+	if (debug || id < 0)
+		return true;
 
-	/* default */
-	else
-		return attr->mode;
+	field = &msi_ec_fields[id];
+	if (field->values) {
+		int idx = msi_ec_enum_decode(field->values, wdata);
+
+		return idx >= 0 && idx < field->values->count;
+	}
 
-	return address == MSI_EC_ADDR_UNSUPP ? 0 : attr->mode;
+	switch (id) {
+	case MSI_EC_STATE_CHARGE_START:
+	case MSI_EC_STATE_CHARGE_END:
+		return wdata >= conf.charge_control.range_min &&
+		       wdata <= conf.charge_control.range_max;
+	case MSI_EC_STATE_CPU_BS_FAN_SPEED:
+		return wdata >= conf.cpu.bs_fan_speed_base_min &&
+		       wdata <= conf.cpu.bs_fan_speed_base_max;
+	default:
+		return true;
+	}
 }
 
-static struct attribute_group msi_root_group = {
-	.is_visible = msi_ec_is_visible,
-	.attrs = msi_root_attrs,
-};
+// runs one entry of a batch, ec_lock must be held
+static int msi_ec_dev_io(struct msi_ec_io *io, bool may_write)
+{
+	u8 stored = 0;
+	u8 wdata;
+	int result;
 
-static struct attribute_group msi_cpu_group = {
-	.name = "cpu",
-	.is_visible = msi_ec_is_visible,
-	.attrs = msi_cpu_attrs,
-};
-static struct attribute_group msi_gpu_group = {
-	.name = "gpu",
-	.is_visible = msi_ec_is_visible,
-	.attrs = msi_gpu_attrs,
-};
+	switch (io->op) {
+	case MSI_EC_IO_READ:
+		if (!debug && !test_bit(io->addr, io_readable))
+			return -EACCES;
 
-static const struct attribute_group msi_debug_group = {
-	.name = "debug",
-	.attrs = msi_debug_attrs,
-};
+		// the node is world readable, batches are throttled like sysfs
+		result = msi_ec_read_cached(io->addr, &stored,
+					    msi_ec_throttle(MSI_EC_THROTTLE_DEV));
+		if (result < 0)
+			return result;
 
-/* the debug group is created separately if needed */
-static const struct attribute_group *msi_platform_groups[] = {
-	&msi_root_group,
-	&msi_cpu_group,
-	&msi_gpu_group,
-	NULL
-};
+		io->value = stored & io->mask;
+		return 0;
 
-static int msi_platform_probe(struct platform_device *pdev)
-{
-	if (debug) {
-		int result = sysfs_create_group(&pdev->dev.kobj,
-						&msi_debug_group);
+	case MSI_EC_IO_WRITE:
+		if (!may_write)
+			return -EACCES;
+		if (!debug && (io->mask & ~io_writable[io->addr]))
+			return -EACCES;
+
+		if (io->mask != 0xff) {
+			result = msi_ec_read_direct(io->addr, &stored);
+			if (result < 0)
+				return result;
+		}
+
+		wdata = (stored & ~io->mask) | (io->value & io->mask);
+		if (!msi_ec_io_value_ok(io->addr, wdata))
+			return -EINVAL;
+
+		result = msi_ec_write(io->addr, wdata);
 		if (result < 0)
 			return result;
-	}
 
-	if (!conf_loaded) // an unsupported device loaded in debug mode
+		ec_journal_record(io->addr, io->mask, io->value);
 		return 0;
 
-	return sysfs_create_groups(&pdev->dev.kobj, msi_platform_groups);
+	default:
+		return -EINVAL;
+	}
 }
 
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0))
-static void msi_platform_remove(struct platform_device *pdev)
-#else
-static int msi_platform_remove(struct platform_device *pdev)
-#endif
+static long msi_ec_dev_batch(struct file *file, void __user *argp)
 {
-	if (debug)
-		sysfs_remove_group(&pdev->dev.kobj, &msi_debug_group);
+	struct msi_ec_io_batch batch;
+	struct msi_ec_io *ios;
+	bool may_write = file->f_mode & FMODE_WRITE;
+	ktime_t start = ktime_get();
+	long result = 0;
 
-	if (conf_loaded)
-		sysfs_remove_groups(&pdev->dev.kobj, msi_platform_groups);
+	if (copy_from_user(&batch, argp, sizeof(batch)))
+		return -EFAULT;
 
-#if (LINUX_VERSION_CODE < KERNEL_VERSION(6, 11, 0))
-	return 0;
-#endif
-}
+	if (batch.flags || batch.count > MSI_EC_IO_MAX)
+		return -EINVAL;
 
-static struct platform_device *msi_platform_device;
+	if (!batch.count)
+		return 0;
 
-static struct platform_driver msi_platform_driver = {
-	.driver = {
-		.name = MSI_EC_DRIVER_NAME,
-	},
-	.probe = msi_platform_probe,
-	.remove = msi_platform_remove,
-};
+	ios = memdup_user(u64_to_user_ptr(batch.ios),
+			  array_size(batch.count, sizeof(*ios)));
+	if (IS_ERR(ios))
+		return PTR_ERR(ios);
 
-// ============================================================ //
-// Sysfs leds subsystem
-// ============================================================ //
+	mutex_lock(&ec_lock);
+	for (u32 i = 0; i < batch.count; i++)
+		ios[i].result = msi_ec_dev_io(&ios[i], may_write);
+	mutex_unlock(&ec_lock);
+	msi_ec_account(MSI_EC_THROTTLE_DEV, start);
 
-static int micmute_led_sysfs_set(struct led_classdev *led_cdev,
-				 enum led_brightness brightness)
+	if (copy_to_user(u64_to_user_ptr(batch.ios), ios,
+			 array_size(batch.count, sizeof(*ios))))
+		result = -EFAULT;
+
+	kfree(ios);
+	return result;
+}
+
+static long msi_ec_dev_state(void __user *argp)
 {
+	struct msi_ec_snapshot snap;
+	struct msi_ec_state state;
+	ktime_t start = ktime_get();
 	int result;
 
-	result = ec_set_bit(conf.leds.micmute_led_address, conf.leds.bit, brightness);
+	if (!conf_loaded)
+		return -ENODEV;
 
+	// a snapshot costs one token, like reading the state attribute
+	result = msi_ec_snapshot_read(&snap,
+				      msi_ec_throttle(MSI_EC_THROTTLE_DEV));
+	msi_ec_account(MSI_EC_THROTTLE_DEV, start);
 	if (result < 0)
 		return result;
 
+	msi_ec_snapshot_decode(&snap, &state);
+
+	if (copy_to_user(argp, &state, sizeof(state)))
+		return -EFAULT;
+
 	return 0;
 }
 
-static int mute_led_sysfs_set(struct led_classdev *led_cdev,
-			      enum led_brightness brightness)
+static long msi_ec_dev_ioctl(struct file *file, unsigned int cmd,
+			     unsigned long arg)
 {
-	int result;
+	void __user *argp = (void __user *)arg;
+
+	switch (cmd) {
+	case MSI_EC_IOC_BATCH:
+		return msi_ec_dev_batch(file, argp);
+	case MSI_EC_IOC_STATE:
+		return msi_ec_dev_state(argp);
+	default:
+		return -ENOTTY;
+	}
+}
 
-	result = ec_set_bit(conf.leds.mute_led_address, conf.leds.bit, brightness);
+static const struct file_operations msi_ec_dev_fops = {
+	.owner = THIS_MODULE,
+	.unlocked_ioctl = msi_ec_dev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = noop_llseek,
+};
 
-	if (result < 0)
-		return result;
+// writes need the node opened for writing, which is root only like sysfs
+static struct miscdevice msi_ec_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = MSI_EC_DRIVER_NAME,
+	.fops = &msi_ec_dev_fops,
+	.mode = 0644,
+};
 
-	return 0;
-}
+// ============================================================ //
+// Debugfs
+// ============================================================ //
 
-static enum led_brightness kbd_bl_sysfs_get(struct led_classdev *led_cdev)
+#define MSI_EC_ACCT_TOP 20
+
+struct msi_ec_acct_row {
+	struct msi_ec_acct acct;
+	u32 accesses; // over the window
+	u32 ec_us;
+};
+
+static int msi_ec_acct_row_cmp(const void *a, const void *b)
 {
-	u8 rdata;
-	int result = ec_read(conf.kbd_bl.bl_state_address, &rdata);
-	if (result < 0)
-		return 0;
-	return rdata & MSI_EC_KBD_BL_STATE_MASK;
+	const struct msi_ec_acct_row *ra = a, *rb = b;
+
+	if (ra->accesses != rb->accesses)
+		return ra->accesses < rb->accesses ? 1 : -1;
+	if (ra->ec_us != rb->ec_us)
+		return ra->ec_us < rb->ec_us ? 1 : -1;
+	return 0;
 }
 
-static int kbd_bl_sysfs_set(struct led_classdev *led_cdev,
-			    enum led_brightness brightness)
+// the processes accessing attributes the most over the last window
+static int top_show(struct seq_file *m, void *v)
 {
-	// By default, on an unregister event, 
-	// kernel triggers the setter with 0 brightness.
-	if (led_cdev->flags & LED_UNREGISTERING) 
-		return 0;
+	struct msi_ec_acct_row *rows;
+	time64_t now = ktime_get_seconds();
+	u64 evictions;
+	int nr_rows = 0;
+
+	rows = kmalloc_array(ARRAY_SIZE(msi_ec_accts), sizeof(*rows),
+			     GFP_KERNEL);
+	if (!rows)
+		return -ENOMEM;
 
-	u8 wdata;
-	if (brightness < 0 || brightness > 3)
-		return -1;
-	wdata = conf.kbd_bl.state_base_value | brightness;
-	return ec_write(conf.kbd_bl.bl_state_address, wdata);
+	spin_lock(&msi_ec_acct_lock);
+	for (int i = 0; i < ARRAY_SIZE(msi_ec_accts); i++) {
+		const struct msi_ec_acct *acct = &msi_ec_accts[i];
+		struct msi_ec_acct_row *row = &rows[nr_rows];
+
+		if (!acct->used || now - acct->last >= MSI_EC_ACCT_WINDOW)
+			continue;
+
+		row->acct = *acct;
+		row->accesses = 0;
+		row->ec_us = 0;
+		// slots older than the window weren't cleared yet
+		for (time64_t t = max_t(time64_t, now - MSI_EC_ACCT_WINDOW + 1, 0);
+		     t <= acct->last; t++) {
+			row->accesses += acct->accesses[t % MSI_EC_ACCT_WINDOW];
+			row->ec_us += acct->ec_us[t % MSI_EC_ACCT_WINDOW];
+		}
+		nr_rows++;
+	}
+	evictions = msi_ec_acct_evictions;
+	spin_unlock(&msi_ec_acct_lock);
+
+	sort(rows, nr_rows, sizeof(*rows), msi_ec_acct_row_cmp, NULL);
+
+	seq_printf(m, "window=%ds evictions=%llu\n", MSI_EC_ACCT_WINDOW,
+		   evictions);
+	seq_printf(m, "%7s %-16s %-32s %9s %9s %10s %12s\n", "pid", "comm",
+		   "attribute", "acc/s", "ec_ms/s", "total", "total_ec_ms");
+
+	for (int i = 0; i < min(nr_rows, MSI_EC_ACCT_TOP); i++) {
+		const struct msi_ec_acct_row *row = &rows[i];
+
+		seq_printf(m, "%7d %-16s %-32s %5u.%03u %5u.%03u %10llu %12llu\n",
+			   row->acct.tgid, row->acct.comm,
+			   msi_ec_throttle_key_name(row->acct.key),
+			   row->accesses / MSI_EC_ACCT_WINDOW,
+			   row->accesses * 1000 / MSI_EC_ACCT_WINDOW % 1000,
+			   row->ec_us / 1000 / MSI_EC_ACCT_WINDOW,
+			   row->ec_us / MSI_EC_ACCT_WINDOW % 1000,
+			   row->acct.total_accesses,
+			   div_u64(row->acct.total_ec_us, 1000));
+	}
+
+	kfree(rows);
+	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(top);
 
-static struct led_classdev micmute_led_cdev = {
-	.name = "platform::micmute",
-	.max_brightness = 1,
-	.brightness_set_blocking = &micmute_led_sysfs_set,
-	.default_trigger = "audio-micmute",
-};
+static struct dentry *msi_ec_debugfs;
 
-static struct led_classdev mute_led_cdev = {
-	.name = "platform::mute",
-	.max_brightness = 1,
-	.brightness_set_blocking = &mute_led_sysfs_set,
-	.default_trigger = "audio-mute",
-};
+// debugfs failures are not fatal and need no checks
+static void msi_ec_debugfs_init(void)
+{
+	msi_ec_debugfs = debugfs_create_dir(MSI_EC_DRIVER_NAME, NULL);
+	debugfs_create_file("top", 0400, msi_ec_debugfs, NULL, &top_fops);
+}
 
-static struct led_classdev msiacpi_led_kbdlight = {
-	.name = "msiacpi::kbd_backlight",
-	.max_brightness = 3,
-	.flags = LED_BRIGHT_HW_CHANGED,
-	.brightness_set_blocking = &kbd_bl_sysfs_set,
-	.brightness_get = &kbd_bl_sysfs_get,
-};
+static void msi_ec_debugfs_exit(void)
+{
+	debugfs_remove_recursive(msi_ec_debugfs);
+}
 
 // ============================================================ //
 // Module load/unload
 // ============================================================ //
 
+static int __init msi_ec_fw_cmp(const void *key, const void *elt)
+{
+	const struct msi_ec_fw_entry *entry = elt;
+
+	return strcmp(key, entry->fw);
+}
+
 // must be called before msi_platform_probe()
 static int __init load_configuration(void)
 {
@@ -4784,13 +5839,30 @@ static int __init load_configuration(void)
 
 	char *ver;
 	char ver_by_ec[MSI_EC_FW_VERSION_LENGTH + 1]; // to store version read from EC
+	const struct msi_ec_fw_entry *entry;
+
+	if (emulate) {
+		if (!firmware) {
+			pr_err("emulate requires the firmware parameter\n");
+			return -EINVAL;
+		}
+
+		// what the EC of that firmware would report
+		memcpy(emulated_ec + MSI_EC_FW_VERSION_ADDRESS, firmware,
+		       strnlen(firmware, MSI_EC_FW_VERSION_LENGTH));
+		memcpy(emulated_ec + MSI_EC_FW_DATE_ADDRESS, "01012024",
+		       MSI_EC_FW_DATE_LENGTH);
+		memcpy(emulated_ec + MSI_EC_FW_TIME_ADDRESS, "00:00:00",
+		       MSI_EC_FW_TIME_LENGTH);
+		pr_info("using an emulated EC\n");
+	}
 
 	if (firmware) {
 		// use fw version passed as a parameter
 		ver = firmware;
 	} else {
 		// get fw version from EC
-		result = ec_get_firmware_version(ver_by_ec);
+		result = ec_get_firmware_version(ver_by_ec, false);
 		if (result < 0) {
 			return result;
 		}
@@ -4799,15 +5871,30 @@ static int __init load_configuration(void)
 	}
 
 	// load the suitable configuration, if exists
-	for (int i = 0; CONFIGURATIONS[i]; i++) {
-		if (match_string(CONFIGURATIONS[i]->allowed_fw, -1, ver) != -EINVAL) {
-			memcpy(&conf,
-			       CONFIGURATIONS[i],
-			       sizeof(struct msi_ec_conf));
-			conf.allowed_fw = NULL;
-			conf_loaded = true;
-			return 0;
-		}
+	entry = bsearch(ver, MSI_EC_FW_INDEX, ARRAY_SIZE(MSI_EC_FW_INDEX),
+			sizeof(MSI_EC_FW_INDEX[0]), msi_ec_fw_cmp);
+#ifdef MSI_EC_MODEL
+	// conf is that of the model even when nothing matches, so the debug
+	// mode can't fall back to an empty configuration here
+	if (!entry || entry->conf != MSI_EC_MODEL_INDEX) {
+		pr_err("Firmware %s is not supported by this single-model build (%s)\n",
+		       ver, __stringify(MSI_EC_MODEL));
+		return -EOPNOTSUPP;
+	}
+#endif
+	if (entry) {
+#ifndef MSI_EC_MODEL
+		memcpy(&conf,
+		       CONFIGURATIONS[entry->conf],
+		       sizeof(struct msi_ec_conf));
+#endif
+		conf_loaded = true;
+		msi_ec_build_enums();
+		msi_ec_build_snapshot_regs();
+		msi_ec_build_residency_map();
+		msi_ec_build_profiles();
+		msi_ec_build_io_access();
+		return 0;
 	}
 
 	// debug mode works regardless of whether the firmware is supported
@@ -4818,17 +5905,73 @@ static int __init load_configuration(void)
 	return -EOPNOTSUPP;
 }
 
+static bool msi_debug_group_created = false;
+
+// registrations nothing else depends on, kept off the init path
+static void msi_ec_late_init_fn(struct work_struct *work)
+{
+	struct device *dev = &msi_platform_device->dev;
+	ktime_t start = ktime_get();
+	int result;
+
+	if (debug) {
+		result = sysfs_create_group(&dev->kobj, &msi_debug_group);
+		if (result < 0)
+			pr_warn("failed to create the debug attributes: %d\n",
+				result);
+		else
+			msi_debug_group_created = true;
+	}
+	msi_ec_debugfs_init();
+	start = msi_ec_init_time(MSI_EC_INIT_DEBUG, start);
+
+	if (conf_loaded) {
+		battery_hook_register(&battery_hook);
+		start = msi_ec_init_time(MSI_EC_INIT_BATTERY, start);
+
+		// register LED classdevs
+		if (msi_ec_has(MSI_EC_CAP_MICMUTE_LED))
+			led_classdev_register(dev, &micmute_led_cdev);
+
+		if (msi_ec_has(MSI_EC_CAP_MUTE_LED))
+			led_classdev_register(dev, &mute_led_cdev);
+
+		if (msi_ec_has(MSI_EC_CAP_KBD_BL))
+			led_classdev_register(dev, &msiacpi_led_kbdlight);
+		start = msi_ec_init_time(MSI_EC_INIT_LEDS, start);
+
+		msi_ec_iio_init(dev);
+		start = msi_ec_init_time(MSI_EC_INIT_IIO, start);
+
+		msi_ec_pmu_init();
+		start = msi_ec_init_time(MSI_EC_INIT_PMU, start);
+
+		msi_ec_events_init();
+		msi_ec_enforce_init();
+		power_source_init();
+		residency_init();
+		msi_ec_init_time(MSI_EC_INIT_EVENTS, start);
+	}
+
+	msi_ec_init_done();
+}
+
+static DECLARE_WORK(msi_ec_late_init_work, msi_ec_late_init_fn);
+
 static int __init msi_ec_init(void)
 {
+	ktime_t start = ktime_get();
 	int result;
 
 	result = load_configuration();
 	if (result < 0)
 		return result;
+	start = msi_ec_init_time(MSI_EC_INIT_CONFIG, start);
 
 	result = platform_driver_register(&msi_platform_driver);
 	if (result < 0)
 		return result;
+	start = msi_ec_init_time(MSI_EC_INIT_DRIVER, start);
 
 	msi_platform_device = platform_device_alloc(MSI_EC_DRIVER_NAME, -1);
 	if (msi_platform_device == NULL) {
@@ -4836,29 +5979,25 @@ static int __init msi_ec_init(void)
 		return -ENOMEM;
 	}
 
+	// the probe is scheduled asynchronously from here
 	result = platform_device_add(msi_platform_device);
 	if (result < 0) {
 		platform_device_del(msi_platform_device);
 		platform_driver_unregister(&msi_platform_driver);
 		return result;
 	}
+	start = msi_ec_init_time(MSI_EC_INIT_DEVICE, start);
 
-	if (conf_loaded) {
-		battery_hook_register(&battery_hook);
-
-		// register LED classdevs
-		if (conf.leds.micmute_led_address != MSI_EC_ADDR_UNSUPP)
-			led_classdev_register(&msi_platform_device->dev,
-					      &micmute_led_cdev);
-
-		if (conf.leds.mute_led_address != MSI_EC_ADDR_UNSUPP)
-			led_classdev_register(&msi_platform_device->dev,
-					      &mute_led_cdev);
+	msi_ec_dev.parent = &msi_platform_device->dev;
+	result = misc_register(&msi_ec_dev);
+	if (result < 0)
+		pr_warn("failed to register /dev/%s: %d\n", msi_ec_dev.name,
+			result);
+	else
+		msi_ec_dev_registered = true;
+	msi_ec_init_time(MSI_EC_INIT_MISC, start);
 
-		if (conf.kbd_bl.bl_state_address != MSI_EC_ADDR_UNSUPP)
-			led_classdev_register(&msi_platform_device->dev,
-					      &msiacpi_led_kbdlight);
-	}
+	schedule_work(&msi_ec_late_init_work);
 
 	pr_info("module_init\n");
 	return 0;
@@ -4866,20 +6005,41 @@ static int __init msi_ec_init(void)
 
 static void __exit msi_ec_exit(void)
 {
+	// everything it registers is unregistered below
+	flush_work(&msi_ec_late_init_work);
+
+	if (conf_loaded) {
+		residency_exit();
+		power_source_exit();
+		msi_ec_enforce_exit();
+		msi_ec_events_exit();
+	}
+
+	if (msi_ec_dev_registered)
+		misc_deregister(&msi_ec_dev);
+
 	if (conf_loaded) {
 		// unregister LED classdevs
-		if (conf.leds.micmute_led_address != MSI_EC_ADDR_UNSUPP)
+		if (msi_ec_has(MSI_EC_CAP_MICMUTE_LED))
 			led_classdev_unregister(&micmute_led_cdev);
 
-		if (conf.leds.mute_led_address != MSI_EC_ADDR_UNSUPP)
+		if (msi_ec_has(MSI_EC_CAP_MUTE_LED))
 			led_classdev_unregister(&mute_led_cdev);
 
-		if (conf.kbd_bl.bl_state_address != MSI_EC_ADDR_UNSUPP)
+		if (msi_ec_has(MSI_EC_CAP_KBD_BL))
 			led_classdev_unregister(&msiacpi_led_kbdlight);
 
+		msi_ec_pmu_exit();
+		msi_ec_iio_exit();
 		battery_hook_unregister(&battery_hook);
 	}
 
+	msi_ec_debugfs_exit();
+
+	if (msi_debug_group_created)
+		sysfs_remove_group(&msi_platform_device->dev.kobj,
+				   &msi_debug_group);
+
 	platform_driver_unregister(&msi_platform_driver);
 	platform_device_del(msi_platform_device);
 
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later WITH Linux-syscall-note */
+/*
+ * msi_ec_uapi.h - Binary interfaces of the MSI Embedded Controller driver
+ * shared with userspace.
+ */
+
+#ifndef __MSI_EC_UAPI__
+#define __MSI_EC_UAPI__
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+// ============================================================ //
+// /sys/devices/platform/msi-ec/state_bin
+// ============================================================ //
+
+#define MSI_EC_STATE_VERSION    1
+#define MSI_EC_STATE_MAX_FIELDS 32
+
+// flags: the EC isn't responding, some values are the last known ones
+#define MSI_EC_STATE_STALE      (1 << 0)
+
+/*
+ * Decoded values:
+ *   on/off and left/right attributes - 1 for "on"/"right", 0 otherwise
+ *   shift_mode, fan_mode, battery_mode - index into the list reported by the
+ *     matching available_* attribute (battery_mode: max, medium, min); a
+ *     shift_mode index past that list means "unspecified"
+ *   temperatures - celsius, fan speeds and thresholds - percent
+ *   LEDs - brightness
+ */
+enum msi_ec_state_field {
+	MSI_EC_STATE_WEBCAM,
+	MSI_EC_STATE_WEBCAM_BLOCK,
+	MSI_EC_STATE_FN_KEY,
+	MSI_EC_STATE_WIN_KEY,
+	MSI_EC_STATE_BATTERY_MODE,
+	MSI_EC_STATE_COOLER_BOOST,
+	MSI_EC_STATE_SHIFT_MODE,
+	MSI_EC_STATE_SUPER_BATTERY,
+	MSI_EC_STATE_FAN_MODE,
+	MSI_EC_STATE_CPU_RT_TEMP,
+	MSI_EC_STATE_CPU_RT_FAN_SPEED,
+	MSI_EC_STATE_CPU_BS_FAN_SPEED,
+	MSI_EC_STATE_GPU_RT_TEMP,
+	MSI_EC_STATE_GPU_RT_FAN_SPEED,
+	MSI_EC_STATE_CHARGE_START,
+	MSI_EC_STATE_CHARGE_END,
+	MSI_EC_STATE_MICMUTE_LED,
+	MSI_EC_STATE_MUTE_LED,
+	MSI_EC_STATE_KBD_BL,
+
+	MSI_EC_STATE_NR_FIELDS
+};
+
+struct msi_ec_state {
+	__u16 version;      // MSI_EC_STATE_VERSION
+	__u16 size;         // sizeof(struct msi_ec_state)
+	__u16 nr_fields;    // fields known to the driver
+	__u16 flags;        // MSI_EC_STATE_*
+
+	__u64 timestamp_ns; // CLOCK_BOOTTIME of the EC snapshot
+
+	__u32 present;      // BIT(field): supported, raw[field] is valid
+	__u32 valid;        // BIT(field): values[field] could be decoded
+
+	__s32 values[MSI_EC_STATE_MAX_FIELDS];
+	__u8 raw[MSI_EC_STATE_MAX_FIELDS]; // EC register behind each field
+};
+
+// ============================================================ //
+// /dev/msi-ec
+// ============================================================ //
+
+#define MSI_EC_IO_MAX 256 // entries per MSI_EC_IOC_BATCH call
+
+enum msi_ec_io_op {
+	MSI_EC_IO_READ,  // value = EC[addr] & mask
+	MSI_EC_IO_WRITE, // EC[addr] bits in mask = value
+};
+
+struct msi_ec_io {
+	__u8 addr;
+	__u8 mask;
+	__u8 value;
+	__u8 op;       // enum msi_ec_io_op
+	__s32 result;  // set by the driver: 0 or a negative errno
+};
+
+/*
+ * Entries are executed in order under a single lock hold. A failed entry
+ * doesn't stop the batch, check every result. Access follows the sysfs
+ * interface: reads are limited to the registers behind the supported
+ * attributes and writes, which need the device opened for writing, to
+ * their bits and valid values (-EACCES, -EINVAL). In debug mode every
+ * register may be read and written.
+ */
+struct msi_ec_io_batch {
+	__u64 ios;     // struct msi_ec_io *
+	__u32 count;   // at most MSI_EC_IO_MAX
+	__u32 flags;   // reserved, 0
+};
+
+#define MSI_EC_IOC_MAGIC 'M'
+#define MSI_EC_IOC_BATCH _IOWR(MSI_EC_IOC_MAGIC, 0x01, struct msi_ec_io_batch)
+// same snapshot as state_bin
+#define MSI_EC_IOC_STATE _IOR(MSI_EC_IOC_MAGIC, 0x02, struct msi_ec_state)
+
+#endif // __MSI_EC_UAPI__
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Compares a single-model build (make MODEL=<name>) with the generic one.
+#
+# Both variants of the driver are built in userspace (see tools/userspace)
+# and compared by object size and by the bench latency of every attribute
+# on an emulated EC running the model's first firmware, best of several
+# rounds. The model build also has to pass the userspace tests for all of
+# its firmwares. If the headers of the running kernel are installed, both
+# modules are built and their sizes compared too; the generic module is
+# rebuilt last.
+#
+# Usage: compare_model_build.py <model> [bench iterations]
+
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CC = os.environ.get('CC', 'cc')
+TARGET = os.environ.get('TARGET', os.uname().release)
+
+CFLAGS = ['-std=gnu11', '-O2', '-Wall', '-I' + ROOT,
+	  '-I' + os.path.join(ROOT, 'tools/userspace'),
+	  '-I' + os.path.join(ROOT, 'tools/userspace/include')]
+CORE = os.path.join(ROOT, 'tools/userspace/msi_ec_core.c')
+ROUNDS = 5
+
+
+def first_firmware(model):
+	section = None
+	with open(os.path.join(ROOT, 'ec_configurations.ini')) as f:
+		for line in f:
+			line = line.split('#', 1)[0].strip()
+			m = re.match(r'^\[(\w+)\]$', line)
+			if m:
+				section = m.group(1)
+				continue
+			m = re.match(r'^allowed_fw\s*=\s*(\S+)$', line)
+			if m and section == model:
+				return m.group(1)
+	return None
+
+
+# stdout of cmd, its stderr is only shown if it fails
+def run(cmd):
+	result = subprocess.run(cmd, stdout=subprocess.PIPE,
+				stderr=subprocess.PIPE, universal_newlines=True)
+	if result.returncode:
+		sys.stderr.write(result.stderr)
+		raise subprocess.CalledProcessError(result.returncode, cmd)
+	return result.stdout
+
+
+def size(path):
+	# text, data and bss of a Berkeley format size line
+	fields = run(['size', path]).split('\n')[1].split()
+	return [int(x) for x in fields[:3]]
+
+
+def build(tmp, name, defines):
+	obj = os.path.join(tmp, name + '.o')
+	run([CC] + CFLAGS + defines + ['-c', '-o', obj, CORE])
+	for tool in ('bench', 'test'):
+		run([CC] + CFLAGS + defines + ['-o', os.path.join(tmp, name + '-' +
+								  tool), CORE,
+		     os.path.join(ROOT, 'tools/userspace', tool + '.c')])
+	return obj
+
+
+# fastest of ROUNDS runs, so noise from the rest of the system only hurts
+# the round it hits
+def bench(binary, firmware, iterations, results):
+	out = run([binary, '-f', firmware, '-n', str(iterations)])
+	for line in out.splitlines():
+		entry = json.loads(line)
+		if 'test' not in entry or entry['errors']:
+			continue
+		name = entry['name']
+		results[name] = min(results.get(name, entry['ns_per_op']),
+				    entry['ns_per_op'])
+
+
+def module_sizes(model):
+	build_dir = '/lib/modules/%s/build' % TARGET
+	if not os.path.isdir(build_dir):
+		return None
+
+	sizes = {}
+	for name, extra in (('model', ['MODEL=' + model]), ('generic', [])):
+		run(['make', '-s', '-C', ROOT, 'modules'] + extra)
+		sizes[name] = size(os.path.join(ROOT, 'msi-ec.ko'))
+	return sizes
+
+
+def row(name, generic, model, unit):
+	change = (model - generic) * 100.0 / generic if generic else 0
+	print('  %-34s %10.1f %10.1f %+7.1f%% %s' %
+	      (name, generic, model, change, unit))
+
+
+def main(argv):
+	if len(argv) not in (2, 3):
+		sys.stderr.write('usage: %s <model> [bench iterations]\n' % argv[0])
+		return 2
+
+	model = argv[1]
+	iterations = int(argv[2]) if len(argv) == 3 else 100000
+	firmware = first_firmware(model)
+	if not firmware:
+		sys.stderr.write('%s: no such model in ec_configurations.ini\n' %
+				 model)
+		return 1
+
+	with tempfile.TemporaryDirectory() as tmp:
+		generic = build(tmp, 'generic', [])
+		single = build(tmp, 'model', ['-DMSI_EC_MODEL=' + model])
+
+		# the model build must behave like the generic one
+		run([os.path.join(tmp, 'model-test')])
+
+		print('%s, firmware %s' % (model, firmware))
+		print('  %-34s %10s %10s %8s' % ('', 'generic', 'model', 'change'))
+
+		for name, g, m in zip(('text', 'data', 'bss'), size(generic),
+				      size(single)):
+			row('userspace object ' + name, g, m, 'bytes')
+
+		sizes = module_sizes(model)
+		if sizes:
+			for name, g, m in zip(('text', 'data', 'bss'),
+					      sizes['generic'], sizes['model']):
+				row('msi-ec.ko ' + name, g, m, 'bytes')
+		else:
+			print('  (no kernel headers for %s, module not built)' %
+			      TARGET)
+
+		# alternated, so both see the same machine
+		g, m = {}, {}
+		for _ in range(ROUNDS):
+			bench(os.path.join(tmp, 'generic-bench'), firmware,
+			      iterations, g)
+			bench(os.path.join(tmp, 'model-bench'), firmware,
+			      iterations, m)
+		for name in sorted(g):
+			if name in m:
+				row(name + ' show', g[name], m[name], 'ns/op')
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main(sys.argv))
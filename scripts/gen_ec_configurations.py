@@ -0,0 +1,631 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Generates the msi-ec configuration tables from the declarative device
+# database (ec_configurations.ini).
+#
+# The database is validated before anything is emitted: duplicated firmware
+# versions, oversized or duplicated mode tables and writable controls sharing
+# the same EC register bits are reported as errors, so a broken entry fails
+# the build instead of misbehaving on someone's laptop.
+#
+# Besides the per-model struct msi_ec_conf tables the generator emits:
+#   - a capability bitmap for every model (.caps), so the driver can decide
+#     which attributes and LEDs to expose without comparing addresses;
+#   - a firmware version index sorted for binary search, so module init does
+#     not have to walk every allowed firmware list;
+#   - the settings behind every platform_profile choice (.profiles), derived
+#     from the mode names unless the database overrides them.
+#
+# Every model is emitted as MSI_EC_<name>_INIT, _CAPS and _INDEX macros, so
+# a single-model build (make MODEL=<name>) can make its configuration a
+# compile-time constant instead of a copy of CONFIGURATIONS[].
+#
+# Usage: gen_ec_configurations.py <database> <output header>
+
+import re
+import sys
+
+# Maximum number of modes in msi_ec_*_mode_conf.modes[], without the NULL entry
+MODES_LIMIT = 4
+
+# Field kinds:
+#   addr  - EC address, 0x00..0xff, "unknown" or "unsupp"; required
+#   opt_addr - like addr, defaults to "unsupp"
+#   byte  - 0x00..0xff, defaults to 0
+#   bit   - 0..7, defaults to 0
+#   bool  - true/false, defaults to false
+#   modes - repeated "<name> <value>" pairs
+#   bytes - whitespace separated list of bytes
+#   settings - "key=value" pairs as accepted by the transaction attribute,
+#              derived from the other fields by default_profiles() if unset
+SCHEMA = {
+	'charge_control': [
+		('address', 'addr'),
+		('offset_start', 'byte'),
+		('offset_end', 'byte'),
+		('range_min', 'byte'),
+		('range_max', 'byte'),
+	],
+	'webcam': [
+		('address', 'addr'),
+		('block_address', 'addr'),
+		('bit', 'bit'),
+	],
+	'fn_win_swap': [
+		('address', 'addr'),
+		('bit', 'bit'),
+		('invert', 'bool'),
+	],
+	'cooler_boost': [
+		('address', 'addr'),
+		('bit', 'bit'),
+	],
+	'shift_mode': [
+		('address', 'addr'),
+		('modes', 'modes'),
+	],
+	'super_battery': [
+		('address', 'addr'),
+		('mask', 'byte'),
+	],
+	'fan_mode': [
+		('address', 'addr'),
+		('modes', 'modes'),
+	],
+	'cpu': [
+		('rt_temp_address', 'addr'),
+		('rt_fan_speed_address', 'addr'),
+		('rt_fan_speed_base_min', 'byte'),
+		('rt_fan_speed_base_max', 'byte'),
+		('bs_fan_speed_address', 'addr'),
+		('bs_fan_speed_base_min', 'byte'),
+		('bs_fan_speed_base_max', 'byte'),
+		('curve_temp_address', 'opt_addr'),
+		('curve_speed_address', 'opt_addr'),
+	],
+	'gpu': [
+		('rt_temp_address', 'addr'),
+		('rt_fan_speed_address', 'addr'),
+		('curve_temp_address', 'opt_addr'),
+		('curve_speed_address', 'opt_addr'),
+	],
+	'leds': [
+		('micmute_led_address', 'addr'),
+		('mute_led_address', 'addr'),
+		('bit', 'bit'),
+	],
+	'kbd_bl': [
+		('bl_mode_address', 'addr'),
+		('bl_modes', 'bytes'),
+		('max_mode', 'byte'),
+		('bl_state_address', 'addr'),
+		('state_base_value', 'byte'),
+		('max_state', 'byte'),
+	],
+	'profile': [
+		('low_power', 'settings'),
+		('balanced', 'settings'),
+		('performance', 'settings'),
+	],
+}
+
+# profile.<field> -> enum msi_ec_profile member
+PROFILES = [
+	('low_power', 'LOW_POWER'),
+	('balanced', 'BALANCED'),
+	('performance', 'PERFORMANCE'),
+]
+
+# Settings a profile may use and the field enabling each of them; mode
+# settings are checked against the mode names, the others take on/off
+PROFILE_SETTINGS = {
+	'shift_mode': 'shift_mode.address',
+	'fan_mode': 'fan_mode.address',
+	'super_battery': 'super_battery.address',
+	'cooler_boost': 'cooler_boost.address',
+}
+
+# Fan curve tables: temperature thresholds and fan speeds, one byte each
+FAN_CURVE_TEMPS = 6
+FAN_CURVE_SPEEDS = 7
+
+# Repeated database keys and the fields they are collected into
+LIST_KEYS = {
+	'shift_mode.mode': 'shift_mode.modes',
+	'fan_mode.mode': 'fan_mode.modes',
+}
+
+# enum msi_ec_capability member -> address field that enables it
+CAPABILITIES = [
+	('CHARGE_CONTROL', 'charge_control.address'),
+	('WEBCAM', 'webcam.address'),
+	('WEBCAM_BLOCK', 'webcam.block_address'),
+	('FN_WIN_SWAP', 'fn_win_swap.address'),
+	('COOLER_BOOST', 'cooler_boost.address'),
+	('SHIFT_MODE', 'shift_mode.address'),
+	('SUPER_BATTERY', 'super_battery.address'),
+	('FAN_MODE', 'fan_mode.address'),
+	('CPU_RT_TEMP', 'cpu.rt_temp_address'),
+	('CPU_RT_FAN_SPEED', 'cpu.rt_fan_speed_address'),
+	('CPU_BS_FAN_SPEED', 'cpu.bs_fan_speed_address'),
+	('GPU_RT_TEMP', 'gpu.rt_temp_address'),
+	('GPU_RT_FAN_SPEED', 'gpu.rt_fan_speed_address'),
+	('MICMUTE_LED', 'leds.micmute_led_address'),
+	('MUTE_LED', 'leds.mute_led_address'),
+	('KBD_BL', 'kbd_bl.bl_state_address'),
+]
+
+ADDR_SPECIAL = {
+	'unknown': 'MSI_EC_ADDR_UNKNOWN',
+	'unsupp': 'MSI_EC_ADDR_UNSUPP',
+}
+
+
+class DatabaseError(Exception):
+	pass
+
+
+class Conf:
+	def __init__(self, name, line):
+		self.name = name
+		self.line = line
+		self.allowed_fw = []  # (version, line)
+		self.values = {}      # 'group.field' -> parsed value
+		self.lines = {}       # 'group.field' -> line number
+
+	def supported(self, key):
+		return self.values[key] not in ADDR_SPECIAL
+
+	def where(self, key=None):
+		return 'line %d (%s)' % (self.lines.get(key, self.line), self.name)
+
+
+def parse_int(text, lo, hi, what):
+	try:
+		value = int(text, 0)
+	except ValueError:
+		raise DatabaseError('%s: "%s" is not a number' % (what, text))
+	if value < lo or value > hi:
+		raise DatabaseError('%s: %s is out of range [%#x, %#x]' %
+				    (what, text, lo, hi))
+	return value
+
+
+def parse_value(kind, text, what):
+	if kind in ('addr', 'opt_addr'):
+		if text in ADDR_SPECIAL:
+			return text
+		return parse_int(text, 0x00, 0xff, what)
+	if kind == 'byte':
+		return parse_int(text, 0x00, 0xff, what)
+	if kind == 'bit':
+		return parse_int(text, 0, 7, what)
+	if kind == 'bool':
+		if text not in ('true', 'false'):
+			raise DatabaseError('%s: expected true or false' % what)
+		return text == 'true'
+	if kind == 'bytes':
+		return [parse_int(t, 0x00, 0xff, what) for t in text.split()]
+	if kind == 'settings':
+		settings = []
+		for pair in text.split():
+			key, sep, value = pair.partition('=')
+			if not sep or not key or not value:
+				raise DatabaseError('%s: expected "key=value" pairs' %
+						    what)
+			settings.append((key, value))
+		return settings
+	if kind == 'mode':
+		parts = text.split()
+		if len(parts) != 2:
+			raise DatabaseError('%s: expected "<name> <value>"' % what)
+		return (parts[0], parse_int(parts[1], 0x00, 0xff, what))
+	raise AssertionError(kind)
+
+
+def field_kinds():
+	kinds = {}
+	for group, fields in SCHEMA.items():
+		for field, kind in fields:
+			kinds['%s.%s' % (group, field)] = kind
+	return kinds
+
+
+def parse(path):
+	kinds = field_kinds()
+	confs = []
+	conf = None
+
+	with open(path) as f:
+		for lineno, raw in enumerate(f, 1):
+			line = raw.split('#', 1)[0].strip()
+			if not line:
+				continue
+
+			where = '%s:%d' % (path, lineno)
+
+			m = re.match(r'^\[(\w+)\]$', line)
+			if m:
+				conf = Conf(m.group(1), lineno)
+				confs.append(conf)
+				continue
+
+			m = re.match(r'^([\w.]+)\s*=\s*(.*)$', line)
+			if not m:
+				raise DatabaseError('%s: syntax error' % where)
+			if conf is None:
+				raise DatabaseError('%s: key outside of a section' % where)
+
+			key, text = m.group(1), m.group(2)
+			if key == 'allowed_fw':
+				if not re.match(r'^[\x21-\x7e]+$', text):
+					raise DatabaseError('%s: bad firmware version' % where)
+				conf.allowed_fw.append((text, lineno))
+			elif key in LIST_KEYS:
+				field = LIST_KEYS[key]
+				mode = parse_value('mode', text, where)
+				conf.values.setdefault(field, []).append(mode)
+				conf.lines.setdefault(field, lineno)
+			elif key in kinds and kinds[key] != 'modes':
+				if key in conf.values:
+					raise DatabaseError('%s: %s is set twice' % (where, key))
+				conf.values[key] = parse_value(kinds[key], text, where)
+				conf.lines[key] = lineno
+			else:
+				raise DatabaseError('%s: unknown key %s' % (where, key))
+
+	return confs
+
+
+def first_mode(conf, group, names):
+	modes = [name for name, value in conf.values['%s.modes' % group]]
+	for name in names:
+		if name in modes:
+			return name
+	return None
+
+
+def default_profiles(conf):
+	"""Settings for every profile, picked from the modes a model has."""
+	choices = {
+		'low_power': {
+			'shift_mode': ['eco', 'comfort'],
+			'fan_mode': ['silent', 'auto'],
+			'super_battery': ['on'],
+		},
+		'balanced': {
+			'shift_mode': ['comfort'],
+			'fan_mode': ['auto'],
+			'super_battery': ['off'],
+		},
+		'performance': {
+			'shift_mode': ['sport', 'turbo'],
+			'fan_mode': ['auto'],
+			'super_battery': ['off'],
+		},
+	}
+
+	profiles = {}
+	for profile, settings in choices.items():
+		profiles[profile] = []
+		for key, names in settings.items():
+			if not conf.supported(PROFILE_SETTINGS[key]):
+				continue
+			if key in ('shift_mode', 'fan_mode'):
+				value = first_mode(conf, key, names)
+			else:
+				value = names[0]
+			if value:
+				profiles[profile].append((key, value))
+
+	return profiles
+
+
+def fill_defaults(conf):
+	for key, kind in field_kinds().items():
+		if key in conf.values or kind == 'settings':
+			continue
+		if kind == 'addr':
+			raise DatabaseError('%s: %s is missing, use "unsupp" if the '
+					    'feature is not available' %
+					    (conf.where(), key))
+		conf.values[key] = {
+			'opt_addr': 'unsupp',
+			'byte': 0,
+			'bit': 0,
+			'bool': False,
+			'bytes': [],
+			'modes': [],
+		}[kind]
+
+
+def writable_regions(conf):
+	"""(address, mask, owner) of every EC register the driver may write."""
+	v = conf.values
+	regions = [
+		('charge_control.address', 0xff),
+		('webcam.address', 1 << v['webcam.bit']),
+		('webcam.block_address', 1 << v['webcam.bit']),
+		('fn_win_swap.address', 1 << v['fn_win_swap.bit']),
+		('cooler_boost.address', 1 << v['cooler_boost.bit']),
+		('shift_mode.address', 0xff),
+		('super_battery.address', v['super_battery.mask']),
+		('fan_mode.address', 0xff),
+		('cpu.bs_fan_speed_address', 0xff),
+		('leds.micmute_led_address', 1 << v['leds.bit']),
+		('leds.mute_led_address', 1 << v['leds.bit']),
+		('kbd_bl.bl_state_address', 0xff),
+	]
+
+	bl_mask = 0
+	for mode in v['kbd_bl.bl_modes']:
+		bl_mask |= mode
+	regions.append(('kbd_bl.bl_mode_address', bl_mask))
+
+	result = [(v[key], mask, key) for key, mask in regions
+		  if conf.supported(key) and mask]
+
+	for group in ('cpu', 'gpu'):
+		for field, length in (('curve_temp_address', FAN_CURVE_TEMPS),
+				      ('curve_speed_address', FAN_CURVE_SPEEDS)):
+			key = '%s.%s' % (group, field)
+			if not conf.supported(key):
+				continue
+			for i in range(length):
+				result.append((v[key] + i, 0xff, key))
+
+	return result
+
+
+def validate_profile(conf, key):
+	errors = []
+	seen = set()
+
+	for setting, value in conf.values[key]:
+		if setting not in PROFILE_SETTINGS:
+			errors.append('%s: %s can\'t be set by a profile' %
+				      (conf.where(key), setting))
+			continue
+		if setting in seen:
+			errors.append('%s: %s is set twice' %
+				      (conf.where(key), setting))
+		seen.add(setting)
+
+		if not conf.supported(PROFILE_SETTINGS[setting]):
+			errors.append('%s: %s is not supported' %
+				      (conf.where(key), setting))
+		elif setting in ('shift_mode', 'fan_mode'):
+			if not first_mode(conf, setting, [value]):
+				errors.append('%s: %s has no mode "%s"' %
+					      (conf.where(key), setting, value))
+		elif value not in ('on', 'off'):
+			errors.append('%s: %s takes on or off' %
+				      (conf.where(key), setting))
+
+	return errors
+
+
+def validate(confs):
+	errors = []
+	names = {}
+	firmware = {}
+
+	for conf in confs:
+		if conf.name in names:
+			errors.append('%s: section name already used at line %d' %
+				      (conf.where(), names[conf.name]))
+		names[conf.name] = conf.line
+
+		if not conf.allowed_fw:
+			errors.append('%s: no allowed_fw entries' % conf.where())
+
+		for fw, lineno in conf.allowed_fw:
+			if fw in firmware:
+				other, other_line = firmware[fw]
+				errors.append('line %d (%s): firmware %s is already '
+					      'allowed by %s at line %d' %
+					      (lineno, conf.name, fw, other.name,
+					       other_line))
+			else:
+				firmware[fw] = (conf, lineno)
+
+		try:
+			fill_defaults(conf)
+		except DatabaseError as e:
+			errors.append(str(e))
+			continue
+
+		defaults = default_profiles(conf)
+		for profile, _ in PROFILES:
+			key = 'profile.%s' % profile
+			if key not in conf.values:
+				conf.values[key] = defaults[profile]
+			errors.extend(validate_profile(conf, key))
+
+		for group in ('shift_mode', 'fan_mode'):
+			key = '%s.modes' % group
+			modes = conf.values[key]
+			if len(modes) > MODES_LIMIT:
+				errors.append('%s: %s has %d modes, the limit is %d' %
+					      (conf.where(key), group, len(modes),
+					       MODES_LIMIT))
+			if conf.supported('%s.address' % group) and not modes:
+				errors.append('%s: %s is supported but has no modes' %
+					      (conf.where('%s.address' % group),
+					       group))
+			seen_names = set()
+			seen_values = set()
+			for name, value in modes:
+				if name in seen_names:
+					errors.append('%s: %s mode "%s" is listed twice' %
+						      (conf.where(key), group, name))
+				if value in seen_values:
+					errors.append('%s: %s value %#04x is used by two '
+						      'modes' % (conf.where(key), group,
+								 value))
+				seen_names.add(name)
+				seen_values.add(value)
+
+		for group in ('cpu', 'gpu'):
+			temp = '%s.curve_temp_address' % group
+			speed = '%s.curve_speed_address' % group
+			if conf.supported(temp) != conf.supported(speed):
+				errors.append('%s: %s fan curve needs both table '
+					      'addresses' % (conf.where(temp), group))
+				continue
+			if not conf.supported(temp):
+				continue
+			if conf.values[temp] + FAN_CURVE_TEMPS > 0x100 or \
+			   conf.values[speed] + FAN_CURVE_SPEEDS > 0x100:
+				errors.append('%s: %s fan curve runs past 0xff' %
+					      (conf.where(temp), group))
+
+		bl_modes = conf.values['kbd_bl.bl_modes']
+		if len(bl_modes) not in (0, 2):
+			errors.append('%s: kbd_bl.bl_modes needs exactly 2 values' %
+				      conf.where('kbd_bl.bl_modes'))
+
+		regions = writable_regions(conf)
+		for i, (addr, mask, owner) in enumerate(regions):
+			for other_addr, other_mask, other in regions[i + 1:]:
+				if addr == other_addr and mask & other_mask:
+					errors.append('%s: %s overlaps with %s '
+						      '(address %#04x, bits %#04x)' %
+						      (conf.where(owner), owner, other,
+						       addr, mask & other_mask))
+
+	if errors:
+		raise DatabaseError('\n'.join(errors))
+
+	return firmware
+
+
+def c_value(kind, value):
+	if kind in ('addr', 'opt_addr'):
+		if value in ADDR_SPECIAL:
+			return ADDR_SPECIAL[value]
+		return '0x%02x' % value
+	if kind == 'byte':
+		return '0x%02x' % value
+	if kind == 'bit':
+		return '%d' % value
+	if kind == 'bool':
+		return 'true' if value else 'false'
+	if kind == 'bytes':
+		return '{ %s }' % ', '.join('0x%02x' % b for b in value)
+	raise AssertionError(kind)
+
+
+def emit_conf(out, conf, index):
+	caps = ['BIT(MSI_EC_CAP_%s)' % cap for cap, key in CAPABILITIES
+		if conf.supported(key)]
+	body = []
+
+	body.append('\t.caps = MSI_EC_%s_CAPS,' % conf.name)
+	for group, fields in SCHEMA.items():
+		if group == 'profile':
+			continue
+		body.append('\t.%s = {' % group)
+		for field, kind in fields:
+			value = conf.values['%s.%s' % (group, field)]
+			if kind == 'modes':
+				body.append('\t\t.%s = {' % field)
+				for name, mode in value:
+					body.append('\t\t\t{ "%s", 0x%02x },' %
+						    (name, mode))
+				body.append('\t\t\tMSI_EC_MODE_NULL')
+				body.append('\t\t},')
+			else:
+				body.append('\t\t.%s = %s,' %
+					    (field, c_value(kind, value)))
+		body.append('\t},')
+	body.append('\t.profiles = {')
+	for profile, member in PROFILES:
+		settings = conf.values['profile.%s' % profile]
+		body.append('\t\t[MSI_EC_PROFILE_%s] = "%s",' %
+			    (member, ' '.join('%s=%s' % s for s in settings)))
+	body.append('\t},')
+
+	# macros, so single-model builds can turn them into constants
+	out.append('#define MSI_EC_%s_INDEX %d' % (conf.name, index))
+	out.append('#define MSI_EC_%s_CAPS (%s)' %
+		   (conf.name, '0' if not caps else
+		    (' | \\\n\t'.join(caps))))
+	out.append('#define MSI_EC_%s_INIT { \\' % conf.name)
+	for line in body:
+		out.append(line + ' \\')
+	out.append('}')
+	out.append('')
+
+
+def generate(src, confs, firmware):
+	guard = '__MSI_EC_CONFIGURATIONS__'
+	out = [
+		'/* SPDX-License-Identifier: GPL-2.0-or-later */',
+		'/*',
+		' * Generated by scripts/gen_ec_configurations.py from %s.' % src,
+		' * Do not edit, change the database instead.',
+		' */',
+		'',
+		'#ifndef %s' % guard,
+		'#define %s' % guard,
+		'',
+	]
+
+	for index, conf in enumerate(confs):
+		emit_conf(out, conf, index)
+
+	# a single-model build uses MSI_EC_<model>_INIT on its own
+	out.append('#ifndef MSI_EC_MODEL')
+	out.append('')
+	for conf in confs:
+		out.append('static struct msi_ec_conf %s __initdata = '
+			   'MSI_EC_%s_INIT;' % (conf.name, conf.name))
+	out.append('')
+	out.append('static struct msi_ec_conf *CONFIGURATIONS[] __initdata = {')
+	for conf in confs:
+		out.append('\t&%s,' % conf.name)
+	out.append('\tNULL')
+	out.append('};')
+	out.append('')
+	out.append('#endif // MSI_EC_MODEL')
+	out.append('')
+
+	index = {conf.name: i for i, conf in enumerate(confs)}
+	out.append('// sorted by strcmp() for bsearch()')
+	out.append('static const struct msi_ec_fw_entry MSI_EC_FW_INDEX[] '
+		   '__initconst = {')
+	for fw in sorted(firmware):
+		out.append('\t{ "%s", %d },' % (fw, index[firmware[fw][0].name]))
+	out.append('};')
+	out.append('')
+	out.append('#endif // %s' % guard)
+	out.append('')
+
+	return '\n'.join(out)
+
+
+def main(argv):
+	if len(argv) != 3:
+		sys.stderr.write('usage: %s <database> <output header>\n' % argv[0])
+		return 2
+
+	src, dst = argv[1], argv[2]
+	try:
+		confs = parse(src)
+		firmware = validate(confs)
+	except DatabaseError as e:
+		for line in str(e).split('\n'):
+			sys.stderr.write('%s: %s\n' % (src, line))
+		return 1
+
+	header = generate(src.split('/')[-1], confs, firmware)
+	with open(dst, 'w') as f:
+		f.write(header)
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main(sys.argv))
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * bench.c - cost of the libmsiec calls.
+ *
+ * For every supported field, compares msi_ec_get() on the cached handle
+ * with opening, reading and closing the attribute like most scripts do,
+ * then measures msi_ec_snapshot() with every backend the driver offers.
+ * With -w, also measures writing the current values back one by one and
+ * with msi_ec_set_many(). Results are JSON lines, like msi-ec-bench.
+ *
+ * Build with "make libmsiec-bench".
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msi_ec.h"
+
+static int iterations = 1000;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(const char *name, const char *test, uint64_t *samples,
+		   int count, int errors)
+{
+	uint64_t sum = 0;
+
+	printf("{\"name\":\"%s\",\"test\":\"%s\",\"samples\":%d,"
+	       "\"errors\":%d", name, test, count, errors);
+
+	if (count) {
+		qsort(samples, count, sizeof(*samples), cmp_u64);
+		for (int i = 0; i < count; i++)
+			sum += samples[i];
+
+		printf(",\"min_ns\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+		       "\"max_ns\":%llu,\"mean_ns\":%llu",
+		       (unsigned long long)samples[0],
+		       (unsigned long long)samples[count / 2],
+		       (unsigned long long)samples[count * 99 / 100],
+		       (unsigned long long)samples[count - 1],
+		       (unsigned long long)(sum / count));
+	}
+
+	printf("}\n");
+}
+
+// what the library saves: a path lookup, an open and a close per read
+static int naive_get(const char *device, enum msi_ec_state_field field)
+{
+	char path[4096], buf[64];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", device, msi_ec_field_name(field));
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	len = read(fd, buf, sizeof(buf));
+	close(fd);
+	return len < 0 ? -errno : 0;
+}
+
+static void bench_get(struct msi_ec *ec, const char *device, uint64_t *samples)
+{
+	for (int field = 0; field < MSI_EC_STATE_NR_FIELDS; field++) {
+		const char *name = msi_ec_field_name(field);
+		int count = 0, errors = 0, value;
+
+		if (!msi_ec_supported(ec, field))
+			continue;
+
+		for (int i = 0; i < iterations; i++) {
+			uint64_t start = now_ns();
+
+			if (msi_ec_get(ec, field, &value) < 0) {
+				errors++;
+				continue;
+			}
+			samples[count++] = now_ns() - start;
+		}
+		report(name, "get", samples, count, errors);
+
+		// LEDs and thresholds live outside the device directory
+		if (naive_get(device, field) == -ENOENT)
+			continue;
+
+		count = errors = 0;
+		for (int i = 0; i < iterations; i++) {
+			uint64_t start = now_ns();
+
+			if (naive_get(device, field) < 0) {
+				errors++;
+				continue;
+			}
+			samples[count++] = now_ns() - start;
+		}
+		report(name, "open_read_close", samples, count, errors);
+	}
+}
+
+static void bench_snapshot(struct msi_ec *ec, uint64_t *samples)
+{
+	enum msi_ec_backend initial = msi_ec_get_backend(ec);
+	struct msi_ec_state state;
+
+	for (int backend = 0; backend < MSI_EC_BACKEND_NR; backend++) {
+		int count = 0, errors = 0;
+
+		if (msi_ec_set_backend(ec, backend) < 0)
+			continue;
+
+		for (int i = 0; i < iterations; i++) {
+			uint64_t start = now_ns();
+
+			if (msi_ec_snapshot(ec, &state) < 0) {
+				errors++;
+				continue;
+			}
+			samples[count++] = now_ns() - start;
+		}
+		report(msi_ec_backend_name(backend), "snapshot", samples, count,
+		       errors);
+	}
+
+	msi_ec_set_backend(ec, initial);
+}
+
+static void bench_set(struct msi_ec *ec, uint64_t *samples)
+{
+	struct msi_ec_setting settings[MSI_EC_STATE_NR_FIELDS];
+	int nr_settings = 0, count, errors;
+
+	// writable settings with a name, written back unchanged
+	for (int field = 0; field < MSI_EC_STATE_NR_FIELDS; field++) {
+		int value;
+
+		if (!msi_ec_writable(ec, field) ||
+		    msi_ec_value_count(ec, field) <= 0 ||
+		    msi_ec_get(ec, field, &value) < 0 ||
+		    !msi_ec_value_name(ec, field, value))
+			continue;
+
+		settings[nr_settings].field = field;
+		settings[nr_settings++].value = value;
+	}
+
+	if (!nr_settings)
+		return;
+
+	count = errors = 0;
+	for (int i = 0; i < iterations; i++) {
+		uint64_t start = now_ns();
+		int result = 0;
+
+		for (int j = 0; j < nr_settings && !result; j++)
+			result = msi_ec_set(ec, settings[j].field,
+					    settings[j].value);
+		if (result < 0) {
+			errors++;
+			continue;
+		}
+		samples[count++] = now_ns() - start;
+	}
+	report("settings", "set_each", samples, count, errors);
+
+	count = errors = 0;
+	for (int i = 0; i < iterations; i++) {
+		uint64_t start = now_ns();
+
+		if (msi_ec_set_many(ec, settings, nr_settings) < 0) {
+			errors++;
+			continue;
+		}
+		samples[count++] = now_ns() - start;
+	}
+	report("settings", "set_many", samples, count, errors);
+}
+
+int main(int argc, char **argv)
+{
+	const char *device = MSI_EC_DEFAULT_DEVICE;
+	bool do_write = false;
+	struct msi_ec *ec;
+	uint64_t *samples;
+	int opt, result;
+
+	while ((opt = getopt(argc, argv, "d:n:wh")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'w':
+			do_write = true;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-d device] [-n iterations] [-w]\n",
+				argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (iterations <= 0)
+		return 1;
+
+	result = msi_ec_open(device, &ec);
+	if (result < 0) {
+		fprintf(stderr, "%s: %s\n", device, strerror(-result));
+		return 1;
+	}
+
+	samples = calloc(iterations, sizeof(*samples));
+	if (!samples) {
+		msi_ec_close(ec);
+		return 1;
+	}
+
+	printf("{\"backend\":\"%s\",\"iterations\":%d}\n",
+	       msi_ec_backend_name(msi_ec_get_backend(ec)), iterations);
+
+	bench_get(ec, device, samples);
+	bench_snapshot(ec, samples);
+	if (do_write)
+		bench_set(ec, samples);
+
+	free(samples);
+	msi_ec_close(ec);
+	return 0;
+}
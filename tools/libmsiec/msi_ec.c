@@ -0,0 +1,657 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi_ec.c - Userspace client library for the msi-ec driver.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "msi_ec.h"
+
+#define MSI_EC_DEV        "/dev/msi-ec"
+#define MSI_EC_BATTERIES  "/sys/class/power_supply/BAT*"
+#define MSI_EC_MAX_MODES  16
+#define MSI_EC_VALUE_SIZE 64
+#define MSI_EC_STATE_SIZE 4096
+
+enum msi_ec_kind {
+	MSI_EC_KIND_NUMBER,
+	MSI_EC_KIND_OFF_ON,
+	MSI_EC_KIND_LEFT_RIGHT,
+	MSI_EC_KIND_ENUM,
+};
+
+struct msi_ec_field_def {
+	const char *name;
+	const char *path; // relative to the device, "@" the battery, or absolute
+	enum msi_ec_kind kind;
+	const char *modes; // attribute listing the values of an enum
+};
+
+static const struct msi_ec_field_def field_defs[MSI_EC_STATE_NR_FIELDS] = {
+	[MSI_EC_STATE_WEBCAM] = {
+		"webcam", "webcam", MSI_EC_KIND_OFF_ON },
+	[MSI_EC_STATE_WEBCAM_BLOCK] = {
+		"webcam_block", "webcam_block", MSI_EC_KIND_OFF_ON },
+	[MSI_EC_STATE_FN_KEY] = {
+		"fn_key", "fn_key", MSI_EC_KIND_LEFT_RIGHT },
+	[MSI_EC_STATE_WIN_KEY] = {
+		"win_key", "win_key", MSI_EC_KIND_LEFT_RIGHT },
+	[MSI_EC_STATE_BATTERY_MODE] = {
+		"battery_mode", "battery_mode", MSI_EC_KIND_ENUM },
+	[MSI_EC_STATE_COOLER_BOOST] = {
+		"cooler_boost", "cooler_boost", MSI_EC_KIND_OFF_ON },
+	[MSI_EC_STATE_SHIFT_MODE] = {
+		"shift_mode", "shift_mode", MSI_EC_KIND_ENUM,
+		"available_shift_modes" },
+	[MSI_EC_STATE_SUPER_BATTERY] = {
+		"super_battery", "super_battery", MSI_EC_KIND_OFF_ON },
+	[MSI_EC_STATE_FAN_MODE] = {
+		"fan_mode", "fan_mode", MSI_EC_KIND_ENUM,
+		"available_fan_modes" },
+	[MSI_EC_STATE_CPU_RT_TEMP] = {
+		"cpu/realtime_temperature", "cpu/realtime_temperature" },
+	[MSI_EC_STATE_CPU_RT_FAN_SPEED] = {
+		"cpu/realtime_fan_speed", "cpu/realtime_fan_speed" },
+	[MSI_EC_STATE_CPU_BS_FAN_SPEED] = {
+		"cpu/basic_fan_speed", "cpu/basic_fan_speed" },
+	[MSI_EC_STATE_GPU_RT_TEMP] = {
+		"gpu/realtime_temperature", "gpu/realtime_temperature" },
+	[MSI_EC_STATE_GPU_RT_FAN_SPEED] = {
+		"gpu/realtime_fan_speed", "gpu/realtime_fan_speed" },
+	[MSI_EC_STATE_CHARGE_START] = {
+		"charge_control_start_threshold",
+		"@charge_control_start_threshold" },
+	[MSI_EC_STATE_CHARGE_END] = {
+		"charge_control_end_threshold",
+		"@charge_control_end_threshold" },
+	[MSI_EC_STATE_MICMUTE_LED] = {
+		"micmute_led", "/sys/class/leds/platform::micmute/brightness" },
+	[MSI_EC_STATE_MUTE_LED] = {
+		"mute_led", "/sys/class/leds/platform::mute/brightness" },
+	[MSI_EC_STATE_KBD_BL] = {
+		"kbd_backlight",
+		"/sys/class/leds/msiacpi::kbd_backlight/brightness" },
+};
+
+static const char *const off_on[] = { "off", "on" };
+static const char *const left_right[] = { "left", "right" };
+// the order of struct msi_ec_state
+static const char *const battery_modes[] = { "max", "medium", "min" };
+
+struct msi_ec_modes {
+	char *names[MSI_EC_MAX_MODES];
+	int count;
+};
+
+struct msi_ec {
+	char device[PATH_MAX];
+	char battery[PATH_MAX];
+
+	int fds[MSI_EC_STATE_NR_FIELDS]; // -1: unsupported
+	bool writable[MSI_EC_STATE_NR_FIELDS];
+	struct msi_ec_modes modes[MSI_EC_STATE_NR_FIELDS];
+
+	int dev_fd;
+	int state_bin_fd;
+	int state_fd;
+	int transaction_fd;
+
+	enum msi_ec_backend backend;
+};
+
+// ============================================================ //
+// Helpers
+// ============================================================ //
+
+static int msi_ec_path(const struct msi_ec *ec, const char *name, char *path)
+{
+	int len;
+
+	if (name[0] == '/')
+		len = snprintf(path, PATH_MAX, "%s", name);
+	else if (name[0] == '@')
+		len = snprintf(path, PATH_MAX, "%s/%s", ec->battery, name + 1);
+	else
+		len = snprintf(path, PATH_MAX, "%s/%s", ec->device, name);
+
+	return len >= PATH_MAX ? -ENAMETOOLONG : 0;
+}
+
+// opens for writing when allowed, *writable tells which one succeeded
+static int msi_ec_open_attr(const struct msi_ec *ec, const char *name,
+			    bool *writable)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	if (msi_ec_path(ec, name, path) < 0)
+		return -1;
+
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (writable)
+		*writable = fd >= 0;
+	if (fd < 0)
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	return fd;
+}
+
+// one show() call, the value is NUL terminated
+static int msi_ec_read_attr(int fd, char *buf, size_t size)
+{
+	ssize_t len = pread(fd, buf, size - 1, 0);
+
+	if (len < 0)
+		return -errno;
+
+	buf[len] = '\0';
+	return len;
+}
+
+static int msi_ec_write_attr(int fd, const char *value)
+{
+	size_t len = strlen(value);
+	ssize_t written = pwrite(fd, value, len, 0);
+
+	if (written < 0)
+		return -errno;
+
+	return written == (ssize_t)len ? 0 : -EIO;
+}
+
+static void msi_ec_load_modes(struct msi_ec *ec, enum msi_ec_state_field field)
+{
+	struct msi_ec_modes *modes = &ec->modes[field];
+	char buf[MSI_EC_STATE_SIZE], *line, *save;
+	int fd, len;
+
+	fd = msi_ec_open_attr(ec, field_defs[field].modes, NULL);
+	if (fd < 0)
+		return;
+
+	len = msi_ec_read_attr(fd, buf, sizeof(buf));
+	close(fd);
+	if (len < 0)
+		return;
+
+	for (line = strtok_r(buf, "\n", &save);
+	     line && modes->count < MSI_EC_MAX_MODES;
+	     line = strtok_r(NULL, "\n", &save))
+		modes->names[modes->count++] = strdup(line);
+}
+
+static void msi_ec_find_battery(struct msi_ec *ec)
+{
+	glob_t found;
+
+	if (glob(MSI_EC_BATTERIES, 0, NULL, &found))
+		return;
+
+	for (size_t i = 0; i < found.gl_pathc; i++) {
+		char path[PATH_MAX];
+
+		snprintf(path, sizeof(path),
+			 "%s/charge_control_end_threshold", found.gl_pathv[i]);
+		if (!access(path, F_OK)) {
+			snprintf(ec->battery, sizeof(ec->battery), "%s",
+				 found.gl_pathv[i]);
+			break;
+		}
+	}
+
+	globfree(&found);
+}
+
+// ============================================================ //
+// Vocabulary
+// ============================================================ //
+
+static int msi_ec_vocabulary(const struct msi_ec *ec,
+			     enum msi_ec_state_field field,
+			     const char *const **names)
+{
+	switch (field_defs[field].kind) {
+	case MSI_EC_KIND_OFF_ON:
+		*names = off_on;
+		return 2;
+	case MSI_EC_KIND_LEFT_RIGHT:
+		*names = left_right;
+		return 2;
+	case MSI_EC_KIND_ENUM:
+		if (!field_defs[field].modes) {
+			*names = battery_modes;
+			return 3;
+		}
+		*names = (const char *const *)ec->modes[field].names;
+		return ec->modes[field].count;
+	default:
+		*names = NULL;
+		return 0;
+	}
+}
+
+int msi_ec_value_count(const struct msi_ec *ec, enum msi_ec_state_field field)
+{
+	const char *const *names;
+
+	if (field >= MSI_EC_STATE_NR_FIELDS)
+		return -EINVAL;
+
+	return msi_ec_vocabulary(ec, field, &names);
+}
+
+const char *msi_ec_value_name(const struct msi_ec *ec,
+			      enum msi_ec_state_field field, int value)
+{
+	const char *const *names;
+	int count;
+
+	if (field >= MSI_EC_STATE_NR_FIELDS)
+		return NULL;
+
+	count = msi_ec_vocabulary(ec, field, &names);
+	if (value < 0 || value >= count)
+		return NULL;
+
+	return names[value];
+}
+
+int msi_ec_value_parse(const struct msi_ec *ec, enum msi_ec_state_field field,
+		       const char *name)
+{
+	const char *const *names;
+	size_t len = strcspn(name, "\n");
+	char *end;
+	long value;
+	int count;
+
+	if (field >= MSI_EC_STATE_NR_FIELDS)
+		return -EINVAL;
+
+	count = msi_ec_vocabulary(ec, field, &names);
+	if (!names) {
+		value = strtol(name, &end, 10);
+		if (end == name || (*end && *end != '\n') || value < 0 ||
+		    value > INT_MAX)
+			return -EINVAL;
+		return value;
+	}
+
+	for (int i = 0; i < count; i++)
+		if (strlen(names[i]) == len && !strncmp(names[i], name, len))
+			return i;
+
+	// a mode the driver reports but doesn't accept, e.g. "unspecified"
+	if (field_defs[field].modes && strncmp(name, "unknown", 7))
+		return count;
+
+	return -ENODATA;
+}
+
+// ============================================================ //
+// Handles
+// ============================================================ //
+
+int msi_ec_open(const char *device, struct msi_ec **result)
+{
+	char path[PATH_MAX];
+	struct msi_ec *ec;
+	int supported = 0;
+
+	ec = calloc(1, sizeof(*ec));
+	if (!ec)
+		return -ENOMEM;
+
+	snprintf(ec->device, sizeof(ec->device), "%s",
+		 device ? device : MSI_EC_DEFAULT_DEVICE);
+	if (access(ec->device, F_OK) < 0) {
+		int error = -errno;
+
+		free(ec);
+		return error;
+	}
+
+	msi_ec_find_battery(ec);
+
+	for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+		const struct msi_ec_field_def *def = &field_defs[i];
+
+		ec->fds[i] = -1;
+		if (def->path[0] == '@' && !ec->battery[0])
+			continue;
+
+		ec->fds[i] = msi_ec_open_attr(ec, def->path, &ec->writable[i]);
+		if (ec->fds[i] < 0)
+			continue;
+
+		supported++;
+		if (def->modes)
+			msi_ec_load_modes(ec, i);
+	}
+
+	ec->dev_fd = open(MSI_EC_DEV, O_RDONLY | O_CLOEXEC);
+	ec->state_bin_fd = msi_ec_open_attr(ec, "state_bin", NULL);
+	ec->state_fd = msi_ec_open_attr(ec, "state", NULL);
+	ec->transaction_fd = -1;
+	if (!msi_ec_path(ec, "transaction", path))
+		ec->transaction_fd = open(path, O_WRONLY | O_CLOEXEC);
+
+	// the fastest snapshot this driver can do
+	for (ec->backend = 0; ec->backend < MSI_EC_BACKEND_ATTRS; ec->backend++)
+		if (!msi_ec_set_backend(ec, ec->backend))
+			break;
+
+	if (!supported) {
+		msi_ec_close(ec);
+		return -ENODEV;
+	}
+
+	*result = ec;
+	return 0;
+}
+
+void msi_ec_close(struct msi_ec *ec)
+{
+	int fds[4];
+
+	if (!ec)
+		return;
+
+	fds[0] = ec->dev_fd;
+	fds[1] = ec->state_bin_fd;
+	fds[2] = ec->state_fd;
+	fds[3] = ec->transaction_fd;
+
+	for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+		if (ec->fds[i] >= 0)
+			close(ec->fds[i]);
+		for (int j = 0; j < ec->modes[i].count; j++)
+			free(ec->modes[i].names[j]);
+	}
+
+	for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+		if (fds[i] >= 0)
+			close(fds[i]);
+
+	free(ec);
+}
+
+bool msi_ec_supported(const struct msi_ec *ec, enum msi_ec_state_field field)
+{
+	return field < MSI_EC_STATE_NR_FIELDS && ec->fds[field] >= 0;
+}
+
+bool msi_ec_writable(const struct msi_ec *ec, enum msi_ec_state_field field)
+{
+	return msi_ec_supported(ec, field) && ec->writable[field];
+}
+
+const char *msi_ec_field_name(enum msi_ec_state_field field)
+{
+	return field < MSI_EC_STATE_NR_FIELDS ? field_defs[field].name : NULL;
+}
+
+// ============================================================ //
+// Getters and setters
+// ============================================================ //
+
+int msi_ec_get(struct msi_ec *ec, enum msi_ec_state_field field, int *value)
+{
+	char buf[MSI_EC_VALUE_SIZE];
+	int result;
+
+	if (!msi_ec_supported(ec, field))
+		return -EOPNOTSUPP;
+
+	result = msi_ec_read_attr(ec->fds[field], buf, sizeof(buf));
+	if (result < 0)
+		return result;
+
+	result = msi_ec_value_parse(ec, field, buf);
+	if (result < 0)
+		return result;
+
+	*value = result;
+	return 0;
+}
+
+// the text form of a value, as written to the attributes
+static int msi_ec_format(const struct msi_ec *ec, enum msi_ec_state_field field,
+			 int value, char *buf, size_t size)
+{
+	const char *name;
+
+	if (field_defs[field].kind == MSI_EC_KIND_NUMBER) {
+		if (value < 0)
+			return -EINVAL;
+		snprintf(buf, size, "%d", value);
+		return 0;
+	}
+
+	name = msi_ec_value_name(ec, field, value);
+	if (!name)
+		return -EINVAL;
+
+	snprintf(buf, size, "%s", name);
+	return 0;
+}
+
+int msi_ec_set(struct msi_ec *ec, enum msi_ec_state_field field, int value)
+{
+	char buf[MSI_EC_VALUE_SIZE];
+	int result;
+
+	if (!msi_ec_supported(ec, field))
+		return -EOPNOTSUPP;
+	if (!ec->writable[field])
+		return -EACCES;
+
+	result = msi_ec_format(ec, field, value, buf, sizeof(buf));
+	if (result < 0)
+		return result;
+
+	return msi_ec_write_attr(ec->fds[field], buf);
+}
+
+// LEDs are set through the LED class, not through transactions
+static bool msi_ec_transactional(enum msi_ec_state_field field)
+{
+	return field_defs[field].path[0] != '/';
+}
+
+int msi_ec_set_many(struct msi_ec *ec, const struct msi_ec_setting *settings,
+		    int count)
+{
+	char buf[MSI_EC_STATE_SIZE], value[MSI_EC_VALUE_SIZE];
+	bool atomic = ec->transaction_fd >= 0;
+	int len = 0, result;
+
+	for (int i = 0; i < count; i++) {
+		enum msi_ec_state_field field = settings[i].field;
+
+		if (!msi_ec_supported(ec, field))
+			return -EOPNOTSUPP;
+		if (!ec->writable[field])
+			return -EACCES;
+
+		result = msi_ec_format(ec, field, settings[i].value, value,
+				       sizeof(value));
+		if (result < 0)
+			return result;
+
+		atomic &= msi_ec_transactional(field);
+		len += snprintf(buf + len, sizeof(buf) - len, "%s=%s ",
+				field_defs[field].name, value);
+		if (len >= (int)sizeof(buf))
+			return -E2BIG;
+	}
+
+	if (atomic)
+		return msi_ec_write_attr(ec->transaction_fd, buf);
+
+	for (int i = 0; i < count; i++) {
+		result = msi_ec_set(ec, settings[i].field, settings[i].value);
+		if (result < 0)
+			return result;
+	}
+
+	return 0;
+}
+
+// ============================================================ //
+// Snapshots
+// ============================================================ //
+
+static const char *const backend_names[MSI_EC_BACKEND_NR] = {
+	[MSI_EC_BACKEND_IOCTL]     = "ioctl",
+	[MSI_EC_BACKEND_STATE_BIN] = "state_bin",
+	[MSI_EC_BACKEND_STATE]     = "state",
+	[MSI_EC_BACKEND_ATTRS]     = "attrs",
+};
+
+const char *msi_ec_backend_name(enum msi_ec_backend backend)
+{
+	return backend < MSI_EC_BACKEND_NR ? backend_names[backend] : NULL;
+}
+
+enum msi_ec_backend msi_ec_get_backend(const struct msi_ec *ec)
+{
+	return ec->backend;
+}
+
+int msi_ec_set_backend(struct msi_ec *ec, enum msi_ec_backend backend)
+{
+	int fd;
+
+	switch (backend) {
+	case MSI_EC_BACKEND_IOCTL:
+		fd = ec->dev_fd;
+		break;
+	case MSI_EC_BACKEND_STATE_BIN:
+		fd = ec->state_bin_fd;
+		break;
+	case MSI_EC_BACKEND_STATE:
+		fd = ec->state_fd;
+		break;
+	case MSI_EC_BACKEND_ATTRS:
+		fd = 0;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (fd < 0)
+		return -EOPNOTSUPP;
+
+	ec->backend = backend;
+	return 0;
+}
+
+static int msi_ec_check_state(const struct msi_ec_state *state)
+{
+	if (state->version != MSI_EC_STATE_VERSION ||
+	    state->size < sizeof(*state))
+		return -EPROTO;
+	return 0;
+}
+
+static int msi_ec_snapshot_state(struct msi_ec *ec, struct msi_ec_state *state)
+{
+	char buf[MSI_EC_STATE_SIZE], *line, *save;
+	int result;
+
+	result = msi_ec_read_attr(ec->state_fd, buf, sizeof(buf));
+	if (result < 0)
+		return result;
+
+	for (line = strtok_r(buf, "\n", &save); line;
+	     line = strtok_r(NULL, "\n", &save)) {
+		char *value = strchr(line, '=');
+
+		if (!value)
+			continue;
+		*value++ = '\0';
+
+		if (!strcmp(line, "timestamp_ns")) {
+			state->timestamp_ns = strtoull(value, NULL, 10);
+			continue;
+		}
+
+		if (!strcmp(line, "stale")) {
+			if (atoi(value))
+				state->flags |= MSI_EC_STATE_STALE;
+			continue;
+		}
+
+		for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+			if (strcmp(line, field_defs[i].name))
+				continue;
+
+			state->present |= 1u << i;
+			result = msi_ec_value_parse(ec, i, value);
+			if (result >= 0) {
+				state->values[i] = result;
+				state->valid |= 1u << i;
+			}
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int msi_ec_snapshot_attrs(struct msi_ec *ec, struct msi_ec_state *state)
+{
+	for (int i = 0; i < MSI_EC_STATE_NR_FIELDS; i++) {
+		if (!msi_ec_supported(ec, i))
+			continue;
+
+		state->present |= 1u << i;
+		if (!msi_ec_get(ec, i, &state->values[i]))
+			state->valid |= 1u << i;
+	}
+
+	return 0;
+}
+
+int msi_ec_snapshot(struct msi_ec *ec, struct msi_ec_state *state)
+{
+	ssize_t len;
+
+	switch (ec->backend) {
+	case MSI_EC_BACKEND_IOCTL:
+		if (ioctl(ec->dev_fd, MSI_EC_IOC_STATE, state) < 0)
+			return -errno;
+		return msi_ec_check_state(state);
+
+	case MSI_EC_BACKEND_STATE_BIN:
+		len = pread(ec->state_bin_fd, state, sizeof(*state), 0);
+		if (len < 0)
+			return -errno;
+		if (len != sizeof(*state))
+			return -EPROTO;
+		return msi_ec_check_state(state);
+
+	default:
+		// raw registers aren't available from the text interfaces
+		memset(state, 0, sizeof(*state));
+		state->version = MSI_EC_STATE_VERSION;
+		state->size = sizeof(*state);
+		state->nr_fields = MSI_EC_STATE_NR_FIELDS;
+
+		if (ec->backend == MSI_EC_BACKEND_STATE)
+			return msi_ec_snapshot_state(ec, state);
+		return msi_ec_snapshot_attrs(ec, state);
+	}
+}
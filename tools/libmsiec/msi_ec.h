@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * msi_ec.h - Userspace client library for the msi-ec driver.
+ *
+ * A handle discovers the supported attributes once and keeps them open,
+ * every access afterwards is a single pread() or pwrite(). Values are
+ * integers encoded like the values of struct msi_ec_state (see
+ * msi_ec_uapi.h): 1 for "on" and "right", indexes into the available
+ * modes for shift_mode and fan_mode, percents and degrees otherwise.
+ *
+ * Snapshots use the most efficient interface the running driver offers:
+ * the MSI_EC_IOC_STATE ioctl of /dev/msi-ec, then state_bin, then the
+ * state attribute, then one read per attribute for old drivers.
+ *
+ * All functions returning int return 0 or a negative errno.
+ */
+
+#ifndef __MSI_EC_LIB__
+#define __MSI_EC_LIB__
+
+#include <stdbool.h>
+
+#include "msi_ec_uapi.h"
+
+#define MSI_EC_DEFAULT_DEVICE "/sys/devices/platform/msi-ec"
+
+struct msi_ec;
+
+enum msi_ec_backend {
+	MSI_EC_BACKEND_IOCTL,      // /dev/msi-ec
+	MSI_EC_BACKEND_STATE_BIN,  // state_bin
+	MSI_EC_BACKEND_STATE,      // state, parsed
+	MSI_EC_BACKEND_ATTRS,      // one read per attribute
+
+	MSI_EC_BACKEND_NR
+};
+
+// a value for msi_ec_set_many()
+struct msi_ec_setting {
+	enum msi_ec_state_field field;
+	int value;
+};
+
+// device is the platform device directory, NULL for the default one
+int msi_ec_open(const char *device, struct msi_ec **ec);
+void msi_ec_close(struct msi_ec *ec);
+
+bool msi_ec_supported(const struct msi_ec *ec, enum msi_ec_state_field field);
+bool msi_ec_writable(const struct msi_ec *ec, enum msi_ec_state_field field);
+
+// key of the field in the state and transaction attributes
+const char *msi_ec_field_name(enum msi_ec_state_field field);
+
+int msi_ec_get(struct msi_ec *ec, enum msi_ec_state_field field, int *value);
+int msi_ec_set(struct msi_ec *ec, enum msi_ec_state_field field, int value);
+
+/*
+ * Applies several settings, atomically through the transaction attribute
+ * when the driver has it, one after the other otherwise.
+ */
+int msi_ec_set_many(struct msi_ec *ec, const struct msi_ec_setting *settings,
+		    int count);
+
+// every supported field, read from one EC snapshot when possible
+int msi_ec_snapshot(struct msi_ec *ec, struct msi_ec_state *state);
+
+enum msi_ec_backend msi_ec_get_backend(const struct msi_ec *ec);
+// -EOPNOTSUPP if the running driver doesn't provide it
+int msi_ec_set_backend(struct msi_ec *ec, enum msi_ec_backend backend);
+const char *msi_ec_backend_name(enum msi_ec_backend backend);
+
+/*
+ * Vocabulary of a field: the string the driver uses for a value, or NULL,
+ * and the value of a string, or a negative errno.
+ */
+const char *msi_ec_value_name(const struct msi_ec *ec,
+			      enum msi_ec_state_field field, int value);
+int msi_ec_value_parse(const struct msi_ec *ec, enum msi_ec_state_field field,
+		       const char *name);
+
+// the values accepted by a field, e.g. the available shift modes
+int msi_ec_value_count(const struct msi_ec *ec, enum msi_ec_state_field field);
+
+#endif // __MSI_EC_LIB__
@@ -0,0 +1,440 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-bench.c - latency and throughput of the msi-ec sysfs interface.
+ *
+ * Measures every attribute of the platform device, its cpu/ and gpu/
+ * directories and the battery charge thresholds:
+ *   cold        the first read after opening the attribute
+ *   read        repeated reads of an open attribute
+ *   write       writing back the current value (only with -w)
+ *   throughput  reads per second with 1, 2, 4... concurrent threads
+ *
+ * Results are printed as JSON, one object per line, so that runs against
+ * different driver versions can be compared. The first line describes the
+ * system. Load the module with "emulate=1 firmware=<version>" to measure
+ * the driver alone, without the cost of the EC.
+ *
+ * Build with "make bench".
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <glob.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_DEVICE   "/sys/devices/platform/msi-ec"
+#define MODULE_DIR       "/sys/module/msi_ec"
+#define MAX_ATTRS        128
+#define MAX_THREADS      64
+#define VALUE_SIZE       4096
+
+struct attr {
+	char path[PATH_MAX];
+	char name[64]; // relative to the device, e.g. "cpu/basic_fan_speed"
+	bool writable;
+};
+
+static struct attr attrs[MAX_ATTRS];
+static int nr_attrs;
+
+static const char *device_dir = DEFAULT_DEVICE;
+static const char *battery_dir;
+static int iterations = 1000;
+static int max_threads = 8;
+static int duration_ms = 500;
+static bool do_write;
+
+// generic device files, not part of the driver
+static const char *const skipped[] = {
+	"uevent", "modalias", "driver_override",
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool is_skipped(const char *name)
+{
+	for (size_t i = 0; i < sizeof(skipped) / sizeof(skipped[0]); i++)
+		if (!strcmp(name, skipped[i]))
+			return true;
+	return false;
+}
+
+static void add_attr(const char *dir, const char *prefix, const char *name)
+{
+	struct attr *attr;
+	struct stat st;
+
+	if (nr_attrs == MAX_ATTRS || is_skipped(name))
+		return;
+
+	attr = &attrs[nr_attrs];
+	snprintf(attr->path, sizeof(attr->path), "%s/%s", dir, name);
+	snprintf(attr->name, sizeof(attr->name), "%s%s", prefix, name);
+
+	if (stat(attr->path, &st) < 0 || !S_ISREG(st.st_mode))
+		return;
+
+	// write-only attributes have nothing to read back
+	if (!(st.st_mode & S_IRUSR))
+		return;
+
+	attr->writable = st.st_mode & S_IWUSR;
+	nr_attrs++;
+}
+
+static void scan_dir(const char *dir, const char *prefix)
+{
+	struct dirent *entry;
+	DIR *d = opendir(dir);
+
+	if (!d)
+		return;
+
+	while ((entry = readdir(d)))
+		if (entry->d_name[0] != '.')
+			add_attr(dir, prefix, entry->d_name);
+
+	closedir(d);
+}
+
+static void scan_battery(void)
+{
+	glob_t found;
+	char dir[PATH_MAX];
+
+	if (battery_dir) {
+		snprintf(dir, sizeof(dir), "%s", battery_dir);
+	} else {
+		if (glob("/sys/class/power_supply/BAT*", 0, NULL, &found) ||
+		    !found.gl_pathc)
+			return;
+		snprintf(dir, sizeof(dir), "%s", found.gl_pathv[0]);
+		globfree(&found);
+	}
+
+	add_attr(dir, "power_supply/", "charge_control_start_threshold");
+	add_attr(dir, "power_supply/", "charge_control_end_threshold");
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void print_latency(const struct attr *attr, const char *test,
+			  uint64_t *samples, int count, int errors)
+{
+	uint64_t sum = 0;
+
+	printf("{\"attr\":\"%s\",\"test\":\"%s\",\"samples\":%d,"
+	       "\"errors\":%d", attr->name, test, count, errors);
+
+	if (count) {
+		qsort(samples, count, sizeof(*samples), cmp_u64);
+		for (int i = 0; i < count; i++)
+			sum += samples[i];
+
+		printf(",\"min_ns\":%llu,\"p50_ns\":%llu,\"p90_ns\":%llu,"
+		       "\"p99_ns\":%llu,\"max_ns\":%llu,\"mean_ns\":%llu",
+		       (unsigned long long)samples[0],
+		       (unsigned long long)samples[count / 2],
+		       (unsigned long long)samples[count * 90 / 100],
+		       (unsigned long long)samples[count * 99 / 100],
+		       (unsigned long long)samples[count - 1],
+		       (unsigned long long)(sum / count));
+	}
+
+	printf("}\n");
+}
+
+static void bench_cold(const struct attr *attr)
+{
+	char value[VALUE_SIZE];
+	uint64_t start, end;
+	int fd, errors = 0;
+
+	start = now_ns();
+	fd = open(attr->path, O_RDONLY);
+	if (fd < 0 || read(fd, value, sizeof(value)) < 0)
+		errors++;
+	end = now_ns();
+
+	if (fd >= 0)
+		close(fd);
+
+	printf("{\"attr\":\"%s\",\"test\":\"cold\",\"errors\":%d,"
+	       "\"ns\":%llu}\n", attr->name, errors,
+	       (unsigned long long)(end - start));
+}
+
+static void bench_read(const struct attr *attr, uint64_t *samples)
+{
+	char value[VALUE_SIZE];
+	int fd, count = 0, errors = 0;
+
+	fd = open(attr->path, O_RDONLY);
+	if (fd < 0) {
+		print_latency(attr, "read", samples, 0, 1);
+		return;
+	}
+
+	for (int i = 0; i < iterations; i++) {
+		uint64_t start = now_ns();
+
+		// sysfs calls show() again for every read at offset 0
+		if (pread(fd, value, sizeof(value), 0) < 0) {
+			errors++;
+			continue;
+		}
+		samples[count++] = now_ns() - start;
+	}
+
+	close(fd);
+	print_latency(attr, "read", samples, count, errors);
+}
+
+static void bench_write(const struct attr *attr, uint64_t *samples)
+{
+	char value[VALUE_SIZE];
+	int fd, count = 0, errors = 0;
+	ssize_t len;
+
+	fd = open(attr->path, O_RDWR);
+	if (fd < 0) {
+		print_latency(attr, "write", samples, 0, 1);
+		return;
+	}
+
+	// the current value, so that the benchmark changes nothing
+	len = pread(fd, value, sizeof(value), 0);
+	if (len <= 0) {
+		close(fd);
+		print_latency(attr, "write", samples, 0, 1);
+		return;
+	}
+
+	for (int i = 0; i < iterations; i++) {
+		uint64_t start = now_ns();
+
+		if (pwrite(fd, value, len, 0) < 0) {
+			errors++;
+			continue;
+		}
+		samples[count++] = now_ns() - start;
+	}
+
+	close(fd);
+	print_latency(attr, "write", samples, count, errors);
+}
+
+struct reader {
+	pthread_t thread;
+	const struct attr *attr;
+	volatile bool *stop;
+	uint64_t reads;
+	uint64_t errors;
+};
+
+static void *reader_fn(void *data)
+{
+	struct reader *reader = data;
+	char value[VALUE_SIZE];
+	int fd = open(reader->attr->path, O_RDONLY);
+
+	if (fd < 0) {
+		reader->errors++;
+		return NULL;
+	}
+
+	while (!*reader->stop) {
+		if (pread(fd, value, sizeof(value), 0) < 0)
+			reader->errors++;
+		else
+			reader->reads++;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void bench_throughput(const struct attr *attr, int threads)
+{
+	struct reader readers[MAX_THREADS] = { 0 };
+	volatile bool stop = false;
+	struct timespec wait = {
+		.tv_sec = duration_ms / 1000,
+		.tv_nsec = (duration_ms % 1000) * 1000000l,
+	};
+	uint64_t start, elapsed, reads = 0, errors = 0;
+	int started = 0;
+
+	start = now_ns();
+	for (; started < threads; started++) {
+		readers[started].attr = attr;
+		readers[started].stop = &stop;
+		if (pthread_create(&readers[started].thread, NULL, reader_fn,
+				   &readers[started]))
+			break;
+	}
+
+	nanosleep(&wait, NULL);
+	stop = true;
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(readers[i].thread, NULL);
+		reads += readers[i].reads;
+		errors += readers[i].errors;
+	}
+	elapsed = now_ns() - start;
+
+	printf("{\"attr\":\"%s\",\"test\":\"throughput\",\"threads\":%d,"
+	       "\"reads\":%llu,\"errors\":%llu,\"reads_per_sec\":%llu}\n",
+	       attr->name, started, (unsigned long long)reads,
+	       (unsigned long long)errors,
+	       (unsigned long long)(reads * 1000000000ull / elapsed));
+}
+
+static void read_line(const char *path, char *buf, size_t size)
+{
+	FILE *f = fopen(path, "r");
+
+	snprintf(buf, size, "unknown");
+	if (!f)
+		return;
+
+	if (fgets(buf, size, f))
+		buf[strcspn(buf, "\n")] = '\0';
+	fclose(f);
+}
+
+static void print_system(void)
+{
+	char path[PATH_MAX], fw[64], version[64], emulated[8];
+	struct utsname uts;
+
+	uname(&uts);
+	snprintf(path, sizeof(path), "%s/fw_version", device_dir);
+	read_line(path, fw, sizeof(fw));
+	read_line(MODULE_DIR "/version", version, sizeof(version));
+	read_line(MODULE_DIR "/parameters/emulate", emulated,
+		  sizeof(emulated));
+
+	printf("{\"kernel\":\"%s\",\"driver\":\"%s\",\"fw_version\":\"%s\","
+	       "\"emulate\":\"%s\",\"iterations\":%d,\"duration_ms\":%d}\n",
+	       uts.release, version, fw, emulated, iterations, duration_ms);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options] [attribute...]\n"
+		"  -d DIR   platform device directory (default " DEFAULT_DEVICE ")\n"
+		"  -b DIR   battery directory (default: first /sys/class/power_supply/BAT*)\n"
+		"  -n N     iterations of the latency tests (default 1000)\n"
+		"  -t N     up to N concurrent readers (default 8)\n"
+		"  -T MS    duration of each throughput test (default 500)\n"
+		"  -w       also measure writes, writing back the current values\n"
+		"Attributes are named relative to the device, e.g. cpu/basic_fan_speed.\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	char dir[PATH_MAX];
+	uint64_t *samples;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:b:n:t:T:wh")) != -1) {
+		switch (opt) {
+		case 'd':
+			device_dir = optarg;
+			break;
+		case 'b':
+			battery_dir = optarg;
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'T':
+			duration_ms = atoi(optarg);
+			break;
+		case 'w':
+			do_write = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (iterations <= 0 || duration_ms <= 0 || max_threads <= 0 ||
+	    max_threads > MAX_THREADS) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (access(device_dir, F_OK) < 0) {
+		fprintf(stderr, "%s: %s\n", device_dir, strerror(errno));
+		return 1;
+	}
+
+	scan_dir(device_dir, "");
+	snprintf(dir, sizeof(dir), "%s/cpu", device_dir);
+	scan_dir(dir, "cpu/");
+	snprintf(dir, sizeof(dir), "%s/gpu", device_dir);
+	scan_dir(dir, "gpu/");
+	scan_battery();
+
+	samples = calloc(iterations, sizeof(*samples));
+	if (!samples)
+		return 1;
+
+	print_system();
+
+	for (int i = 0; i < nr_attrs; i++) {
+		const struct attr *attr = &attrs[i];
+		bool selected = optind == argc;
+
+		for (int j = optind; j < argc; j++)
+			selected |= !strcmp(argv[j], attr->name);
+		if (!selected)
+			continue;
+
+		bench_cold(attr);
+		bench_read(attr, samples);
+		if (do_write && attr->writable)
+			bench_write(attr, samples);
+		for (int threads = 1; threads <= max_threads; threads *= 2)
+			bench_throughput(attr, threads);
+		fflush(stdout);
+	}
+
+	free(samples);
+	return 0;
+}
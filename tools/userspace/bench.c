@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * bench.c - throughput of the driver's show and store paths.
+ *
+ * Runs every readable attribute's show, and with -w every writable
+ * attribute's store of its current value, in a loop against the emulated
+ * EC. There is no EC latency and no syscall, so this measures the
+ * driver's own code: decoding, encoding, locking and formatting. Results
+ * are JSON lines, like msi-ec-bench; run it under perf to see where the
+ * time goes.
+ *
+ *   bench [-f firmware] [-n iterations] [-w] [attribute...]
+ *
+ * Build with "make userspace-bench".
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msi_ec_core.h"
+
+#define PAGE 4096
+
+static long iterations = 100000;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void report(const char *name, const char *test, uint64_t elapsed,
+		   long errors)
+{
+	printf("{\"name\":\"%s\",\"test\":\"%s\",\"iterations\":%ld,"
+	       "\"errors\":%ld,\"ns_per_op\":%.1f,\"ops_per_s\":%.0f}\n",
+	       name, test, iterations, errors, (double)elapsed / iterations,
+	       elapsed ? iterations * 1e9 / elapsed : 0);
+}
+
+static void bench_attr(const char *name, bool do_write)
+{
+	unsigned int mode = msi_ec_core_attr_mode(name);
+	char buf[PAGE], value[PAGE];
+	uint64_t start;
+	ssize_t len;
+	long errors;
+
+	if (mode & 0444) {
+		errors = 0;
+		start = now_ns();
+		for (long i = 0; i < iterations; i++)
+			errors += msi_ec_core_show(name, buf) < 0;
+		report(name, "show", now_ns() - start, errors);
+	}
+
+	if (!do_write || !(mode & 0222) || !(mode & 0444))
+		return;
+
+	len = msi_ec_core_show(name, value);
+	if (len <= 0)
+		return;
+
+	errors = 0;
+	start = now_ns();
+	for (long i = 0; i < iterations; i++)
+		errors += msi_ec_core_store(name, value, len) < 0;
+	report(name, "store", now_ns() - start, errors);
+}
+
+int main(int argc, char **argv)
+{
+	const char *firmware = "14C1EMS1.012";
+	bool do_write = false;
+	int opt, result;
+
+	while ((opt = getopt(argc, argv, "f:n:wh")) != -1) {
+		switch (opt) {
+		case 'f':
+			firmware = optarg;
+			break;
+		case 'n':
+			iterations = atol(optarg);
+			break;
+		case 'w':
+			do_write = true;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-f firmware] [-n iterations] [-w] "
+				"[attribute...]\n", argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (iterations <= 0)
+		return 1;
+
+	msi_ec_core_quiet(true);
+	result = msi_ec_core_load(firmware, false);
+	if (result < 0) {
+		fprintf(stderr, "%s: load failed: %d\n", firmware, result);
+		return 1;
+	}
+
+	printf("{\"firmware\":\"%s\",\"iterations\":%ld}\n", firmware,
+	       iterations);
+
+	if (optind < argc) {
+		for (int i = optind; i < argc; i++)
+			bench_attr(argv[i], do_write);
+	} else {
+		for (int i = 0; i < msi_ec_core_nr_attrs(); i++)
+			bench_attr(msi_ec_core_attr_name(i), do_write);
+	}
+
+	msi_ec_core_unload();
+	return 0;
+}
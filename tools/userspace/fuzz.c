@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * fuzz.c - fuzzes the driver's parsers and decoders.
+ *
+ * An input is an attribute index, an EC register and its value, then the
+ * bytes to store into the attribute. The register is set first, so the
+ * decoders see arbitrary EC contents, then every readable attribute is
+ * shown and must produce a newline-terminated page.
+ *
+ * Built with clang -fsanitize=fuzzer and -DMSI_EC_LIBFUZZER this is a
+ * libFuzzer target. Otherwise main() runs the files given as arguments,
+ * or random inputs:
+ *
+ *   fuzz [-f firmware] [-n iterations] [-s seed] [file...]
+ *
+ * The firmware can also be set with MSI_EC_FIRMWARE. Build with
+ * "make userspace-fuzz".
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "msi_ec_core.h"
+
+#define PAGE 4096
+#define DEFAULT_FIRMWARE "14C1EMS1.012"
+
+static int nr_attrs;
+
+static void fuzz_init(const char *firmware)
+{
+	int result;
+
+	if (!firmware)
+		firmware = getenv("MSI_EC_FIRMWARE");
+	if (!firmware)
+		firmware = DEFAULT_FIRMWARE;
+
+	msi_ec_core_quiet(true);
+	result = msi_ec_core_load(firmware, true);
+	if (result < 0) {
+		fprintf(stderr, "%s: load failed: %d\n", firmware, result);
+		exit(1);
+	}
+
+	nr_attrs = msi_ec_core_nr_attrs();
+}
+
+static void fuzz_one(const uint8_t *data, size_t size)
+{
+	uint8_t *regs = msi_ec_core_registers();
+	const char *name;
+	char buf[PAGE];
+
+	if (size < 3 || !nr_attrs)
+		return;
+
+	name = msi_ec_core_attr_name(data[0] % nr_attrs);
+
+	// the firmware version stays, the driver read it once at load
+	if (data[1] < 0xa0 || data[1] >= 0xbc)
+		regs[data[1]] = data[2];
+
+	if (msi_ec_core_attr_mode(name) & 0222)
+		msi_ec_core_store(name, (const char *)data + 3, size - 3);
+
+	for (int i = 0; i < nr_attrs; i++) {
+		ssize_t len;
+
+		name = msi_ec_core_attr_name(i);
+		if (!(msi_ec_core_attr_mode(name) & 0444))
+			continue;
+
+		len = msi_ec_core_show(name, buf);
+		if (len >= PAGE || (len > 0 && buf[len - 1] != '\n')) {
+			fprintf(stderr, "%s: show returned %zd\n", name, len);
+			abort();
+		}
+	}
+}
+
+#ifdef MSI_EC_LIBFUZZER
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	fuzz_init(NULL);
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	fuzz_one(data, size);
+	return 0;
+}
+
+#else
+
+static int run_file(const char *path)
+{
+	uint8_t data[PAGE];
+	size_t size;
+	FILE *file;
+
+	file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return 1;
+	}
+
+	size = fread(data, 1, sizeof(data), file);
+	fclose(file);
+
+	fuzz_one(data, size);
+	return 0;
+}
+
+// inputs a parser is likely to care about, mixed with random bytes
+static size_t random_input(uint8_t *data, size_t max)
+{
+	static const char *const words[] = {
+		"on", "off", "left", "right", "min", "medium", "max", "eco",
+		"comfort", "sport", "turbo", "auto", "silent", "basic",
+		"advanced", "0", "50", "100", "255", "-1", "0x", "\n", " ",
+		"=", ",", "shift_mode", "fan_mode", "webcam", "cooler_boost",
+	};
+	size_t size = 3;
+
+	for (int i = 0; i < 3; i++)
+		data[i] = rand();
+
+	while (size < max - 16 && rand() % 4) {
+		if (rand() % 3) {
+			const char *word = words[rand() % (sizeof(words) /
+							  sizeof(*words))];
+
+			memcpy(data + size, word, strlen(word));
+			size += strlen(word);
+		} else {
+			data[size++] = rand();
+		}
+	}
+
+	return size;
+}
+
+int main(int argc, char **argv)
+{
+	const char *firmware = NULL;
+	long iterations = 100000;
+	unsigned int seed = 1;
+	uint8_t data[256];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:n:s:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			firmware = optarg;
+			break;
+		case 'n':
+			iterations = atol(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-f firmware] [-n iterations] "
+				"[-s seed] [file...]\n", argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	fuzz_init(firmware);
+
+	if (optind < argc) {
+		int failed = 0;
+
+		for (int i = optind; i < argc; i++)
+			failed += run_file(argv[i]);
+		return failed ? 1 : 0;
+	}
+
+	srand(seed);
+	for (long i = 0; i < iterations; i++)
+		fuzz_one(data, random_input(data, sizeof(data)));
+
+	printf("%ld inputs, seed %u\n", iterations, seed);
+	msi_ec_core_unload();
+	return 0;
+}
+
+#endif // MSI_EC_LIBFUZZER
@@ -0,0 +1,1704 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * kernel.h - The kernel API used by msi-ec.c, implemented in userspace.
+ *
+ * Every <linux/...> header the driver includes resolves to this file.
+ * It is included by msi_ec_core.c only, together with msi-ec.c, so its
+ * functions are static and its state is private to that translation unit.
+ *
+ * Registrations (attribute groups, LEDs, the battery hook, the misc device,
+ * the platform profile, debugfs files, the IIO device, the PMU) are
+ * recorded so that the harness can reach the driver's callbacks. Work items run when
+ * the harness drains them with uspace_run_work(). Locks, spinlocks included, are pthread mutexes and
+ * allocations go through malloc(), so sanitizers see everything the
+ * driver does.
+ */
+
+#ifndef __MSI_EC_USPACE_KERNEL__
+#define __MSI_EC_USPACE_KERNEL__
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ============================================================ //
+// Types and macros
+// ============================================================ //
+
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 12, 0)
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef s64 ktime_t;
+typedef unsigned int gfp_t;
+typedef unsigned short umode_t;
+typedef unsigned int fmode_t;
+
+#define __init
+#define __initconst
+#define __initdata
+#define __exit
+#define __user
+
+#define KBUILD_MODNAME "msi_ec"
+#define THIS_MODULE NULL
+#define GFP_KERNEL 0
+#define PAGE_SIZE 4096
+#define ENOTSUPP 524
+#define U8_MAX 0xff
+
+#define BIT(n) (1UL << (n))
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define BITS_TO_LONGS(n) (((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define __stringify_1(x) #x
+#define __stringify(x) __stringify_1(x)
+#define __maybe_unused __attribute__((unused))
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(t, a, b) min((t)(a), (t)(b))
+#define max_t(t, a, b) max((t)(a), (t)(b))
+#define clamp(v, lo, hi) min(max(v, lo), hi)
+#define DIV_ROUND_CLOSEST(x, d) \
+	(((x) > 0) == ((d) > 0) ? ((x) + (d) / 2) / (d) : ((x) - (d) / 2) / (d))
+
+#define __aligned(x) __attribute__((aligned(x)))
+
+#define READ_ONCE(x) (*(volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, v) (*(volatile typeof(x) *)&(x) = (v))
+
+#define IS_ERR(p) ((unsigned long)(p) >= (unsigned long)-4095)
+#define PTR_ERR(p) ((long)(p))
+#define ERR_PTR(e) ((void *)(long)(e))
+#define IS_ENABLED(x) 1
+#define IS_REACHABLE(x) 1
+#define static_assert(x) _Static_assert(x, #x)
+#define lockdep_assert_held(m) ((void)(m))
+
+// drivers log through this, the harness can silence it (e.g. fuzzing)
+static bool uspace_quiet;
+
+#define uspace_log(fmt, ...) \
+	do { \
+		if (!uspace_quiet) \
+			fprintf(stderr, fmt, ##__VA_ARGS__); \
+	} while (0)
+#define pr_err(fmt, ...) uspace_log(pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_warn(fmt, ...) uspace_log(pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_info(fmt, ...) uspace_log(pr_fmt(fmt), ##__VA_ARGS__)
+
+#define module_param(name, type, perm)
+#define module_param_array(name, type, nump, perm)
+#define MODULE_PARM_DESC(name, desc)
+#define MODULE_LICENSE(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_VERSION(x)
+#define module_init(fn) int (*const uspace_module_init)(void) = fn
+#define module_exit(fn) void (*const uspace_module_exit)(void) = fn
+
+// ============================================================ //
+// Memory and strings
+// ============================================================ //
+
+static inline void *kmalloc(size_t size, gfp_t gfp)
+{
+	return malloc(size);
+}
+
+static inline void *kzalloc(size_t size, gfp_t gfp)
+{
+	return calloc(1, size);
+}
+
+static inline void *kmalloc_array(size_t n, size_t size, gfp_t gfp)
+{
+	return n && size > SIZE_MAX / n ? NULL : malloc(n * size);
+}
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+static inline char *kmemdup_nul(const char *s, size_t len, gfp_t gfp)
+{
+	char *p = malloc(len + 1);
+
+	if (p) {
+		memcpy(p, s, len);
+		p[len] = '\0';
+	}
+	return p;
+}
+
+static inline size_t array_size(size_t a, size_t b)
+{
+	size_t bytes;
+
+	return __builtin_mul_overflow(a, b, &bytes) ? SIZE_MAX : bytes;
+}
+
+// user pointers are plain pointers here
+static inline unsigned long copy_from_user(void *to, const void *from,
+					   unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline unsigned long copy_to_user(void *to, const void *from,
+					 unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline void *memdup_user(const void *src, size_t len)
+{
+	void *p = malloc(len ? len : 1);
+
+	if (!p)
+		return ERR_PTR(-ENOMEM);
+	memcpy(p, src, len);
+	return p;
+}
+
+#define u64_to_user_ptr(x) ((void *)(uintptr_t)(x))
+
+static inline ssize_t strscpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strnlen(src, size);
+
+	if (!size)
+		return -E2BIG;
+	if (len == size) {
+		memcpy(dst, src, size - 1);
+		dst[size - 1] = '\0';
+		return -E2BIG;
+	}
+	memcpy(dst, src, len + 1);
+	return len;
+}
+
+static inline int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	if (!size)
+		return 0;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+
+	return len >= (int)size ? (int)size - 1 : len;
+}
+
+static inline int sysfs_emit_at(char *buf, int at, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static inline int sysfs_emit_at(char *buf, int at, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	if (at < 0 || at >= PAGE_SIZE)
+		return 0;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf + at, PAGE_SIZE - at, fmt, args);
+	va_end(args);
+
+	return len >= PAGE_SIZE - at ? PAGE_SIZE - at - 1 : len;
+}
+
+#define sysfs_emit(buf, fmt, ...) sysfs_emit_at(buf, 0, fmt, ##__VA_ARGS__)
+
+// like the kernel: one trailing newline allowed, nothing else
+static inline int uspace_kstrtoull(const char *s, unsigned int base,
+				   unsigned long long max,
+				   unsigned long long *res)
+{
+	unsigned long long value;
+	char *end;
+
+	if (*s == '+')
+		s++;
+	if (!*s || *s == '-' || *s == ' ')
+		return -EINVAL;
+
+	errno = 0;
+	value = strtoull(s, &end, base);
+	if (end == s || errno == ERANGE)
+		return end == s ? -EINVAL : -ERANGE;
+	if (*end == '\n')
+		end++;
+	if (*end)
+		return -EINVAL;
+	if (value > max)
+		return -ERANGE;
+
+	*res = value;
+	return 0;
+}
+
+static inline int kstrtou8(const char *s, unsigned int base, u8 *res)
+{
+	unsigned long long value;
+	int result = uspace_kstrtoull(s, base, U8_MAX, &value);
+
+	if (!result)
+		*res = value;
+	return result;
+}
+
+static inline int kstrtoint(const char *s, unsigned int base, int *res)
+{
+	unsigned long long value;
+	bool negative = *s == '-';
+	int result;
+
+	result = uspace_kstrtoull(s + negative, base,
+				  (unsigned long long)INT_MAX + negative,
+				  &value);
+	if (!result)
+		*res = negative ? -(long long)value : (long long)value;
+	return result;
+}
+
+static inline int kstrtobool(const char *s, bool *res)
+{
+	if (!s)
+		return -EINVAL;
+
+	switch (s[0]) {
+	case 'y': case 'Y': case '1':
+		*res = true;
+		return 0;
+	case 'n': case 'N': case '0':
+		*res = false;
+		return 0;
+	case 'o': case 'O':
+		if (s[1] == 'n' || s[1] == 'N') {
+			*res = true;
+			return 0;
+		}
+		if (s[1] == 'f' || s[1] == 'F') {
+			*res = false;
+			return 0;
+		}
+		break;
+	}
+	return -EINVAL;
+}
+
+// parameters are plain variables, the harness sets them directly
+struct kernel_param {
+	void *arg;
+};
+
+struct kernel_param_ops {
+	int (*set)(const char *val, const struct kernel_param *kp);
+	int (*get)(char *buf, const struct kernel_param *kp);
+};
+
+#define module_param_cb(name, ops, arg, perm) \
+	static const struct kernel_param_ops *uspace_param_##name \
+		__attribute__((unused)) = (ops)
+
+static inline int param_set_bool(const char *val,
+				 const struct kernel_param *kp)
+{
+	return kstrtobool(val, kp->arg);
+}
+
+static inline int param_get_bool(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%c\n", *(bool *)kp->arg ? 'Y' : 'N');
+}
+
+static inline int param_set_uint(const char *val,
+				 const struct kernel_param *kp)
+{
+	unsigned long long value;
+	int result = uspace_kstrtoull(val, 0, UINT_MAX, &value);
+
+	if (!result)
+		*(unsigned int *)kp->arg = value;
+	return result;
+}
+
+static inline int param_get_uint(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%u\n", *(unsigned int *)kp->arg);
+}
+
+#define kernel_param_lock(mod) do { } while (0)
+#define kernel_param_unlock(mod) do { } while (0)
+
+static inline char *strim(char *s)
+{
+	size_t len = strlen(s);
+
+	while (len && isspace((unsigned char)s[len - 1]))
+		s[--len] = '\0';
+	while (isspace((unsigned char)*s))
+		s++;
+	return s;
+}
+
+static inline bool sysfs_streq(const char *a, const char *b)
+{
+	while (*a && *a == *b) {
+		a++;
+		b++;
+	}
+
+	if (*a == *b)
+		return true;
+	if (*a == '\n' && !a[1] && !*b)
+		return true;
+	if (*b == '\n' && !b[1] && !*a)
+		return true;
+	return false;
+}
+
+static inline u32 full_name_hash(const void *salt, const char *name,
+				 unsigned int len)
+{
+	u32 hash = 2166136261u;
+
+	while (len--)
+		hash = (hash ^ (u8)*name++) * 16777619u;
+	return hash;
+}
+
+
+static inline u64 div_u64(u64 a, u32 b)
+{
+	return a / b;
+}
+
+static inline unsigned long long div64_u64(unsigned long long a,
+					   unsigned long long b)
+{
+	return a / b;
+}
+
+static inline u32 hash_32(u32 val, unsigned int bits)
+{
+	return (val * 0x61c88647u) >> (32 - bits);
+}
+
+// the caller's uid, root unless the harness says otherwise
+static uid_t uspace_uid;
+
+typedef struct {
+	uid_t val;
+} kuid_t;
+
+static int init_user_ns;
+
+static inline kuid_t current_uid(void)
+{
+	return (kuid_t) { uspace_uid };
+}
+
+static inline uid_t from_kuid(void *ns, kuid_t uid)
+{
+	return uid.val;
+}
+
+// one CPU, whose idle and wall times the harness advances
+static u64 uspace_cpu_idle_us, uspace_cpu_wall_us;
+
+#define for_each_online_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+static inline u64 get_cpu_idle_time_us(int cpu, u64 *wall)
+{
+	*wall = uspace_cpu_wall_us;
+	return uspace_cpu_idle_us;
+}
+
+enum cpu_usage_stat {
+	CPUTIME_IDLE,
+	CPUTIME_IOWAIT,
+	NR_STATS,
+};
+
+struct kernel_cpustat {
+	u64 cpustat[NR_STATS];
+};
+
+static struct kernel_cpustat uspace_kcpustat;
+
+#define kcpustat_cpu(cpu) (uspace_kcpustat)
+
+#define TASK_COMM_LEN 16
+
+struct task_struct {
+	pid_t pid;
+	pid_t tgid;
+	char comm[TASK_COMM_LEN];
+};
+
+// the caller's process, one for the whole harness unless it says otherwise
+static struct task_struct uspace_task = {
+	.pid = 1,
+	.tgid = 1,
+	.comm = "uspace",
+};
+
+#define current (&uspace_task)
+
+static inline pid_t task_tgid_nr(struct task_struct *task)
+{
+	return task->tgid;
+}
+
+// the kernel's sort() is a heapsort taking an optional swap function
+#define sort(base, num, size, cmp, swap) qsort(base, num, size, cmp)
+
+// ============================================================ //
+// Bitmaps
+// ============================================================ //
+
+static inline bool test_bit(long nr, const unsigned long *addr)
+{
+	return addr[nr / BITS_PER_LONG] & (1UL << (nr % BITS_PER_LONG));
+}
+
+static inline void __set_bit(long nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+static inline void __clear_bit(long nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] &= ~(1UL << (nr % BITS_PER_LONG));
+}
+
+static inline void set_bit(long nr, unsigned long *addr)
+{
+	__atomic_fetch_or(&addr[nr / BITS_PER_LONG],
+			  1UL << (nr % BITS_PER_LONG), __ATOMIC_SEQ_CST);
+}
+
+static inline bool test_and_set_bit(long nr, unsigned long *addr)
+{
+	unsigned long bit = 1UL << (nr % BITS_PER_LONG);
+
+	return __atomic_fetch_or(&addr[nr / BITS_PER_LONG], bit,
+				 __ATOMIC_SEQ_CST) & bit;
+}
+
+static inline void bitmap_zero(unsigned long *dst, unsigned int nbits)
+{
+	memset(dst, 0, BITS_TO_LONGS(nbits) * sizeof(long));
+}
+
+static inline void bitmap_copy(unsigned long *dst, const unsigned long *src,
+			       unsigned int nbits)
+{
+	memcpy(dst, src, BITS_TO_LONGS(nbits) * sizeof(long));
+}
+
+static inline void bitmap_set(unsigned long *map, unsigned int start,
+			      unsigned int len)
+{
+	while (len--)
+		__set_bit(start++, map);
+}
+
+static inline unsigned long find_next_bit(const unsigned long *addr,
+					  unsigned long size,
+					  unsigned long offset)
+{
+	for (; offset < size; offset++)
+		if (test_bit(offset, addr))
+			return offset;
+	return size;
+}
+
+#define for_each_set_bit(bit, addr, size) \
+	for ((bit) = find_next_bit((addr), (size), 0); (bit) < (size); \
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+// ============================================================ //
+// Time, locks and atomics
+// ============================================================ //
+
+static inline ktime_t ktime_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static inline u64 ktime_get_boottime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+typedef s64 time64_t;
+
+static inline time64_t ktime_get_seconds(void)
+{
+	return ktime_get() / 1000000000ll;
+}
+
+#define NSEC_PER_USEC 1000ll
+#define NSEC_PER_MSEC 1000000ll
+
+static inline s64 ktime_to_ns(ktime_t kt)
+{
+	return kt;
+}
+
+static inline ktime_t ktime_sub(ktime_t a, ktime_t b)
+{
+	return a - b;
+}
+
+static inline s64 ktime_to_us(ktime_t kt)
+{
+	return kt / 1000;
+}
+
+static inline s64 ktime_us_delta(ktime_t later, ktime_t earlier)
+{
+	return (later - earlier) / 1000;
+}
+
+static inline s64 ktime_ms_delta(ktime_t later, ktime_t earlier)
+{
+	return (later - earlier) / 1000000;
+}
+
+static inline ktime_t ktime_add_ms(ktime_t kt, u64 ms)
+{
+	return kt + ms * 1000000;
+}
+
+static inline bool ktime_before(ktime_t a, ktime_t b)
+{
+	return a < b;
+}
+
+static inline unsigned long msecs_to_jiffies(unsigned int ms)
+{
+	return ms;
+}
+
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define DEFINE_MUTEX(name) \
+	struct mutex name = { .lock = PTHREAD_MUTEX_INITIALIZER }
+
+static inline void mutex_lock(struct mutex *m)
+{
+	pthread_mutex_lock(&m->lock);
+}
+
+static inline void mutex_unlock(struct mutex *m)
+{
+	pthread_mutex_unlock(&m->lock);
+}
+
+typedef struct {
+	pthread_mutex_t lock;
+} spinlock_t;
+
+#define DEFINE_SPINLOCK(name) \
+	spinlock_t name = { .lock = PTHREAD_MUTEX_INITIALIZER }
+
+static inline void spin_lock(spinlock_t *l)
+{
+	pthread_mutex_lock(&l->lock);
+}
+
+static inline void spin_unlock(spinlock_t *l)
+{
+	pthread_mutex_unlock(&l->lock);
+}
+
+// there are no interrupts to disable
+#define spin_lock_irqsave(l, flags) \
+	do { \
+		(flags) = 0; \
+		spin_lock(l); \
+	} while (0)
+#define spin_unlock_irqrestore(l, flags) ((void)(flags), spin_unlock(l))
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define ATOMIC_INIT(i) { (i) }
+
+static inline bool atomic_dec_and_test(atomic_t *v)
+{
+	return __atomic_sub_fetch(&v->counter, 1, __ATOMIC_SEQ_CST) == 0;
+}
+
+// ============================================================ //
+// Work items
+// ============================================================ //
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *);
+
+struct work_struct {
+	work_func_t func;
+	bool pending;
+};
+
+struct delayed_work {
+	struct work_struct work;
+};
+
+#define DECLARE_WORK(n, f) struct work_struct n = { .func = (f) }
+#define DECLARE_DELAYED_WORK(n, f) \
+	struct delayed_work n = { .work = { .func = (f) } }
+#define DECLARE_DEFERRABLE_WORK(n, f) \
+	struct delayed_work n = { .work = { .func = (f) } }
+#define to_delayed_work(w) container_of(w, struct delayed_work, work)
+
+#define USPACE_MAX_WORK 16
+static struct work_struct *uspace_work[USPACE_MAX_WORK];
+static int uspace_nr_work;
+
+static inline bool schedule_work(struct work_struct *work)
+{
+	if (work->pending || uspace_nr_work == USPACE_MAX_WORK)
+		return false;
+
+	work->pending = true;
+	uspace_work[uspace_nr_work++] = work;
+	return true;
+}
+
+// delays are ignored, the harness decides when work runs
+static inline bool schedule_delayed_work(struct delayed_work *dwork,
+					 unsigned long delay)
+{
+	return schedule_work(&dwork->work);
+}
+
+struct workqueue_struct;
+#define system_wq ((struct workqueue_struct *)NULL)
+
+static inline bool mod_delayed_work(struct workqueue_struct *wq,
+				    struct delayed_work *dwork,
+				    unsigned long delay)
+{
+	return schedule_work(&dwork->work);
+}
+
+static inline bool cancel_work_sync(struct work_struct *work)
+{
+	bool pending = work->pending;
+
+	for (int i = 0; i < uspace_nr_work; i++) {
+		if (uspace_work[i] != work)
+			continue;
+		memmove(&uspace_work[i], &uspace_work[i + 1],
+			(uspace_nr_work - i - 1) * sizeof(uspace_work[0]));
+		uspace_nr_work--;
+		break;
+	}
+
+	work->pending = false;
+	return pending;
+}
+
+static inline bool cancel_delayed_work_sync(struct delayed_work *dwork)
+{
+	return cancel_work_sync(&dwork->work);
+}
+
+static inline bool flush_work(struct work_struct *work)
+{
+	bool pending = cancel_work_sync(work);
+
+	if (pending)
+		work->func(work);
+	return pending;
+}
+
+// runs the pending work items, including the ones they schedule, once each:
+// the ones rescheduling themselves are left to uspace_run_pending_work()
+static inline int uspace_run_work(void)
+{
+	struct work_struct *done[USPACE_MAX_WORK];
+	int count = 0;
+
+	while (count < USPACE_MAX_WORK) {
+		struct work_struct *work = NULL;
+
+		for (int i = 0; i < uspace_nr_work && !work; i++) {
+			work = uspace_work[i];
+			for (int j = 0; j < count; j++)
+				if (done[j] == work)
+					work = NULL;
+		}
+		if (!work)
+			break;
+
+		cancel_work_sync(work);
+		work->func(work);
+		done[count++] = work;
+	}
+
+	return count;
+}
+
+// runs the work items pending now, for the ones rescheduling themselves
+static inline int uspace_run_pending_work(void)
+{
+	struct work_struct *pending[USPACE_MAX_WORK];
+	int count = uspace_nr_work;
+
+	memcpy(pending, uspace_work, count * sizeof(pending[0]));
+	for (int i = 0; i < count; i++) {
+		cancel_work_sync(pending[i]);
+		pending[i]->func(pending[i]);
+	}
+
+	return count;
+}
+
+// ============================================================ //
+// Devices and sysfs
+// ============================================================ //
+
+struct kobject {
+	const char *name;
+};
+
+struct attribute {
+	const char *name;
+	umode_t mode;
+};
+
+struct device {
+	struct kobject kobj;
+	struct device *parent;
+};
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count);
+};
+
+struct file {
+	fmode_t f_mode;
+};
+
+#define FMODE_READ  0x1
+#define FMODE_WRITE 0x2
+
+struct bin_attribute {
+	struct attribute attr;
+	size_t size;
+	ssize_t (*read)(struct file *, struct kobject *,
+			struct bin_attribute *, char *, loff_t, size_t);
+	ssize_t (*write)(struct file *, struct kobject *,
+			 struct bin_attribute *, char *, loff_t, size_t);
+};
+
+struct attribute_group {
+	const char *name;
+	umode_t (*is_visible)(struct kobject *, struct attribute *, int);
+	struct attribute **attrs;
+};
+
+#define __ATTR(_name, _mode, _show, _store) \
+	{ .attr = { .name = #_name, .mode = _mode }, \
+	  .show = _show, .store = _store }
+#define DEVICE_ATTR(_name, _mode, _show, _store) \
+	struct device_attribute dev_attr_##_name = \
+	__ATTR(_name, _mode, _show, _store)
+#define DEVICE_ATTR_RW(_name) struct device_attribute dev_attr_##_name = \
+	__ATTR(_name, 0644, _name##_show, _name##_store)
+#define DEVICE_ATTR_RO(_name) struct device_attribute dev_attr_##_name = \
+	__ATTR(_name, 0444, _name##_show, NULL)
+#define DEVICE_ATTR_WO(_name) struct device_attribute dev_attr_##_name = \
+	__ATTR(_name, 0200, NULL, _name##_store)
+#define ATTRIBUTE_GROUPS(_name) \
+	static const struct attribute_group _name##_group = { \
+		.attrs = _name##_attrs, \
+	}; \
+	static const struct attribute_group *_name##_groups[] = { \
+		&_name##_group, NULL, \
+	}
+#define BIN_ATTR_RO(_name, _size) struct bin_attribute bin_attr_##_name = \
+	{ .attr = { .name = #_name, .mode = 0444 }, \
+	  .read = _name##_read, .size = _size }
+#define BIN_ATTR_RW(_name, _size) struct bin_attribute bin_attr_##_name = \
+	{ .attr = { .name = #_name, .mode = 0644 }, \
+	  .read = _name##_read, .write = _name##_write, .size = _size }
+
+// what the driver created, for the harness to find its callbacks
+struct uspace_group {
+	struct kobject *kobj;
+	const struct attribute_group *group;
+};
+
+#define USPACE_MAX_GROUPS 16
+#define USPACE_MAX_BIN_FILES 8
+static struct uspace_group uspace_groups[USPACE_MAX_GROUPS];
+static int uspace_nr_groups;
+static const struct bin_attribute *uspace_bin_files[USPACE_MAX_BIN_FILES];
+static int uspace_nr_bin_files;
+
+static inline int sysfs_create_group(struct kobject *kobj,
+				     const struct attribute_group *group)
+{
+	if (uspace_nr_groups == USPACE_MAX_GROUPS)
+		return -ENOSPC;
+
+	uspace_groups[uspace_nr_groups].kobj = kobj;
+	uspace_groups[uspace_nr_groups++].group = group;
+	return 0;
+}
+
+static inline void sysfs_remove_group(struct kobject *kobj,
+				      const struct attribute_group *group)
+{
+	for (int i = 0; i < uspace_nr_groups; i++) {
+		if (uspace_groups[i].kobj != kobj ||
+		    uspace_groups[i].group != group)
+			continue;
+		uspace_groups[i] = uspace_groups[--uspace_nr_groups];
+		return;
+	}
+}
+
+static inline int sysfs_create_groups(struct kobject *kobj,
+				      const struct attribute_group **groups)
+{
+	for (; *groups; groups++) {
+		int result = sysfs_create_group(kobj, *groups);
+
+		if (result < 0)
+			return result;
+	}
+	return 0;
+}
+
+static inline void sysfs_remove_groups(struct kobject *kobj,
+				       const struct attribute_group **groups)
+{
+	for (; *groups; groups++)
+		sysfs_remove_group(kobj, *groups);
+}
+
+static inline int device_add_groups(struct device *dev,
+				    const struct attribute_group **groups)
+{
+	return sysfs_create_groups(&dev->kobj, groups);
+}
+
+static inline void device_remove_groups(struct device *dev,
+					const struct attribute_group **groups)
+{
+	sysfs_remove_groups(&dev->kobj, groups);
+}
+
+static inline int device_create_bin_file(struct device *dev,
+					 const struct bin_attribute *attr)
+{
+	if (uspace_nr_bin_files == USPACE_MAX_BIN_FILES)
+		return -ENOSPC;
+
+	uspace_bin_files[uspace_nr_bin_files++] = attr;
+	return 0;
+}
+
+static inline void device_remove_bin_file(struct device *dev,
+					  const struct bin_attribute *attr)
+{
+	for (int i = 0; i < uspace_nr_bin_files; i++) {
+		if (uspace_bin_files[i] != attr)
+			continue;
+		uspace_bin_files[i] = uspace_bin_files[--uspace_nr_bin_files];
+		return;
+	}
+}
+
+static inline void sysfs_notify(struct kobject *kobj, const char *dir,
+				const char *attr)
+{
+}
+
+struct dev_pm_ops {
+	int (*suspend)(struct device *dev);
+	int (*resume)(struct device *dev);
+};
+
+#define DEFINE_SIMPLE_DEV_PM_OPS(name, suspend_fn, resume_fn) \
+	const struct dev_pm_ops name = { \
+		.suspend = suspend_fn, .resume = resume_fn }
+#define pm_sleep_ptr(p) (p)
+
+enum probe_type {
+	PROBE_DEFAULT_STRATEGY,
+	PROBE_PREFER_ASYNCHRONOUS,
+};
+
+struct device_driver {
+	const char *name;
+	enum probe_type probe_type;
+	const struct dev_pm_ops *pm;
+};
+
+struct platform_device {
+	const char *name;
+	struct device dev;
+};
+
+struct platform_driver {
+	struct device_driver driver;
+	int (*probe)(struct platform_device *);
+	void (*remove)(struct platform_device *);
+};
+
+static struct platform_driver *uspace_driver;
+static struct platform_device *uspace_bound;
+
+static inline int platform_driver_register(struct platform_driver *drv)
+{
+	uspace_driver = drv;
+	return 0;
+}
+
+// unbinds the device, like the driver core
+static inline void platform_driver_unregister(struct platform_driver *drv)
+{
+	if (uspace_bound)
+		drv->remove(uspace_bound);
+	uspace_bound = NULL;
+	uspace_driver = NULL;
+}
+
+static inline struct platform_device *platform_device_alloc(const char *name,
+							     int id)
+{
+	struct platform_device *pdev = calloc(1, sizeof(*pdev));
+
+	if (pdev) {
+		pdev->name = name;
+		pdev->dev.kobj.name = name;
+	}
+	return pdev;
+}
+
+// probes synchronously, whatever the driver prefers; like the driver
+// core, a failed probe leaves the device unbound but doesn't fail the add
+static inline int platform_device_add(struct platform_device *pdev)
+{
+	if (!uspace_driver || strcmp(uspace_driver->driver.name, pdev->name))
+		return 0;
+
+	if (uspace_driver->probe(pdev) < 0)
+		uspace_log("%s: probe failed\n", pdev->name);
+	else
+		uspace_bound = pdev;
+	return 0;
+}
+
+// also drops the last reference, the driver never calls put
+static inline void platform_device_del(struct platform_device *pdev)
+{
+	if (uspace_bound == pdev) {
+		uspace_driver->remove(pdev);
+		uspace_bound = NULL;
+	}
+	free(pdev);
+}
+
+// ============================================================ //
+// Subsystems
+// ============================================================ //
+
+enum led_brightness {
+	LED_OFF = 0,
+};
+
+#define LED_UNREGISTERING BIT(1)
+#define LED_BRIGHT_HW_CHANGED BIT(21)
+
+struct led_classdev {
+	const char *name;
+	unsigned int max_brightness;
+	unsigned long flags;
+	const char *default_trigger;
+	int (*brightness_set_blocking)(struct led_classdev *,
+				       enum led_brightness);
+	enum led_brightness (*brightness_get)(struct led_classdev *);
+};
+
+#define USPACE_MAX_LEDS 4
+static struct led_classdev *uspace_leds[USPACE_MAX_LEDS];
+static int uspace_nr_leds;
+
+static inline int led_classdev_register(struct device *parent,
+					struct led_classdev *led)
+{
+	if (uspace_nr_leds == USPACE_MAX_LEDS)
+		return -ENOSPC;
+
+	uspace_leds[uspace_nr_leds++] = led;
+	return 0;
+}
+
+static inline void led_classdev_unregister(struct led_classdev *led)
+{
+	for (int i = 0; i < uspace_nr_leds; i++) {
+		if (uspace_leds[i] != led)
+			continue;
+		uspace_leds[i] = uspace_leds[--uspace_nr_leds];
+		return;
+	}
+}
+
+static inline void
+led_classdev_notify_brightness_hw_changed(struct led_classdev *led,
+					  unsigned int brightness)
+{
+}
+
+struct power_supply {
+	struct device dev;
+};
+
+struct acpi_battery_hook {
+	const char *name;
+	int (*add_battery)(struct power_supply *, struct acpi_battery_hook *);
+	int (*remove_battery)(struct power_supply *,
+			      struct acpi_battery_hook *);
+};
+
+// a battery for the hook, its groups are recorded like the device's
+static struct power_supply uspace_battery = {
+	.dev = { .kobj = { .name = "BAT1" } },
+};
+static struct acpi_battery_hook *uspace_battery_hook;
+
+static inline void battery_hook_register(struct acpi_battery_hook *hook)
+{
+	uspace_battery_hook = hook;
+	hook->add_battery(&uspace_battery, hook);
+}
+
+static inline void battery_hook_unregister(struct acpi_battery_hook *hook)
+{
+	hook->remove_battery(&uspace_battery, hook);
+	uspace_battery_hook = NULL;
+}
+
+struct notifier_block {
+	int (*notifier_call)(struct notifier_block *nb, unsigned long event,
+			     void *data);
+};
+
+#define NOTIFY_OK 0x0001
+#define PSY_EVENT_PROP_CHANGED 0
+
+// the system runs on AC unless the harness unplugs it
+static bool uspace_on_battery;
+static struct notifier_block *uspace_psy_notifier;
+
+static inline int power_supply_is_system_supplied(void)
+{
+	return !uspace_on_battery;
+}
+
+static inline int power_supply_reg_notifier(struct notifier_block *nb)
+{
+	uspace_psy_notifier = nb;
+	return 0;
+}
+
+static inline void power_supply_unreg_notifier(struct notifier_block *nb)
+{
+	uspace_psy_notifier = NULL;
+}
+
+// an IIO device with a triggered buffer, the harness plays the trigger
+typedef int irqreturn_t;
+
+#define IRQ_HANDLED     1
+#define IRQ_WAKE_THREAD 2
+
+enum iio_chan_type {
+	IIO_TEMP,
+	IIO_POSITIONRELATIVE,
+	IIO_TIMESTAMP,
+};
+
+enum iio_chan_info_enum {
+	IIO_CHAN_INFO_RAW,
+	IIO_CHAN_INFO_PROCESSED,
+	IIO_CHAN_INFO_SCALE,
+	IIO_CHAN_INFO_OFFSET,
+};
+
+#define IIO_VAL_INT        1
+#define IIO_VAL_FRACTIONAL 10
+#define INDIO_DIRECT_MODE  0x01
+
+struct iio_scan_type {
+	char sign;
+	u8 realbits;
+	u8 storagebits;
+};
+
+struct iio_chan_spec {
+	enum iio_chan_type type;
+	int channel;
+	unsigned long address;
+	int scan_index;
+	struct iio_scan_type scan_type;
+	long info_mask_separate;
+	unsigned indexed:1;
+};
+
+#define IIO_CHAN_SOFT_TIMESTAMP(_si) {					\
+	.type = IIO_TIMESTAMP,						\
+	.channel = -1,							\
+	.scan_index = _si,						\
+	.scan_type = {							\
+		.sign = 's',						\
+		.realbits = 64,						\
+		.storagebits = 64,					\
+	},								\
+}
+
+struct iio_dev;
+struct iio_trigger;
+
+struct iio_info {
+	int (*read_raw)(struct iio_dev *indio_dev,
+			const struct iio_chan_spec *chan, int *val, int *val2,
+			long mask);
+	int (*read_label)(struct iio_dev *indio_dev,
+			  const struct iio_chan_spec *chan, char *label);
+};
+
+struct iio_dev {
+	int modes;
+	const char *name;
+	const struct iio_info *info;
+	const struct iio_chan_spec *channels;
+	int num_channels;
+	const unsigned long *active_scan_mask;
+	struct iio_trigger *trig;
+};
+
+struct iio_poll_func {
+	struct iio_dev *indio_dev;
+	s64 timestamp;
+};
+
+static struct iio_dev *uspace_iio;
+static irqreturn_t (*uspace_iio_handler)(int irq, void *p);
+
+// the last scan pushed, and its size
+static u8 uspace_iio_scan[64];
+static size_t uspace_iio_scan_bytes;
+
+static inline struct iio_dev *iio_device_alloc(struct device *parent,
+					       int sizeof_priv)
+{
+	return calloc(1, sizeof(struct iio_dev) + sizeof_priv);
+}
+
+static inline void iio_device_free(struct iio_dev *indio_dev)
+{
+	free(indio_dev);
+}
+
+static inline int iio_device_register(struct iio_dev *indio_dev)
+{
+	uspace_iio = indio_dev;
+	return 0;
+}
+
+static inline void iio_device_unregister(struct iio_dev *indio_dev)
+{
+	uspace_iio = NULL;
+}
+
+static inline irqreturn_t iio_pollfunc_store_time(int irq, void *p)
+{
+	return IRQ_WAKE_THREAD;
+}
+
+static inline int iio_triggered_buffer_setup(struct iio_dev *indio_dev,
+	irqreturn_t (*top)(int irq, void *p),
+	irqreturn_t (*thread)(int irq, void *p), const void *setup_ops)
+{
+	uspace_iio_handler = thread;
+	return 0;
+}
+
+static inline void iio_triggered_buffer_cleanup(struct iio_dev *indio_dev)
+{
+	uspace_iio_handler = NULL;
+}
+
+static inline unsigned int iio_get_masklength(const struct iio_dev *indio_dev)
+{
+	return indio_dev->num_channels;
+}
+
+#define iio_for_each_active_channel(indio_dev, chan) \
+	for_each_set_bit(chan, (indio_dev)->active_scan_mask, \
+			 iio_get_masklength(indio_dev))
+
+// the active channels packed in scan order, the timestamp 8-byte aligned
+static inline int iio_push_to_buffers_with_timestamp(struct iio_dev *indio_dev,
+						     void *data, s64 timestamp)
+{
+	size_t bytes = 0;
+	int bit;
+
+	iio_for_each_active_channel(indio_dev, bit)
+		if (indio_dev->channels[bit].type != IIO_TIMESTAMP)
+			bytes += indio_dev->channels[bit].scan_type.storagebits / 8;
+	bytes = (bytes + 7) & ~(size_t)7;
+
+	memcpy(uspace_iio_scan, data, bytes);
+	memcpy(uspace_iio_scan + bytes, &timestamp, sizeof(timestamp));
+	uspace_iio_scan_bytes = bytes + sizeof(timestamp);
+	return 0;
+}
+
+static inline void iio_trigger_notify_done(struct iio_trigger *trig)
+{
+}
+
+// a PMU, the harness opens and reads its events
+typedef struct {
+	s64 counter;
+} local64_t;
+
+static inline void local64_set(local64_t *l, s64 v)
+{
+	l->counter = v;
+}
+
+static inline s64 local64_read(local64_t *l)
+{
+	return l->counter;
+}
+
+static inline s64 local64_xchg(local64_t *l, s64 v)
+{
+	s64 old = l->counter;
+
+	l->counter = v;
+	return old;
+}
+
+static inline void local64_add(s64 v, local64_t *l)
+{
+	l->counter += v;
+}
+
+#define PERF_HES_STOPPED  0x01
+#define PERF_HES_UPTODATE 0x02
+#define PERF_EF_START     0x01
+#define PERF_EF_RELOAD    0x02
+#define PERF_EF_UPDATE    0x04
+
+#define PERF_PMU_CAP_NO_INTERRUPT 0x0001
+#define PERF_PMU_CAP_NO_EXCLUDE   0x0080
+
+enum perf_event_task_context {
+	perf_invalid_context = -1,
+};
+
+struct perf_event_attr {
+	u32 type;
+	u64 config;
+	u64 sample_period;
+};
+
+struct hw_perf_event {
+	int state;
+	local64_t prev_count;
+};
+
+struct pmu;
+
+struct perf_event {
+	struct perf_event_attr attr;
+	struct hw_perf_event hw;
+	local64_t count;
+	int cpu;
+	struct pmu *pmu;
+};
+
+struct pmu {
+	void *module;
+	int type;
+	int task_ctx_nr;
+	int capabilities;
+	const struct attribute_group **attr_groups;
+	int (*event_init)(struct perf_event *event);
+	int (*add)(struct perf_event *event, int flags);
+	void (*del)(struct perf_event *event, int flags);
+	void (*start)(struct perf_event *event, int flags);
+	void (*stop)(struct perf_event *event, int flags);
+	void (*read)(struct perf_event *event);
+};
+
+struct perf_pmu_events_attr {
+	struct device_attribute attr;
+	u64 id;
+	const char *event_str;
+};
+
+static inline ssize_t perf_event_sysfs_show(struct device *dev,
+					    struct device_attribute *attr,
+					    char *page)
+{
+	struct perf_pmu_events_attr *pmu_attr =
+		container_of(attr, struct perf_pmu_events_attr, attr);
+
+	return sysfs_emit(page, "%s\n", pmu_attr->event_str);
+}
+
+#define PMU_EVENT_ATTR_STRING(_name, _var, _str)			\
+	static struct perf_pmu_events_attr _var = {			\
+		.attr = __ATTR(_name, 0444, perf_event_sysfs_show, NULL), \
+		.id = 0,						\
+		.event_str = _str,					\
+	};
+
+#define PMU_FORMAT_ATTR(_name, _format)					\
+	static ssize_t _name##_show(struct device *dev,			\
+				    struct device_attribute *attr,	\
+				    char *page)				\
+	{								\
+		return sysfs_emit(page, _format "\n");			\
+	}								\
+	static struct device_attribute format_attr_##_name =		\
+		__ATTR(_name, 0444, _name##_show, NULL)
+
+static inline bool is_sampling_event(struct perf_event *event)
+{
+	return event->attr.sample_period != 0;
+}
+
+#define USPACE_PMU_TYPE 42
+static struct pmu *uspace_pmu;
+
+static inline int perf_pmu_register(struct pmu *pmu, const char *name,
+				    int type)
+{
+	pmu->type = USPACE_PMU_TYPE;
+	uspace_pmu = pmu;
+	return 0;
+}
+
+static inline void perf_pmu_unregister(struct pmu *pmu)
+{
+	uspace_pmu = NULL;
+}
+
+struct seq_file;
+
+struct file_operations {
+	void *owner;
+	long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+	long (*compat_ioctl)(struct file *, unsigned int, unsigned long);
+	loff_t (*llseek)(struct file *, loff_t, int);
+	// the show callback of DEFINE_SHOW_ATTRIBUTE, there is no VFS here
+	int (*uspace_show)(struct seq_file *, void *);
+};
+
+#define compat_ptr_ioctl NULL
+#define noop_llseek NULL
+
+struct miscdevice {
+	int minor;
+	const char *name;
+	const struct file_operations *fops;
+	umode_t mode;
+	struct device *parent;
+};
+
+#define MISC_DYNAMIC_MINOR 255
+
+static struct miscdevice *uspace_misc;
+
+static inline int misc_register(struct miscdevice *misc)
+{
+	uspace_misc = misc;
+	return 0;
+}
+
+static inline void misc_deregister(struct miscdevice *misc)
+{
+	uspace_misc = NULL;
+}
+
+// a seq_file writes into the caller's buffer and stops when it is full
+struct seq_file {
+	char *buf;
+	size_t size;
+	size_t count;
+};
+
+static inline void seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	if (m->count >= m->size)
+		return;
+
+	va_start(args, fmt);
+	len = vsnprintf(m->buf + m->count, m->size - m->count, fmt, args);
+	va_end(args);
+
+	m->count = min(m->count + max(len, 0), m->size);
+}
+
+static inline void seq_puts(struct seq_file *m, const char *s)
+{
+	seq_printf(m, "%s", s);
+}
+
+#define DEFINE_SHOW_ATTRIBUTE(name) \
+	static const struct file_operations name##_fops = { \
+		.uspace_show = name##_show, \
+	}
+
+struct dentry {
+	char name[32];
+	const struct file_operations *fops;
+};
+
+#define USPACE_MAX_DEBUGFS 8
+static struct dentry uspace_debugfs[USPACE_MAX_DEBUGFS];
+static int uspace_nr_debugfs;
+
+// files are looked up by name, directories need no state
+static struct dentry uspace_debugfs_dir;
+
+static inline struct dentry *debugfs_create_dir(const char *name,
+						struct dentry *parent)
+{
+	return &uspace_debugfs_dir;
+}
+
+static inline struct dentry *debugfs_create_file(const char *name,
+						 umode_t mode,
+						 struct dentry *parent,
+						 void *data,
+						 const struct file_operations *fops)
+{
+	struct dentry *dentry;
+
+	if (uspace_nr_debugfs == USPACE_MAX_DEBUGFS)
+		return ERR_PTR(-ENOMEM);
+
+	dentry = &uspace_debugfs[uspace_nr_debugfs++];
+	snprintf(dentry->name, sizeof(dentry->name), "%s", name);
+	dentry->fops = fops;
+	return dentry;
+}
+
+static inline void debugfs_remove_recursive(struct dentry *dentry)
+{
+	if (dentry == &uspace_debugfs_dir)
+		uspace_nr_debugfs = 0;
+}
+
+// the driver's own emulated EC is used instead, see msi_ec_core.c; the
+// tests set what a real EC answers with uspace_ec_result, or put it in
+// front of uspace_ec_regs, failing its uspace_ec_fail_write-th write
+static int uspace_ec_result = -ENODEV;
+static u8 *uspace_ec_regs;
+static int uspace_ec_writes, uspace_ec_fail_write;
+
+static inline int ec_read(u8 addr, u8 *val)
+{
+	if (uspace_ec_regs) {
+		*val = uspace_ec_regs[addr];
+		return 0;
+	}
+
+	if (!uspace_ec_result)
+		*val = 0;
+
+	return uspace_ec_result;
+}
+
+static inline int ec_write(u8 addr, u8 val)
+{
+	if (!uspace_ec_regs)
+		return -ENODEV;
+	if (++uspace_ec_writes == uspace_ec_fail_write)
+		return -EIO;
+
+	uspace_ec_regs[addr] = val;
+	return 0;
+}
+
+typedef u32 acpi_status;
+
+#define ACPI_SUCCESS(s) (!(s))
+#define ACPI_FAILURE(s) (s)
+#define AE_ALREADY_ACQUIRED 0x0014
+
+union acpi_object;
+
+typedef void (*wmi_notify_handler)(union acpi_object *data, void *context);
+
+// no firmware, no WMI events: they stay disabled
+static inline bool wmi_has_guid(const char *guid)
+{
+	return false;
+}
+
+static inline acpi_status wmi_install_notify_handler(const char *guid,
+						     wmi_notify_handler handler,
+						     void *data)
+{
+	return 1;
+}
+
+static inline acpi_status wmi_remove_notify_handler(const char *guid)
+{
+	return 1;
+}
+
+struct input_dev {
+	const char *name;
+	const char *phys;
+	struct {
+		u16 bustype;
+	} id;
+	struct device dev;
+};
+
+#define BUS_HOST 0x19
+#define EV_KEY 0x01
+#define KEY_PROG1 148
+#define KEY_PROG2 149
+#define KEY_CAMERA_ACCESS_ENABLE 0x24b
+#define KEY_CAMERA_ACCESS_DISABLE 0x24c
+
+static inline struct input_dev *input_allocate_device(void)
+{
+	return calloc(1, sizeof(struct input_dev));
+}
+
+static inline void input_free_device(struct input_dev *dev)
+{
+	free(dev);
+}
+
+static inline int input_register_device(struct input_dev *dev)
+{
+	return 0;
+}
+
+static inline void input_unregister_device(struct input_dev *dev)
+{
+	free(dev);
+}
+
+static inline void input_set_capability(struct input_dev *dev,
+					unsigned int type, unsigned int code)
+{
+}
+
+static inline void input_report_key(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+}
+
+static inline void input_sync(struct input_dev *dev)
+{
+}
+
+enum platform_profile_option {
+	PLATFORM_PROFILE_LOW_POWER,
+	PLATFORM_PROFILE_COOL,
+	PLATFORM_PROFILE_QUIET,
+	PLATFORM_PROFILE_BALANCED,
+	PLATFORM_PROFILE_BALANCED_PERFORMANCE,
+	PLATFORM_PROFILE_PERFORMANCE,
+	PLATFORM_PROFILE_CUSTOM,
+	PLATFORM_PROFILE_LAST,
+};
+
+struct platform_profile_handler {
+	const char *name;
+	struct device *dev;
+	unsigned long choices[BITS_TO_LONGS(PLATFORM_PROFILE_LAST)];
+	int (*profile_get)(struct platform_profile_handler *,
+			   enum platform_profile_option *);
+	int (*profile_set)(struct platform_profile_handler *,
+			   enum platform_profile_option);
+};
+
+static struct platform_profile_handler *uspace_profile;
+
+static inline int platform_profile_register(struct platform_profile_handler *h)
+{
+	uspace_profile = h;
+	return 0;
+}
+
+static inline int platform_profile_remove(void)
+{
+	uspace_profile = NULL;
+	return 0;
+}
+
+static inline void platform_profile_notify(void)
+{
+}
+
+#endif // __MSI_EC_USPACE_KERNEL__
@@ -0,0 +1,504 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi_ec_core.c - msi-ec.c compiled as a userspace library.
+ *
+ * Includes the driver itself, so the accessors below reach its static
+ * callbacks and state. Build with "make userspace-test".
+ */
+
+#include "msi-ec.c"
+
+#include "msi_ec_core.h"
+
+static bool msi_ec_core_loaded = false;
+
+// attributes found after is_visible, -1 until scanned
+static int msi_ec_core_nr_visible = -1;
+
+// a single-model build only loads the firmwares of its model
+static bool msi_ec_core_known(int i)
+{
+#ifdef MSI_EC_MODEL
+	return MSI_EC_FW_INDEX[i].conf == MSI_EC_MODEL_INDEX;
+#else
+	return true;
+#endif
+}
+
+int msi_ec_core_nr_firmwares(void)
+{
+	int count = 0;
+
+	for (int i = 0; i < (int)ARRAY_SIZE(MSI_EC_FW_INDEX); i++)
+		count += msi_ec_core_known(i);
+
+	return count;
+}
+
+const char *msi_ec_core_firmware(int index)
+{
+	for (int i = 0; i < (int)ARRAY_SIZE(MSI_EC_FW_INDEX); i++)
+		if (msi_ec_core_known(i) && index-- == 0)
+			return MSI_EC_FW_INDEX[i].fw;
+
+	return NULL;
+}
+
+int msi_ec_core_load(const char *fw, bool with_debug)
+{
+	int result;
+
+	if (msi_ec_core_loaded)
+		return -EBUSY;
+
+	firmware = (char *)fw;
+	emulate = true;
+	debug = with_debug;
+
+	result = uspace_module_init();
+	if (result < 0)
+		return result;
+
+	uspace_run_work();
+	msi_ec_core_loaded = true;
+	return 0;
+}
+
+void msi_ec_core_unload(void)
+{
+	if (!msi_ec_core_loaded)
+		return;
+
+	uspace_module_exit();
+	uspace_run_work();
+	msi_ec_core_loaded = false;
+	msi_ec_core_nr_visible = -1;
+}
+
+int msi_ec_core_nr_registered(void)
+{
+	return uspace_nr_groups + uspace_nr_bin_files + uspace_nr_leds +
+	       uspace_nr_work + uspace_nr_debugfs + !!uspace_battery_hook +
+	       !!uspace_psy_notifier + !!uspace_misc + !!uspace_profile +
+	       !!uspace_iio + !!uspace_pmu + !!uspace_driver;
+}
+
+void msi_ec_core_quiet(bool quiet)
+{
+	uspace_quiet = quiet;
+}
+
+uint8_t *msi_ec_core_registers(void)
+{
+	return emulated_ec;
+}
+
+// ============================================================ //
+// Attributes
+// ============================================================ //
+
+struct msi_ec_core_attr {
+	char name[64];
+	struct kobject *kobj;
+	struct device_attribute *attr;
+	umode_t mode;
+};
+
+#define MSI_EC_CORE_MAX_ATTRS 256
+static struct msi_ec_core_attr msi_ec_core_attrs[MSI_EC_CORE_MAX_ATTRS];
+
+// what sysfs would show, after is_visible
+static void msi_ec_core_scan(void)
+{
+	msi_ec_core_nr_visible = 0;
+
+	for (int i = 0; i < uspace_nr_groups; i++) {
+		const struct attribute_group *group = uspace_groups[i].group;
+		struct kobject *kobj = uspace_groups[i].kobj;
+
+		for (int j = 0; group->attrs[j]; j++) {
+			struct attribute *attr = group->attrs[j];
+			struct msi_ec_core_attr *entry;
+			umode_t mode = attr->mode;
+
+			if (group->is_visible)
+				mode = group->is_visible(kobj, attr, j);
+			if (!mode ||
+			    msi_ec_core_nr_visible == MSI_EC_CORE_MAX_ATTRS)
+				continue;
+
+			entry = &msi_ec_core_attrs[msi_ec_core_nr_visible++];
+			snprintf(entry->name, sizeof(entry->name), "%s%s%s",
+				 group->name ? group->name : "",
+				 group->name ? "/" : "", attr->name);
+			entry->kobj = kobj;
+			entry->attr = container_of(attr, struct device_attribute,
+						   attr);
+			entry->mode = mode;
+		}
+	}
+}
+
+static struct msi_ec_core_attr *msi_ec_core_find(const char *name)
+{
+	if (msi_ec_core_nr_visible < 0)
+		msi_ec_core_scan();
+
+	for (int i = 0; i < msi_ec_core_nr_visible; i++)
+		if (!strcmp(msi_ec_core_attrs[i].name, name))
+			return &msi_ec_core_attrs[i];
+
+	return NULL;
+}
+
+int msi_ec_core_nr_attrs(void)
+{
+	if (msi_ec_core_nr_visible < 0)
+		msi_ec_core_scan();
+
+	return msi_ec_core_nr_visible;
+}
+
+const char *msi_ec_core_attr_name(int index)
+{
+	if (index < 0 || index >= msi_ec_core_nr_attrs())
+		return NULL;
+
+	return msi_ec_core_attrs[index].name;
+}
+
+unsigned int msi_ec_core_attr_mode(const char *name)
+{
+	struct msi_ec_core_attr *entry = msi_ec_core_find(name);
+
+	return entry ? entry->mode : 0;
+}
+
+ssize_t msi_ec_core_show(const char *name, char *buf)
+{
+	struct msi_ec_core_attr *entry = msi_ec_core_find(name);
+
+	if (!entry)
+		return -ENOENT;
+	if (!(entry->mode & 0444) || !entry->attr->show)
+		return -EACCES;
+
+	return entry->attr->show(container_of(entry->kobj, struct device, kobj),
+				 entry->attr, buf);
+}
+
+ssize_t msi_ec_core_store(const char *name, const char *buf, size_t count)
+{
+	struct msi_ec_core_attr *entry = msi_ec_core_find(name);
+	char *page;
+	ssize_t result;
+
+	if (!entry)
+		return -ENOENT;
+	if (!(entry->mode & 0222) || !entry->attr->store)
+		return -EACCES;
+	if (count >= PAGE_SIZE)
+		return -EINVAL;
+
+	// sysfs hands stores a NUL-terminated copy of the written bytes
+	page = kmemdup_nul(buf, count, GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	result = entry->attr->store(container_of(entry->kobj, struct device,
+						 kobj),
+				    entry->attr, page, count);
+	kfree(page);
+	return result;
+}
+
+// ============================================================ //
+// LEDs, PM and the character device
+// ============================================================ //
+
+static struct led_classdev *msi_ec_core_led(const char *name)
+{
+	for (int i = 0; i < uspace_nr_leds; i++)
+		if (!strcmp(uspace_leds[i]->name, name))
+			return uspace_leds[i];
+
+	return NULL;
+}
+
+int msi_ec_core_led_get(const char *name)
+{
+	struct led_classdev *led = msi_ec_core_led(name);
+
+	if (!led)
+		return -ENOENT;
+	if (!led->brightness_get)
+		return -EOPNOTSUPP;
+
+	return led->brightness_get(led);
+}
+
+int msi_ec_core_led_set(const char *name, int brightness)
+{
+	struct led_classdev *led = msi_ec_core_led(name);
+
+	if (!led)
+		return -ENOENT;
+	if (brightness < 0 || brightness > (int)led->max_brightness)
+		return -EINVAL;
+
+	return led->brightness_set_blocking(led, brightness);
+}
+
+int msi_ec_core_resume(void)
+{
+	if (!uspace_driver || !uspace_driver->driver.pm)
+		return -ENODEV;
+
+	return uspace_driver->driver.pm->resume(&msi_platform_device->dev);
+}
+
+int msi_ec_core_power_supply(bool online)
+{
+	if (!uspace_psy_notifier)
+		return -ENODEV;
+
+	uspace_on_battery = !online;
+	uspace_psy_notifier->notifier_call(uspace_psy_notifier,
+					   PSY_EVENT_PROP_CHANGED, NULL);
+	uspace_run_work();
+	return 0;
+}
+
+void msi_ec_core_cpu_load(int percent)
+{
+	uspace_cpu_wall_us += 1000000;
+	uspace_cpu_idle_us += (100 - percent) * 10000;
+}
+
+int msi_ec_core_run_pending_work(void)
+{
+	return uspace_run_pending_work();
+}
+
+int msi_ec_core_enforce(void)
+{
+	return msi_ec_enforce();
+}
+
+int msi_ec_core_dev_reads(uint8_t addr, int count)
+{
+	struct msi_ec_io ios[MSI_EC_IO_MAX] = {};
+	struct msi_ec_io_batch batch = {
+		.ios = (uintptr_t)ios,
+		.count = count,
+	};
+	int result, done = 0;
+
+	if (count < 0 || count > MSI_EC_IO_MAX)
+		return -EINVAL;
+
+	for (int i = 0; i < count; i++) {
+		ios[i].addr = addr;
+		ios[i].mask = 0xff;
+		ios[i].op = MSI_EC_IO_READ;
+	}
+
+	result = msi_ec_core_ioctl(MSI_EC_IOC_BATCH, &batch);
+	if (result < 0)
+		return result;
+
+	for (int i = 0; i < count; i++)
+		done += !ios[i].result;
+
+	return done;
+}
+
+void msi_ec_core_set_uid(unsigned int uid)
+{
+	uspace_uid = uid;
+}
+
+int msi_ec_core_ec_read(uint8_t addr, int ec_result)
+{
+	bool cached = test_bit(addr, ec_cache_valid);
+	int result;
+	u8 val;
+
+	emulate = false;
+	uspace_ec_result = ec_result;
+	result = msi_ec_read(addr, &val);
+	uspace_ec_result = -ENODEV;
+	emulate = true;
+
+	// the emulated EC stays the only source of values
+	if (!cached)
+		__clear_bit(addr, ec_cache_valid);
+
+	return result;
+}
+
+void msi_ec_core_breaker_expire(void)
+{
+	spin_lock(&ec_breaker_lock);
+	ec_breaker.next_probe = ktime_get();
+	spin_unlock(&ec_breaker_lock);
+}
+
+void msi_ec_core_fail_write(int nth)
+{
+	// a real EC in front of the emulated registers
+	emulate = !nth;
+	uspace_ec_regs = nth ? emulated_ec : NULL;
+	uspace_ec_writes = 0;
+	uspace_ec_fail_write = nth;
+
+	// the emulated EC stays the only source of values
+	if (!nth)
+		bitmap_zero(ec_cache_valid, 256);
+}
+
+void msi_ec_core_journal(uint8_t *mask, uint8_t *value)
+{
+	mutex_lock(&ec_lock);
+	memcpy(mask, ec_journal.mask, sizeof(ec_journal.mask));
+	memcpy(value, ec_journal.value, sizeof(ec_journal.value));
+	mutex_unlock(&ec_lock);
+}
+
+long msi_ec_core_ioctl(unsigned int cmd, void *arg)
+{
+	struct file file = { .f_mode = FMODE_READ | FMODE_WRITE };
+
+	if (!uspace_misc)
+		return -ENODEV;
+
+	return uspace_misc->fops->unlocked_ioctl(&file, cmd,
+						 (unsigned long)arg);
+}
+
+// the channel of the IIO device labelled label
+static const struct iio_chan_spec *msi_ec_core_iio_channel(const char *label)
+{
+	char buf[PAGE_SIZE];
+
+	for (int i = 0; uspace_iio && i < uspace_iio->num_channels; i++) {
+		const struct iio_chan_spec *chan = &uspace_iio->channels[i];
+
+		if (chan->type != IIO_TIMESTAMP &&
+		    uspace_iio->info->read_label(uspace_iio, chan, buf) > 0 &&
+		    !strncmp(buf, label, strlen(label)) &&
+		    buf[strlen(label)] == '\n')
+			return chan;
+	}
+
+	return NULL;
+}
+
+int msi_ec_core_iio_read(const char *label, long info, int *val, int *val2)
+{
+	const struct iio_chan_spec *chan = msi_ec_core_iio_channel(label);
+
+	if (!chan)
+		return -ENOENT;
+
+	return uspace_iio->info->read_raw(uspace_iio, chan, val, val2, info);
+}
+
+ssize_t msi_ec_core_iio_capture(unsigned long scan_mask, void *buf,
+				size_t size)
+{
+	struct iio_poll_func pf;
+
+	if (!uspace_iio || !uspace_iio_handler)
+		return -ENODEV;
+
+	uspace_iio->active_scan_mask = &scan_mask;
+	pf.indio_dev = uspace_iio;
+	pf.timestamp = ktime_get();
+
+	uspace_iio_scan_bytes = 0;
+	uspace_iio_handler(0, &pf);
+	uspace_iio->active_scan_mask = NULL;
+
+	if (!uspace_iio_scan_bytes)
+		return -ENODATA;
+
+	memcpy(buf, uspace_iio_scan, min(size, uspace_iio_scan_bytes));
+	return uspace_iio_scan_bytes;
+}
+
+int msi_ec_core_pmu_event_init(uint64_t config, bool sampling)
+{
+	struct perf_event event = {
+		.attr = {
+			.type = USPACE_PMU_TYPE,
+			.config = config,
+			.sample_period = sampling,
+		},
+		.pmu = uspace_pmu,
+	};
+
+	if (!uspace_pmu)
+		return -ENODEV;
+
+	return uspace_pmu->event_init(&event);
+}
+
+int64_t msi_ec_core_pmu_count(uint64_t config, int ms)
+{
+	struct timespec sleep = {
+		.tv_sec = ms / 1000,
+		.tv_nsec = ms % 1000 * 1000000l,
+	};
+	struct perf_event event = {
+		.attr = {
+			.type = USPACE_PMU_TYPE,
+			.config = config,
+		},
+		.pmu = uspace_pmu,
+	};
+	int result;
+
+	if (!uspace_pmu)
+		return -ENODEV;
+
+	result = uspace_pmu->event_init(&event);
+	if (result < 0)
+		return result;
+
+	// the start schedules the first sample
+	uspace_pmu->add(&event, PERF_EF_START);
+	uspace_run_pending_work();
+	nanosleep(&sleep, NULL);
+	uspace_pmu->read(&event);
+	uspace_pmu->del(&event, 0);
+
+	// stopped, the sampling work doesn't reschedule itself
+	uspace_run_pending_work();
+
+	return local64_read(&event.count);
+}
+
+ssize_t msi_ec_core_debugfs_read(const char *name, char *buf, size_t size)
+{
+	struct seq_file m = { .buf = buf, .size = size };
+	int result;
+
+	for (int i = 0; i < uspace_nr_debugfs; i++) {
+		if (strcmp(uspace_debugfs[i].name, name))
+			continue;
+
+		result = uspace_debugfs[i].fops->uspace_show(&m, NULL);
+		if (result < 0)
+			return result;
+
+		// seq_file truncates, like a read with a short buffer
+		if (m.count == size)
+			m.count--;
+		buf[m.count] = '\0';
+		return m.count;
+	}
+
+	return -ENOENT;
+}
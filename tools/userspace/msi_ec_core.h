@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * msi_ec_core.h - The msi-ec driver built as a userspace library.
+ *
+ * msi-ec.c is compiled unchanged against the kernel API of kernel.h and
+ * runs with its emulate parameter set: every EC access goes to the
+ * driver's own emulated register file, which the caller can inspect and
+ * modify directly.
+ *
+ * The driver keeps its state in static variables, so a process loads it
+ * once. Forking before msi_ec_core_load() gives each configuration a clean
+ * driver (see test.c).
+ *
+ * All functions returning int or ssize_t return a negative errno on error.
+ */
+
+#ifndef __MSI_EC_CORE__
+#define __MSI_EC_CORE__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// the firmware versions known to the driver, in the order of its index
+int msi_ec_core_nr_firmwares(void);
+const char *msi_ec_core_firmware(int index);
+
+// runs module_init and the work it schedules, debug adds the debug group
+int msi_ec_core_load(const char *firmware, bool debug);
+void msi_ec_core_unload(void);
+
+// groups, files, devices, hooks and work items currently registered
+int msi_ec_core_nr_registered(void);
+
+// silences the driver's log, e.g. while fuzzing
+void msi_ec_core_quiet(bool quiet);
+
+// the emulated EC, 256 registers
+uint8_t *msi_ec_core_registers(void);
+
+/*
+ * Attributes of the platform device and of the battery, by path relative
+ * to their directory ("shift_mode", "cpu/realtime_fan_speed",
+ * "charge_control_start_threshold"). Attributes hidden by is_visible
+ * don't exist.
+ */
+int msi_ec_core_nr_attrs(void);
+const char *msi_ec_core_attr_name(int index);
+// 0 if the attribute doesn't exist
+unsigned int msi_ec_core_attr_mode(const char *name);
+// buf has room for 4096 bytes, like a sysfs page
+ssize_t msi_ec_core_show(const char *name, char *buf);
+ssize_t msi_ec_core_store(const char *name, const char *buf, size_t count);
+
+// LED class devices by name
+int msi_ec_core_led_get(const char *name);
+int msi_ec_core_led_set(const char *name, int brightness);
+
+// the resume callback of the platform driver
+int msi_ec_core_resume(void);
+
+// plugs or unplugs AC, then runs the work the notifier schedules
+int msi_ec_core_power_supply(bool online);
+
+// one second of CPU time, busy for percent of it
+void msi_ec_core_cpu_load(int percent);
+
+// runs the work items pending now, not the ones they schedule
+int msi_ec_core_run_pending_work(void);
+
+// one enforcement check, as run by its work and on EC events
+int msi_ec_core_enforce(void);
+
+// count reads of addr in one MSI_EC_IOC_BATCH, returns how many succeeded
+int msi_ec_core_dev_reads(uint8_t addr, int count);
+
+// the uid the driver sees for the caller, 0 by default
+void msi_ec_core_set_uid(unsigned int uid);
+
+// one show handler read of a real EC answering with ec_result, through the
+// circuit breaker; expire makes a due probe of an open breaker
+int msi_ec_core_ec_read(uint8_t addr, int ec_result);
+void msi_ec_core_breaker_expire(void);
+
+// routes the driver's EC accesses through ec_read() and ec_write() to the
+// emulated registers and fails the nth write from now on, 0 goes back to
+// plain emulation
+void msi_ec_core_fail_write(int nth);
+
+// the bits written through the driver and their values, 256 bytes each
+void msi_ec_core_journal(uint8_t *mask, uint8_t *value);
+
+// the ioctl handler of /dev/msi-ec, arg is a plain pointer
+long msi_ec_core_ioctl(unsigned int cmd, void *arg);
+
+/*
+ * The IIO device: a read_raw of the channel labelled label, with info one
+ * of IIO_CHAN_INFO_RAW (0), _SCALE (2) or _OFFSET (3), and one trigger of
+ * the buffer with the channels in scan_mask enabled, returning the scan
+ * as pushed: the values, then the timestamp at the next multiple of 8.
+ */
+int msi_ec_core_iio_read(const char *label, long info, int *val, int *val2);
+ssize_t msi_ec_core_iio_capture(unsigned long scan_mask, void *buf,
+				size_t size);
+
+/*
+ * The msi_ec perf PMU: the event_init of an event, and the count of an
+ * event run for ms milliseconds on CPU 0, or a negative error.
+ */
+int msi_ec_core_pmu_event_init(uint64_t config, bool sampling);
+int64_t msi_ec_core_pmu_count(uint64_t config, int ms);
+
+// a file in /sys/kernel/debug/msi-ec, NUL-terminated
+ssize_t msi_ec_core_debugfs_read(const char *name, char *buf, size_t size);
+
+#endif // __MSI_EC_CORE__
@@ -0,0 +1,788 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * test.c - round trips through every configuration of the driver.
+ *
+ * For every firmware the driver knows (or the ones given as arguments),
+ * loads the driver in a child process against a zeroed emulated EC and
+ * checks that:
+ *   - every readable attribute shows a newline-terminated value or fails;
+ *   - every value a writable attribute accepts, from the available modes,
+ *     a small vocabulary and the numbers 0 to 255, reads back unchanged,
+ *     or rounded to a value that reads back unchanged;
+ *   - rejected values leave the registers untouched;
+ *   - a transaction failing at any of its writes leaves the registers and
+ *     the resume journal untouched;
+ *   - the values written survive an EC reset followed by a resume;
+ *   - unloading leaves nothing registered behind.
+ *
+ * Build with "make userspace-test", which also runs it under
+ * AddressSanitizer and UndefinedBehaviorSanitizer.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "msi_ec_core.h"
+
+#define PAGE 4096
+
+static const char *const vocabulary[] = {
+	"on", "off", "left", "right", "min", "medium", "max",
+};
+
+static bool verbose = false;
+static int checks, failures;
+
+#define check(cond, fmt, ...) \
+	do { \
+		checks++; \
+		if (!(cond)) { \
+			failures++; \
+			fprintf(stderr, "%s: " fmt "\n", firmware, \
+				##__VA_ARGS__); \
+		} \
+	} while (0)
+
+static const char *firmware;
+
+// the shown value without its newline, or NULL
+static const char *show(const char *name, char *buf)
+{
+	ssize_t len = msi_ec_core_show(name, buf);
+
+	if (len <= 0 || buf[len - 1] != '\n')
+		return NULL;
+
+	buf[len - 1] = '\0';
+	return buf;
+}
+
+static void test_show(void)
+{
+	char buf[PAGE];
+	const char *date;
+
+	for (int i = 0; i < msi_ec_core_nr_attrs(); i++) {
+		const char *name = msi_ec_core_attr_name(i);
+		ssize_t len;
+
+		if (!(msi_ec_core_attr_mode(name) & 0444))
+			continue;
+
+		// registers out of range may fail, but never corrupt the page
+		len = msi_ec_core_show(name, buf);
+		check(len < PAGE && (len <= 0 || buf[len - 1] == '\n'),
+		      "%s: show returned %zd", name, len);
+	}
+
+	// the emulated EC reports 01012024 00:00:00
+	date = show("fw_release_date", buf);
+	check(date && !strcmp(date, "2024/01/01 00:00:00"),
+	      "fw_release_date: shows \"%s\"", date ? date : "(error)");
+}
+
+/*
+ * Stores value, expecting it to read back when accepted. Scaled values
+ * may read back rounded, then the value shown must store to the same
+ * registers and read back unchanged.
+ */
+static void try_value(const char *name, const char *value)
+{
+	uint8_t before[256], after[256], *regs = msi_ec_core_registers();
+	char buf[PAGE], shown[PAGE];
+	ssize_t result;
+
+	memcpy(before, regs, sizeof(before));
+	result = msi_ec_core_store(name, value, strlen(value));
+
+	if (result < 0) {
+		check(!memcmp(before, regs, sizeof(before)),
+		      "%s: rejected \"%s\" (%zd) but wrote the EC", name,
+		      value, result);
+		return;
+	}
+
+	check(result == (ssize_t)strlen(value),
+	      "%s: store \"%s\" returned %zd", name, value, result);
+	if (verbose)
+		printf("%s: %s = %s\n", firmware, name, value);
+
+	if (!show(name, shown)) {
+		check(false, "%s: stored \"%s\", show failed", name, value);
+		return;
+	}
+	if (!strcmp(shown, value))
+		return;
+
+	memcpy(after, regs, sizeof(after));
+	result = msi_ec_core_store(name, shown, strlen(shown));
+	check(result >= 0 && !memcmp(after, regs, sizeof(after)) &&
+	      show(name, buf) && !strcmp(buf, shown),
+	      "%s: stored \"%s\", shows \"%s\" which doesn't read back",
+	      name, value, shown);
+}
+
+static void test_store(const char *name)
+{
+	char current[PAGE], available[PAGE], number[16];
+	const char *list = NULL;
+
+	if (!strcmp(name, "shift_mode"))
+		list = show("available_shift_modes", available);
+	else if (!strcmp(name, "fan_mode"))
+		list = show("available_fan_modes", available);
+
+	for (char *mode = list ? available : NULL, *next; mode; mode = next) {
+		next = strchr(mode, '\n');
+		if (next)
+			*next++ = '\0';
+		try_value(name, mode);
+	}
+
+	for (size_t i = 0; i < sizeof(vocabulary) / sizeof(*vocabulary); i++)
+		try_value(name, vocabulary[i]);
+
+	for (int i = 0; i <= 255; i++) {
+		snprintf(number, sizeof(number), "%d", i);
+		try_value(name, number);
+	}
+
+	// garbage is rejected without a write
+	try_value(name, "");
+	try_value(name, "-1");
+	try_value(name, "256");
+	try_value(name, "on off");
+
+	// and the current value is accepted as is
+	if (show(name, current))
+		try_value(name, current);
+}
+
+static bool skip_store(const char *name)
+{
+	// raw EC access and multi-field writes have their own semantics
+	return !strcmp(name, "transaction") || !strncmp(name, "debug/", 6) ||
+	       !strcmp(name, "fan_control/enabled") ||
+	       strstr(name, "shift_governor") || strstr(name, "residency");
+}
+
+// a transaction whose nth write fails leaves neither the EC nor the
+// journal changed, for every write it makes
+static void test_transaction(void)
+{
+	static const char *const toggles[] = {
+		"webcam", "webcam_block", "cooler_boost", "super_battery",
+	};
+	uint8_t *regs = msi_ec_core_registers();
+	uint8_t before[256], mask[256], value[256], jmask[256], jvalue[256];
+	char settings[PAGE] = "", restore[PAGE] = "", buf[PAGE];
+	size_t len = 0, restore_len = 0;
+	int count = 0, nth;
+	ssize_t result = -1;
+
+	for (size_t i = 0; i < sizeof(toggles) / sizeof(*toggles); i++) {
+		const char *current = show(toggles[i], buf);
+
+		if (!current || (strcmp(current, "on") && strcmp(current, "off")))
+			continue;
+
+		len += snprintf(settings + len, sizeof(settings) - len,
+				"%s=%s ", toggles[i],
+				strcmp(current, "on") ? "on" : "off");
+		restore_len += snprintf(restore + restore_len,
+					sizeof(restore) - restore_len,
+					"%s=%s ", toggles[i], current);
+		count++;
+	}
+	if (count < 2)
+		return;
+
+	memcpy(before, regs, sizeof(before));
+	msi_ec_core_journal(mask, value);
+
+	// once nth is past the last write the transaction goes through
+	for (nth = 1; nth <= 16; nth++) {
+		msi_ec_core_fail_write(nth);
+		result = msi_ec_core_store("transaction", settings, len);
+		msi_ec_core_fail_write(0);
+		if (result >= 0)
+			break;
+
+		msi_ec_core_journal(jmask, jvalue);
+		check(result == -EIO && !memcmp(before, regs, sizeof(before)) &&
+		      !memcmp(mask, jmask, sizeof(mask)) &&
+		      !memcmp(value, jvalue, sizeof(value)),
+		      "transaction: write %d of \"%s\" failed (%zd), but the "
+		      "EC or the journal changed", nth, settings, result);
+	}
+
+	check(nth > 1 && result == (ssize_t)len,
+	      "transaction: \"%s\" returned %zd after %d failed writes",
+	      settings, result, nth - 1);
+
+	msi_ec_core_store("transaction", restore, restore_len);
+}
+
+static void test_resume(void)
+{
+	uint8_t *regs = msi_ec_core_registers();
+	char before[256][64], buf[PAGE];
+	int count = msi_ec_core_nr_attrs();
+	uint8_t saved[256];
+
+	for (int i = 0; i < count && i < 256; i++) {
+		const char *name = msi_ec_core_attr_name(i);
+
+		if (!show(name, buf))
+			buf[0] = '\0';
+		snprintf(before[i], sizeof(before[i]), "%.63s", buf);
+	}
+
+	// the firmware forgets everything but its version, date and time
+	memcpy(saved, regs, sizeof(saved));
+	memset(regs, 0, 0xa0);
+	memcpy(regs + 0xa0, saved + 0xa0, 0x20);
+	memset(regs + 0xc0, 0, 0x40);
+
+	check(msi_ec_core_resume() == 0, "resume failed");
+
+	for (int i = 0; i < count && i < 256; i++) {
+		const char *name = msi_ec_core_attr_name(i);
+
+		if (!(msi_ec_core_attr_mode(name) & 0222) || skip_store(name) ||
+		    !before[i][0])
+			continue;
+
+		check(show(name, buf) && !strcmp(buf, before[i]),
+		      "%s: \"%s\" before the reset, \"%s\" after the resume",
+		      name, before[i], buf);
+	}
+}
+
+// batches through /dev/msi-ec spend the budget of an unprivileged user
+static void test_dev_throttle(void)
+{
+	char buf[PAGE];
+	int addr = 0;
+
+	// a register the node lets everyone read
+	while (addr < 256 && msi_ec_core_dev_reads(addr, 1) != 1)
+		addr++;
+	if (addr == 256)
+		return;
+
+	msi_ec_core_set_uid(1000);
+	check(msi_ec_core_dev_reads(addr, 30) == 30,
+	      "dev: throttled reads of %#x failed", addr);
+	msi_ec_core_set_uid(0);
+
+	// 20 at once, the rest is answered with the last known values
+	check(show("throttle", buf) &&
+	      strstr(buf, "uid=1000 attr=dev allowed=20 throttled=10"),
+	      "dev: 30 reads of uid 1000 not throttled:\n%s", buf);
+}
+
+// ec_breaker state of the circuit breaker
+static bool breaker_is(const char *state)
+{
+	char buf[PAGE], want[64];
+
+	snprintf(want, sizeof(want), "state=%s\n", state);
+	return msi_ec_core_show("ec_breaker", buf) > 0 &&
+	       !strncmp(buf, want, strlen(want));
+}
+
+// the EC times out, then a probe fails for another reason, then recovers
+static void test_breaker(void)
+{
+	for (int i = 0; i < 3; i++)
+		msi_ec_core_ec_read(0x68, -ETIME);
+	check(breaker_is("open"), "ec_breaker: not open after 3 timeouts");
+
+	// a probe answered with an error unrelated to the EC's health
+	msi_ec_core_breaker_expire();
+	check(msi_ec_core_ec_read(0x68, -EINVAL) == -EINVAL,
+	      "ec_breaker: the due probe didn't reach the EC");
+	check(breaker_is("open"), "ec_breaker: not open after a -EINVAL probe");
+
+	msi_ec_core_breaker_expire();
+	check(msi_ec_core_ec_read(0x68, 0) == 0,
+	      "ec_breaker: the next probe didn't reach the EC");
+	check(breaker_is("closed"), "ec_breaker: not closed by a good probe");
+}
+
+// the firmware flips every register, only the enforced settings come back
+static void test_enforce(void)
+{
+	static const char *const names[] = {
+		"shift_mode", "fan_mode", "cooler_boost",
+	};
+	uint8_t saved[256], flipped[256], *regs = msi_ec_core_registers();
+	char before[3][PAGE], buf[PAGE];
+	int present = 0, result, restored = 0;
+
+	// every setting was stored by test_store, so every one is enforced
+	for (int i = 0; i < 3; i++) {
+		if (msi_ec_core_attr_mode(names[i]) & 0222)
+			present++;
+		if (!show(names[i], before[i]))
+			before[i][0] = '\0';
+	}
+
+	// but the firmware version, date and time
+	memcpy(saved, regs, sizeof(saved));
+	for (int i = 0; i < 256; i++)
+		if (i < 0xa0 || i >= 0xc0)
+			regs[i] = ~regs[i];
+	memcpy(flipped, regs, sizeof(flipped));
+
+	result = msi_ec_core_enforce();
+	check(result == present, "enforce re-applied %d settings, not %d",
+	      result, present);
+
+	for (int i = 0; i < 3; i++)
+		check(!before[i][0] || (show(names[i], buf) &&
+					!strcmp(buf, before[i])),
+		      "%s: \"%s\" before, \"%s\" after the enforcement",
+		      names[i], before[i], buf);
+
+	for (int i = 0; i < 256; i++)
+		restored += regs[i] != flipped[i];
+	check(restored <= present, "enforce rewrote %d registers", restored);
+
+	check(show("enforce_stats", buf) && strstr(buf, "write_errors=0"),
+	      "enforce_stats: \"%s\"", buf);
+
+	memcpy(regs, saved, sizeof(saved));
+}
+
+// two shift modes, one per power source, follow the AC adapter
+static void test_power_source(void)
+{
+	char available[PAGE], buf[PAGE], ac[64], battery[64];
+	char *modes[2] = { available, NULL };
+
+	if (!show("available_shift_modes", available))
+		return;
+	modes[1] = strchr(available, '\n');
+	if (!modes[1])
+		return;
+	*modes[1]++ = '\0';
+	strtok(modes[1], "\n");
+
+	snprintf(ac, sizeof(ac), "shift_mode=%.32s", modes[0]);
+	snprintf(battery, sizeof(battery), "shift_mode=%.32s", modes[1]);
+
+	// the system runs on AC, its profile applies when written
+	check(msi_ec_core_store("power_source/battery", battery,
+				strlen(battery)) > 0 &&
+	      msi_ec_core_store("power_source/ac", ac, strlen(ac)) > 0 &&
+	      show("shift_mode", buf) && !strcmp(buf, modes[0]),
+	      "power_source: \"%s\" on AC, shift_mode is \"%s\"", ac, buf);
+
+	check(msi_ec_core_power_supply(false) == 0 &&
+	      show("shift_mode", buf) && !strcmp(buf, modes[1]) &&
+	      show("power_source/source", buf) && !strcmp(buf, "battery"),
+	      "power_source: \"%s\" on battery, shift_mode is \"%s\"",
+	      battery, buf);
+
+	check(msi_ec_core_power_supply(true) == 0 &&
+	      show("shift_mode", buf) && !strcmp(buf, modes[0]),
+	      "power_source: back on AC, shift_mode is \"%s\"", buf);
+
+	msi_ec_core_store("power_source/ac", "", 0);
+	msi_ec_core_store("power_source/battery", "", 0);
+}
+
+static void store(const char *name, const char *value)
+{
+	check(msi_ec_core_store(name, value, strlen(value)) > 0,
+	      "%s: \"%s\" rejected", name, value);
+}
+
+// a busy CPU climbs to the fastest mode, an idle one back to the slowest
+static void test_shift_governor(void)
+{
+	static const char *const ladder[] = {
+		"eco", "comfort", "sport", "turbo",
+	};
+	const char *slowest = NULL, *fastest = NULL;
+	char available[PAGE], before[PAGE], buf[PAGE];
+
+	if (!msi_ec_core_attr_mode("shift_governor/enabled") ||
+	    !show("available_shift_modes", available) ||
+	    !show("shift_mode", before))
+		return;
+
+	for (int i = 0; i < 4; i++) {
+		char *mode = strstr(available, ladder[i]);
+
+		if (!mode || (mode > available && mode[-1] != '\n'))
+			continue;
+		if (!slowest)
+			slowest = ladder[i];
+		fastest = ladder[i];
+	}
+	if (slowest == fastest)
+		return;
+
+	store("shift_governor/dwell_ms", "0");
+	store("shift_governor/temp_limit", "100");
+	store("shift_governor/enabled", "1");
+
+	for (int i = 0; i < 4; i++) {
+		msi_ec_core_cpu_load(100);
+		msi_ec_core_run_pending_work();
+	}
+	check(show("shift_mode", buf) && !strcmp(buf, fastest),
+	      "shift_governor: \"%s\" when busy, not \"%s\"", buf, fastest);
+
+	for (int i = 0; i < 4; i++) {
+		msi_ec_core_cpu_load(0);
+		msi_ec_core_run_pending_work();
+	}
+	check(show("shift_mode", buf) && !strcmp(buf, slowest),
+	      "shift_governor: \"%s\" when idle, not \"%s\"", buf, slowest);
+
+	check(show("shift_governor/stats", buf) && strstr(buf, "->"),
+	      "shift_governor/stats: \"%s\"", buf);
+
+	// in the band between the thresholds nothing changes
+	msi_ec_core_cpu_load(40);
+	msi_ec_core_run_pending_work();
+	check(show("shift_mode", buf) && !strcmp(buf, slowest),
+	      "shift_governor: \"%s\" at 40%%, not \"%s\"", buf, slowest);
+
+	store("shift_governor/enabled", "0");
+	check(show("shift_mode", buf) && !strcmp(buf, before),
+	      "shift_governor: \"%s\" after disabling, not \"%s\"", buf,
+	      before);
+}
+
+// the controller follows its curve, and skips its periods while the EC
+// breaker serves last known values
+static void test_fan_control(void)
+{
+	uint8_t saved[256], *regs = msi_ec_core_registers();
+	char buf[PAGE], speed[PAGE], mode[PAGE], saved_speed[PAGE];
+	char saved_mode[PAGE];
+	bool has_mode;
+
+	if (!msi_ec_core_attr_mode("fan_control/enabled") ||
+	    !show("cpu/basic_fan_speed", saved_speed))
+		return;
+
+	if (!show("fan_mode", saved_mode))
+		saved_mode[0] = '\0';
+	memcpy(saved, regs, sizeof(saved));
+	for (int i = 0; i < 256; i++)
+		if (i < 0xa0 || i >= 0xbc)
+			regs[i] = 60;
+
+	// what 40 % looks like once scaled to the register
+	store("cpu/basic_fan_speed", "40");
+	if (!show("cpu/basic_fan_speed", speed))
+		speed[0] = '\0';
+	store("cpu/basic_fan_speed", "0");
+	has_mode = show("fan_mode", mode);
+
+	store("fan_control/curve", "40:20 80:60");
+	store("fan_control/kp", "0");
+	store("fan_control/ki", "0");
+	store("fan_control/kd", "0");
+	store("fan_control/enabled", "1");
+	msi_ec_core_run_pending_work();
+
+	check(show("cpu/basic_fan_speed", buf) && !strcmp(buf, speed),
+	      "fan_control: basic_fan_speed \"%s\" at 60 celsius, not \"%s\"",
+	      buf, speed);
+	check(show("fan_control/stats", buf) && strstr(buf, "output=40\n") &&
+	      strstr(buf, "samples=1\n") && strstr(buf, "writes=1\n"),
+	      "fan_control/stats: \"%s\" after one period", buf);
+
+	for (int i = 0; i < 3; i++)
+		msi_ec_core_ec_read(0x68, -ETIME);
+	msi_ec_core_run_pending_work();
+	check(show("fan_control/stats", buf) && strstr(buf, "samples=1\n") &&
+	      strstr(buf, "\nstale_skips=1"),
+	      "fan_control/stats: \"%s\" with the breaker open", buf);
+
+	msi_ec_core_breaker_expire();
+	msi_ec_core_ec_read(0x68, 0);
+
+	store("fan_control/enabled", "0");
+	check(!has_mode || (show("fan_mode", buf) && !strcmp(buf, mode)),
+	      "fan_control: fan_mode \"%s\" after disabling, not \"%s\"",
+	      buf, mode);
+
+	// the journal holds the controller's writes, what the resume restores
+	memcpy(regs, saved, sizeof(saved));
+	store("cpu/basic_fan_speed", saved_speed);
+	if (saved_mode[0])
+		store("fan_mode", saved_mode);
+}
+
+// a mode change through the driver and one behind its back, seen sampling
+static void test_residency(void)
+{
+	uint8_t before[256], *regs = msi_ec_core_registers();
+	char available[PAGE], buf[PAGE], from[64], to[64], trans[160];
+	int addr = -1;
+	char *next;
+
+	if (!show("available_shift_modes", available) ||
+	    !show("shift_mode", from))
+		return;
+
+	for (char *mode = available; mode; mode = next) {
+		next = strchr(mode, '\n');
+		if (next)
+			*next++ = '\0';
+		if (strcmp(mode, from)) {
+			snprintf(to, sizeof(to), "%.63s", mode);
+			break;
+		}
+	}
+
+	store("residency/reset", "1");
+	memcpy(before, regs, sizeof(before));
+	store("shift_mode", to);
+	for (int i = 0; i < 256; i++)
+		if (regs[i] != before[i])
+			addr = i;
+	if (addr < 0)
+		return;
+
+	// the firmware puts the mode back, the next sample notices
+	regs[addr] = before[addr];
+	msi_ec_core_run_pending_work();
+
+	snprintf(trans, sizeof(trans), "shift_mode total=2 %.32s->%.32s=1",
+		 from, to);
+	check(show("residency/trans_table", buf) && strstr(buf, trans),
+	      "residency/trans_table: \"%s\"", buf);
+
+	snprintf(trans, sizeof(trans), " %.32s=", to);
+	check(show("residency/time_in_state", buf) &&
+	      !strncmp(buf, "shift_mode ", 11) && strstr(buf, trans),
+	      "residency/time_in_state: \"%s\"", buf);
+
+	// what the resume restores
+	store("shift_mode", from);
+}
+
+// a capture of the IIO channels agrees with their attributes
+static void test_iio(void)
+{
+	static const char *const labels[][2] = {
+		{ "cpu_temperature", "cpu/realtime_temperature" },
+		{ "gpu_temperature", "gpu/realtime_temperature" },
+		{ "cpu_fan_speed", "cpu/realtime_fan_speed" },
+		{ "gpu_fan_speed", "gpu/realtime_fan_speed" },
+	};
+	uint8_t saved[256], scan[64], *regs = msi_ec_core_registers();
+	int present[4], nr = 0, raw, unused;
+	char buf[PAGE];
+	int64_t timestamp;
+	ssize_t bytes;
+
+	for (int i = 0; i < 4; i++)
+		if (msi_ec_core_iio_read(labels[i][0], 0, &raw, &unused) >= 0)
+			present[nr++] = i;
+	if (!nr)
+		return;
+
+	// arbitrary contents, the firmware version stays
+	memcpy(saved, regs, sizeof(saved));
+	for (int i = 0; i < 256; i++)
+		if (i < 0xa0 || i >= 0xbc)
+			regs[i] = i * 37 + 11;
+
+	bytes = msi_ec_core_iio_capture((1ul << nr) - 1, scan, sizeof(scan));
+	check(bytes == 16, "iio: scan of %d channels is %zd bytes", nr, bytes);
+
+	memcpy(&timestamp, scan + 8, sizeof(timestamp));
+	check(bytes < 16 || timestamp > 0, "iio: timestamp %lld",
+	      (long long)timestamp);
+
+	for (int i = 0; i < nr && bytes == 16; i++) {
+		const char *const *label = labels[present[i]];
+		int offset, scale, scale2, value;
+
+		msi_ec_core_iio_read(label[0], 0, &raw, &unused);
+		msi_ec_core_iio_read(label[0], 3, &offset, &unused);
+		if (msi_ec_core_iio_read(label[0], 2, &scale, &scale2) == 1)
+			scale2 = 1;
+		value = (raw + offset) * scale / scale2;
+		if (present[i] < 2)
+			value /= 1000;
+
+		check(scan[i] == raw, "iio: %s captured %d, read %d", label[0],
+		      scan[i], raw);
+
+		// fan registers out of their range show nothing
+		check(!show(label[1], buf) || atoi(buf) == value,
+		      "iio: %s is %d, %s shows \"%s\"", label[0], value,
+		      label[1], buf);
+	}
+
+	// a single channel moves to the front of the scan
+	msi_ec_core_iio_read(labels[present[nr - 1]][0], 0, &raw, &unused);
+	bytes = msi_ec_core_iio_capture(1ul << (nr - 1), scan, sizeof(scan));
+	check(bytes == 16 && scan[0] == raw,
+	      "iio: %s alone captured %d in %zd bytes, read %d",
+	      labels[present[nr - 1]][0], scan[0], bytes, raw);
+
+	memcpy(regs, saved, sizeof(saved));
+}
+
+// an event counts its value over time, 20 ms of a constant temperature
+static void test_pmu(void)
+{
+	uint8_t saved[256], *regs = msi_ec_core_registers();
+	char buf[PAGE];
+	int64_t count;
+	int temp;
+
+	if (msi_ec_core_pmu_event_init(0, false) < 0)
+		return;
+
+	check(msi_ec_core_pmu_event_init(0, true) < 0 &&
+	      msi_ec_core_pmu_event_init(4, false) < 0,
+	      "pmu: sampling or unknown events accepted");
+
+	memcpy(saved, regs, sizeof(saved));
+	for (int i = 0; i < 256; i++)
+		if (i < 0xa0 || i >= 0xbc)
+			regs[i] = 40;
+
+	count = msi_ec_core_pmu_count(0, 20);
+	temp = show("cpu/realtime_temperature", buf) ? atoi(buf) : -1;
+
+	// in value * us, the sampling starts right before the sleep
+	check(temp == 40 && count >= 40 * 20000 && count < 40 * 1000000,
+	      "pmu: cpu_temp counted %lld in 20 ms at %d", (long long)count,
+	      temp);
+
+	memcpy(regs, saved, sizeof(saved));
+}
+
+// the harness is a single process, its busiest attribute comes first
+static void test_top(void)
+{
+	char buf[PAGE];
+
+	for (int i = 0; i < 5; i++)
+		show("fw_version", buf);
+
+	check(msi_ec_core_debugfs_read("top", buf, sizeof(buf)) > 0,
+	      "debugfs top can't be read");
+	check(strstr(buf, "uspace") && strstr(buf, " fw "),
+	      "debugfs top doesn't list the accesses:\n%s", buf);
+}
+
+static int test_firmware(void)
+{
+	int result = msi_ec_core_load(firmware, true);
+
+	if (result < 0) {
+		fprintf(stderr, "%s: load failed: %d\n", firmware, result);
+		return 1;
+	}
+
+	test_show();
+	test_top();
+
+	for (int i = 0; i < msi_ec_core_nr_attrs(); i++) {
+		const char *name = msi_ec_core_attr_name(i);
+
+		if ((msi_ec_core_attr_mode(name) & 0222) && !skip_store(name))
+			test_store(name);
+	}
+
+	test_transaction();
+	test_breaker();
+	test_dev_throttle();
+	test_enforce();
+	test_power_source();
+	test_shift_governor();
+	test_fan_control();
+	test_residency();
+	test_iio();
+	test_pmu();
+	test_resume();
+	test_show();
+	msi_ec_core_unload();
+	check(msi_ec_core_nr_registered() == 0,
+	      "%d registrations left after unloading",
+	      msi_ec_core_nr_registered());
+
+	if (verbose || failures)
+		printf("%s: %d checks, %d failures\n", firmware, checks,
+		       failures);
+
+	return failures ? 1 : 0;
+}
+
+// each configuration gets a fresh driver in its own process
+static int run(const char *fw)
+{
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+		return -errno;
+
+	if (pid == 0) {
+		firmware = fw;
+		msi_ec_core_quiet(!verbose);
+		exit(test_firmware());
+	}
+
+	if (waitpid(pid, &status, 0) < 0)
+		return -errno;
+
+	if (!WIFEXITED(status)) {
+		fprintf(stderr, "%s: killed by signal %d\n", fw,
+			WTERMSIG(status));
+		return 1;
+	}
+
+	return WEXITSTATUS(status);
+}
+
+int main(int argc, char **argv)
+{
+	int failed = 0, total = 0, opt;
+
+	while ((opt = getopt(argc, argv, "vh")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [firmware...]\n",
+				argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind < argc) {
+		for (int i = optind; i < argc; i++, total++)
+			failed += run(argv[i]) != 0;
+	} else {
+		for (int i = 0; i < msi_ec_core_nr_firmwares(); i++, total++)
+			failed += run(msi_ec_core_firmware(i)) != 0;
+	}
+
+	printf("%d firmwares, %d failed\n", total, failed);
+	return failed ? 1 : 0;
+}